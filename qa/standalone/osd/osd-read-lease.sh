@@ -0,0 +1,113 @@
+#!/usr/bin/env bash
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Library Public License as published by
+# the Free Software Foundation; either version 2, or (at your option)
+# any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Library Public License for more details.
+#
+
+source $CEPH_ROOT/qa/standalone/ceph-helpers.sh
+
+LEASE_INTERVAL=5
+
+function run() {
+    local dir=$1
+    shift
+
+    export CEPH_MON="127.0.0.1:7155" # git grep '\<7155\>' : there must be only one
+    export CEPH_ARGS
+    CEPH_ARGS+="--fsid=$(uuidgen) --auth-supported=none "
+    CEPH_ARGS+="--mon-host=$CEPH_MON "
+
+    local funcs=${@:-$(set | sed -n -e 's/^\(TEST_[0-9a-z_]*\) .*/\1/p')}
+    for func in $funcs ; do
+        setup $dir || return 1
+        $func $dir || return 1
+        teardown $dir || return 1
+    done
+}
+
+# sum of an osd perf counter over the given osds
+function sum_counter() {
+    local name=$1
+    shift
+
+    local sum=0
+    for osd in "$@" ; do
+        local v=$(ceph daemon osd.$osd perf dump | jq ".osd.$name")
+        sum=$(expr $sum + $v)
+    done
+    echo $sum
+}
+
+# read the object with balanced reads and check what comes back
+function balanced_reads() {
+    local dir=$1
+    local poolname=$2
+    local objname=$3
+    local count=$4
+
+    for i in $(seq 1 $count) ; do
+        rados --pool $poolname --objecter-replica-read-policy=balance \
+            get $objname $dir/COPY || return 1
+        diff $dir/ORIGINAL $dir/COPY || return 1
+    done
+}
+
+function TEST_read_lease() {
+    local dir=$1
+    local poolname=test
+    local objname=obj
+
+    run_mon $dir a --osd_pool_default_size=3 || return 1
+    run_mgr $dir x || return 1
+    for id in 0 1 2 ; do
+        run_osd $dir $id || return 1
+    done
+    create_pool $poolname 1 1 || return 1
+    ceph osd pool set $poolname read_lease_interval $LEASE_INTERVAL || return 1
+    wait_for_clean || return 1
+
+    echo one > $dir/ORIGINAL
+    rados --pool $poolname put $objname $dir/ORIGINAL || return 1
+
+    local primary=$(get_primary $poolname $objname)
+    local replicas=$(get_osds $poolname $objname | \
+        tr ' ' '\n' | grep -v "^$primary\$")
+
+    # a replica without a lease sends the read back to the primary with
+    # -EAGAIN and asks for one; the Objecter resends to the primary
+    balanced_reads $dir $poolname $objname 20 || return 1
+    test $(sum_counter replica_read_redirect $replicas) -gt 0 || return 1
+    test $(sum_counter lease_grant $primary) -gt 0 || return 1
+
+    # once granted, the replicas serve reads themselves
+    sleep 1
+    balanced_reads $dir $poolname $objname 20 || return 1
+    test $(sum_counter replica_read $replicas) -gt 0 || return 1
+
+    # a write is seen by every later read, wherever it is served
+    echo two > $dir/ORIGINAL
+    rados --pool $poolname put $objname $dir/ORIGINAL || return 1
+    balanced_reads $dir $poolname $objname 20 || return 1
+
+    # without reads the leases run out, and the next read on a replica
+    # is redirected again while it asks for a new one
+    local redirects=$(sum_counter replica_read_redirect $replicas)
+    local grants=$(sum_counter lease_grant $primary)
+    sleep $(expr $LEASE_INTERVAL + 2)
+    balanced_reads $dir $poolname $objname 20 || return 1
+    test $(sum_counter replica_read_redirect $replicas) -gt $redirects || return 1
+    test $(sum_counter lease_grant $primary) -gt $grants || return 1
+}
+
+main osd-read-lease "$@"
+
+# Local Variables:
+# compile-command: "cd ../.. ; make -j4 && ../qa/run-standalone.sh osd-read-lease.sh"
+# End:
@@ -2281,6 +2281,14 @@ function test_mon_osd_pool_set()
       ceph osd pool get $TEST_POOL_GETSET $size | expect_false grep '.'
   done
 
+  ceph osd pool get $TEST_POOL_GETSET read_lease_interval | expect_false grep '.'
+  expect_false ceph osd pool set $TEST_POOL_GETSET read_lease_interval -1
+  expect_false ceph osd pool set $TEST_POOL_GETSET read_lease_interval 61
+  ceph osd pool set $TEST_POOL_GETSET read_lease_interval 2.5
+  ceph osd pool get $TEST_POOL_GETSET read_lease_interval | grep '2.5'
+  ceph osd pool set $TEST_POOL_GETSET read_lease_interval 0
+  ceph osd pool get $TEST_POOL_GETSET read_lease_interval | expect_false grep '.'
+
   ceph osd pool set $TEST_POOL_GETSET nodelete 1
   expect_false ceph osd pool delete $TEST_POOL_GETSET $TEST_POOL_GETSET --yes-i-really-really-mean-it
   ceph osd pool set $TEST_POOL_GETSET nodelete 0
@@ -963,6 +963,9 @@ OPTION(bluestore_block_db_create, OPT_BOOL)
 OPTION(bluestore_block_wal_path, OPT_STR)
 OPTION(bluestore_block_wal_size, OPT_U64) // rocksdb wal
 OPTION(bluestore_block_wal_create, OPT_BOOL)
+OPTION(bluestore_block_cache_path, OPT_STR)
+OPTION(bluestore_block_cache_size, OPT_U64) // write-back cache for block
+OPTION(bluestore_block_cache_create, OPT_BOOL)
 OPTION(bluestore_block_preallocate_file, OPT_BOOL) //whether preallocate space if block/db_path/wal_path is file rather that block device.
 OPTION(bluestore_ignore_data_csum, OPT_BOOL)
 OPTION(bluestore_csum_type, OPT_STR) // none|xxhash32|xxhash64|crc32c|crc32c_16|crc32c_8
@@ -1046,6 +1049,11 @@ OPTION(bluestore_nid_prealloc, OPT_INT)
 OPTION(bluestore_blobid_prealloc, OPT_U64)
 OPTION(bluestore_clone_cow, OPT_BOOL)  // do copy-on-write for clones
 OPTION(bluestore_default_buffered_read, OPT_BOOL)
+OPTION(bluestore_readahead_max, OPT_U64)
+OPTION(bluestore_readahead_max_hdd, OPT_U64)
+OPTION(bluestore_readahead_max_ssd, OPT_U64)
+OPTION(bluestore_readahead_trigger_requests, OPT_U64)
+OPTION(bluestore_omap_readahead, OPT_U64)
 OPTION(bluestore_default_buffered_write, OPT_BOOL)
 OPTION(bluestore_debug_misc, OPT_BOOL)
 OPTION(bluestore_debug_no_reuse_blocks, OPT_BOOL)
@@ -1084,6 +1084,24 @@ std::vector<Option> get_global_options() {
     .set_description("Maximum threadpool size of AsyncMessenger")
     .add_see_also("ms_async_op_threads"),
 
+    Option("ms_async_busy_poll_us", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_description("How long AsyncMessenger workers busy poll for events before sleeping (0 to never busy poll)")
+    .set_long_description("After handling an event a worker keeps polling without blocking for up to this many microseconds, trading CPU for wakeup latency. The window halves (down to 1/16 of this) each time the worker then sleeps longer than this before the next event, and doubles back when the next event comes sooner.")
+    .add_see_also("ms_async_op_threads"),
+
+    Option("ms_async_affinity_cores", Option::TYPE_STR, Option::LEVEL_ADVANCED)
+    .set_default("")
+    .set_description("CPUs to pin AsyncMessenger workers to, e.g. 0-3,8")
+    .set_long_description("Worker N is pinned to the Nth CPU in the list, wrapping around.")
+    .add_see_also("ms_async_numa_node"),
+
+    Option("ms_async_numa_node", Option::TYPE_INT, Option::LEVEL_ADVANCED)
+    .set_default(-1)
+    .set_description("NUMA node whose CPUs AsyncMessenger workers are pinned to, one CPU each (-1 for none)")
+    .set_long_description("Ignored if ms_async_affinity_cores is set.")
+    .add_see_also("ms_async_affinity_cores"),
+
     Option("ms_async_rdma_device_name", Option::TYPE_STR, Option::LEVEL_ADVANCED)
     .set_default("")
     .set_description(""),
@@ -1320,6 +1338,12 @@ std::vector<Option> get_global_options() {
     .add_service("mon")
     .set_description("granularity of PG placement calculation background work"),
 
+    Option("mon_osd_mapping_incremental", Option::TYPE_BOOL, Option::LEVEL_DEV)
+    .set_default(true)
+    .add_service("mon")
+    .set_description("update PG placements from the last osdmap incremental")
+    .set_long_description("When the OSDMap advances by a single epoch and the previous mapping completed, only recalculate the PGs the incremental can have moved instead of every PG in the cluster."),
+
     Option("mon_clean_pg_upmaps_per_chunk", Option::TYPE_UINT, Option::LEVEL_DEV)
     .set_default(256)
     .add_service("mon")
@@ -2238,6 +2262,20 @@ std::vector<Option> get_global_options() {
     .set_default(false)
     .set_description(""),
 
+    Option("objecter_replica_read_policy", Option::TYPE_STR, Option::LEVEL_ADVANCED)
+    .set_default("default")
+    .set_enum_allowed({"default", "balance", "localize"})
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Where to send read-only operations")
+    .set_long_description("'default' sends all reads to the primary. 'balance' "
+                          "picks the less busy of two random acting set members, "
+                          "'localize' the closest one according to crush_location "
+                          "(and the less busy one among equally close members). "
+                          "Replicas only serve such reads consistently on pools "
+                          "with read_lease_interval set; otherwise use them for "
+                          "immutable data only.")
+    .add_see_also("crush_location"),
+
     Option("filer_max_purge_ops", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
     .set_default(10)
     .set_description("Max in-flight operations for purging a striped range (e.g., MDS journal)"),
@@ -2637,7 +2675,8 @@ std::vector<Option> get_global_options() {
 
     Option("osd_map_dedup", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
     .set_default(true)
-    .set_description(""),
+    .set_description("share unchanged parts of nearby osdmap epochs")
+    .set_long_description("Cached osdmaps share sections (crush, addresses, pg_temp, ...) that are unchanged from a neighbouring epoch. Incrementals are applied to a copy of the previous map that shares such sections, and full maps reuse an unchanged crush map instead of decoding it again."),
 
     Option("osd_map_cache_size", Option::TYPE_INT, Option::LEVEL_ADVANCED)
     .set_default(50)
@@ -2741,6 +2780,20 @@ std::vector<Option> get_global_options() {
     .set_long_description("the threshold between high priority ops that use strict priority ordering and low priority ops that use a fairness algorithm that may or may not incorporate priority")
     .add_see_also("osd_op_queue"),
 
+    Option("osd_op_queue_lockless_enqueue", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Hand new ops to an op shard without taking its lock")
+    .set_long_description("New ops are pushed onto a bounded lock-free ring that the shard's worker threads move into the op queue, so that dispatching threads do not contend with the workers for the shard lock.  When the ring is full, ops take the shard lock as before.")
+    .add_see_also("osd_op_thread_spin_us"),
+
+    Option("osd_op_thread_spin_us", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Microseconds an op worker thread busy-waits for new ops before going to sleep")
+    .set_long_description("Spinning avoids the cost of sleeping and being woken up when ops arrive back to back, at the cost of some CPU.  Only ops handed over by osd_op_queue_lockless_enqueue are noticed while spinning.")
+    .add_see_also("osd_op_queue_lockless_enqueue"),
+
     Option("osd_op_queue_mclock_client_op_res", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
     .set_default(1000.0)
     .set_description("mclock reservation of client operator requests")
@@ -3197,6 +3250,56 @@ std::vector<Option> get_global_options() {
     .add_see_also("osd_op_queue_mclock_scrub_res")
     .add_see_also("osd_op_queue_mclock_scrub_wgt"),
 
+    Option("osd_op_queue_mclock_cost_model", Option::TYPE_STR, Option::LEVEL_ADVANCED)
+    .set_default("static")
+    .set_enum_allowed({"static", "adaptive"})
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("how mclock charges queued operations")
+    .set_long_description("With 'static' every operation costs the same. With 'adaptive' an operation costs its estimated device time, derived from its size and the device IOPS and bandwidth (measured at startup unless configured), and scaled up while the object store commits more slowly than it did during calibration. Only used when osd_op_queue is either 'mclock_opclass' or 'mclock_client'.")
+    .add_see_also("osd_op_queue")
+    .add_see_also("osd_op_queue_mclock_device_iops")
+    .add_see_also("osd_op_queue_mclock_device_bandwidth")
+    .add_see_also("osd_op_queue_mclock_cost_max_scale"),
+
+    Option("osd_op_queue_mclock_device_iops", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(0.0)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("small write IOPS of the OSD device for the adaptive mclock cost model")
+    .set_long_description("If zero, the OSD measures it at startup by writing osd_op_queue_mclock_calibration_small_size blocks to its object store.")
+    .add_see_also("osd_op_queue_mclock_cost_model"),
+
+    Option("osd_op_queue_mclock_device_bandwidth", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("write bandwidth of the OSD device in bytes/sec for the adaptive mclock cost model")
+    .set_long_description("If zero, the OSD measures it at startup by writing osd_op_queue_mclock_calibration_large_size blocks to its object store.")
+    .add_see_also("osd_op_queue_mclock_cost_model"),
+
+    Option("osd_op_queue_mclock_calibration_small_size", Option::TYPE_SIZE, Option::LEVEL_DEV)
+    .set_default(4_K)
+    .set_description("block size used to measure device IOPS at startup"),
+
+    Option("osd_op_queue_mclock_calibration_large_size", Option::TYPE_SIZE, Option::LEVEL_DEV)
+    .set_default(4_M)
+    .set_description("block size used to measure device bandwidth at startup"),
+
+    Option("osd_op_queue_mclock_calibration_queue_depth", Option::TYPE_UINT, Option::LEVEL_DEV)
+    .set_default(16)
+    .set_min(1)
+    .set_description("number of writes kept in flight while measuring the device at startup"),
+
+    Option("osd_op_queue_mclock_calibration_duration", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(2.0)
+    .set_description("seconds spent on each startup device measurement")
+    .set_long_description("The OSD measures IOPS and bandwidth one after the other, each for at most this long, before it boots.")
+    .add_see_also("osd_op_queue_mclock_cost_model"),
+
+    Option("osd_op_queue_mclock_cost_max_scale", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(8.0)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("upper bound on how much slow commits may inflate mclock costs")
+    .add_see_also("osd_op_queue_mclock_cost_model"),
+
     Option("osd_ignore_stale_divergent_priors", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
     .set_default(false)
     .set_description(""),
@@ -3205,6 +3308,11 @@ std::vector<Option> get_global_options() {
     .set_default(false)
     .set_description(""),
 
+    Option("osd_ec_parity_delta_writes", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Apply small EC overwrites as parity deltas")
+    .set_long_description("When a write to an erasure coded pool with allow_ec_overwrites touches few data chunks of a stripe and the plugin's code is linear, read only the touched data chunks and the parity chunks, and update the parity with the encoded difference instead of reading and re-encoding the whole stripe.  Only used when no other write to the object is in flight."),
+
     Option("osd_recover_clone_overlap_limit", Option::TYPE_INT, Option::LEVEL_ADVANCED)
     .set_default(10)
     .set_description(""),
@@ -3497,6 +3605,27 @@ std::vector<Option> get_global_options() {
     .set_default(512_K)
     .set_description("Number of bytes to read from an object at a time during deep scrub"),
 
+    Option("osd_deep_scrub_readahead_bytes", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(16_M)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Deep scrub data the OSD may read ahead of the scrubbing PGs")
+    .set_long_description("While a PG hashes one osd_deep_scrub_stride of an object, the next stride (or the start of the next object) is read and its crc computed by the deep scrub read-ahead threads. This bounds the reads in flight across all PGs; 0 disables read-ahead.")
+    .add_see_also({"osd_deep_scrub_stride", "osd_deep_scrub_readahead_threads"}),
+
+    Option("osd_deep_scrub_readahead_threads", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(2)
+    .set_min(1)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Threads issuing deep scrub read-ahead and computing its crc")
+    .add_see_also("osd_deep_scrub_readahead_bytes"),
+
+    Option("osd_deep_scrub_readahead_client_ops", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(16)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Skip deep scrub read-ahead while more replicated writes than this are in progress on the OSD")
+    .set_long_description("This is the op_wip perf counter: the writes this OSD is primary for, from clients as well as internal sources such as snap trimming or cache tiering. Deep scrub then falls back to one synchronous read per stride, so that it leaves the disk to that io. 0 disables this check.")
+    .add_see_also("osd_deep_scrub_readahead_bytes"),
+
     Option("osd_deep_scrub_keys", Option::TYPE_INT, Option::LEVEL_ADVANCED)
     .set_default(1024)
     .set_description("Number of keys to read from an object at a time during deep scrub"),
@@ -3787,6 +3916,12 @@ std::vector<Option> get_global_options() {
     .set_default(64)
     .set_description(""),
 
+    Option("osd_pg_object_context_cache_negative", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(true)
+    .set_description("Remember objects found not to exist in the object context cache")
+    .set_long_description("Lookups of head objects that do not exist (e.g. rgw checking for an object before creating it) are then answered without asking the object store again.  Only the primary keeps such entries, since replicas do not see writes through their object contexts.  The entries are dropped on interval change, like the rest of the cache.")
+    .add_see_also("osd_pg_object_context_cache_count"),
+
     Option("osd_tracing", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
     .set_default(false)
     .set_description(""),
@@ -4186,6 +4321,17 @@ std::vector<Option> get_global_options() {
     .set_default(16)
     .set_description(""),
 
+    Option("bdev_ioring", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Enables Linux io_uring API instead of libaio")
+    .set_long_description("Submit and reap KernelDevice aios through an io_uring instance with the block device fds registered.  Falls back to libaio if Ceph was built without liburing or the running kernel does not support io_uring."),
+
+    Option("bdev_ioring_sqthread_poll", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Enables Linux io_uring API submission queue polling")
+    .set_long_description("A kernel thread polls the io_uring submission queue, so submitting I/O does not require a syscall.  This burns a CPU core in the kernel while the device is busy and usually requires root privileges.")
+    .add_see_also("bdev_ioring"),
+
     Option("bdev_block_size", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
     .set_default(4_K)
     .set_description(""),
@@ -4383,6 +4529,55 @@ std::vector<Option> get_global_options() {
     .add_see_also("bluestore_block_wal_path")
     .add_see_also("bluestore_block_wal_size"),
 
+    Option("bluestore_block_cache_path", Option::TYPE_STR, Option::LEVEL_DEV)
+    .set_default("")
+    .set_flag(Option::FLAG_CREATE)
+    .set_description("Path to fast block device/file used as a write-back cache for the main device"),
+
+    Option("bluestore_block_cache_size", Option::TYPE_SIZE, Option::LEVEL_DEV)
+    .set_default(1_G)
+    .set_flag(Option::FLAG_CREATE)
+    .set_description("Size of file to create for bluestore_block_cache_path"),
+
+    Option("bluestore_block_cache_create", Option::TYPE_BOOL, Option::LEVEL_DEV)
+    .set_default(false)
+    .set_flag(Option::FLAG_CREATE)
+    .set_description("Create bluestore_block_cache_path if it doesn't exist")
+    .add_see_also("bluestore_block_cache_path")
+    .add_see_also("bluestore_block_cache_size"),
+
+    Option("bluestore_block_cache_max_write", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(1_M)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Largest write absorbed by the block cache")
+    .set_long_description("Larger writes, which a rotational main device handles well, go straight to it.  Also bounds the size of read misses that are promoted into the cache.")
+    .add_see_also("bluestore_block_cache_path"),
+
+    Option("bluestore_block_cache_destage_ratio", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(.5)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Fraction of the block cache log in use above which dirty data is destaged to the main device")
+    .add_see_also("bluestore_block_cache_path"),
+
+    Option("bluestore_block_cache_destage_batch", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(16_M)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Amount of the block cache log destaged per batch")
+    .set_long_description("Each batch is written to the main device in offset order and followed by a single flush, so larger batches make destaging more sequential.")
+    .add_see_also("bluestore_block_cache_path"),
+
+    Option("bluestore_block_cache_promote_reads", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(true)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Copy regions of the main device that are read repeatedly into the block cache")
+    .add_see_also("bluestore_block_cache_path"),
+
+    Option("bluestore_block_cache_drain_on_umount", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Destage all dirty data in the block cache when unmounting")
+    .set_long_description("Leaves the main device self-contained, e.g. before the cache device is removed.")
+    .add_see_also("bluestore_block_cache_path"),
+
     Option("bluestore_block_preallocate_file", Option::TYPE_BOOL, Option::LEVEL_DEV)
     .set_default(false)
     .set_flag(Option::FLAG_CREATE)
@@ -4562,7 +4757,22 @@ std::vector<Option> get_global_options() {
     Option("bluestore_cache_type", Option::TYPE_STR, Option::LEVEL_DEV)
     .set_default("2q")
     .set_enum_allowed({"2q", "lru"})
-    .set_description("Cache replacement algorithm"),
+    .set_description("Cache replacement algorithm")
+    .set_long_description("Applies to the buffer cache; onodes are always cached in LRU order."),
+
+    Option("bluestore_cache_onode_shards", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Number of onode cache shards")
+    .set_long_description("Each onode cache shard has its own lock and LRU.  0 means one shard per OSD op shard.")
+    .add_see_also("bluestore_cache_buffer_shards"),
+
+    Option("bluestore_cache_buffer_shards", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Number of buffer (data) cache shards")
+    .set_long_description("Each buffer cache shard has its own lock and replacement lists.  0 means one shard per OSD op shard.")
+    .add_see_also("bluestore_cache_onode_shards"),
 
     Option("bluestore_2q_cache_kin_ratio", Option::TYPE_FLOAT, Option::LEVEL_DEV)
     .set_default(.5)
@@ -4619,6 +4829,12 @@ std::vector<Option> get_global_options() {
     .set_description("Allocator policy")
     .set_long_description("Allocator to use for bluestore.  Stupid should only be used for testing."),
 
+    Option("bluestore_allocator_trace_path", Option::TYPE_STR, Option::LEVEL_DEV)
+    .set_default("")
+    .set_description("Record every allocator call to this file")
+    .set_long_description("The trace can be replayed against any allocator implementation with ceph_test_alloc_replay.  Allocator calls are serialized while tracing, so this is for collecting workloads, not for production use.")
+    .add_see_also("bluestore_allocator"),
+
     Option("bluestore_freelist_blocks_per_key", Option::TYPE_SIZE, Option::LEVEL_DEV)
     .set_default(128)
     .set_description("Block (and bits) per database key"),
@@ -4645,7 +4861,9 @@ std::vector<Option> get_global_options() {
 
     Option("bluestore_rocksdb_cfs", Option::TYPE_STR, Option::LEVEL_DEV)
     .set_default("M= P= L=")
-    .set_description("List of whitespace-separate key/value pairs where key is CF name and value is CF options"),
+    .set_description("List of whitespace-separate key/value pairs where key is CF name and value is CF options")
+    .set_long_description("Each entry is NAME[(SHARDS[,BEGIN-END])][=OPTIONS]: the key prefix NAME gets its own column family, optionally spread over SHARDS column families by hashing key bytes BEGIN to END, with rocksdb options OPTIONS.  The layout is fixed at mkfs; use ceph-bluestore-tool reshard to change it for an existing OSD.  Options given here override the stored ones.")
+    .add_see_also("bluestore_rocksdb_cf"),
 
     Option("bluestore_fsck_on_mount", Option::TYPE_BOOL, Option::LEVEL_DEV)
     .set_default(false)
@@ -4675,11 +4893,21 @@ std::vector<Option> get_global_options() {
     .set_default(false)
     .set_description("Try to submit metadata transaction to rocksdb in queuing thread context"),
 
+    Option("bluestore_kv_commit_pipeline_depth", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_description("Number of kv_sync batches that may wait for the kv_commit thread")
+    .set_long_description("If non-zero, the kv_sync thread hands the synchronous rocksdb commit of each batch to a separate kv_commit thread and starts flushing and submitting the next batch while the previous one is being synced.  0 syncs each batch in the kv_sync thread."),
+
     Option("bluestore_fsck_read_bytes_cap", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
     .set_default(64_M)
     .set_flag(Option::FLAG_RUNTIME)
     .set_description("Maximum bytes read at once by deep fsck"),
 
+    Option("bluestore_fsck_threads", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(4)
+    .set_description("Number of threads checking objects during fsck")
+    .set_long_description("The object keyspace is still walked by a single thread, which hands the objects over to this many workers for checking.  0 or 1 checks objects inline."),
+
     Option("bluestore_throttle_bytes", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
     .set_default(64_M)
     .set_flag(Option::FLAG_RUNTIME)
@@ -4742,6 +4970,36 @@ std::vector<Option> get_global_options() {
     .set_flag(Option::FLAG_RUNTIME)
     .set_description("Cache read results by default (unless hinted NOCACHE or WONTNEED)"),
 
+    Option("bluestore_readahead_max", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Maximum readahead window for sequential object reads")
+    .set_long_description("If this value is non-zero, it overrides bluestore_readahead_max_hdd and bluestore_readahead_max_ssd."),
+
+    Option("bluestore_readahead_max_hdd", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(1_M)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Default bluestore_readahead_max for rotational media")
+    .add_see_also("bluestore_readahead_max"),
+
+    Option("bluestore_readahead_max_ssd", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Default bluestore_readahead_max for non-rotational (solid state) media")
+    .add_see_also("bluestore_readahead_max"),
+
+    Option("bluestore_readahead_trigger_requests", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(2)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Number of sequential reads of an object before readahead starts")
+    .add_see_also("bluestore_readahead_max"),
+
+    Option("bluestore_omap_readahead", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Readahead size for omap iteration")
+    .set_long_description("Omap scans are bounded to the keys of a single object, so RocksDB may prefetch this many bytes of SST data when iterating. 0 leaves readahead to RocksDB, which starts prefetching on its own after a few sequential reads from the same file."),
+
     Option("bluestore_default_buffered_write", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
     .set_default(false)
     .set_flag(Option::FLAG_RUNTIME)
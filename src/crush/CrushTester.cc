@@ -10,6 +10,7 @@
 #include <boost/algorithm/string/join.hpp>
 
 #include "common/SubProcess.h"
+#include "common/ceph_time.h"
 #include "common/fork_function.h"
 
 #include "include/stringify.h"
@@ -92,6 +93,50 @@ int CrushTester::get_maximum_affected_by_rule(int ruleno)
   return max_affected;
 }
 
+void CrushTester::measure_mapping_rate(int ruleno, int nr,
+				       const vector<__u32>& weight)
+{
+  vector<int> xs;
+  for (int x = min_x; x <= max_x; x++) {
+    if (pool_id != -1)
+      xs.push_back(crush_hash32_2(CRUSH_HASH_RJENKINS1, x, (uint32_t)pool_id));
+    else
+      xs.push_back(x);
+  }
+
+  vector<vector<int>> single(xs.size());
+  auto start = ceph::mono_clock::now();
+  for (unsigned i = 0; i < xs.size(); i++)
+    crush.do_rule(ruleno, xs[i], single[i], nr, weight, 0);
+  double single_secs = std::chrono::duration<double>(
+    ceph::mono_clock::now() - start).count();
+
+  vector<vector<int>> batched;
+  start = ceph::mono_clock::now();
+  crush.do_rule_batch(ruleno, xs, &batched, nr, weight, 0);
+  double batch_secs = std::chrono::duration<double>(
+    ceph::mono_clock::now() - start).count();
+
+  int mismatches = 0;
+  for (unsigned i = 0; i < xs.size(); i++) {
+    if (single[i] != batched[i]) {
+      err << "rule " << ruleno << " x " << (min_x + (int)i)
+	  << " batched mapping " << batched[i]
+	  << " differs from " << single[i] << std::endl;
+      mismatches++;
+    }
+  }
+
+  err << "rule " << ruleno << " (" << crush.get_rule_name(ruleno)
+      << ") num_rep " << nr << " mappings " << xs.size()
+      << " single " << (single_secs > 0 ? xs.size() / single_secs : 0)
+      << "/s batched " << (batch_secs > 0 ? xs.size() / batch_secs : 0)
+      << "/s";
+  if (mismatches)
+    err << " MISMATCHES " << mismatches;
+  err << std::endl;
+}
+
 
 map<int,int> CrushTester::get_collapsed_mapping()
 {
@@ -540,6 +585,9 @@ int CrushTester::test()
       << std::endl;
 
     for (int nr = minr; nr <= maxr; nr++) {
+      if (output_mapping_rate && use_crush)
+	measure_mapping_rate(r, nr, weight);
+
       vector<int> per(crush.get_max_devices());
       map<int,int> sizes;
 
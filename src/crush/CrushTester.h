@@ -31,6 +31,7 @@ class CrushTester {
   bool output_mappings;
   bool output_bad_mappings;
   bool output_choose_tries;
+  bool output_mapping_rate;
 
   bool output_data_file;
   bool output_csv;
@@ -48,6 +49,13 @@ class CrushTester {
    */
   int get_maximum_affected_by_rule(int ruleno);
 
+  /*
+   * time mapping min_x..max_x one x at a time and as a batch, and check
+   * that both agree.
+   */
+  void measure_mapping_rate(int ruleno, int nr,
+			    const std::vector<__u32>& weight);
+
   /*
    * for maps where in devices have non-sequential id numbers, return a mapping of device id
    * to a sequential id number. For example, if we have devices with id's 0 1 4 5 6 return a map
@@ -183,6 +191,7 @@ public:
       output_mappings(false),
       output_bad_mappings(false),
       output_choose_tries(false),
+      output_mapping_rate(false),
       output_data_file(false),
       output_csv(false),
       output_data_file_name("")
@@ -252,6 +261,13 @@ public:
     return output_choose_tries;
   }
 
+  void set_output_mapping_rate(bool b) {
+    output_mapping_rate = b;
+  }
+  bool get_output_mapping_rate() const {
+    return output_mapping_rate;
+  }
+
   void set_batches(int b) {
     num_batches = b;
   }
@@ -1588,6 +1588,34 @@ public:
       out[i] = rawout[i];
   }
 
+  /**
+   * map each of xs like do_rule() does, sharing the workspace and the
+   * choose_args lookup across all of them.  out->at(i) is the mapping
+   * of xs[i].
+   */
+  template<typename WeightVector>
+  void do_rule_batch(int rule, const std::vector<int>& xs,
+		     std::vector<std::vector<int>> *out, int maxout,
+		     const WeightVector& weight,
+		     uint64_t choose_args_index) const {
+    int count = xs.size();
+    std::vector<int> rawout(count * maxout);
+    std::vector<int> lens(count);
+    std::vector<char> work(crush_work_size(crush, maxout));
+    crush_init_workspace(crush, work.data());
+    crush_choose_arg_map arg_map = choose_args_get_with_fallback(
+      choose_args_index);
+    crush_do_rule_batch(crush, rule, xs.data(), count, rawout.data(), maxout,
+			lens.data(), &weight[0], weight.size(), work.data(),
+			arg_map.args);
+    out->resize(count);
+    for (int i = 0; i < count; i++) {
+      int numrep = std::max(lens[i], 0);
+      auto first = rawout.begin() + i * maxout;
+      (*out)[i].assign(first, first + numrep);
+    }
+  }
+
   int _choose_type_stack(
     CephContext *cct,
     const std::vector<std::pair<int,int>>& stack,
@@ -2,6 +2,15 @@
 # include <linux/crush/hash.h>
 #else
 # include "hash.h"
+# if defined(__x86_64__)
+#  include <immintrin.h>
+#  include "arch/probe.h"
+#  include "arch/intel.h"
+#  define CRUSH_HASH_AVX2
+# elif defined(__aarch64__)
+#  include <arm_neon.h>
+#  define CRUSH_HASH_NEON
+# endif
 #endif
 
 /*
@@ -140,6 +149,111 @@ __u32 crush_hash32_5(int type, __u32 a, __u32 b, __u32 c, __u32 d, __u32 e)
 	}
 }
 
+/*
+ * The same mix on a vector of lanes.  Every step is a 32-bit add, sub,
+ * xor or shift, so each lane yields exactly what the scalar code does.
+ */
+#define crush_hashmix_vec(a, b, c, SUB, XOR, SHR, SHL) do {	\
+		a = SUB(a, b);  a = SUB(a, c);  a = XOR(a, SHR(c, 13));	\
+		b = SUB(b, c);  b = SUB(b, a);  b = XOR(b, SHL(a, 8));	\
+		c = SUB(c, a);  c = SUB(c, b);  c = XOR(c, SHR(b, 13));	\
+		a = SUB(a, b);  a = SUB(a, c);  a = XOR(a, SHR(c, 12));	\
+		b = SUB(b, c);  b = SUB(b, a);  b = XOR(b, SHL(a, 16));	\
+		c = SUB(c, a);  c = SUB(c, b);  c = XOR(c, SHR(b, 5));	\
+		a = SUB(a, b);  a = SUB(a, c);  a = XOR(a, SHR(c, 3));	\
+		b = SUB(b, c);  b = SUB(b, a);  b = XOR(b, SHL(a, 10));	\
+		c = SUB(c, a);  c = SUB(c, b);  c = XOR(c, SHR(b, 15));	\
+	} while (0)
+
+#define crush_hash32_rjenkins1_3_vec(a, b, c, hash, SET1, SUB, XOR, SHR, SHL) \
+	do {								\
+		__typeof__(hash) x = SET1(231232);			\
+		__typeof__(hash) y = SET1(1232);			\
+		hash = XOR(XOR(XOR(SET1(crush_hash_seed), a), b), c);	\
+		crush_hashmix_vec(a, b, hash, SUB, XOR, SHR, SHL);	\
+		crush_hashmix_vec(c, x, hash, SUB, XOR, SHR, SHL);	\
+		crush_hashmix_vec(y, a, hash, SUB, XOR, SHR, SHL);	\
+		crush_hashmix_vec(b, x, hash, SUB, XOR, SHR, SHL);	\
+		crush_hashmix_vec(y, c, hash, SUB, XOR, SHR, SHL);	\
+	} while (0)
+
+#ifdef CRUSH_HASH_AVX2
+#define avx2_set1(v) _mm256_set1_epi32((int)(v))
+#define avx2_shr(v, n) _mm256_srli_epi32(v, n)
+#define avx2_shl(v, n) _mm256_slli_epi32(v, n)
+
+__attribute__((target("avx2")))
+static unsigned int crush_hash32_rjenkins1_3_avx2(__u32 a, const __u32 *b,
+						  __u32 c, __u32 *out,
+						  unsigned int n)
+{
+	unsigned int i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m256i va = avx2_set1(a);
+		__m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+		__m256i vc = avx2_set1(c);
+		__m256i hash;
+		crush_hash32_rjenkins1_3_vec(va, vb, vc, hash, avx2_set1,
+					     _mm256_sub_epi32,
+					     _mm256_xor_si256,
+					     avx2_shr, avx2_shl);
+		_mm256_storeu_si256((__m256i *)(out + i), hash);
+	}
+	return i;
+}
+
+static int crush_hash_use_avx2 = -1;
+#endif
+
+#ifdef CRUSH_HASH_NEON
+#define neon_shr(v, n) vshrq_n_u32(v, n)
+#define neon_shl(v, n) vshlq_n_u32(v, n)
+
+static unsigned int crush_hash32_rjenkins1_3_neon(__u32 a, const __u32 *b,
+						  __u32 c, __u32 *out,
+						  unsigned int n)
+{
+	unsigned int i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		uint32x4_t va = vdupq_n_u32(a);
+		uint32x4_t vb = vld1q_u32(b + i);
+		uint32x4_t vc = vdupq_n_u32(c);
+		uint32x4_t hash;
+		crush_hash32_rjenkins1_3_vec(va, vb, vc, hash, vdupq_n_u32,
+					     vsubq_u32, veorq_u32,
+					     neon_shr, neon_shl);
+		vst1q_u32(out + i, hash);
+	}
+	return i;
+}
+#endif
+
+void crush_hash32_3_vec(int type, __u32 a, const __u32 *b, __u32 c,
+			__u32 *out, unsigned int n)
+{
+	unsigned int i = 0;
+
+	switch (type) {
+	case CRUSH_HASH_RJENKINS1:
+#if defined(CRUSH_HASH_AVX2)
+		if (crush_hash_use_avx2 < 0) {
+			ceph_arch_probe();
+			crush_hash_use_avx2 = ceph_arch_intel_avx2;
+		}
+		if (crush_hash_use_avx2)
+			i = crush_hash32_rjenkins1_3_avx2(a, b, c, out, n);
+#elif defined(CRUSH_HASH_NEON)
+		i = crush_hash32_rjenkins1_3_neon(a, b, c, out, n);
+#endif
+		for (; i < n; i++)
+			out[i] = crush_hash32_rjenkins1_3(a, b[i], c);
+		break;
+	default:
+		for (; i < n; i++)
+			out[i] = 0;
+	}
+}
+
 const char *crush_hash_name(int type)
 {
 	switch (type) {
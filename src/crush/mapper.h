@@ -78,6 +78,25 @@ extern int crush_do_rule(const struct crush_map *map,
 			 const __u32 *weights, int weight_max,
 			 void *cwin, const struct crush_choose_arg *choose_args);
 
+/** @ingroup API
+ *
+ * Map each of __x__[0..__nx__) as crush_do_rule() would, sharing one
+ * workspace, which only needs crush_init_workspace() once.  The
+ * mapping of __x__[i] is stored at __result__ + i * __result_max__
+ * and its size in __result_len__[i].
+ *
+ * @param result an array of __nx__ * __result_max__ items
+ * @param result_len an array of __nx__ sizes
+ *
+ * @return __nx__
+ */
+extern int crush_do_rule_batch(const struct crush_map *map,
+			       int ruleno, const int *x, int nx,
+			       int *result, int result_max, int *result_len,
+			       const __u32 *weights, int weight_max,
+			       void *cwin,
+			       const struct crush_choose_arg *choose_args);
+
 /* Returns the exact amount of workspace that will need to be used
    for a given combination of crush_map and result_max. The caller can
    then allocate this much on its own, either on the stack, in a
@@ -96,6 +96,10 @@ namespace ceph {
 
     const std::vector<int> &get_chunk_mapping() const override;
 
+    bool supports_parity_delta() const override {
+      return false;
+    }
+
     int to_mapping(const ErasureCodeProfile &profile,
 		   std::ostream *ss);
 
@@ -447,6 +447,22 @@ namespace ceph {
      */
     virtual const std::vector<int> &get_chunk_mapping() const = 0;
 
+    /**
+     * Return true if the coding chunks are a linear function of the
+     * data chunks, with addition being XOR. Encoding the XOR of two
+     * inputs then yields the XOR of their coding chunks, so when some
+     * data chunks change the coding chunks can be updated by encoding
+     * just the change:
+     *
+     *   coding' = coding ^ encode(data ^ data')
+     *
+     * which lets a small overwrite skip reading the data chunks it
+     * does not modify.
+     *
+     * @return **true** if coding chunks can be updated from a delta
+     */
+    virtual bool supports_parity_delta() const = 0;
+
     /**
      * Decode the first **get_data_chunk_count()** **chunks** and
      * concatenate them into **decoded**.
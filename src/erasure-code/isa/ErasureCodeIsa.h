@@ -134,6 +134,10 @@ public:
                           char **coding,
                           int blocksize) override;
 
+  bool supports_parity_delta() const override {
+    return true;
+  }
+
   virtual bool erasure_contains(int *erasures, int i);
 
   int isa_decode(int *erasures,
@@ -96,6 +96,9 @@
 /* Defind if you have POSIX AIO */
 #cmakedefine HAVE_POSIXAIO
 
+/* Defined if you have liburing */
+#cmakedefine HAVE_LIBURING
+
 /* Defined if OpenLDAP enabled */
 #cmakedefine HAVE_OPENLDAP
 
@@ -16,6 +16,7 @@
 #define _CEPH_INCLUDE_MEMPOOL_H
 
 #include <cstddef>
+#include <deque>
 #include <map>
 #include <unordered_map>
 #include <set>
@@ -433,12 +434,22 @@ public:
     template<typename v>						\
     using vector = std::vector<v,pool_allocator<v>>;			\
                                                                         \
+    template<typename v>						\
+    using deque = std::deque<v,pool_allocator<v>>;			\
+                                                                        \
     template<typename k, typename v,					\
 	     typename h=std::hash<k>,					\
 	     typename eq = std::equal_to<k>>				\
     using unordered_map =						\
       std::unordered_map<k,v,h,eq,pool_allocator<std::pair<const k,v>>>;\
                                                                         \
+    template<typename k, typename v,					\
+	     typename h=std::hash<k>,					\
+	     typename eq = std::equal_to<k>>				\
+    using unordered_multimap =						\
+      std::unordered_multimap<k,v,h,eq,					\
+			      pool_allocator<std::pair<const k,v>>>;	\
+                                                                        \
     inline size_t allocated_bytes() {					\
       return mempool::get_pool(id).allocated_bytes();			\
     }									\
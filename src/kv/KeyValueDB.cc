@@ -2,6 +2,8 @@
 // vim: ts=8 sw=2 smarttab
 
 #include "KeyValueDB.h"
+#include "common/strtol.h"
+#include "include/str_list.h"
 #ifdef WITH_LEVELDB
 #include "LevelDBStore.h"
 #endif
@@ -65,3 +67,98 @@ int KeyValueDB::test_init(const string& type, const string& dir)
   }
   return -EINVAL;
 }
+
+int KeyValueDB::parse_sharding(const string& def,
+			       vector<ColumnFamily> *cfs,
+			       std::ostream *err)
+{
+  std::ostringstream devnull;
+  std::ostream& e = err ? *err : devnull;
+  for (auto& token : get_str_vec(def, " \t\n")) {
+    string name, option;
+    string::size_type eq = token.find('=');
+    if (eq != string::npos) {
+      option = token.substr(eq + 1);
+    }
+    string head = token.substr(0, eq);
+    uint32_t shards = 1;
+    uint32_t hash_l = 0;
+    uint32_t hash_h = UINT32_MAX;
+    string::size_type paren = head.find('(');
+    if (paren == string::npos) {
+      name = head;
+    } else {
+      name = head.substr(0, paren);
+      if (head.back() != ')') {
+	e << "missing ')' in '" << token << "'";
+	return -EINVAL;
+      }
+      string args = head.substr(paren + 1, head.size() - paren - 2);
+      string range;
+      string::size_type comma = args.find(',');
+      if (comma != string::npos) {
+	range = args.substr(comma + 1);
+	args.resize(comma);
+      }
+      string serr;
+      long long n = strict_strtoll(args.c_str(), 10, &serr);
+      if (!serr.empty() || n < 1 || n > 1024) {
+	e << "bad shard count '" << args << "' in '" << token << "'";
+	return -EINVAL;
+      }
+      shards = n;
+      if (!range.empty()) {
+	string::size_type dash = range.find('-');
+	if (dash == string::npos) {
+	  e << "bad hash range '" << range << "' in '" << token << "'";
+	  return -EINVAL;
+	}
+	string l = range.substr(0, dash);
+	string h = range.substr(dash + 1);
+	long long lv = strict_strtoll(l.c_str(), 10, &serr);
+	long long hv = h.empty() ? UINT32_MAX : strict_strtoll(h.c_str(), 10, &serr);
+	if (!serr.empty() || lv < 0 || hv <= lv || hv > UINT32_MAX) {
+	  e << "bad hash range '" << range << "' in '" << token << "'";
+	  return -EINVAL;
+	}
+	hash_l = lv;
+	hash_h = hv;
+      }
+    }
+    if (name.empty() || name.find_first_of("()-") != string::npos) {
+      e << "bad column family name in '" << token << "'";
+      return -EINVAL;
+    }
+    for (auto& c : *cfs) {
+      if (c.name == name) {
+	e << "column family '" << name << "' defined twice";
+	return -EINVAL;
+      }
+    }
+    cfs->emplace_back(name, option, shards, hash_l, hash_h);
+  }
+  return 0;
+}
+
+string KeyValueDB::print_sharding(const vector<ColumnFamily>& cfs)
+{
+  std::ostringstream out;
+  for (auto& c : cfs) {
+    if (out.tellp() > 0) {
+      out << ' ';
+    }
+    out << c.name;
+    if (c.shards > 1 || c.hash_l != 0 || c.hash_h != UINT32_MAX) {
+      out << '(' << c.shards;
+      if (c.hash_l != 0 || c.hash_h != UINT32_MAX) {
+	out << ',' << c.hash_l << '-';
+	if (c.hash_h != UINT32_MAX) {
+	  out << c.hash_h;
+	}
+      }
+      out << ')';
+    }
+    out << '=' << c.option;
+  }
+  return out.str();
+}
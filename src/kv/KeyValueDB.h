@@ -7,6 +7,7 @@
 #include <ostream>
 #include <set>
 #include <map>
+#include <optional>
 #include <string>
 #include <boost/scoped_ptr.hpp>
 #include "include/encoding.h"
@@ -31,10 +32,38 @@ public:
   struct ColumnFamily {
     string name;      //< name of this individual column family
     string option;    //< configure option string for this CF
+    uint32_t shards = 1;          //< number of CFs the prefix is hashed over
+    uint32_t hash_l = 0;          //< first key byte fed to the shard hash
+    uint32_t hash_h = UINT32_MAX; //< one past the last key byte hashed
     ColumnFamily(const string &name, const string &option)
       : name(name), option(option) {}
+    ColumnFamily(const string &name, const string &option,
+		 uint32_t shards, uint32_t hash_l, uint32_t hash_h)
+      : name(name), option(option),
+	shards(shards), hash_l(hash_l), hash_h(hash_h) {}
   };
 
+  /**
+   * Parse a column family sharding definition.
+   *
+   * The definition is a whitespace separated list of
+   *
+   *   NAME[(SHARDS[,BEGIN-END])][=OPTIONS]
+   *
+   * where NAME is the prefix that gets its own column family, SHARDS
+   * the number of column families the prefix is spread over, BEGIN-END
+   * the byte range of the key that is hashed to pick a shard (END may
+   * be omitted to hash up to the end of the key) and OPTIONS the
+   * rocksdb options string for the family, e.g.
+   *
+   *   "O(4,0-13)=write_buffer_size=16777216 M(4) P L="
+   */
+  static int parse_sharding(const std::string& def,
+			    std::vector<ColumnFamily> *cfs,
+			    std::ostream *err = nullptr);
+  /// format a sharding definition in the form parse_sharding accepts
+  static std::string print_sharding(const std::vector<ColumnFamily>& cfs);
+
   class TransactionImpl {
   public:
     /// Set Keys
@@ -171,6 +200,16 @@ public:
   /// Try to repair K/V database. leveldb and rocksdb require that database must be not opened.
   virtual int repair(std::ostream &out) { return 0; }
 
+  /**
+   * Move keys so that they match a new column family sharding
+   * definition (see parse_sharding).  The database must be
+   * initialized but not opened.  An interrupted reshard is resumed by
+   * calling this again with the same definition.
+   */
+  virtual int reshard(const std::string& new_sharding, std::ostream &out) {
+    return -EOPNOTSUPP;
+  }
+
   virtual Transaction get_transaction() = 0;
   virtual int submit_transaction(Transaction) = 0;
   virtual int submit_transaction_sync(Transaction t) {
@@ -274,7 +313,7 @@ public:
   };
   typedef std::shared_ptr< WholeSpaceIteratorImpl > WholeSpaceIterator;
 
-private:
+protected:
   // This class filters a WholeSpaceIterator by a prefix.
   class PrefixIteratorImpl : public IteratorImpl {
     const std::string prefix;
@@ -332,6 +371,18 @@ public:
       get_wholespace_iterator());
   }
 
+  /// hints for an iterator that is known to stay within part of a prefix
+  struct IteratorHints {
+    std::optional<std::string> lower_bound;  ///< no keys before this
+    std::optional<std::string> upper_bound;  ///< no keys at or after this
+    size_t readahead = 0;  ///< bytes to prefetch; 0 leaves it to the backend
+  };
+  /// as above, with hints; callers still check keys against their bounds
+  virtual Iterator get_iterator(const std::string &prefix,
+				const IteratorHints &hints) {
+    return get_iterator(prefix);
+  }
+
   void add_column_family(const std::string& cf_name, void *handle) {
     cf_handles.insert(std::make_pair(cf_name, handle));
   }
@@ -22,6 +22,7 @@
 using std::string;
 #include "common/perf_counters.h"
 #include "common/PriorityCache.h"
+#include "include/ceph_hash.h"
 #include "include/str_list.h"
 #include "include/stringify.h"
 #include "include/str_map.h"
@@ -77,6 +78,9 @@ public:
     for (auto& p : store.cf_handles) {
       names.erase(p.first);
     }
+    for (auto& p : store.cf_shards) {
+      names.erase(p.first);
+    }
     for (auto& p : names) {
       store.assoc_name += '.';
       store.assoc_name += p.first;
@@ -310,6 +314,79 @@ int RocksDBStore::install_cf_mergeop(
   return 0;
 }
 
+rocksdb::Env *RocksDBStore::get_env()
+{
+  if (env) {
+    return env;
+  }
+  return rocksdb::Env::Default();
+}
+
+int RocksDBStore::read_sharding(const string& fn,
+				vector<ColumnFamily> *cfs,
+				bool *exists)
+{
+  rocksdb::Env *e = get_env();
+  *exists = false;
+  rocksdb::Status status = e->FileExists(fn);
+  if (status.IsNotFound()) {
+    return 0;
+  }
+  string def;
+  if (status.ok()) {
+    status = rocksdb::ReadFileToString(e, fn, &def);
+  }
+  if (!status.ok()) {
+    derr << __func__ << " failed to read " << fn << ": "
+	 << status.ToString() << dendl;
+    return -EIO;
+  }
+  std::ostringstream err;
+  int r = parse_sharding(def, cfs, &err);
+  if (r < 0) {
+    derr << __func__ << " bad sharding in " << fn << ": " << err.str()
+	 << dendl;
+    return r;
+  }
+  *exists = true;
+  return 0;
+}
+
+int RocksDBStore::write_sharding(const string& fn,
+				 const vector<ColumnFamily>& cfs)
+{
+  string def = print_sharding(cfs);
+  rocksdb::Status status =
+    rocksdb::WriteStringToFile(get_env(), def, fn, true);
+  if (!status.ok()) {
+    derr << __func__ << " failed to write " << fn << ": "
+	 << status.ToString() << dendl;
+    return -EIO;
+  }
+  dout(10) << __func__ << " " << fn << " '" << def << "'" << dendl;
+  return 0;
+}
+
+string RocksDBStore::shard_cf_name(const ColumnFamily& cf, uint32_t shard)
+{
+  if (cf.shards == 1) {
+    return cf.name;
+  }
+  return cf.name + "-" + stringify(shard);
+}
+
+uint32_t RocksDBStore::shard_of(uint32_t hash_l, uint32_t hash_h,
+				uint32_t shards,
+				const char *key, size_t keylen)
+{
+  if (shards == 1) {
+    return 0;
+  }
+  size_t l = std::min<size_t>(hash_l, keylen);
+  size_t h = std::min<size_t>(hash_h, keylen);
+  return ceph_str_hash_rjenkins(key + l, h - l) % shards;
+}
+
 int RocksDBStore::create_and_open(ostream &out,
 				  const vector<ColumnFamily>& cfs)
 {
@@ -497,19 +574,62 @@ int RocksDBStore::do_open(ostream &out,
 	  return -EINVAL;
 	}
 	install_cf_mergeop(p.name, &cf_opt);
-	rocksdb::ColumnFamilyHandle *cf;
-	status = db->CreateColumnFamily(cf_opt, p.name, &cf);
-	if (!status.ok()) {
-	  derr << __func__ << " Failed to create rocksdb column family: "
-	       << p.name << dendl;
-	  return -EINVAL;
+	prefix_shards shards;
+	shards.hash_l = p.hash_l;
+	shards.hash_h = p.hash_h;
+	for (uint32_t i = 0; i < p.shards; ++i) {
+	  string name = shard_cf_name(p, i);
+	  rocksdb::ColumnFamilyHandle *cf;
+	  status = db->CreateColumnFamily(cf_opt, name, &cf);
+	  if (!status.ok()) {
+	    derr << __func__ << " Failed to create rocksdb column family: "
+		 << name << dendl;
+	    return -EINVAL;
+	  }
+	  shards.handles.push_back(cf);
+	}
+	// store the new CF handle(s)
+	if (p.shards == 1) {
+	  add_column_family(p.name, static_cast<void*>(shards.handles[0]));
+	} else {
+	  cf_shards[p.name] = std::move(shards);
+	}
+      }
+      if (!cfs->empty()) {
+	r = write_sharding(sharding_file(), *cfs);
+	if (r < 0) {
+	  return r;
 	}
-	// store the new CF handle
-	add_column_family(p.name, static_cast<void*>(cf));
       }
     }
     default_cf = db->DefaultColumnFamily();
   } else {
+    bool resharding = false;
+    vector<ColumnFamily> pending;
+    r = read_sharding(resharding_file(), &pending, &resharding);
+    if (r < 0) {
+      return r;
+    }
+    if (resharding) {
+      derr << __func__ << " an interrupted reshard to '"
+	   << print_sharding(pending) << "' must be finished first" << dendl;
+      out << "an interrupted reshard to '" << print_sharding(pending)
+	  << "' must be finished first" << std::endl;
+      return -EBUSY;
+    }
+    // the stored sharding says which prefix (and shard) each column
+    // family holds; without it every column family is named after its
+    // prefix.
+    bool have_sharding = false;
+    vector<ColumnFamily> sharding;
+    r = read_sharding(sharding_file(), &sharding, &have_sharding);
+    if (r < 0) {
+      return r;
+    }
+    if (have_sharding) {
+      dout(1) << __func__ << " sharding '" << print_sharding(sharding) << "'"
+	      << dendl;
+    }
     std::vector<string> existing_cfs;
     status = rocksdb::DB::ListColumnFamilies(
       rocksdb::DBOptions(opt),
@@ -532,29 +652,47 @@ int RocksDBStore::do_open(ostream &out,
       // we cannot change column families for a created database.  so, map
       // what options we are given to whatever cf's already exist.
       std::vector<rocksdb::ColumnFamilyDescriptor> column_families;
+      std::vector<ColumnFamily> cf_defs;   // prefix held by each CF
+      std::vector<uint32_t> cf_shard;      // and the shard within it
       for (auto& n : existing_cfs) {
 	// copy default CF settings, block cache, merge operators as
 	// the base for new CF
 	rocksdb::ColumnFamilyOptions cf_opt(opt);
+	ColumnFamily def(n, string());
+	uint32_t shard = 0;
 	bool found = false;
+	for (auto& c : sharding) {
+	  for (uint32_t i = 0; i < c.shards; ++i) {
+	    if (shard_cf_name(c, i) == n) {
+	      def = c;
+	      shard = i;
+	      found = true;
+	    }
+	  }
+	}
 	if (cfs) {
 	  for (auto& i : *cfs) {
-	    if (i.name == n) {
+	    if (i.name == def.name) {
 	      found = true;
-	      status = rocksdb::GetColumnFamilyOptionsFromString(
-		cf_opt, i.option, &cf_opt);
-	      if (!status.ok()) {
-		derr << __func__ << " invalid db column family options for CF '"
-		     << i.name << "': " << i.option << dendl;
-		return -EINVAL;
+	      if (!i.option.empty()) {
+		def.option = i.option;
 	      }
 	    }
 	  }
 	}
+	status = rocksdb::GetColumnFamilyOptionsFromString(
+	  cf_opt, def.option, &cf_opt);
+	if (!status.ok()) {
+	  derr << __func__ << " invalid db column family options for CF '"
+	       << n << "': " << def.option << dendl;
+	  return -EINVAL;
+	}
 	if (n != rocksdb::kDefaultColumnFamilyName) {
-	  install_cf_mergeop(n, &cf_opt);
+	  install_cf_mergeop(def.name, &cf_opt);
 	}
 	column_families.push_back(rocksdb::ColumnFamilyDescriptor(n, cf_opt));
+	cf_defs.push_back(def);
+	cf_shard.push_back(shard);
 	if (!found && n != rocksdb::kDefaultColumnFamilyName) {
 	  dout(1) << __func__ << " column family '" << n
 		  << "' exists but not expected" << dendl;
@@ -577,8 +715,23 @@ int RocksDBStore::do_open(ostream &out,
 	if (existing_cfs[i] == rocksdb::kDefaultColumnFamilyName) {
 	  default_cf = handles[i];
 	  must_close_default_cf = true;
+	} else if (cf_defs[i].shards > 1) {
+	  auto& shards = cf_shards[cf_defs[i].name];
+	  shards.hash_l = cf_defs[i].hash_l;
+	  shards.hash_h = cf_defs[i].hash_h;
+	  shards.handles.resize(cf_defs[i].shards);
+	  shards.handles[cf_shard[i]] = handles[i];
 	} else {
-	  add_column_family(existing_cfs[i], static_cast<void*>(handles[i]));
+	  add_column_family(cf_defs[i].name, static_cast<void*>(handles[i]));
+	}
+      }
+      for (auto& p : cf_shards) {
+	for (unsigned i = 0; i < p.second.handles.size(); ++i) {
+	  if (!p.second.handles[i]) {
+	    derr << __func__ << " column family for shard " << i
+		 << " of prefix '" << p.first << "' is missing" << dendl;
+	    return -EINVAL;
+	  }
 	}
       }
     }
@@ -634,6 +787,14 @@ RocksDBStore::~RocksDBStore()
       static_cast<rocksdb::ColumnFamilyHandle*>(p.second));
     p.second = nullptr;
   }
+  for (auto& p : cf_shards) {
+    for (auto& cf : p.second.handles) {
+      if (cf) {
+	db->DestroyColumnFamilyHandle(cf);
+	cf = nullptr;
+      }
+    }
+  }
   if (must_close_default_cf) {
     db->DestroyColumnFamilyHandle(default_cf);
     must_close_default_cf = false;
@@ -682,6 +843,259 @@ int RocksDBStore::repair(std::ostream &out)
   }
 }
 
+int RocksDBStore::reshard_move_keys(
+  rocksdb::ColumnFamilyHandle *from,
+  const string& from_prefix,
+  const std::map<string, prefix_shards>& target,
+  ostream &out)
+{
+  const uint64_t batch_keys = 10000;
+  rocksdb::ReadOptions ropts;
+  ropts.fill_cache = false;
+  rocksdb::WriteOptions wopts;
+  wopts.sync = true;
+  std::unique_ptr<rocksdb::Iterator> it(db->NewIterator(ropts, from));
+  rocksdb::WriteBatch bat;
+  uint64_t batched = 0, moved = 0;
+  string prefix = from_prefix;
+  for (it->SeekToFirst(); it->Valid(); it->Next()) {
+    rocksdb::Slice key = it->key();
+    if (from == default_cf) {
+      // keys in the default column family carry their prefix
+      const char *sep = (const char *)memchr(key.data(), 0, key.size());
+      if (!sep) {
+	continue;
+      }
+      prefix.assign(key.data(), sep - key.data());
+      key = rocksdb::Slice(sep + 1, key.size() - prefix.size() - 1);
+    }
+    rocksdb::ColumnFamilyHandle *to = default_cf;
+    auto t = target.find(prefix);
+    if (t != target.end()) {
+      to = t->second.handles[shard_of(t->second.hash_l, t->second.hash_h,
+				      t->second.handles.size(),
+				      key.data(), key.size())];
+    }
+    if (to == from) {
+      continue;
+    }
+    if (to == default_cf) {
+      bat.Put(to, combine_strings(prefix, key.ToString()), it->value());
+    } else {
+      bat.Put(to, key, it->value());
+    }
+    bat.Delete(from, it->key());
+    ++moved;
+    if (++batched == batch_keys) {
+      rocksdb::Status s = db->Write(wopts, &bat);
+      if (!s.ok()) {
+	out << "failed to move keys: " << s.ToString() << std::endl;
+	return -EIO;
+      }
+      bat.Clear();
+      batched = 0;
+    }
+  }
+  if (!it->status().ok()) {
+    out << "failed to iterate column family " << from->GetName() << ": "
+	<< it->status().ToString() << std::endl;
+    return -EIO;
+  }
+  if (batched) {
+    rocksdb::Status s = db->Write(wopts, &bat);
+    if (!s.ok()) {
+      out << "failed to move keys: " << s.ToString() << std::endl;
+      return -EIO;
+    }
+  }
+  out << "moved " << moved << " keys out of column family "
+      << from->GetName() << std::endl;
+  return 0;
+}
+
+int RocksDBStore::reshard(const string& new_sharding, ostream &out)
+{
+  ceph_assert(db == nullptr);
+  vector<ColumnFamily> target;
+  int r = parse_sharding(new_sharding, &target, &out);
+  if (r < 0) {
+    out << std::endl;
+    return r;
+  }
+
+  // record what we are resharding to first, so an interrupted run is
+  // noticed by open() and can only be finished with the same target
+  bool resuming = false;
+  vector<ColumnFamily> pending;
+  r = read_sharding(resharding_file(), &pending, &resuming);
+  if (r < 0) {
+    return r;
+  }
+  if (resuming) {
+    if (print_sharding(pending) != print_sharding(target)) {
+      out << "an interrupted reshard to '" << print_sharding(pending)
+	  << "' must be finished first" << std::endl;
+      return -EBUSY;
+    }
+    out << "resuming reshard to '" << print_sharding(target) << "'"
+	<< std::endl;
+  } else {
+    r = write_sharding(resharding_file(), target);
+    if (r < 0) {
+      return r;
+    }
+  }
+  bool have_current = false;
+  vector<ColumnFamily> current;
+  r = read_sharding(sharding_file(), &current, &have_current);
+  if (r < 0) {
+    return r;
+  }
+
+  rocksdb::Options opt;
+  r = load_rocksdb_options(false, opt);
+  if (r) {
+    out << "load rocksdb options failed" << std::endl;
+    return r;
+  }
+  std::vector<string> existing_cfs;
+  rocksdb::Status status = rocksdb::DB::ListColumnFamilies(
+    rocksdb::DBOptions(opt), path, &existing_cfs);
+  if (!status.ok()) {
+    out << "failed to list column families: " << status.ToString()
+	<< std::endl;
+    return -EIO;
+  }
+
+  // the prefix a column family holds; names never change meaning between
+  // shardings (NAME or NAME-SHARD), so either definition will do
+  auto prefix_of = [&](const string& n) {
+    for (auto defs : { &target, &current }) {
+      for (auto& c : *defs) {
+	for (uint32_t i = 0; i < c.shards; ++i) {
+	  if (shard_cf_name(c, i) == n) {
+	    return c.name;
+	  }
+	}
+      }
+    }
+    return n;
+  };
+
+  std::vector<rocksdb::ColumnFamilyDescriptor> column_families;
+  for (auto& n : existing_cfs) {
+    rocksdb::ColumnFamilyOptions cf_opt(opt);
+    if (n != rocksdb::kDefaultColumnFamilyName) {
+      install_cf_mergeop(prefix_of(n), &cf_opt);
+    }
+    column_families.push_back(rocksdb::ColumnFamilyDescriptor(n, cf_opt));
+  }
+  std::vector<rocksdb::ColumnFamilyHandle*> handles;
+  status = rocksdb::DB::Open(rocksdb::DBOptions(opt), path, column_families,
+			     &handles, &db);
+  if (!status.ok()) {
+    out << "failed to open db: " << status.ToString() << std::endl;
+    return -EIO;
+  }
+  std::map<string, rocksdb::ColumnFamilyHandle*> by_name;
+  for (unsigned i = 0; i < existing_cfs.size(); ++i) {
+    by_name[existing_cfs[i]] = handles[i];
+    if (existing_cfs[i] == rocksdb::kDefaultColumnFamilyName) {
+      default_cf = handles[i];
+    }
+  }
+
+  std::map<string, prefix_shards> target_shards;
+  for (auto& c : target) {
+    rocksdb::ColumnFamilyOptions cf_opt(opt);
+    status = rocksdb::GetColumnFamilyOptionsFromString(
+      cf_opt, c.option, &cf_opt);
+    if (!status.ok()) {
+      out << "invalid options for column family '" << c.name << "': "
+	  << c.option << std::endl;
+      r = -EINVAL;
+      goto out_close;
+    }
+    install_cf_mergeop(c.name, &cf_opt);
+    auto& shards = target_shards[c.name];
+    shards.hash_l = c.hash_l;
+    shards.hash_h = c.hash_h;
+    for (uint32_t i = 0; i < c.shards; ++i) {
+      string name = shard_cf_name(c, i);
+      auto p = by_name.find(name);
+      if (p == by_name.end()) {
+	rocksdb::ColumnFamilyHandle *cf;
+	status = db->CreateColumnFamily(cf_opt, name, &cf);
+	if (!status.ok()) {
+	  out << "failed to create column family " << name << ": "
+	      << status.ToString() << std::endl;
+	  r = -EIO;
+	  goto out_close;
+	}
+	out << "created column family " << name << std::endl;
+	p = by_name.emplace(name, cf).first;
+      }
+      shards.handles.push_back(p->second);
+    }
+  }
+
+  // every batch moves keys atomically, so rerunning after a crash just
+  // finds fewer keys out of place
+  for (unsigned i = 0; i < existing_cfs.size(); ++i) {
+    r = reshard_move_keys(handles[i], prefix_of(existing_cfs[i]),
+			  target_shards, out);
+    if (r < 0) {
+      goto out_close;
+    }
+  }
+
+  // whatever is not part of the new sharding is empty by now
+  for (auto& p : by_name) {
+    bool keep = p.first == rocksdb::kDefaultColumnFamilyName;
+    for (auto& t : target_shards) {
+      for (auto cf : t.second.handles) {
+	keep |= cf == p.second;
+      }
+    }
+    if (keep) {
+      continue;
+    }
+    status = db->DropColumnFamily(p.second);
+    if (!status.ok()) {
+      out << "failed to drop column family " << p.first << ": "
+	  << status.ToString() << std::endl;
+      r = -EIO;
+      goto out_close;
+    }
+    out << "dropped column family " << p.first << std::endl;
+  }
+
+ out_close:
+  for (auto& p : by_name) {
+    db->DestroyColumnFamilyHandle(p.second);
+  }
+  default_cf = nullptr;
+  delete db;
+  db = nullptr;
+  if (r < 0) {
+    return r;
+  }
+
+  r = write_sharding(sharding_file(), target);
+  if (r < 0) {
+    return r;
+  }
+  status = get_env()->DeleteFile(resharding_file());
+  if (!status.ok()) {
+    out << "failed to remove " << resharding_file() << ": "
+	<< status.ToString() << std::endl;
+    return -EIO;
+  }
+  out << "reshard to '" << print_sharding(target) << "' complete"
+      << std::endl;
+  return 0;
+}
+
 void RocksDBStore::split_stats(const std::string &s, char delim, std::vector<std::string> &elems) {
     std::stringstream ss;
     ss.str(s);
@@ -693,16 +1107,20 @@ void RocksDBStore::split_stats(const std::string &s, char delim, std::vector<std
 
 int64_t RocksDBStore::estimate_prefix_size(const string& prefix)
 {
-  auto cf = get_cf_handle(prefix);
+  auto cfs = get_cf_handles(prefix);
   uint64_t size = 0;
   uint8_t flags =
     //rocksdb::DB::INCLUDE_MEMTABLES |  // do not include memtables...
     rocksdb::DB::INCLUDE_FILES;
-  if (cf) {
+  if (!cfs.empty()) {
     string start(1, '\x00');
     string limit("\xff\xff\xff\xff");
     rocksdb::Range r(start, limit);
-    db->GetApproximateSizes(cf, &r, 1, &size, flags);
+    for (auto cf : cfs) {
+      uint64_t cf_size = 0;
+      db->GetApproximateSizes(cf, &r, 1, &cf_size, flags);
+      size += cf_size;
+    }
   } else {
     string limit = prefix + "\xff\xff\xff\xff";
     rocksdb::Range r(prefix, limit);
@@ -879,7 +1297,7 @@ void RocksDBStore::RocksDBTransactionImpl::set(
   const string &k,
   const bufferlist &to_set_bl)
 {
-  auto cf = db->get_cf_handle(prefix);
+  auto cf = db->get_cf_handle(prefix, k);
   if (cf) {
     put_bat(bat, cf, k, to_set_bl);
   } else {
@@ -893,7 +1311,7 @@ void RocksDBStore::RocksDBTransactionImpl::set(
   const char *k, size_t keylen,
   const bufferlist &to_set_bl)
 {
-  auto cf = db->get_cf_handle(prefix);
+  auto cf = db->get_cf_handle(prefix, k, keylen);
   if (cf) {
     string key(k, keylen);  // fixme?
     put_bat(bat, cf, key, to_set_bl);
@@ -907,7 +1325,7 @@ void RocksDBStore::RocksDBTransactionImpl::set(
 void RocksDBStore::RocksDBTransactionImpl::rmkey(const string &prefix,
 					         const string &k)
 {
-  auto cf = db->get_cf_handle(prefix);
+  auto cf = db->get_cf_handle(prefix, k);
   if (cf) {
     bat.Delete(cf, rocksdb::Slice(k));
   } else {
@@ -919,7 +1337,7 @@ void RocksDBStore::RocksDBTransactionImpl::rmkey(const string &prefix,
 					         const char *k,
 						 size_t keylen)
 {
-  auto cf = db->get_cf_handle(prefix);
+  auto cf = db->get_cf_handle(prefix, k, keylen);
   if (cf) {
     bat.Delete(cf, rocksdb::Slice(k, keylen));
   } else {
@@ -932,7 +1350,7 @@ void RocksDBStore::RocksDBTransactionImpl::rmkey(const string &prefix,
 void RocksDBStore::RocksDBTransactionImpl::rm_single_key(const string &prefix,
 					                 const string &k)
 {
-  auto cf = db->get_cf_handle(prefix);
+  auto cf = db->get_cf_handle(prefix, k);
   if (cf) {
     bat.SingleDelete(cf, k);
   } else {
@@ -942,8 +1360,8 @@ void RocksDBStore::RocksDBTransactionImpl::rm_single_key(const string &prefix,
 
 void RocksDBStore::RocksDBTransactionImpl::rmkeys_by_prefix(const string &prefix)
 {
-  auto cf = db->get_cf_handle(prefix);
-  if (cf) {
+  auto cfs = db->get_cf_handles(prefix);
+  if (!cfs.empty()) {
     if (db->enable_rmrange) {
       string endprefix("\xff\xff\xff\xff");  // FIXME: this is cheating...
       if (db->max_items_rmrange) {
@@ -955,22 +1373,28 @@ void RocksDBStore::RocksDBTransactionImpl::rmkeys_by_prefix(const string &prefix
         it->next()) {
           if (!cnt) {
             bat.RollbackToSavePoint();
-            bat.DeleteRange(cf, string(), endprefix);
+            for (auto cf : cfs) {
+              bat.DeleteRange(cf, string(), endprefix);
+            }
             return;
           }
-          bat.Delete(cf, rocksdb::Slice(it->key()));
+          string k = it->key();
+          bat.Delete(db->get_cf_handle(prefix, k), rocksdb::Slice(k));
           --cnt;
         }
         bat.PopSavePoint();
       } else {
-        bat.DeleteRange(cf, string(), endprefix);
+        for (auto cf : cfs) {
+          bat.DeleteRange(cf, string(), endprefix);
+        }
       }
     } else {
       auto it = db->get_iterator(prefix);
       for (it->seek_to_first();
 	   it->valid();
 	   it->next()) {
-	bat.Delete(cf, rocksdb::Slice(it->key()));
+	string k = it->key();
+	bat.Delete(db->get_cf_handle(prefix, k), rocksdb::Slice(k));
       }
     }
   } else {
@@ -1015,8 +1439,8 @@ void RocksDBStore::RocksDBTransactionImpl::rm_range_keys(const string &prefix,
                                                          const string &start,
                                                          const string &end)
 {
-  auto cf = db->get_cf_handle(prefix);
-  if (cf) {
+  auto cfs = db->get_cf_handles(prefix);
+  if (!cfs.empty()) {
     if (db->enable_rmrange) {
       if (db->max_items_rmrange) {
         uint64_t cnt = db->max_items_rmrange;
@@ -1024,30 +1448,36 @@ void RocksDBStore::RocksDBTransactionImpl::rm_range_keys(const string &prefix,
         bat.SetSavePoint();
         it->lower_bound(start);
         while (it->valid()) {
-          if (it->key() >= end) {
+          string k = it->key();
+          if (k >= end) {
             break;
           }
           if (!cnt) {
             bat.RollbackToSavePoint();
-            bat.DeleteRange(cf, rocksdb::Slice(start), rocksdb::Slice(end));
+            for (auto cf : cfs) {
+              bat.DeleteRange(cf, rocksdb::Slice(start), rocksdb::Slice(end));
+            }
             return;
           }
-          bat.Delete(cf, rocksdb::Slice(it->key()));
+          bat.Delete(db->get_cf_handle(prefix, k), rocksdb::Slice(k));
           it->next();
           --cnt;
         }
         bat.PopSavePoint();
       } else {
-        bat.DeleteRange(cf, rocksdb::Slice(start), rocksdb::Slice(end));
+        for (auto cf : cfs) {
+          bat.DeleteRange(cf, rocksdb::Slice(start), rocksdb::Slice(end));
+        }
       }
     } else {
       auto it = db->get_iterator(prefix);
       it->lower_bound(start);
       while (it->valid()) {
-	if (it->key() >= end) {
+	string k = it->key();
+	if (k >= end) {
 	  break;
 	}
-	bat.Delete(cf, rocksdb::Slice(it->key()));
+	bat.Delete(db->get_cf_handle(prefix, k), rocksdb::Slice(k));
 	it->next();
       }
     }
@@ -1102,7 +1532,7 @@ void RocksDBStore::RocksDBTransactionImpl::merge(
   const string &k,
   const bufferlist &to_set_bl)
 {
-  auto cf = db->get_cf_handle(prefix);
+  auto cf = db->get_cf_handle(prefix, k);
   if (cf) {
     // bufferlist::c_str() is non-constant, so we can't call c_str()
     if (to_set_bl.is_contiguous() && to_set_bl.length() > 0) {
@@ -1143,35 +1573,44 @@ int RocksDBStore::get(
     std::map<string, bufferlist> *out)
 {
   utime_t start = ceph_clock_now();
-  auto cf = get_cf_handle(prefix);
-  if (cf) {
+  if (keys.empty()) {
+    return 0;
+  }
+  // one MultiGet shares a snapshot and the memtable/sst lookups across
+  // all keys instead of paying for them once per key
+  std::vector<rocksdb::ColumnFamilyHandle*> cfs;
+  std::vector<string> combined;
+  std::vector<rocksdb::Slice> slices;
+  cfs.reserve(keys.size());
+  slices.reserve(keys.size());
+  if (get_cf_handle(prefix) || cf_shards.count(prefix)) {
     for (auto& key : keys) {
-      std::string value;
-      auto status = db->Get(rocksdb::ReadOptions(),
-			    cf,
-			    rocksdb::Slice(key),
-			    &value);
-      if (status.ok()) {
-	(*out)[key].append(value);
-      } else if (status.IsIOError()) {
-	ceph_abort_msg(status.getState());
-      }
+      cfs.push_back(get_cf_handle(prefix, key));
+      slices.emplace_back(key);
     }
   } else {
+    combined.reserve(keys.size());
     for (auto& key : keys) {
-      std::string value;
-      string k = combine_strings(prefix, key);
-      auto status = db->Get(rocksdb::ReadOptions(),
-			    default_cf,
-			    rocksdb::Slice(k),
-			    &value);
-      if (status.ok()) {
-	(*out)[key].append(value);
-      } else if (status.IsIOError()) {
-	ceph_abort_msg(status.getState());
-      }
+      cfs.push_back(default_cf);
+      combined.push_back(combine_strings(prefix, key));
+      slices.emplace_back(combined.back());
     }
   }
+  std::vector<string> values;
+  std::vector<rocksdb::Status> status = db->MultiGet(rocksdb::ReadOptions(),
+						     cfs, slices, &values);
+  auto hint = out->end();
+  size_t i = 0;
+  for (auto& key : keys) {
+    if (status[i].ok()) {
+      hint = out->emplace_hint(hint, key, bufferlist());
+      hint->second.append(values[i]);
+      ++hint;
+    } else if (status[i].IsIOError()) {
+      ceph_abort_msg(status[i].getState());
+    }
+    ++i;
+  }
   utime_t lat = ceph_clock_now() - start;
   logger->inc(l_rocksdb_gets);
   logger->tinc(l_rocksdb_get_latency, lat);
@@ -1188,7 +1627,7 @@ int RocksDBStore::get(
   int r = 0;
   string value;
   rocksdb::Status s;
-  auto cf = get_cf_handle(prefix);
+  auto cf = get_cf_handle(prefix, key);
   if (cf) {
     s = db->Get(rocksdb::ReadOptions(),
 		cf,
@@ -1225,7 +1664,7 @@ int RocksDBStore::get(
   int r = 0;
   string value;
   rocksdb::Status s;
-  auto cf = get_cf_handle(prefix);
+  auto cf = get_cf_handle(prefix, key, keylen);
   if (cf) {
     s = db->Get(rocksdb::ReadOptions(),
 		cf,
@@ -1283,6 +1722,11 @@ void RocksDBStore::compact()
       static_cast<rocksdb::ColumnFamilyHandle*>(cf.second),
       nullptr, nullptr);
   }
+  for (auto& p : cf_shards) {
+    for (auto cf : p.second.handles) {
+      db->CompactRange(options, cf, nullptr, nullptr);
+    }
+  }
 }
 
 
@@ -1367,6 +1811,80 @@ void RocksDBStore::compact_range(const string& start, const string& end)
   rocksdb::Slice cstart(start);
   rocksdb::Slice cend(end);
   db->CompactRange(options, &cstart, &cend);
+
+  // [start, end) is in combined prefix+key space, but prefixes with their
+  // own column families store bare keys there: compact the part of the
+  // range that falls into each of them
+  auto compact_cfs = [&](const string& prefix,
+			 const std::vector<rocksdb::ColumnFamilyHandle*>& cfs) {
+    string lo = combine_strings(prefix, string());
+    string hi = past_prefix(prefix);
+    if (end <= lo || start >= hi) {
+      return;
+    }
+    // anything strictly between lo and hi starts with lo
+    rocksdb::Slice kstart, kend;
+    rocksdb::Slice *pstart = nullptr, *pend = nullptr;
+    if (start > lo) {
+      kstart = rocksdb::Slice(start.data() + lo.size(),
+			      start.size() - lo.size());
+      pstart = &kstart;
+    }
+    if (end < hi) {
+      kend = rocksdb::Slice(end.data() + lo.size(), end.size() - lo.size());
+      pend = &kend;
+    }
+    for (auto cf : cfs) {
+      db->CompactRange(options, cf, pstart, pend);
+    }
+  };
+  for (auto& p : cf_handles) {
+    compact_cfs(p.first,
+		{static_cast<rocksdb::ColumnFamilyHandle*>(p.second)});
+  }
+  for (auto& p : cf_shards) {
+    compact_cfs(p.first, p.second.handles);
+  }
+}
+
+struct RocksDBStore::BoundedReadOptions {
+  string lower, upper;
+  rocksdb::Slice lower_slice, upper_slice;
+  rocksdb::ReadOptions opts;
+};
+
+std::unique_ptr<RocksDBStore::BoundedReadOptions>
+RocksDBStore::make_read_options(const string *prefix,
+				const IteratorHints &hints)
+{
+  // keys in the default column family carry their prefix, so bound
+  // those iterators to the prefix even without explicit bounds
+  auto ro = std::make_unique<BoundedReadOptions>();
+  if (prefix) {
+    ro->lower = combine_strings(*prefix, hints.lower_bound.value_or(""));
+    ro->upper = hints.upper_bound ?
+      combine_strings(*prefix, *hints.upper_bound) : past_prefix(*prefix);
+  } else {
+    ro->lower = hints.lower_bound.value_or("");
+    ro->upper = hints.upper_bound.value_or("");
+  }
+  if (prefix || hints.lower_bound) {
+    ro->lower_slice = rocksdb::Slice(ro->lower);
+    ro->opts.iterate_lower_bound = &ro->lower_slice;
+  }
+  if (prefix || hints.upper_bound) {
+    ro->upper_slice = rocksdb::Slice(ro->upper);
+    ro->opts.iterate_upper_bound = &ro->upper_slice;
+  }
+  ro->opts.readahead_size = hints.readahead;
+  return ro;
+}
+
+RocksDBStore::RocksDBWholeSpaceIteratorImpl::RocksDBWholeSpaceIteratorImpl(
+  rocksdb::Iterator *iter,
+  std::unique_ptr<BoundedReadOptions> ro)
+  : dbiter(iter), ropts(std::move(ro))
+{
 }
 
 RocksDBStore::RocksDBWholeSpaceIteratorImpl::~RocksDBWholeSpaceIteratorImpl()
@@ -1508,10 +2026,13 @@ class CFIteratorImpl : public KeyValueDB::IteratorImpl {
 protected:
   string prefix;
   rocksdb::Iterator *dbiter;
+  std::unique_ptr<RocksDBStore::BoundedReadOptions> ropts;
 public:
-  explicit CFIteratorImpl(const std::string& p,
-				 rocksdb::Iterator *iter)
-    : prefix(p), dbiter(iter) { }
+  explicit CFIteratorImpl(
+    const std::string& p,
+    rocksdb::Iterator *iter,
+    std::unique_ptr<RocksDBStore::BoundedReadOptions> ro = nullptr)
+    : prefix(p), dbiter(iter), ropts(std::move(ro)) { }
   ~CFIteratorImpl() {
     delete dbiter;
   }
@@ -1569,8 +2090,153 @@ public:
   }
 };
 
+//
+// Walks the shards of a sharded prefix in key order.  Every key lives in
+// exactly one shard, so the merged stream is just the union of the shard
+// streams; a linear scan over the shard heads is cheap for the handful of
+// shards a prefix is spread over.
+//
+class ShardMergeIteratorImpl : public KeyValueDB::IteratorImpl {
+protected:
+  string prefix;
+  std::vector<rocksdb::Iterator*> iters;
+  std::unique_ptr<RocksDBStore::BoundedReadOptions> ropts;
+  int current = -1;     ///< shard positioned at the merged key, or -1
+  bool forward = true;  ///< direction the other shards are positioned for
+
+  void pick() {
+    current = -1;
+    for (int i = 0; i < (int)iters.size(); ++i) {
+      if (!iters[i]->Valid()) {
+	continue;
+      }
+      if (current < 0) {
+	current = i;
+	continue;
+      }
+      int c = iters[i]->key().compare(iters[current]->key());
+      if (forward ? c < 0 : c > 0) {
+	current = i;
+      }
+    }
+  }
+public:
+  ShardMergeIteratorImpl(
+    const std::string& p,
+    std::vector<rocksdb::Iterator*>&& i,
+    std::unique_ptr<RocksDBStore::BoundedReadOptions> ro = nullptr)
+    : prefix(p), iters(std::move(i)), ropts(std::move(ro)) { }
+  ~ShardMergeIteratorImpl() {
+    for (auto it : iters) {
+      delete it;
+    }
+  }
+
+  int seek_to_first() override {
+    forward = true;
+    for (auto it : iters) {
+      it->SeekToFirst();
+    }
+    pick();
+    return status();
+  }
+  int seek_to_last() override {
+    forward = false;
+    for (auto it : iters) {
+      it->SeekToLast();
+    }
+    pick();
+    return status();
+  }
+  int upper_bound(const string &after) override {
+    lower_bound(after);
+    if (valid() && (key() == after)) {
+      next();
+    }
+    return status();
+  }
+  int lower_bound(const string &to) override {
+    forward = true;
+    rocksdb::Slice slice_bound(to);
+    for (auto it : iters) {
+      it->Seek(slice_bound);
+    }
+    pick();
+    return status();
+  }
+  int next() override {
+    if (valid()) {
+      if (!forward) {
+	// the other shards sit before the current key; move them past it
+	string k = key();
+	for (int i = 0; i < (int)iters.size(); ++i) {
+	  if (i != current) {
+	    iters[i]->Seek(k);
+	  }
+	}
+	forward = true;
+      }
+      iters[current]->Next();
+      pick();
+    }
+    return status();
+  }
+  int prev() override {
+    if (valid()) {
+      if (forward) {
+	string k = key();
+	for (int i = 0; i < (int)iters.size(); ++i) {
+	  if (i != current) {
+	    iters[i]->SeekForPrev(k);
+	  }
+	}
+	forward = false;
+      }
+      iters[current]->Prev();
+      pick();
+    }
+    return status();
+  }
+  bool valid() override {
+    return current >= 0;
+  }
+  string key() override {
+    return iters[current]->key().ToString();
+  }
+  std::pair<std::string, std::string> raw_key() override {
+    return make_pair(prefix, key());
+  }
+  bufferlist value() override {
+    return to_bufferlist(iters[current]->value());
+  }
+  bufferptr value_as_ptr() override {
+    rocksdb::Slice val = iters[current]->value();
+    return bufferptr(val.data(), val.size());
+  }
+  int status() override {
+    for (auto it : iters) {
+      if (!it->status().ok()) {
+	return -1;
+      }
+    }
+    return 0;
+  }
+};
+
 KeyValueDB::Iterator RocksDBStore::get_iterator(const std::string& prefix)
 {
+  if (!cf_shards.empty()) {
+    auto p = cf_shards.find(prefix);
+    if (p != cf_shards.end()) {
+      std::vector<rocksdb::Iterator*> iters;
+      // one consistent view across all shards
+      rocksdb::Status s = db->NewIterators(rocksdb::ReadOptions(),
+					   p->second.handles, &iters);
+      ceph_assert(s.ok());
+      return std::make_shared<ShardMergeIteratorImpl>(
+	prefix, std::move(iters));
+    }
+  }
   rocksdb::ColumnFamilyHandle *cf_handle =
     static_cast<rocksdb::ColumnFamilyHandle*>(get_cf_handle(prefix));
   if (cf_handle) {
@@ -1581,3 +2247,31 @@ KeyValueDB::Iterator RocksDBStore::get_iterator(const std::string& prefix)
     return KeyValueDB::get_iterator(prefix);
   }
 }
+
+KeyValueDB::Iterator RocksDBStore::get_iterator(const std::string& prefix,
+						const IteratorHints &hints)
+{
+  if (!cf_shards.empty()) {
+    auto p = cf_shards.find(prefix);
+    if (p != cf_shards.end()) {
+      auto ro = make_read_options(nullptr, hints);
+      std::vector<rocksdb::Iterator*> iters;
+      rocksdb::Status s = db->NewIterators(ro->opts, p->second.handles,
+					   &iters);
+      ceph_assert(s.ok());
+      return std::make_shared<ShardMergeIteratorImpl>(
+	prefix, std::move(iters), std::move(ro));
+    }
+  }
+  rocksdb::ColumnFamilyHandle *cf_handle = get_cf_handle(prefix);
+  if (cf_handle) {
+    auto ro = make_read_options(nullptr, hints);
+    rocksdb::Iterator *it = db->NewIterator(ro->opts, cf_handle);
+    return std::make_shared<CFIteratorImpl>(prefix, it, std::move(ro));
+  }
+  auto ro = make_read_options(&prefix, hints);
+  rocksdb::Iterator *it = db->NewIterator(ro->opts, default_cf);
+  return std::make_shared<PrefixIteratorImpl>(
+    prefix,
+    std::make_shared<RocksDBWholeSpaceIteratorImpl>(it, std::move(ro)));
+}
@@ -87,6 +87,15 @@ class RocksDBStore : public KeyValueDB {
   bool must_close_default_cf = false;
   rocksdb::ColumnFamilyHandle *default_cf = nullptr;
 
+  /// a prefix hashed over several column families
+  struct prefix_shards {
+    uint32_t hash_l = 0;          ///< first key byte fed to the hash
+    uint32_t hash_h = UINT32_MAX; ///< one past the last key byte hashed
+    std::vector<rocksdb::ColumnFamilyHandle*> handles;
+  };
+  /// sharded prefixes; unsharded ones live in cf_handles
+  std::unordered_map<std::string, prefix_shards> cf_shards;
+
   int submit_common(rocksdb::WriteOptions& woptions, KeyValueDB::Transaction t);
   int install_cf_mergeop(const string &cf_name, rocksdb::ColumnFamilyOptions *cf_opt);
   int create_db_dir();
@@ -94,6 +103,25 @@ class RocksDBStore : public KeyValueDB {
 	      const vector<ColumnFamily>* cfs = nullptr);
   int load_rocksdb_options(bool create_if_missing, rocksdb::Options& opt);
 
+  // persistent prefix -> column family mapping
+  rocksdb::Env *get_env();
+  string sharding_file() const {
+    return path + "/sharding";
+  }
+  string resharding_file() const {
+    return path + "/sharding.new";
+  }
+  int read_sharding(const string& fn, vector<ColumnFamily> *cfs,
+		    bool *exists);
+  int write_sharding(const string& fn, const vector<ColumnFamily>& cfs);
+  static string shard_cf_name(const ColumnFamily& cf, uint32_t shard);
+  static uint32_t shard_of(uint32_t hash_l, uint32_t hash_h,
+			   uint32_t shards, const char *key, size_t keylen);
+  int reshard_move_keys(rocksdb::ColumnFamilyHandle *from,
+			const string& from_prefix,
+			const std::map<string, prefix_shards>& target,
+			ostream &out);
+
   // manage async compactions
   Mutex compact_queue_lock;
   Cond compact_queue_cond;
@@ -188,7 +216,40 @@ public:
     else
       return static_cast<rocksdb::ColumnFamilyHandle*>(iter->second);
   }
+  /// column family holding prefix/key, or nullptr for the default CF
+  rocksdb::ColumnFamilyHandle *get_cf_handle(const std::string& prefix,
+					     const char *key, size_t keylen) {
+    if (!cf_shards.empty()) {
+      auto p = cf_shards.find(prefix);
+      if (p != cf_shards.end()) {
+	return p->second.handles[shard_of(p->second.hash_l, p->second.hash_h,
+					  p->second.handles.size(),
+					  key, keylen)];
+      }
+    }
+    return get_cf_handle(prefix);
+  }
+  rocksdb::ColumnFamilyHandle *get_cf_handle(const std::string& prefix,
+					     const std::string& key) {
+    return get_cf_handle(prefix, key.data(), key.size());
+  }
+  /// all column families holding prefix; empty for the default CF
+  std::vector<rocksdb::ColumnFamilyHandle*> get_cf_handles(
+    const std::string& prefix) {
+    if (!cf_shards.empty()) {
+      auto p = cf_shards.find(prefix);
+      if (p != cf_shards.end()) {
+	return p->second.handles;
+      }
+    }
+    auto cf = get_cf_handle(prefix);
+    if (cf) {
+      return {cf};
+    }
+    return {};
+  }
   int repair(std::ostream &out) override;
+  int reshard(const std::string& new_sharding, std::ostream &out) override;
   void split_stats(const std::string &s, char delim, std::vector<std::string> &elems);
   void get_statistics(Formatter *f) override;
 
@@ -358,13 +419,20 @@ public:
     bufferlist *out) override;
 
 
+  /// ReadOptions whose iterate bounds live as long as the iterator
+  struct BoundedReadOptions;
+  std::unique_ptr<BoundedReadOptions> make_read_options(
+    const std::string *prefix, const IteratorHints &hints);
+
   class RocksDBWholeSpaceIteratorImpl :
     public KeyValueDB::WholeSpaceIteratorImpl {
   protected:
     rocksdb::Iterator *dbiter;
+    std::unique_ptr<BoundedReadOptions> ropts;
   public:
-    explicit RocksDBWholeSpaceIteratorImpl(rocksdb::Iterator *iter) :
-      dbiter(iter) { }
+    explicit RocksDBWholeSpaceIteratorImpl(
+      rocksdb::Iterator *iter,
+      std::unique_ptr<BoundedReadOptions> ro = nullptr);
     //virtual ~RocksDBWholeSpaceIteratorImpl() { }
     ~RocksDBWholeSpaceIteratorImpl() override;
 
@@ -388,6 +456,8 @@ public:
   };
 
   Iterator get_iterator(const std::string& prefix) override;
+  Iterator get_iterator(const std::string& prefix,
+			const IteratorHints &hints) override;
 
   /// Utility
   static string combine_strings(const string &prefix, const string &value) {
@@ -0,0 +1,106 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_MOSDPGLEASE_H
+#define CEPH_MOSDPGLEASE_H
+
+#include "MOSDFastDispatchOp.h"
+
+/**
+ * A replica asks the primary for a read lease (REQUEST) and the
+ * primary hands one out (GRANT).  The replica measures the lease from
+ * the time it sent the matching request, so it never outlives what the
+ * primary believes it granted.
+ */
+class MOSDPGLease : public MOSDFastDispatchOp {
+private:
+  static constexpr int HEAD_VERSION = 1;
+  static constexpr int COMPAT_VERSION = 1;
+public:
+  spg_t pgid;
+  epoch_t map_epoch = 0;
+  enum {
+    REQUEST = 0,
+    GRANT = 1,
+  };
+  int32_t type = -1;
+  pg_shard_t from;
+  epoch_t interval_start = 0;  ///< same_interval_since the lease is bound to
+  uint64_t seq = 0;            ///< matches a GRANT to its REQUEST
+  utime_t duration;            ///< GRANT: how long the lease lasts
+
+  epoch_t get_map_epoch() const override {
+    return map_epoch;
+  }
+  spg_t get_spg() const override {
+    return pgid;
+  }
+
+  MOSDPGLease()
+    : MOSDFastDispatchOp{MSG_OSD_PG_LEASE, HEAD_VERSION, COMPAT_VERSION} {}
+  MOSDPGLease(spg_t pgid,
+	      epoch_t map_epoch,
+	      int type,
+	      pg_shard_t from,
+	      epoch_t interval_start,
+	      uint64_t seq,
+	      utime_t duration = utime_t())
+    : MOSDFastDispatchOp{MSG_OSD_PG_LEASE, HEAD_VERSION, COMPAT_VERSION},
+      pgid(pgid), map_epoch(map_epoch),
+      type(type), from(from),
+      interval_start(interval_start), seq(seq), duration(duration) {}
+
+  std::string_view get_type_name() const override {
+    return "MOSDPGLease";
+  }
+
+  void print(ostream& out) const override {
+    out << "MOSDPGLease(" << pgid << " ";
+    switch (type) {
+    case REQUEST:
+      out << "REQUEST ";
+      break;
+    case GRANT:
+      out << "GRANT " << duration << " ";
+      break;
+    }
+    out << "seq " << seq << " interval " << interval_start
+	<< " e" << map_epoch << ")";
+  }
+
+  void decode_payload() override {
+    auto p = payload.cbegin();
+    decode(pgid, p);
+    decode(map_epoch, p);
+    decode(type, p);
+    decode(from, p);
+    decode(interval_start, p);
+    decode(seq, p);
+    decode(duration, p);
+  }
+
+  void encode_payload(uint64_t features) override {
+    using ceph::encode;
+    encode(pgid, payload);
+    encode(map_epoch, payload);
+    encode(type, payload);
+    encode(from, payload);
+    encode(interval_start, payload);
+    encode(seq, payload);
+    encode(duration, payload);
+  }
+private:
+  template<class T, typename... Args>
+  friend boost::intrusive_ptr<T> ceph::make_message(Args&&... args);
+};
+
+#endif
@@ -499,6 +499,8 @@ void OSDMonitor::update_from_paxos(bool *need_bootstrap)
   // walk through incrementals
   MonitorDBStore::TransactionRef t;
   size_t tx_size = 0;
+  bool single_inc = (version == osdmap.epoch + 1);
+  mapping_inc.reset();
   while (version > osdmap.epoch) {
     bufferlist inc_bl;
     int err = get_version(osdmap.epoch+1, inc_bl);
@@ -552,6 +554,7 @@ void OSDMonitor::update_from_paxos(bool *need_bootstrap)
 
 	osdmap = OSDMap();
 	osdmap.decode(orig_full_bl);
+	single_inc = false;
 
 	dout(20) << __func__ << " canonical full osdmap:\n";
 	JSONFormatter jf(true);
@@ -589,6 +592,9 @@ void OSDMonitor::update_from_paxos(bool *need_bootstrap)
 	osd_epochs.erase(osd_state.first);
       }
     }
+    if (single_inc) {
+      mapping_inc = std::make_unique<OSDMap::Incremental>(std::move(inc));
+    }
   }
 
   if (t) {
@@ -641,10 +647,21 @@ void OSDMonitor::start_mapping()
   }
   if (!osdmap.get_pools().empty()) {
     auto fin = new C_UpdateCreatingPGs(this, osdmap.get_epoch());
-    mapping_job = mapping.start_update(osdmap, mapper,
-				       g_conf()->mon_osd_mapping_pgs_per_chunk);
-    dout(10) << __func__ << " started mapping job " << mapping_job.get()
-	     << " at " << fin->start << dendl;
+    if (mapping_inc &&
+	mapping.can_update(osdmap, *mapping_inc) &&
+	g_conf().get_val<bool>("mon_osd_mapping_incremental")) {
+      mapping_job = mapping.start_update(osdmap, *mapping_inc, mapper,
+					 g_conf()->mon_osd_mapping_pgs_per_chunk);
+      dout(10) << __func__ << " started incremental mapping job "
+	       << mapping_job.get() << " from e" << mapping.get_epoch()
+	       << " at " << fin->start << dendl;
+    } else {
+      mapping_job = mapping.start_update(osdmap, mapper,
+					 g_conf()->mon_osd_mapping_pgs_per_chunk);
+      dout(10) << __func__ << " started mapping job " << mapping_job.get()
+	       << " at " << fin->start << dendl;
+    }
+    mapping_inc.reset();
     mapping_job->set_finish_event(fin);
   } else {
     dout(10) << __func__ << " no pools, no mapping job" << dendl;
@@ -4765,7 +4782,7 @@ namespace {
     COMPRESSION_MAX_BLOB_SIZE, COMPRESSION_MIN_BLOB_SIZE,
     CSUM_TYPE, CSUM_MAX_BLOCK, CSUM_MIN_BLOCK, FINGERPRINT_ALGORITHM,
     PG_AUTOSCALE_MODE, PG_NUM_MIN, TARGET_SIZE_BYTES, TARGET_SIZE_RATIO,
-    PG_AUTOSCALE_BIAS };
+    PG_AUTOSCALE_BIAS, READ_LEASE_INTERVAL };
 
   std::set<osd_pool_get_choices>
     subtract_second_from_first(const std::set<osd_pool_get_choices>& first,
@@ -5466,6 +5483,7 @@ bool OSDMonitor::preprocess_command(MonOpRequestRef op)
       {"target_size_bytes", TARGET_SIZE_BYTES},
       {"target_size_ratio", TARGET_SIZE_RATIO},
       {"pg_autoscale_bias", PG_AUTOSCALE_BIAS},
+      {"read_lease_interval", READ_LEASE_INTERVAL},
     };
 
     typedef std::set<osd_pool_get_choices> choices_set_t;
@@ -5682,6 +5700,7 @@ bool OSDMonitor::preprocess_command(MonOpRequestRef op)
 	  case TARGET_SIZE_BYTES:
 	  case TARGET_SIZE_RATIO:
 	  case PG_AUTOSCALE_BIAS:
+	  case READ_LEASE_INTERVAL:
             pool_opts_t::key_t key = pool_opts_t::get_opt_desc(i->first).key;
             if (p->opts.is_set(key)) {
               if(*it == CSUM_TYPE) {
@@ -5839,6 +5858,7 @@ bool OSDMonitor::preprocess_command(MonOpRequestRef op)
 	  case TARGET_SIZE_BYTES:
 	  case TARGET_SIZE_RATIO:
 	  case PG_AUTOSCALE_BIAS:
+	  case READ_LEASE_INTERVAL:
 	    for (i = ALL_CHOICES.begin(); i != ALL_CHOICES.end(); ++i) {
 	      if (i->second == *it)
 		break;
@@ -7941,6 +7961,15 @@ int OSDMonitor::prepare_command_pool_set(const cmdmap_t& cmdmap,
 	ss << "pg_autoscale_bias must be between 0 and 1000";
 	return -EINVAL;
       }
+    } else if (var == "read_lease_interval") {
+      if (!p.is_replicated()) {
+	ss << "read leases are only supported on replicated pools";
+	return -EINVAL;
+      }
+      if (f < 0.0 || f > 60.0) {
+	ss << "read_lease_interval must be between 0 and 60 seconds";
+	return -EINVAL;
+      }
     }
 
     pool_opts_t::opt_desc_t desc = pool_opts_t::get_opt_desc(var);
@@ -360,6 +360,8 @@ private:
   ParallelPGMapper mapper;                        ///< for background pg work
   OSDMapMapping mapping;                          ///< pg <-> osd mappings
   unique_ptr<ParallelPGMapper::Job> mapping_job;  ///< background mapping job
+  /// the incremental last applied, if mapping can be brought forward by it
+  unique_ptr<OSDMap::Incremental> mapping_inc;
   void start_mapping();
 
   void update_logger();
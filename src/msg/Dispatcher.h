@@ -23,6 +23,7 @@
 
 class Messenger;
 class Connection;
+struct entity_addrvec_t;
 class CryptoKey;
 class CephContext;
 class KeyStore;
@@ -164,6 +165,21 @@ public:
    */
   virtual void ms_handle_fast_accept(Connection *con) {}
 
+  /**
+   * Suggest which messenger worker thread should serve a new outgoing
+   * Connection, e.g. to keep traffic for a peer on the CPUs that will
+   * process it.  Messengers without worker threads ignore this.  It is
+   * called with messenger locks held, so it must not block.
+   *
+   * @param peer_type The CEPH_ENTITY_TYPE_* of the peer.
+   * @param addrs The peer's addresses.
+   * @return A worker index, reduced modulo the number of workers, or -1
+   * for no preference.
+   */
+  virtual int ms_get_worker_hint(int peer_type, const entity_addrvec_t& addrs) {
+    return -1;
+  }
+
   /*
    * this indicates that the ordered+reliable delivery semantics have
    * been violated.  Messages may have been lost due to a fault
@@ -95,6 +95,7 @@
 #include "messages/MOSDPGRecoveryDelete.h"
 #include "messages/MOSDPGRecoveryDeleteReply.h"
 #include "messages/MOSDPGReadyToMerge.h"
+#include "messages/MOSDPGLease.h"
 
 #include "messages/MRemoveSnaps.h"
 
@@ -584,6 +585,9 @@ Message *decode_message(CephContext *cct, int crcflags,
   case MSG_OSD_PG_READY_TO_MERGE:
     m = make_message<MOSDPGReadyToMerge>();
     break;
+  case MSG_OSD_PG_LEASE:
+    m = make_message<MOSDPGLease>();
+    break;
   case MSG_OSD_EC_WRITE:
     m = make_message<MOSDECSubOpWrite>();
     break;
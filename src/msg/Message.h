@@ -130,6 +130,7 @@
 #define MSG_OSD_SCRUB2          121
 
 #define MSG_OSD_PG_READY_TO_MERGE 122
+#define MSG_OSD_PG_LEASE        123
 
 // *** MDS ***
 
@@ -753,6 +753,23 @@ public:
     }
   }
 
+  /**
+   * Ask the Dispatchers which worker should serve a new outgoing
+   * Connection; the first with a preference wins.
+   *
+   * @param peer_type The CEPH_ENTITY_TYPE_* of the peer.
+   * @param addrs The peer's addresses.
+   * @return A worker hint, or -1 for no preference.
+   */
+  int ms_deliver_get_worker_hint(int peer_type, const entity_addrvec_t& addrs) {
+    for (const auto& dispatcher : dispatchers) {
+      int hint = dispatcher->ms_get_worker_hint(peer_type, addrs);
+      if (hint >= 0)
+	return hint;
+    }
+    return -1;
+  }
+
   /**
    * Notify each Dispatcher of a Connection which may have lost
    * Messages. Call this function whenever you detect that a lossy Connection
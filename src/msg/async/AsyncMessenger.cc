@@ -591,7 +591,8 @@ AsyncConnectionRef AsyncMessenger::create_connect(
   }
 
   // create connection
-  Worker *w = stack->get_worker();
+  int hint = ms_deliver_get_worker_hint(type, addrs);
+  Worker *w = hint >= 0 ? stack->get_worker_by_hint(hint) : stack->get_worker();
   AsyncConnectionRef conn = new AsyncConnection(cct, this, &dispatch_queue, w,
 						target.is_msgr2(), false);
   conn->connect(addrs, type, target);
@@ -464,7 +464,9 @@ void EventCenter::dispatch_event_external(EventCallbackRef e)
     external_events.push_back(e);
     num = ++external_num_events;
   }
-  if (num == 1 && !in_thread())
+  // a busy polling owner finds it on its next pass.  (it clears polling
+  // before checking external_num_events and blocking.)
+  if (num == 1 && !in_thread() && !polling)
     wakeup();
 
   ldout(cct, 30) << __func__ << " " << e << " pending " << num << dendl;
@@ -158,6 +158,9 @@ class EventCenter {
   pthread_t owner = 0;
   std::mutex external_lock;
   std::atomic_ulong external_num_events;
+  // set while the owner is busy polling, so external events need not
+  // interrupt an event_wait
+  std::atomic<bool> polling = {false};
   deque<EventCallbackRef> external_events;
   vector<FileEvent> file_events;
   EventDriver *driver;
@@ -205,6 +208,9 @@ class EventCenter {
   void delete_time_event(uint64_t id);
   int process_events(unsigned timeout_microseconds, ceph::timespan *working_dur = nullptr);
   void wakeup();
+  void set_polling(bool p) {
+    polling = p;
+  }
 
   // Used by external thread
   void dispatch_event_external(EventCallbackRef e);
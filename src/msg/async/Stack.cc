@@ -19,6 +19,7 @@
 #include "include/compat.h"
 #include "common/Cond.h"
 #include "common/errno.h"
+#include "common/numa.h"
 #include "PosixStack.h"
 #ifdef HAVE_RDMA
 #include "rdma/RDMAStack.h"
@@ -42,15 +43,63 @@ std::function<void ()> NetworkStack::add_thread(unsigned i)
       sprintf(tp_name, "msgr-worker-%u", w->id);
       ceph_pthread_setname(pthread_self(), tp_name);
       const unsigned EventMaxWaitUs = 30000000;
+#if defined(__linux__)
+      if (!worker_cpus.empty()) {
+        int cpu = worker_cpus[w->id % worker_cpus.size()];
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(cpu, &cpu_set);
+        int r = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+        if (r != 0) {
+          lderr(cct) << __func__ << " failed to pin worker " << w->id
+                     << " to cpu " << cpu << ": " << cpp_strerror(r) << dendl;
+        } else {
+          ldout(cct, 1) << __func__ << " pinned worker " << w->id
+                        << " to cpu " << cpu << dendl;
+        }
+      }
+#endif
       w->center.set_owner();
       ldout(cct, 10) << __func__ << " starting" << dendl;
       w->initialize();
       w->init_done();
+
+      // With busy polling, spin on non-blocking passes for a while after
+      // the last event before blocking in event_wait again.  The window
+      // adapts: if we are woken soon after giving up, spinning longer
+      // would have caught that event, so double it; if we sleep longer
+      // than the window, halve it.
+      const std::chrono::microseconds max_poll_us(
+        cct->_conf.get_val<uint64_t>("ms_async_busy_poll_us"));
+      const std::chrono::microseconds min_poll_us(
+        std::max<uint64_t>(max_poll_us.count() / 16, 1));
+      std::chrono::microseconds poll_us = max_poll_us;
+      auto last_event = ceph::mono_clock::now();
       while (!w->done) {
         ldout(cct, 30) << __func__ << " calling event process" << dendl;
 
         ceph::timespan dur;
-        int r = w->center.process_events(EventMaxWaitUs, &dur);
+        int r;
+        if (max_poll_us.count() &&
+            ceph::mono_clock::now() - last_event < poll_us) {
+          w->center.set_polling(true);
+          r = w->center.process_events(0, &dur);
+          if (r > 0) {
+            last_event = ceph::mono_clock::now();
+          }
+        } else {
+          w->center.set_polling(false);
+          auto wait_start = ceph::mono_clock::now();
+          r = w->center.process_events(EventMaxWaitUs, &dur);
+          if (max_poll_us.count()) {
+            last_event = ceph::mono_clock::now();
+            if (last_event - wait_start - dur < max_poll_us) {
+              poll_us = std::min(poll_us * 2, max_poll_us);
+            } else {
+              poll_us = std::max(poll_us / 2, min_poll_us);
+            }
+          }
+        }
         if (r < 0) {
           ldout(cct, 20) << __func__ << " process events failed: "
                          << cpp_strerror(errno) << dendl;
@@ -58,6 +107,7 @@ std::function<void ()> NetworkStack::add_thread(unsigned i)
         }
         w->perf_logger->tinc(l_msgr_running_total_time, dur);
       }
+      w->center.set_polling(false);
       w->reset();
       w->destroy();
   };
@@ -120,6 +170,35 @@ NetworkStack::NetworkStack(CephContext *c, const string &t): type(t), started(fa
     w->center.init(InitEventNumber, i, type);
     workers.push_back(w);
   }
+
+  // cpus to pin workers to: an explicit list, else those of a numa node
+  size_t cpu_set_size = 0;
+  cpu_set_t cpu_set;
+  int r = -ENOENT;
+  auto cores = cct->_conf.get_val<std::string>("ms_async_affinity_cores");
+  auto numa_node = cct->_conf.get_val<int64_t>("ms_async_numa_node");
+  if (!cores.empty()) {
+    r = parse_cpu_set_list(cores.c_str(), &cpu_set_size, &cpu_set);
+    if (r < 0) {
+      lderr(cct) << __func__ << " unable to parse ms_async_affinity_cores '"
+                 << cores << "': " << cpp_strerror(r) << dendl;
+    }
+  } else if (numa_node >= 0) {
+    r = get_numa_node_cpu_set(numa_node, &cpu_set_size, &cpu_set);
+    if (r < 0) {
+      lderr(cct) << __func__ << " unable to get cpus of numa node "
+                 << numa_node << ": " << cpp_strerror(r) << dendl;
+    }
+  }
+  if (r >= 0) {
+    // cpu_set_size is where parsing stopped, not the highest cpu
+    cpu_set_size = CPU_SETSIZE;
+    for (auto cpu : cpu_set_to_set(cpu_set_size, &cpu_set)) {
+      worker_cpus.push_back(cpu);
+    }
+    ldout(cct, 1) << __func__ << " pinning workers to cpus "
+                  << cpu_set_to_str_list(cpu_set_size, &cpu_set) << dendl;
+  }
 }
 
 void NetworkStack::start()
@@ -308,6 +308,7 @@ class NetworkStack {
   unsigned num_workers = 0;
   ceph::spinlock pool_spin;
   bool started = false;
+  std::vector<int> worker_cpus;  ///< cpu each worker is pinned to, round robin
 
   std::function<void ()> add_thread(unsigned i);
 
@@ -346,6 +347,12 @@ class NetworkStack {
   Worker *get_worker(unsigned i) {
     return workers[i];
   }
+  /// pick a worker per a Dispatcher::ms_get_worker_hint() hint
+  Worker *get_worker_by_hint(unsigned hint) {
+    Worker *w = workers[hint % num_workers];
+    ++w->references;
+    return w;
+  }
   void drain();
   unsigned get_num_worker() const {
     return num_workers;
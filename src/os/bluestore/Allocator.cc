@@ -1,13 +1,101 @@
 // -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
 // vim: ts=8 sw=2 smarttab
 
+#include <cinttypes>
+#include <cmath>
+
 #include "Allocator.h"
 #include "StupidAllocator.h"
 #include "BitmapAllocator.h"
+#include "common/ceph_mutex.h"
 #include "common/debug.h"
+#include "common/errno.h"
 
 #define dout_subsys ceph_subsys_bluestore
 
+/*
+ * Trace format, one call per line, all numbers in decimal:
+ *
+ *  init <type> <size> <block_size>
+ *  add <offset>~<length>                            (init_add_free)
+ *  rm <offset>~<length>                             (init_rm_free)
+ *  alloc <want> <unit> <max> <hint> <r> [<offset>~<length> ...]
+ *  free <offset>~<length> [<offset>~<length> ...]
+ *
+ * Calls are serialized while tracing so that the order in the file is
+ * the order the wrapped allocator saw them in.
+ */
+class AllocatorTracer : public Allocator {
+  std::unique_ptr<Allocator> alloc;
+  ceph::mutex lock = ceph::make_mutex("AllocatorTracer::lock");
+  FILE *f;
+
+public:
+  AllocatorTracer(Allocator *a, FILE *f) : alloc(a), f(f) {}
+  ~AllocatorTracer() override {
+    fclose(f);
+  }
+
+  int64_t allocate(uint64_t want_size, uint64_t alloc_unit,
+		   uint64_t max_alloc_size, int64_t hint,
+		   PExtentVector *extents) override {
+    std::lock_guard l(lock);
+    size_t old_size = extents->size();
+    int64_t r = alloc->allocate(want_size, alloc_unit, max_alloc_size, hint,
+				extents);
+    fprintf(f, "alloc %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRId64
+	    " %" PRId64, want_size, alloc_unit, max_alloc_size, hint, r);
+    for (size_t i = old_size; i < extents->size(); ++i) {
+      auto& e = (*extents)[i];
+      fprintf(f, " %" PRIu64 "~%" PRIu32, e.offset, e.length);
+    }
+    fputc('\n', f);
+    return r;
+  }
+
+  void release(const interval_set<uint64_t>& release_set) override {
+    std::lock_guard l(lock);
+    alloc->release(release_set);
+    fputs("free", f);
+    for (auto p = release_set.begin(); p != release_set.end(); ++p) {
+      fprintf(f, " %" PRIu64 "~%" PRIu64, p.get_start(), p.get_len());
+    }
+    fputc('\n', f);
+  }
+
+  void dump() override {
+    alloc->dump();
+  }
+  void dump(std::function<void(uint64_t offset, uint64_t length)> notify)
+    override {
+    alloc->dump(notify);
+  }
+
+  void init_add_free(uint64_t offset, uint64_t length) override {
+    std::lock_guard l(lock);
+    alloc->init_add_free(offset, length);
+    fprintf(f, "add %" PRIu64 "~%" PRIu64 "\n", offset, length);
+  }
+  void init_rm_free(uint64_t offset, uint64_t length) override {
+    std::lock_guard l(lock);
+    alloc->init_rm_free(offset, length);
+    fprintf(f, "rm %" PRIu64 "~%" PRIu64 "\n", offset, length);
+  }
+
+  uint64_t get_free() override {
+    return alloc->get_free();
+  }
+  double get_fragmentation(uint64_t alloc_unit) override {
+    return alloc->get_fragmentation(alloc_unit);
+  }
+
+  void shutdown() override {
+    alloc->shutdown();
+    std::lock_guard l(lock);
+    fflush(f);
+  }
+};
+
 Allocator *Allocator::create(CephContext* cct, string type,
                              int64_t size, int64_t block_size)
 {
@@ -21,6 +109,22 @@ Allocator *Allocator::create(CephContext* cct, string type,
   return nullptr;
 }
 
+Allocator *Allocator::create_tracer(CephContext* cct, Allocator *alloc,
+				    const string& type, int64_t size,
+				    int64_t block_size, const string& path)
+{
+  FILE *f = fopen(path.c_str(), "w");
+  if (!f) {
+    lderr(cct) << "Allocator::" << __func__ << " unable to open " << path
+	       << ": " << cpp_strerror(errno) << dendl;
+    delete alloc;
+    return nullptr;
+  }
+  fprintf(f, "init %s %" PRId64 " %" PRId64 "\n", type.c_str(), size,
+	  block_size);
+  return new AllocatorTracer(alloc, f);
+}
+
 void Allocator::release(const PExtentVector& release_vec)
 {
   interval_set<uint64_t> release_set;
@@ -29,3 +133,26 @@ void Allocator::release(const PExtentVector& release_vec)
   }
   release(release_set);
 }
+
+double Allocator::get_fragmentation_score(uint64_t alloc_unit)
+{
+  ceph_assert(alloc_unit);
+  // an extent is worth how many times it can be halved before it gets
+  // down to alloc_unit, per byte; compare what the free extents are worth
+  // to what the same amount of free space would be as a single extent
+  auto worth = [alloc_unit](uint64_t length) {
+    return length > alloc_unit ?
+      length * std::log2((double)length / alloc_unit) : 0.0;
+  };
+  double sum = 0;
+  uint64_t total = 0;
+  dump([&](uint64_t offset, uint64_t length) {
+      sum += worth(length);
+      total += length;
+    });
+  double ideal = worth(total);
+  if (ideal <= 0) {
+    return 0.0;
+  }
+  return std::max(0.0, 1.0 - sum / ideal);
+}
@@ -12,6 +12,7 @@
 #ifndef CEPH_OS_BLUESTORE_ALLOCATOR_H
 #define CEPH_OS_BLUESTORE_ALLOCATOR_H
 
+#include <functional>
 #include <ostream>
 #include "include/ceph_assert.h"
 #include "os/bluestore/bluestore_types.h"
@@ -44,6 +45,9 @@ public:
   void release(const PExtentVector& release_set);
 
   virtual void dump() = 0;
+  /// enumerate free extents, in no particular order
+  virtual void dump(
+    std::function<void(uint64_t offset, uint64_t length)> notify) = 0;
 
   virtual void init_add_free(uint64_t offset, uint64_t length) = 0;
   virtual void init_rm_free(uint64_t offset, uint64_t length) = 0;
@@ -54,9 +58,27 @@ public:
     return 0.0;
   }
 
+  /*
+   * Score how scattered the free space is: 0.0 if it is a single extent,
+   * 1.0 if it is all in alloc_unit sized pieces.  Unlike
+   * get_fragmentation() this accounts for extent sizes, not just their
+   * number, and is comparable across allocator implementations.
+   */
+  double get_fragmentation_score(uint64_t alloc_unit);
+
   virtual void shutdown() = 0;
   static Allocator *create(CephContext* cct, string type, int64_t size,
 			   int64_t block_size);
+
+  /*
+   * Wrap an allocator so that every call made through the returned one is
+   * also appended to a trace file, for replay with ceph_test_alloc_replay.
+   * Takes ownership of @alloc.  Returns nullptr if the file can't be
+   * opened.
+   */
+  static Allocator *create_tracer(CephContext* cct, Allocator *alloc,
+				  const string& type, int64_t size,
+				  int64_t block_size, const string& path);
 };
 
 #endif
@@ -36,6 +36,11 @@ public:
   }
 
   void dump() override;
+  void dump(std::function<void(uint64_t offset, uint64_t length)> notify)
+    override
+  {
+    foreach(notify);
+  }
   double get_fragmentation(uint64_t) override
   {
     return _get_fragmentation();
@@ -165,10 +165,15 @@ void BlueFS::_shutdown_logger()
 
 void BlueFS::_update_logger_stats()
 {
-  // we must be holding the lock
-  logger->set(l_bluefs_num_files, file_map.size());
+  // we must be holding the log_lock
+  {
+    std::lock_guard l(lock);
+    logger->set(l_bluefs_num_files, file_map.size());
+  }
   logger->set(l_bluefs_log_bytes, log_writer->file->fnode.size);
 
+  std::lock_guard al(alloc_lock);
+
   if (alloc[BDEV_WAL]) {
     logger->set(l_bluefs_wal_total_bytes, block_all[BDEV_WAL].size());
     logger->set(l_bluefs_wal_used_bytes,
@@ -251,7 +256,7 @@ void BlueFS::_add_block_extent(unsigned id, uint64_t offset, uint64_t length)
 int BlueFS::reclaim_blocks(unsigned id, uint64_t want,
 			   PExtentVector *extents)
 {
-  std::unique_lock l(lock);
+  std::unique_lock l(log_lock);
   dout(1) << __func__ << " bdev " << id
           << " want 0x" << std::hex << want << std::dec << dendl;
   ceph_assert(id < alloc.size());
@@ -267,9 +272,12 @@ int BlueFS::reclaim_blocks(unsigned id, uint64_t want,
     return got;
   }
 
-  for (auto& p : *extents) {
-    block_all[id].erase(p.offset, p.length);
-    log_t.op_alloc_rm(id, p.offset, p.length);
+  {
+    std::lock_guard al(alloc_lock);
+    for (auto& p : *extents) {
+      block_all[id].erase(p.offset, p.length);
+      log_t.op_alloc_rm(id, p.offset, p.length);
+    }
   }
 
   flush_bdev();
@@ -291,7 +299,7 @@ void BlueFS::handle_discard(unsigned id, interval_set<uint64_t>& to_release)
 
 uint64_t BlueFS::get_used()
 {
-  std::lock_guard l(lock);
+  std::lock_guard l(alloc_lock);
   uint64_t used = 0;
   for (unsigned id = 0; id < MAX_BDEV; ++id) {
     if (alloc[id]) {
@@ -303,14 +311,14 @@ uint64_t BlueFS::get_used()
 
 uint64_t BlueFS::get_total(unsigned id)
 {
-  std::lock_guard l(lock);
+  std::lock_guard l(alloc_lock);
   ceph_assert(id < block_all.size());
   return block_all[id].size();
 }
 
 uint64_t BlueFS::get_free(unsigned id)
 {
-  std::lock_guard l(lock);
+  std::lock_guard l(alloc_lock);
   ceph_assert(id < alloc.size());
   return alloc[id]->get_free();
 }
@@ -341,7 +349,7 @@ void BlueFS::dump_block_extents(ostream& out)
 
 void BlueFS::get_usage(vector<pair<uint64_t,uint64_t>> *usage)
 {
-  std::lock_guard l(lock);
+  std::lock_guard l(alloc_lock);
   usage->resize(bdev.size());
   for (unsigned id = 0; id < bdev.size(); ++id) {
     if (!bdev[id]) {
@@ -364,7 +372,7 @@ void BlueFS::get_usage(vector<pair<uint64_t,uint64_t>> *usage)
 
 int BlueFS::get_block_extents(unsigned id, interval_set<uint64_t> *extents)
 {
-  std::lock_guard l(lock);
+  std::lock_guard l(alloc_lock);
   dout(10) << __func__ << " bdev " << id << dendl;
   if (id >= block_all.size())
     return -EINVAL;
@@ -374,7 +382,7 @@ int BlueFS::get_block_extents(unsigned id, interval_set<uint64_t> *extents)
 
 int BlueFS::mkfs(uuid_d osd_uuid)
 {
-  std::unique_lock l(lock);
+  std::unique_lock l(log_lock);
   dout(1) << __func__
 	  << " osd_uuid " << osd_uuid
 	  << dendl;
@@ -1341,6 +1349,7 @@ void BlueFS::_drop_link(FileRef file)
     file_map.erase(file->fnode.ino);
     file->deleted = true;
 
+    std::lock_guard dl(dirty_lock);
     if (file->dirty_seq) {
       ceph_assert(file->dirty_seq > log_seq_stable);
       ceph_assert(dirty_files.count(file->dirty_seq));
@@ -1560,9 +1569,13 @@ uint64_t BlueFS::_estimate_log_size()
   int avg_dir_size = 40;  // fixme
   int avg_file_size = 12;
   uint64_t size = 4096 * 2;
+  std::lock_guard l(lock);
   size += file_map.size() * (1 + sizeof(bluefs_fnode_t));
-  for (auto& p : block_all)
-    size += p.num_intervals() * (1 + 1 + sizeof(uint64_t) * 2);
+  {
+    std::lock_guard al(alloc_lock);
+    for (auto& p : block_all)
+      size += p.num_intervals() * (1 + 1 + sizeof(uint64_t) * 2);
+  }
   size += dir_map.size() + (1 + avg_dir_size);
   size += file_map.size() * (1 + avg_dir_size + avg_file_size);
   return round_up_to(size, super.block_size);
@@ -1570,7 +1583,7 @@ uint64_t BlueFS::_estimate_log_size()
 
 void BlueFS::compact_log()
 {
-  std::unique_lock l(lock);
+  std::unique_lock l(log_lock);
   if (cct->_conf->bluefs_compact_log_sync) {
      _compact_log_sync();
   } else {
@@ -1603,6 +1616,9 @@ void BlueFS::_compact_log_dump_metadata(bluefs_transaction_t *t,
   t->uuid = super.uuid;
   dout(20) << __func__ << " op_init" << dendl;
 
+  std::lock_guard l(lock);
+  std::lock_guard dl(dirty_lock);
+  std::lock_guard al(alloc_lock);
   t->op_init();
   for (unsigned bdev = 0; bdev < MAX_BDEV; ++bdev) {
     interval_set<uint64_t>& p = block_all[bdev];
@@ -1866,7 +1882,9 @@ void BlueFS::_compact_log_async(std::unique_lock<ceph::mutex>& l)
   ceph_assert(r == 0);
 
   // 4. wait
-  _flush_bdev_safely(new_log_writer);
+  l.unlock();
+  _flush_bdev(new_log_writer);
+  l.lock();
 
   // 5. update our log fnode
   // discard first old_log_jump_to extents
@@ -1914,9 +1932,9 @@ void BlueFS::_compact_log_async(std::unique_lock<ceph::mutex>& l)
   ++super.version;
   _write_super(BDEV_DB);
 
-  lock.unlock();
+  l.unlock();
   flush_bdev();
-  lock.lock();
+  l.lock();
 
   // 7. release old space
   dout(10) << __func__ << " release old log extents " << old_extents << dendl;
@@ -1926,10 +1944,13 @@ void BlueFS::_compact_log_async(std::unique_lock<ceph::mutex>& l)
 
   // delete the new log, remove from the dirty files list
   _close_writer(new_log_writer);
-  if (new_log->dirty_seq) {
-    ceph_assert(dirty_files.count(new_log->dirty_seq));
-    auto it = dirty_files[new_log->dirty_seq].iterator_to(*new_log);
-    dirty_files[new_log->dirty_seq].erase(it);
+  {
+    std::lock_guard dl(dirty_lock);
+    if (new_log->dirty_seq) {
+      ceph_assert(dirty_files.count(new_log->dirty_seq));
+      auto it = dirty_files[new_log->dirty_seq].iterator_to(*new_log);
+      dirty_files[new_log->dirty_seq].erase(it);
+    }
   }
   new_log_writer = nullptr;
   new_log = nullptr;
@@ -1951,7 +1972,7 @@ void BlueFS::_pad_bl(bufferlist& bl)
 
 void BlueFS::flush_log()
 {
-  std::unique_lock l(lock);
+  std::unique_lock l(log_lock);
   flush_bdev();
   _flush_and_sync_log(l);
 }
@@ -1972,6 +1993,7 @@ int BlueFS::_flush_and_sync_log(std::unique_lock<ceph::mutex>& l,
     ceph_assert(!jump_to);
     return 0;
   }
+  std::unique_lock dl(dirty_lock);
   if (log_t.empty() && dirty_files.empty()) {
     dout(10) << __func__ << " want_seq " << want_seq
 	     << " " << log_t << " not dirty, dirty_files empty, no-op" << dendl;
@@ -1986,7 +2008,9 @@ int BlueFS::_flush_and_sync_log(std::unique_lock<ceph::mutex>& l,
   ceph_assert(want_seq == 0 || want_seq <= seq);
   log_t.uuid = super.uuid;
 
-  // log dirty files
+  // log dirty files.  writers update their fnode under dirty_lock, so
+  // what we encode here is consistent; anything they change after we
+  // drop it is re-dirtied against seq + 1.
   auto lsi = dirty_files.find(seq);
   if (lsi != dirty_files.end()) {
     dout(20) << __func__ << " " << lsi->second.size() << " dirty_files" << dendl;
@@ -1995,6 +2019,7 @@ int BlueFS::_flush_and_sync_log(std::unique_lock<ceph::mutex>& l,
       log_t.op_file_update(f.fnode);
     }
   }
+  dl.unlock();
 
   dout(10) << __func__ << " " << log_t << dendl;
   ceph_assert(!log_t.empty());
@@ -2042,12 +2067,15 @@ int BlueFS::_flush_and_sync_log(std::unique_lock<ceph::mutex>& l,
     log_writer->file->fnode.size = jump_to;
   }
 
-  _flush_bdev_safely(log_writer);
+  l.unlock();
+  _flush_bdev(log_writer);
+  l.lock();
 
   log_flushing = false;
   log_cond.notify_all();
 
   // clean dirty files
+  dl.lock();
   if (seq > log_seq_stable) {
     log_seq_stable = seq;
     dout(20) << __func__ << " log_seq_stable " << log_seq_stable << dendl;
@@ -2077,6 +2105,7 @@ int BlueFS::_flush_and_sync_log(std::unique_lock<ceph::mutex>& l,
              << " already >= out seq " << seq
              << ", we lost a race against another log flush, done" << dendl;
   }
+  dl.unlock();
 
   for (unsigned i = 0; i < to_release.size(); ++i) {
     if (!to_release[i].empty()) {
@@ -2129,6 +2158,16 @@ int BlueFS::_flush_range(FileWriter *h, uint64_t offset, uint64_t length)
 
   uint64_t allocated = h->file->fnode.get_allocated();
 
+  // the log (ino 1) and its compacting replacement (ino 0) are only
+  // written with log_lock held.  other files need it only when they
+  // allocate, since that may log op_alloc_add via the slow device
+  // expander.
+  std::unique_lock ll(log_lock, std::defer_lock);
+  if (h->file->fnode.ino > 1 && allocated < offset + length) {
+    ll.lock();
+  }
+  std::unique_lock dl(dirty_lock);
+
   // do not bother to dirty the file if we are overwriting
   // previously allocated extents.
   bool must_dirty = false;
@@ -2193,6 +2232,10 @@ int BlueFS::_flush_range(FileWriter *h, uint64_t offset, uint64_t length)
     }
   }
   dout(20) << __func__ << " file now " << h->file->fnode << dendl;
+  dl.unlock();
+  if (ll.owns_lock()) {
+    ll.unlock();
+  }
 
   uint64_t x_off = 0;
   auto p = h->file->fnode.seek(offset, &x_off);
@@ -2393,52 +2436,57 @@ int BlueFS::_truncate(FileWriter *h, uint64_t offset)
     ceph_abort_msg("truncate up not supported");
   }
   ceph_assert(h->file->fnode.size >= offset);
+  std::lock_guard ll(log_lock);
+  std::lock_guard dl(dirty_lock);
   h->file->fnode.size = offset;
   log_t.op_file_update(h->file->fnode);
   return 0;
 }
 
-int BlueFS::_fsync(FileWriter *h, std::unique_lock<ceph::mutex>& l)
+int BlueFS::_fsync(FileWriter *h)
 {
   dout(10) << __func__ << " " << h << " " << h->file->fnode << dendl;
   int r = _flush(h, true);
   if (r < 0)
      return r;
-  uint64_t old_dirty_seq = h->file->dirty_seq;
+  uint64_t old_dirty_seq;
+  {
+    std::lock_guard dl(dirty_lock);
+    old_dirty_seq = h->file->dirty_seq;
+  }
 
-  _flush_bdev_safely(h);
+  // data io does not need any BlueFS-wide lock; h->lock keeps other
+  // users of this writer out.
+  _flush_bdev(h);
 
   if (old_dirty_seq) {
+    std::unique_lock l(log_lock);
     uint64_t s = log_seq;
     dout(20) << __func__ << " file metadata was dirty (" << old_dirty_seq
 	     << ") on " << h->file->fnode << ", flushing log" << dendl;
     _flush_and_sync_log(l, old_dirty_seq);
+    std::lock_guard dl(dirty_lock);
     ceph_assert(h->file->dirty_seq == 0 ||  // cleaned
 	   h->file->dirty_seq > s);    // or redirtied by someone else
   }
   return 0;
 }
 
-void BlueFS::_flush_bdev_safely(FileWriter *h)
+void BlueFS::_flush_bdev(FileWriter *h)
 {
+  // NOTE: this is safe to call without a lock, as long as the caller
+  // owns h (h->lock, or log_lock and log_flushing for the log writers).
   std::array<bool, MAX_BDEV> flush_devs = h->dirty_devs;
   h->dirty_devs.fill(false);
 #ifdef HAVE_LIBAIO
   if (!cct->_conf->bluefs_sync_write) {
     list<aio_t> completed_ios;
     _claim_completed_aios(h, &completed_ios);
-    lock.unlock();
     wait_for_aio(h);
     completed_ios.clear();
-    flush_bdev(flush_devs);
-    lock.lock();
-  } else
-#endif
-  {
-    lock.unlock();
-    flush_bdev(flush_devs);
-    lock.lock();
   }
+#endif
+  flush_bdev(flush_devs);
 }
 
 void BlueFS::flush_bdev(std::array<bool, MAX_BDEV>& dirty_bdevs)
@@ -2469,9 +2517,14 @@ int BlueFS::_expand_slow_device(uint64_t need, PExtentVector& extents)
     int id = _get_slow_device_id();
     ceph_assert(id <= (int)alloc.size() && alloc[id]);
     auto min_need = round_up_to(need, min_alloc_size);
+    uint64_t owned;
+    {
+      std::lock_guard al(alloc_lock);
+      owned = block_all[id].size();
+    }
     need = std::max(need,
       slow_dev_expander->get_recommended_expansion_delta(
-        alloc[id]->get_free(), block_all[id].size()));
+        alloc[id]->get_free(), owned));
 
     need = round_up_to(need, min_alloc_size);
     dout(10) << __func__ << " expanding slow device by 0x"
@@ -2558,8 +2611,11 @@ int BlueFS::_allocate(uint8_t id, uint64_t len,
     extents.clear();
     if (_expand_slow_device(left, extents) == 0) {
       id = _get_slow_device_id();
-      for (auto& e : extents) {
-	_add_block_extent(id, e.offset, e.length);
+      {
+	std::lock_guard al(alloc_lock);
+	for (auto& e : extents) {
+	  _add_block_extent(id, e.offset, e.length);
+	}
       }
       extents.clear();
       auto* last_alloc = alloc[id];
@@ -2582,6 +2638,7 @@ int BlueFS::_allocate(uint8_t id, uint64_t len,
       return -ENOSPC;
     }
   } else {
+    std::lock_guard al(alloc_lock);
     uint64_t total_allocated =
       block_all[id].size() - alloc[id]->get_free();
     if (max_bytes[id] < total_allocated) {
@@ -2619,7 +2676,7 @@ int BlueFS::_preallocate(FileRef f, uint64_t off, uint64_t len)
 
 void BlueFS::sync_metadata()
 {
-  std::unique_lock l(lock);
+  std::unique_lock l(log_lock);
   if (log_t.empty()) {
     dout(10) << __func__ << " - no pending log events" << dendl;
   } else {
@@ -2645,6 +2702,7 @@ int BlueFS::open_for_write(
   FileWriter **h,
   bool overwrite)
 {
+  std::lock_guard ll(log_lock);
   std::lock_guard l(lock);
   dout(10) << __func__ << " " << dirname << "/" << filename << dendl;
   map<string,DirRef>::iterator p = dir_map.find(dirname);
@@ -2660,6 +2718,7 @@ int BlueFS::open_for_write(
 
   FileRef file;
   bool create = false;
+  std::unique_lock dl(dirty_lock);
   map<string,FileRef>::iterator q = dir->file_map.find(filename);
   if (q == dir->file_map.end()) {
     if (overwrite) {
@@ -2712,6 +2771,7 @@ int BlueFS::open_for_write(
 	   << " to bdev " << (int)file->fnode.prefer_bdev << dendl;
 
   log_t.op_file_update(file->fnode);
+  dl.unlock();
   if (create)
     log_t.op_dir_link(dirname, filename, file->fnode.ino);
 
@@ -2793,6 +2853,7 @@ int BlueFS::rename(
   const string& old_dirname, const string& old_filename,
   const string& new_dirname, const string& new_filename)
 {
+  std::lock_guard ll(log_lock);
   std::lock_guard l(lock);
   dout(10) << __func__ << " " << old_dirname << "/" << old_filename
 	   << " -> " << new_dirname << "/" << new_filename << dendl;
@@ -2840,6 +2901,7 @@ int BlueFS::rename(
 
 int BlueFS::mkdir(const string& dirname)
 {
+  std::lock_guard ll(log_lock);
   std::lock_guard l(lock);
   dout(10) << __func__ << " " << dirname << dendl;
   map<string,DirRef>::iterator p = dir_map.find(dirname);
@@ -2854,6 +2916,7 @@ int BlueFS::mkdir(const string& dirname)
 
 int BlueFS::rmdir(const string& dirname)
 {
+  std::lock_guard ll(log_lock);
   std::lock_guard l(lock);
   dout(10) << __func__ << " " << dirname << dendl;
   map<string,DirRef>::iterator p = dir_map.find(dirname);
@@ -2899,6 +2962,7 @@ int BlueFS::stat(const string& dirname, const string& filename,
     return -ENOENT;
   }
   File *file = q->second.get();
+  std::lock_guard dl(dirty_lock);
   dout(10) << __func__ << " " << dirname << "/" << filename
 	   << " " << file->fnode << dendl;
   if (size)
@@ -2911,6 +2975,7 @@ int BlueFS::stat(const string& dirname, const string& filename,
 int BlueFS::lock_file(const string& dirname, const string& filename,
 		      FileLock **plock)
 {
+  std::lock_guard ll(log_lock);
   std::lock_guard l(lock);
   dout(10) << __func__ << " " << dirname << "/" << filename << dendl;
   map<string,DirRef>::iterator p = dir_map.find(dirname);
@@ -2987,6 +3052,7 @@ int BlueFS::readdir(const string& dirname, vector<string> *ls)
 
 int BlueFS::unlink(const string& dirname, const string& filename)
 {
+  std::lock_guard ll(log_lock);
   std::lock_guard l(lock);
   dout(10) << __func__ << " " << dirname << "/" << filename << dendl;
   map<string,DirRef>::iterator p = dir_map.find(dirname);
@@ -256,7 +256,28 @@ public:
   };
 
 private:
+  /*
+   * Locking
+   *
+   * lock       - namespace: dir_map, file_map, ino_last, and File::refs,
+   *              locked, deleted
+   * log_lock   - log_t, log_writer, log_seq_stable, log_flushing,
+   *              pending_release and the compaction state (new_log*);
+   *              dropped while we wait for log io
+   * dirty_lock - dirty_files, log_seq, File::dirty_seq, and the fnode of
+   *              any file that may be open for write
+   * alloc_lock - block_all and max_bytes (the Allocators lock themselves)
+   *
+   * FileWriter::lock serializes flush/fsync/truncate on one writer.
+   * Lock order is FileWriter::lock -> log_lock -> lock -> dirty_lock ->
+   * alloc_lock.  Reads take none of these: a file is never open for
+   * read and write at the same time (see _flush_range), so its extents
+   * do not change underneath a FileReader.
+   */
   ceph::mutex lock = ceph::make_mutex("BlueFS::lock");
+  ceph::mutex log_lock = ceph::make_mutex("BlueFS::log_lock");
+  ceph::mutex dirty_lock = ceph::make_mutex("BlueFS::dirty_lock");
+  ceph::mutex alloc_lock = ceph::make_mutex("BlueFS::alloc_lock");
 
   PerfCounters *logger = nullptr;
 
@@ -326,7 +347,7 @@ private:
 
   int _flush_range(FileWriter *h, uint64_t offset, uint64_t length);
   int _flush(FileWriter *h, bool force);
-  int _fsync(FileWriter *h, std::unique_lock<ceph::mutex>& l);
+  int _fsync(FileWriter *h);
 
 #ifdef HAVE_LIBAIO
   void _claim_completed_aios(FileWriter *h, list<aio_t> *ls);
@@ -358,7 +379,7 @@ private:
 
   //void _aio_finish(void *priv);
 
-  void _flush_bdev_safely(FileWriter *h);
+  void _flush_bdev(FileWriter *h);  // this is safe to call without a lock
   void flush_bdev();  // this is safe to call without a lock
   void flush_bdev(std::array<bool, MAX_BDEV>& dirty_bdevs);  // this is safe to call without a lock
 
@@ -447,7 +468,8 @@ public:
     bool random = false);
 
   void close_writer(FileWriter *h) {
-    std::lock_guard l(lock);
+    // no need to hold any BlueFS lock; we only touch h, and the caller
+    // guarantees nobody else is using it.
     _close_writer(h);
   }
 
@@ -484,8 +506,11 @@ public:
 
   /// gift more block space
   void add_block_extent(unsigned bdev, uint64_t offset, uint64_t len) {
-    std::unique_lock l(lock);
-    _add_block_extent(bdev, offset, len);
+    std::unique_lock l(log_lock);
+    {
+      std::lock_guard al(alloc_lock);
+      _add_block_extent(bdev, offset, len);
+    }
     int r = _flush_and_sync_log(l);
     ceph_assert(r == 0);
   }
@@ -498,16 +523,16 @@ public:
   void handle_discard(unsigned dev, interval_set<uint64_t>& to_release);
 
   void flush(FileWriter *h) {
-    std::lock_guard l(lock);
+    std::lock_guard hl(h->lock);
     _flush(h, false);
   }
   void flush_range(FileWriter *h, uint64_t offset, uint64_t length) {
-    std::lock_guard l(lock);
+    std::lock_guard hl(h->lock);
     _flush_range(h, offset, length);
   }
   int fsync(FileWriter *h) {
-    std::unique_lock l(lock);
-    return _fsync(h, l);
+    std::lock_guard hl(h->lock);
+    return _fsync(h);
   }
   int read(FileReader *h, FileReaderBuffer *buf, uint64_t offset, size_t len,
 	   bufferlist *outbl, char *out) {
@@ -524,15 +549,18 @@ public:
     return _read_random(h, offset, len, out);
   }
   void invalidate_cache(FileRef f, uint64_t offset, uint64_t len) {
-    std::lock_guard l(lock);
+    std::lock_guard dl(dirty_lock);
     _invalidate_cache(f, offset, len);
   }
   int preallocate(FileRef f, uint64_t offset, uint64_t len) {
-    std::lock_guard l(lock);
+    // NOTE: BlueRocksEnv only preallocates from the thread that owns
+    // the file's writer, so this does not race with _flush_range.
+    std::lock_guard ll(log_lock);
+    std::lock_guard dl(dirty_lock);
     return _preallocate(f, offset, len);
   }
   int truncate(FileWriter *h, uint64_t offset) {
-    std::lock_guard l(lock);
+    std::lock_guard hl(h->lock);
     return _truncate(h, offset);
   }
 
@@ -33,6 +33,7 @@
 #include "common/safe_io.h"
 #include "common/PriorityCache.h"
 #include "Allocator.h"
+#include "CachedDevice.h"
 #include "FreelistManager.h"
 #include "BlueFS.h"
 #include "BlueRocksEnv.h"
@@ -77,6 +78,7 @@ const string PREFIX_DEFERRED = "L";    // id -> deferred_transaction_t
 const string PREFIX_ALLOC = "B";       // u64 offset -> u64 length (freelist)
 const string PREFIX_ALLOC_BITMAP = "b";// (see BitmapFreelistManager)
 const string PREFIX_SHARED_BLOB = "X"; // u64 offset -> shared_blob_t
+const string PREFIX_BLOCK_CACHE = "W"; // u64 offset -> extent in block.cache
 
 const string BLUESTORE_GLOBAL_STATFS_KEY = "bluestore_statfs";
 
@@ -883,148 +885,303 @@ int64_t BlueStore::GarbageCollector::estimate(
   return expected_for_release - expected_allocations;
 }
 
-// Cache
+// OnodeCacheShard
 
-BlueStore::Cache *BlueStore::Cache::create(CephContext* cct, string type,
-					   PerfCounters *logger)
-{
-  Cache *c = nullptr;
-
-  if (type == "lru")
-    c = new LRUCache(cct);
-  else if (type == "2q")
-    c = new TwoQCache(cct);
-  else
-    ceph_abort_msg("unrecognized cache type");
+// LruOnodeCacheShard
+struct LruOnodeCacheShard : public BlueStore::OnodeCacheShard {
+  typedef boost::intrusive::list<
+    BlueStore::Onode,
+    boost::intrusive::member_hook<
+      BlueStore::Onode,
+      boost::intrusive::list_member_hook<>,
+      &BlueStore::Onode::lru_item> > list_t;
+  list_t lru;
 
-  c->logger = logger;
-  return c;
-}
+  explicit LruOnodeCacheShard(CephContext *cct) : BlueStore::OnodeCacheShard(cct) {}
 
-void BlueStore::Cache::trim(uint64_t onode_max, uint64_t buffer_max)
-{
-  std::lock_guard l(lock);
-  _trim(onode_max, buffer_max);
-}
-
-void BlueStore::Cache::trim_all()
-{
-  std::lock_guard l(lock);
-  _trim(0, 0);
-}
+  void _add(BlueStore::OnodeRef& o, int level) override
+  {
+    (level > 0) ? lru.push_front(*o) : lru.push_back(*o);
+  }
+  void _rm(BlueStore::OnodeRef& o) override
+  {
+    lru.erase(lru.iterator_to(*o));
+  }
+  void _touch(BlueStore::OnodeRef& o) override
+  {
+    lru.erase(lru.iterator_to(*o));
+    lru.push_front(*o);
+  }
+  uint64_t _get_num() override
+  {
+    return lru.size();
+  }
+  void _trim_to(uint64_t max) override;
+  void add_stats(uint64_t *onodes) override
+  {
+    std::lock_guard l(lock);
+    *onodes += lru.size();
+  }
+#ifdef DEBUG_CACHE
+  void _audit(const char *s) override
+  {
+    // lru is the only structure; nothing to cross-check
+  }
+#endif
+};
 
-// LRUCache
 #undef dout_prefix
-#define dout_prefix *_dout << "bluestore.LRUCache(" << this << ") "
+#define dout_prefix *_dout << "bluestore.LruOnodeCacheShard(" << this << ") "
 
-void BlueStore::LRUCache::_touch_onode(OnodeRef& o)
+void LruOnodeCacheShard::_trim_to(uint64_t new_size)
 {
-  auto p = onode_lru.iterator_to(*o);
-  onode_lru.erase(p);
-  onode_lru.push_front(*o);
-}
-
-void BlueStore::LRUCache::_trim(uint64_t onode_max, uint64_t buffer_max)
-{
-  dout(20) << __func__ << " onodes " << onode_lru.size() << " / " << onode_max
-	   << " buffers " << buffer_size << " / " << buffer_max
+  dout(20) << __func__ << " onodes " << lru.size() << " / " << new_size
 	   << dendl;
 
-  _audit("trim start");
-
-  // buffers
-  while (buffer_size > buffer_max) {
-    auto i = buffer_lru.rbegin();
-    if (i == buffer_lru.rend()) {
-      // stop if buffer_lru is now empty
-      break;
-    }
-
-    Buffer *b = &*i;
-    ceph_assert(b->is_clean());
-    dout(20) << __func__ << " rm " << *b << dendl;
-    b->space->_rm_buffer(this, b);
-  }
-
   // onodes
-  if (onode_max >= onode_lru.size()) {
+  if (new_size >= lru.size()) {
     return; // don't even try
   }
-  uint64_t num = onode_lru.size() - onode_max;
+  uint64_t n = lru.size() - new_size;
 
-  auto p = onode_lru.end();
-  ceph_assert(p != onode_lru.begin());
+  auto p = lru.end();
+  ceph_assert(p != lru.begin());
   --p;
   int skipped = 0;
   int max_skipped = g_conf()->bluestore_cache_trim_max_skip_pinned;
-  while (num > 0) {
-    Onode *o = &*p;
+  while (n > 0) {
+    BlueStore::Onode *o = &*p;
     int refs = o->nref.load();
     if (refs > 1) {
       dout(20) << __func__ << "  " << o->oid << " has " << refs
 	       << " refs, skipping" << dendl;
       if (++skipped >= max_skipped) {
         dout(20) << __func__ << " maximum skip pinned reached; stopping with "
-                 << num << " left to trim" << dendl;
+                 << n << " left to trim" << dendl;
         break;
       }
 
-      if (p == onode_lru.begin()) {
+      if (p == lru.begin()) {
         break;
       } else {
         p--;
-        num--;
+        n--;
         continue;
       }
     }
     dout(30) << __func__ << "  rm " << o->oid << dendl;
-    if (p != onode_lru.begin()) {
-      onode_lru.erase(p--);
+    if (p != lru.begin()) {
+      lru.erase(p--);
     } else {
-      onode_lru.erase(p);
-      ceph_assert(num == 1);
+      lru.erase(p);
+      ceph_assert(n == 1);
     }
+    // dropping the last ref may release SharedBlobs, which takes the
+    // *buffer* cache shard lock; never our (onode shard) lock.
     o->get();  // paranoia
     o->c->onode_map.remove(o->oid);
     o->put();
-    --num;
+    --n;
   }
 }
 
+BlueStore::OnodeCacheShard *BlueStore::OnodeCacheShard::create(
+  CephContext* cct,
+  string type,
+  PerfCounters *logger)
+{
+  BlueStore::OnodeCacheShard *c = nullptr;
+  // Currently we only implement an LRU cache for onodes
+  c = new LruOnodeCacheShard(cct);
+  c->logger = logger;
+  return c;
+}
+
+// LruBufferCacheShard
+struct LruBufferCacheShard : public BlueStore::BufferCacheShard {
+  typedef boost::intrusive::list<
+    BlueStore::Buffer,
+    boost::intrusive::member_hook<
+      BlueStore::Buffer,
+      boost::intrusive::list_member_hook<>,
+      &BlueStore::Buffer::lru_item> > list_t;
+  list_t lru;
+  uint64_t buffer_bytes = 0;
+
+  explicit LruBufferCacheShard(CephContext *cct) : BlueStore::BufferCacheShard(cct) {}
+
+  void _add(BlueStore::Buffer *b, int level, BlueStore::Buffer *near) override {
+    if (near) {
+      auto q = lru.iterator_to(*near);
+      lru.insert(q, *b);
+    } else if (level > 0) {
+      lru.push_front(*b);
+    } else {
+      lru.push_back(*b);
+    }
+    buffer_bytes += b->length;
+  }
+  void _rm(BlueStore::Buffer *b) override {
+    ceph_assert(buffer_bytes >= b->length);
+    buffer_bytes -= b->length;
+    auto q = lru.iterator_to(*b);
+    lru.erase(q);
+  }
+  void _move(BlueStore::BufferCacheShard *src, BlueStore::Buffer *b) override {
+    src->_rm(b);
+    _add(b, 0, nullptr);
+  }
+  void _adjust_size(BlueStore::Buffer *b, int64_t delta) override {
+    ceph_assert((int64_t)buffer_bytes + delta >= 0);
+    buffer_bytes += delta;
+  }
+  void _touch(BlueStore::Buffer *b) override {
+    auto p = lru.iterator_to(*b);
+    lru.erase(p);
+    lru.push_front(*b);
+    _audit("_touch_buffer end");
+  }
+  uint64_t _get_bytes() override {
+    return buffer_bytes;
+  }
+
+  void _trim_to(uint64_t max) override;
+
+  void add_stats(uint64_t *extents,
+                 uint64_t *blobs,
+                 uint64_t *buffers,
+                 uint64_t *bytes) override {
+    std::lock_guard l(lock);
+    *extents += num_extents;
+    *blobs += num_blobs;
+    *buffers += lru.size();
+    *bytes += buffer_bytes;
+  }
 #ifdef DEBUG_CACHE
-void BlueStore::LRUCache::_audit(const char *when)
+  void _audit(const char *s) override;
+#endif
+};
+
+#undef dout_prefix
+#define dout_prefix *_dout << "bluestore.LruBufferCacheShard(" << this << ") "
+
+void LruBufferCacheShard::_trim_to(uint64_t max)
+{
+  dout(20) << __func__ << " buffers " << buffer_bytes << " / " << max
+	   << dendl;
+
+  _audit("trim start");
+
+  while (buffer_bytes > max) {
+    auto i = lru.rbegin();
+    if (i == lru.rend()) {
+      // stop if lru is now empty
+      break;
+    }
+
+    BlueStore::Buffer *b = &*i;
+    ceph_assert(b->is_clean());
+    dout(20) << __func__ << " rm " << *b << dendl;
+    b->space->_rm_buffer(this, b);
+  }
+}
+
+#ifdef DEBUG_CACHE
+void LruBufferCacheShard::_audit(const char *when)
 {
   dout(10) << __func__ << " " << when << " start" << dendl;
   uint64_t s = 0;
-  for (auto i = buffer_lru.begin(); i != buffer_lru.end(); ++i) {
+  for (auto i = lru.begin(); i != lru.end(); ++i) {
     s += i->length;
   }
-  if (s != buffer_size) {
-    derr << __func__ << " buffer_size " << buffer_size << " actual " << s
+  if (s != buffer_bytes) {
+    derr << __func__ << " buffer_bytes " << buffer_bytes << " actual " << s
 	 << dendl;
-    for (auto i = buffer_lru.begin(); i != buffer_lru.end(); ++i) {
+    for (auto i = lru.begin(); i != lru.end(); ++i) {
       derr << __func__ << " " << *i << dendl;
     }
-    ceph_assert(s == buffer_size);
+    ceph_assert(s == buffer_bytes);
   }
-  dout(20) << __func__ << " " << when << " buffer_size " << buffer_size
+  dout(20) << __func__ << " " << when << " buffer_bytes " << buffer_bytes
 	   << " ok" << dendl;
 }
 #endif
 
-// TwoQCache
-#undef dout_prefix
-#define dout_prefix *_dout << "bluestore.2QCache(" << this << ") "
+// TwoQBufferCacheShard
+
+struct TwoQBufferCacheShard : public BlueStore::BufferCacheShard {
+  typedef boost::intrusive::list<
+    BlueStore::Buffer,
+    boost::intrusive::member_hook<
+      BlueStore::Buffer,
+      boost::intrusive::list_member_hook<>,
+      &BlueStore::Buffer::lru_item> > list_t;
+  list_t hot;      ///< "Am" hot buffers
+  list_t warm_in;  ///< "A1in" newly warm buffers
+  list_t warm_out; ///< "A1out" empty buffers we've evicted
+  uint64_t buffer_bytes = 0;     ///< bytes
+
+  enum {
+    BUFFER_NEW = 0,
+    BUFFER_WARM_IN,   ///< in warm_in
+    BUFFER_WARM_OUT,  ///< in warm_out
+    BUFFER_HOT,       ///< in hot
+    BUFFER_TYPE_MAX
+  };
 
+  uint64_t list_bytes[BUFFER_TYPE_MAX] = {0}; ///< bytes per type
 
-void BlueStore::TwoQCache::_touch_onode(OnodeRef& o)
-{
-  auto p = onode_lru.iterator_to(*o);
-  onode_lru.erase(p);
-  onode_lru.push_front(*o);
-}
+public:
+  explicit TwoQBufferCacheShard(CephContext *cct) : BufferCacheShard(cct) {}
+
+  void _add(BlueStore::Buffer *b, int level, BlueStore::Buffer *near) override;
+  void _rm(BlueStore::Buffer *b) override;
+  void _move(BlueStore::BufferCacheShard *src, BlueStore::Buffer *b) override;
+  void _adjust_size(BlueStore::Buffer *b, int64_t delta) override;
+  void _touch(BlueStore::Buffer *b) override {
+    switch (b->cache_private) {
+    case BUFFER_WARM_IN:
+      // do nothing (somewhat counter-intuitively!)
+      break;
+    case BUFFER_WARM_OUT:
+      // move from warm_out to hot LRU
+      ceph_abort_msg("this happens via discard hint");
+      break;
+    case BUFFER_HOT:
+      // move to front of hot LRU
+      hot.erase(hot.iterator_to(*b));
+      hot.push_front(*b);
+      break;
+    }
+    _audit("_touch_buffer end");
+  }
+  uint64_t _get_bytes() override {
+    return buffer_bytes;
+  }
+
+  void _trim_to(uint64_t max) override;
+
+  void add_stats(uint64_t *extents,
+                 uint64_t *blobs,
+                 uint64_t *buffers,
+                 uint64_t *bytes) override {
+    std::lock_guard l(lock);
+    *extents += num_extents;
+    *blobs += num_blobs;
+    *buffers += hot.size() + warm_in.size();
+    *bytes += buffer_bytes;
+  }
+
+#ifdef DEBUG_CACHE
+  void _audit(const char *s) override;
+#endif
+};
+
+#undef dout_prefix
+#define dout_prefix *_dout << "bluestore.2QBufferCacheShard(" << this << ") "
 
-void BlueStore::TwoQCache::_add_buffer(Buffer *b, int level, Buffer *near)
+void TwoQBufferCacheShard::_add(BlueStore::Buffer *b, int level,
+				BlueStore::Buffer *near)
 {
   dout(20) << __func__ << " level " << level << " near " << near
 	   << " on " << *b
@@ -1033,14 +1190,14 @@ void BlueStore::TwoQCache::_add_buffer(Buffer *b, int level, Buffer *near)
     b->cache_private = near->cache_private;
     switch (b->cache_private) {
     case BUFFER_WARM_IN:
-      buffer_warm_in.insert(buffer_warm_in.iterator_to(*near), *b);
+      warm_in.insert(warm_in.iterator_to(*near), *b);
       break;
     case BUFFER_WARM_OUT:
       ceph_assert(b->is_empty());
-      buffer_warm_out.insert(buffer_warm_out.iterator_to(*near), *b);
+      warm_out.insert(warm_out.iterator_to(*near), *b);
       break;
     case BUFFER_HOT:
-      buffer_hot.insert(buffer_hot.iterator_to(*near), *b);
+      hot.insert(hot.iterator_to(*near), *b);
       break;
     default:
       ceph_abort_msg("bad cache_private");
@@ -1048,10 +1205,10 @@ void BlueStore::TwoQCache::_add_buffer(Buffer *b, int level, Buffer *near)
   } else if (b->cache_private == BUFFER_NEW) {
     b->cache_private = BUFFER_WARM_IN;
     if (level > 0) {
-      buffer_warm_in.push_front(*b);
+      warm_in.push_front(*b);
     } else {
       // take caller hint to start at the back of the warm queue
-      buffer_warm_in.push_back(*b);
+      warm_in.push_back(*b);
     }
   } else {
     // we got a hint from discard
@@ -1060,14 +1217,14 @@ void BlueStore::TwoQCache::_add_buffer(Buffer *b, int level, Buffer *near)
       // stay in warm_in.  move to front, even though 2Q doesn't actually
       // do this.
       dout(20) << __func__ << " move to front of warm " << *b << dendl;
-      buffer_warm_in.push_front(*b);
+      warm_in.push_front(*b);
       break;
     case BUFFER_WARM_OUT:
       b->cache_private = BUFFER_HOT;
       // move to hot.  fall-thru
     case BUFFER_HOT:
       dout(20) << __func__ << " move to front of hot " << *b << dendl;
-      buffer_hot.push_front(*b);
+      hot.push_front(*b);
       break;
     default:
       ceph_abort_msg("bad cache_private");
@@ -1075,129 +1232,128 @@ void BlueStore::TwoQCache::_add_buffer(Buffer *b, int level, Buffer *near)
   }
   if (!b->is_empty()) {
     buffer_bytes += b->length;
-    buffer_list_bytes[b->cache_private] += b->length;
+    list_bytes[b->cache_private] += b->length;
   }
 }
 
-void BlueStore::TwoQCache::_rm_buffer(Buffer *b)
+void TwoQBufferCacheShard::_rm(BlueStore::Buffer *b)
 {
   dout(20) << __func__ << " " << *b << dendl;
  if (!b->is_empty()) {
     ceph_assert(buffer_bytes >= b->length);
     buffer_bytes -= b->length;
-    ceph_assert(buffer_list_bytes[b->cache_private] >= b->length);
-    buffer_list_bytes[b->cache_private] -= b->length;
+    ceph_assert(list_bytes[b->cache_private] >= b->length);
+    list_bytes[b->cache_private] -= b->length;
   }
   switch (b->cache_private) {
   case BUFFER_WARM_IN:
-    buffer_warm_in.erase(buffer_warm_in.iterator_to(*b));
+    warm_in.erase(warm_in.iterator_to(*b));
     break;
   case BUFFER_WARM_OUT:
-    buffer_warm_out.erase(buffer_warm_out.iterator_to(*b));
+    warm_out.erase(warm_out.iterator_to(*b));
     break;
   case BUFFER_HOT:
-    buffer_hot.erase(buffer_hot.iterator_to(*b));
+    hot.erase(hot.iterator_to(*b));
     break;
   default:
     ceph_abort_msg("bad cache_private");
   }
 }
 
-void BlueStore::TwoQCache::_move_buffer(Cache *srcc, Buffer *b)
+void TwoQBufferCacheShard::_move(BlueStore::BufferCacheShard *srcc,
+				 BlueStore::Buffer *b)
 {
-  TwoQCache *src = static_cast<TwoQCache*>(srcc);
-  src->_rm_buffer(b);
+  TwoQBufferCacheShard *src = static_cast<TwoQBufferCacheShard*>(srcc);
+  src->_rm(b);
 
   // preserve which list we're on (even if we can't preserve the order!)
   switch (b->cache_private) {
   case BUFFER_WARM_IN:
     ceph_assert(!b->is_empty());
-    buffer_warm_in.push_back(*b);
+    warm_in.push_back(*b);
     break;
   case BUFFER_WARM_OUT:
     ceph_assert(b->is_empty());
-    buffer_warm_out.push_back(*b);
+    warm_out.push_back(*b);
     break;
   case BUFFER_HOT:
     ceph_assert(!b->is_empty());
-    buffer_hot.push_back(*b);
+    hot.push_back(*b);
     break;
   default:
     ceph_abort_msg("bad cache_private");
   }
   if (!b->is_empty()) {
     buffer_bytes += b->length;
-    buffer_list_bytes[b->cache_private] += b->length;
+    list_bytes[b->cache_private] += b->length;
   }
 }
 
-void BlueStore::TwoQCache::_adjust_buffer_size(Buffer *b, int64_t delta)
+void TwoQBufferCacheShard::_adjust_size(BlueStore::Buffer *b, int64_t delta)
 {
   dout(20) << __func__ << " delta " << delta << " on " << *b << dendl;
   if (!b->is_empty()) {
     ceph_assert((int64_t)buffer_bytes + delta >= 0);
     buffer_bytes += delta;
-    ceph_assert((int64_t)buffer_list_bytes[b->cache_private] + delta >= 0);
-    buffer_list_bytes[b->cache_private] += delta;
+    ceph_assert((int64_t)list_bytes[b->cache_private] + delta >= 0);
+    list_bytes[b->cache_private] += delta;
   }
 }
 
-void BlueStore::TwoQCache::_trim(uint64_t onode_max, uint64_t buffer_max)
+void TwoQBufferCacheShard::_trim_to(uint64_t max)
 {
-  dout(20) << __func__ << " onodes " << onode_lru.size() << " / " << onode_max
-	   << " buffers " << buffer_bytes << " / " << buffer_max
+  dout(20) << __func__ << " buffers " << buffer_bytes << " / " << max
 	   << dendl;
 
   _audit("trim start");
 
-  // buffers
-  if (buffer_bytes > buffer_max) {
-    uint64_t kin = buffer_max * cct->_conf->bluestore_2q_cache_kin_ratio;
-    uint64_t khot = buffer_max - kin;
+  if (buffer_bytes > max) {
+    uint64_t kin = max * cct->_conf->bluestore_2q_cache_kin_ratio;
+    uint64_t khot = max - kin;
 
     // pre-calculate kout based on average buffer size too,
     // which is typical(the warm_in and hot lists may change later)
     uint64_t kout = 0;
-    uint64_t buffer_num = buffer_hot.size() + buffer_warm_in.size();
+    uint64_t buffer_num = hot.size() + warm_in.size();
     if (buffer_num) {
-      uint64_t buffer_avg_size = buffer_bytes / buffer_num;
-      ceph_assert(buffer_avg_size);
-      uint64_t calculated_buffer_num = buffer_max / buffer_avg_size;
-      kout = calculated_buffer_num * cct->_conf->bluestore_2q_cache_kout_ratio;
+      uint64_t avg_size = buffer_bytes / buffer_num;
+      ceph_assert(avg_size);
+      uint64_t calculated_num = max / avg_size;
+      kout = calculated_num * cct->_conf->bluestore_2q_cache_kout_ratio;
     }
 
-    if (buffer_list_bytes[BUFFER_HOT] < khot) {
+    if (list_bytes[BUFFER_HOT] < khot) {
       // hot is small, give slack to warm_in
-      kin += khot - buffer_list_bytes[BUFFER_HOT];
-    } else if (buffer_list_bytes[BUFFER_WARM_IN] < kin) {
+      kin += khot - list_bytes[BUFFER_HOT];
+    } else if (list_bytes[BUFFER_WARM_IN] < kin) {
       // warm_in is small, give slack to hot
-      khot += kin - buffer_list_bytes[BUFFER_WARM_IN];
+      khot += kin - list_bytes[BUFFER_WARM_IN];
     }
 
     // adjust warm_in list
-    int64_t to_evict_bytes = buffer_list_bytes[BUFFER_WARM_IN] - kin;
+    int64_t to_evict_bytes = list_bytes[BUFFER_WARM_IN] - kin;
     uint64_t evicted = 0;
 
     while (to_evict_bytes > 0) {
-      auto p = buffer_warm_in.rbegin();
-      if (p == buffer_warm_in.rend()) {
+      auto p = warm_in.rbegin();
+      if (p == warm_in.rend()) {
         // stop if warm_in list is now empty
         break;
       }
 
-      Buffer *b = &*p;
+      BlueStore::Buffer *b = &*p;
       ceph_assert(b->is_clean());
       dout(20) << __func__ << " buffer_warm_in -> out " << *b << dendl;
       ceph_assert(buffer_bytes >= b->length);
       buffer_bytes -= b->length;
-      ceph_assert(buffer_list_bytes[BUFFER_WARM_IN] >= b->length);
-      buffer_list_bytes[BUFFER_WARM_IN] -= b->length;
+      ceph_assert(list_bytes[BUFFER_WARM_IN] >= b->length);
+      list_bytes[BUFFER_WARM_IN] -= b->length;
       to_evict_bytes -= b->length;
       evicted += b->length;
-      b->state = Buffer::STATE_EMPTY;
+      b->state = BlueStore::Buffer::STATE_EMPTY;
       b->data.clear();
-      buffer_warm_in.erase(buffer_warm_in.iterator_to(*b));
-      buffer_warm_out.push_front(*b);
+      warm_in.erase(warm_in.iterator_to(*b));
+      warm_out.push_front(*b);
       b->cache_private = BUFFER_WARM_OUT;
     }
 
@@ -1208,17 +1364,17 @@ void BlueStore::TwoQCache::_trim(uint64_t onode_max, uint64_t buffer_max)
     }
 
     // adjust hot list
-    to_evict_bytes = buffer_list_bytes[BUFFER_HOT] - khot;
+    to_evict_bytes = list_bytes[BUFFER_HOT] - khot;
     evicted = 0;
 
     while (to_evict_bytes > 0) {
-      auto p = buffer_hot.rbegin();
-      if (p == buffer_hot.rend()) {
+      auto p = hot.rbegin();
+      if (p == hot.rend()) {
         // stop if hot list is now empty
         break;
       }
 
-      Buffer *b = &*p;
+      BlueStore::Buffer *b = &*p;
       dout(20) << __func__ << " buffer_hot rm " << *b << dendl;
       ceph_assert(b->is_clean());
       // adjust evict size before buffer goes invalid
@@ -1234,90 +1390,45 @@ void BlueStore::TwoQCache::_trim(uint64_t onode_max, uint64_t buffer_max)
     }
 
     // adjust warm out list too, if necessary
-    int64_t num = buffer_warm_out.size() - kout;
-    while (num-- > 0) {
-      Buffer *b = &*buffer_warm_out.rbegin();
+    int64_t n = warm_out.size() - kout;
+    while (n-- > 0) {
+      BlueStore::Buffer *b = &*warm_out.rbegin();
       ceph_assert(b->is_empty());
       dout(20) << __func__ << " buffer_warm_out rm " << *b << dendl;
       b->space->_rm_buffer(this, b);
     }
   }
-
-  // onodes
-  if (onode_max >= onode_lru.size()) {
-    return; // don't even try
-  }
-  uint64_t num = onode_lru.size() - onode_max;
-
-  auto p = onode_lru.end();
-  ceph_assert(p != onode_lru.begin());
-  --p;
-  int skipped = 0;
-  int max_skipped = g_conf()->bluestore_cache_trim_max_skip_pinned;
-  while (num > 0) {
-    Onode *o = &*p;
-    dout(20) << __func__ << " considering " << o << dendl;
-    int refs = o->nref.load();
-    if (refs > 1) {
-      dout(20) << __func__ << "  " << o->oid << " has " << refs
-	       << " refs; skipping" << dendl;
-      if (++skipped >= max_skipped) {
-        dout(20) << __func__ << " maximum skip pinned reached; stopping with "
-                 << num << " left to trim" << dendl;
-        break;
-      }
-
-      if (p == onode_lru.begin()) {
-        break;
-      } else {
-        p--;
-        num--;
-        continue;
-      }
-    }
-    dout(30) << __func__ << " " << o->oid << " num=" << num <<" lru size="<<onode_lru.size()<< dendl;
-    if (p != onode_lru.begin()) {
-      onode_lru.erase(p--);
-    } else {
-      onode_lru.erase(p);
-      ceph_assert(num == 1);
-    }
-    o->get();  // paranoia
-    o->c->onode_map.remove(o->oid);
-    o->put();
-    --num;
-  }
 }
 
 #ifdef DEBUG_CACHE
-void BlueStore::TwoQCache::_audit(const char *when)
+void TwoQBufferCacheShard::_audit(const char *when)
 {
   dout(10) << __func__ << " " << when << " start" << dendl;
   uint64_t s = 0;
-  for (auto i = buffer_hot.begin(); i != buffer_hot.end(); ++i) {
+  for (auto i = hot.begin(); i != hot.end(); ++i) {
     s += i->length;
   }
 
   uint64_t hot_bytes = s;
-  if (hot_bytes != buffer_list_bytes[BUFFER_HOT]) {
+  if (hot_bytes != list_bytes[BUFFER_HOT]) {
     derr << __func__ << " hot_list_bytes "
-         << buffer_list_bytes[BUFFER_HOT]
+         << list_bytes[BUFFER_HOT]
          << " != actual " << hot_bytes
          << dendl;
-    ceph_assert(hot_bytes == buffer_list_bytes[BUFFER_HOT]);
+    ceph_assert(hot_bytes == list_bytes[BUFFER_HOT]);
   }
 
-  for (auto i = buffer_warm_in.begin(); i != buffer_warm_in.end(); ++i) {
+  for (auto i = warm_in.begin(); i != warm_in.end(); ++i) {
     s += i->length;
   }
 
   uint64_t warm_in_bytes = s - hot_bytes;
-  if (warm_in_bytes != buffer_list_bytes[BUFFER_WARM_IN]) {
+  if (warm_in_bytes != list_bytes[BUFFER_WARM_IN]) {
     derr << __func__ << " warm_in_list_bytes "
-         << buffer_list_bytes[BUFFER_WARM_IN]
+         << list_bytes[BUFFER_WARM_IN]
          << " != actual " << warm_in_bytes
          << dendl;
-    ceph_assert(warm_in_bytes == buffer_list_bytes[BUFFER_WARM_IN]);
+    ceph_assert(warm_in_bytes == list_bytes[BUFFER_WARM_IN]);
   }
 
   if (s != buffer_bytes) {
@@ -1331,13 +1442,31 @@ void BlueStore::TwoQCache::_audit(const char *when)
 }
 #endif
 
+// BufferCacheShard
+
+BlueStore::BufferCacheShard *BlueStore::BufferCacheShard::create(
+  CephContext* cct,
+  string type,
+  PerfCounters *logger)
+{
+  BufferCacheShard *c = nullptr;
+  if (type == "lru")
+    c = new LruBufferCacheShard(cct);
+  else if (type == "2q")
+    c = new TwoQBufferCacheShard(cct);
+  else
+    ceph_abort_msg("unrecognized cache type");
+  c->logger = logger;
+  return c;
+}
+
 
 // BufferSpace
 
 #undef dout_prefix
 #define dout_prefix *_dout << "bluestore.BufferSpace(" << this << " in " << cache << ") "
 
-void BlueStore::BufferSpace::_clear(Cache* cache)
+void BlueStore::BufferSpace::_clear(BufferCacheShard* cache)
 {
   // note: we already hold cache->lock
   ldout(cache->cct, 20) << __func__ << dendl;
@@ -1346,7 +1475,7 @@ void BlueStore::BufferSpace::_clear(Cache* cache)
   }
 }
 
-int BlueStore::BufferSpace::_discard(Cache* cache, uint32_t offset, uint32_t length)
+int BlueStore::BufferSpace::_discard(BufferCacheShard* cache, uint32_t offset, uint32_t length)
 {
   // note: we already hold cache->lock
   ldout(cache->cct, 20) << __func__ << std::hex << " 0x" << offset << "~" << length
@@ -1379,7 +1508,7 @@ int BlueStore::BufferSpace::_discard(Cache* cache, uint32_t offset, uint32_t len
 		      0, b);
 	}
 	if (!b->is_writing()) {
-	  cache->_adjust_buffer_size(b, front - (int64_t)b->length);
+	  cache->_adjust_size(b, front - (int64_t)b->length);
 	}
 	b->truncate(front);
 	b->maybe_rebuild();
@@ -1388,7 +1517,7 @@ int BlueStore::BufferSpace::_discard(Cache* cache, uint32_t offset, uint32_t len
       } else {
 	// drop tail
 	if (!b->is_writing()) {
-	  cache->_adjust_buffer_size(b, front - (int64_t)b->length);
+	  cache->_adjust_size(b, front - (int64_t)b->length);
 	}
 	b->truncate(front);
 	b->maybe_rebuild();
@@ -1420,7 +1549,7 @@ int BlueStore::BufferSpace::_discard(Cache* cache, uint32_t offset, uint32_t len
 }
 
 void BlueStore::BufferSpace::read(
-  Cache* cache, 
+  BufferCacheShard* cache, 
   uint32_t offset,
   uint32_t length,
   BlueStore::ready_regions_t& res,
@@ -1454,7 +1583,7 @@ void BlueStore::BufferSpace::read(
 	  offset += l;
 	  length -= l;
 	  if (!b->is_writing()) {
-	    cache->_touch_buffer(b);
+	    cache->_touch(b);
 	  }
 	  continue;
         }
@@ -1467,7 +1596,7 @@ void BlueStore::BufferSpace::read(
 	  length -= gap;
         }
         if (!b->is_writing()) {
-	  cache->_touch_buffer(b);
+	  cache->_touch(b);
         }
         if (b->length > length) {
 	  res[offset].substr_of(b->data, 0, length);
@@ -1492,7 +1621,7 @@ void BlueStore::BufferSpace::read(
   cache->logger->inc(l_bluestore_buffer_miss_bytes, miss_bytes);
 }
 
-void BlueStore::BufferSpace::_finish_write(Cache* cache, uint64_t seq)
+void BlueStore::BufferSpace::_finish_write(BufferCacheShard* cache, uint64_t seq)
 {
   auto i = writing.begin();
   while (i != writing.end()) {
@@ -1516,7 +1645,7 @@ void BlueStore::BufferSpace::_finish_write(Cache* cache, uint64_t seq)
       writing.erase(i++);
       b->maybe_rebuild();
       b->data.reassign_to_mempool(mempool::mempool_bluestore_cache_data);
-      cache->_add_buffer(b, 1, nullptr);
+      cache->_add(b, 1, nullptr);
       ldout(cache->cct, 20) << __func__ << " added " << *b << dendl;
     }
   }
@@ -1524,7 +1653,7 @@ void BlueStore::BufferSpace::_finish_write(Cache* cache, uint64_t seq)
   cache->_audit("finish_write end");
 }
 
-void BlueStore::BufferSpace::split(Cache* cache, size_t pos, BlueStore::BufferSpace &r)
+void BlueStore::BufferSpace::split(BufferCacheShard* cache, size_t pos, BlueStore::BufferSpace &r)
 {
   std::lock_guard lk(cache->lock);
   if (buffer_map.empty())
@@ -1548,7 +1677,7 @@ void BlueStore::BufferSpace::split(Cache* cache, size_t pos, BlueStore::BufferSp
 	r._add_buffer(cache, new Buffer(&r, p->second->state, p->second->seq, 0, right),
 		      0, p->second.get());
       }
-      cache->_adjust_buffer_size(p->second.get(), -right);
+      cache->_adjust_size(p->second.get(), -right);
       p->second->truncate(left);
       break;
     }
@@ -1591,7 +1720,7 @@ BlueStore::OnodeRef BlueStore::OnodeSpace::add(const ghobject_t& oid, OnodeRef o
   }
   ldout(cache->cct, 30) << __func__ << " " << oid << " " << o << dendl;
   onode_map[oid] = o;
-  cache->_add_onode(o, 1);
+  cache->_add(o, 1);
   return o;
 }
 
@@ -1609,7 +1738,7 @@ BlueStore::OnodeRef BlueStore::OnodeSpace::lookup(const ghobject_t& oid)
     } else {
       ldout(cache->cct, 30) << __func__ << " " << oid << " hit " << p->second
 			    << dendl;
-      cache->_touch_onode(p->second);
+      cache->_touch(p->second);
       hit = true;
       o = p->second;
     }
@@ -1628,7 +1757,7 @@ void BlueStore::OnodeSpace::clear()
   std::lock_guard l(cache->lock);
   ldout(cache->cct, 10) << __func__ << dendl;
   for (auto &p : onode_map) {
-    cache->_rm_onode(p.second);
+    cache->_rm(p.second);
   }
   onode_map.clear();
 }
@@ -1657,7 +1786,7 @@ void BlueStore::OnodeSpace::rename(
   if (pn != onode_map.end()) {
     ldout(cache->cct, 30) << __func__ << "  removing target " << pn->second
 			  << dendl;
-    cache->_rm_onode(pn->second);
+    cache->_rm(pn->second);
     onode_map.erase(pn);
   }
   OnodeRef o = po->second;
@@ -1665,11 +1794,11 @@ void BlueStore::OnodeSpace::rename(
   // install a non-existent onode at old location
   oldo.reset(new Onode(o->c, old_oid, o->key));
   po->second = oldo;
-  cache->_add_onode(po->second, 1);
+  cache->_add(po->second, 1);
 
   // add at new position and fix oid, key
   onode_map.insert(make_pair(new_oid, o));
-  cache->_touch_onode(o);
+  cache->_touch(o);
   o->oid = new_oid;
   o->key = new_okey;
 }
@@ -1779,7 +1908,7 @@ void BlueStore::SharedBlob::put_ref(uint64_t offset, uint32_t length,
 void BlueStore::SharedBlob::finish_write(uint64_t seq)
 {
   while (true) {
-    Cache *cache = coll->cache;
+    BufferCacheShard *cache = coll->cache;
     std::lock_guard l(cache->lock);
     if (coll->cache != cache) {
       ldout(coll->store->cct, 20) << __func__
@@ -2548,9 +2677,9 @@ void BlueStore::ExtentMap::reshard(
     bool was_too_many_blobs_check = false;
     auto too_many_blobs_threshold =
       g_conf()->bluestore_debug_too_many_blobs_threshold;
-    auto& dumped_onodes = onode->c->cache->dumped_onodes;
-    decltype(onode->c->cache->dumped_onodes)::value_type* oid_slot = nullptr;
-    decltype(onode->c->cache->dumped_onodes)::value_type* oldest_slot = nullptr;
+    auto& dumped_onodes = onode->c->get_onode_cache()->dumped_onodes;
+    decltype(onode->c->get_onode_cache()->dumped_onodes)::value_type* oid_slot = nullptr;
+    decltype(onode->c->get_onode_cache()->dumped_onodes)::value_type* oldest_slot = nullptr;
 
     for (auto e = extent_map.lower_bound(dummy); e != extent_map.end(); ++e) {
       if (e->logical_offset >= needs_reshard_end) {
@@ -3241,14 +3370,38 @@ void BlueStore::Onode::flush()
 {
   if (flushing_count.load()) {
     ldout(c->store->cct, 20) << __func__ << " cnt:" << flushing_count << dendl;
-    std::unique_lock l(flush_lock);
+    auto& stripe = c->store->_get_onode_flush_stripe(this);
+    std::unique_lock l(stripe.lock);
     while (flushing_count.load()) {
-      flush_cond.wait(l);
+      stripe.cond.wait(l);
     }
   }
   ldout(c->store->cct, 20) << __func__ << " done" << dendl;
 }
 
+void BlueStore::Onode::pack_attrs()
+{
+  size_t len = 0;
+  for (auto& i : onode.attrs) {
+    len += i.second.length();
+  }
+  if (onode.attrs.size() < 2 || len == 0) {
+    for (auto& i : onode.attrs) {
+      i.second.reassign_to_mempool(mempool::mempool_bluestore_cache_other);
+    }
+    return;
+  }
+  bufferptr packed(buffer::create_in_mempool(
+    len, mempool::mempool_bluestore_cache_other));
+  unsigned off = 0;
+  for (auto& i : onode.attrs) {
+    unsigned l = i.second.length();
+    packed.copy_in(off, l, i.second.c_str());
+    i.second = bufferptr(packed, off, l);
+    off += l;
+  }
+}
+
 void BlueStore::Onode::dump(Formatter* f) const
 {
   onode.dump(f);
@@ -3303,6 +3456,7 @@ void BlueStore::DeferredBatch::prepare_write(
 	   << " crc " << i.first->second.bl.crc32c(-1)
 	   << std::dec << dendl;
   seq_bytes[seq] += length;
+  ++queued_extents;
 #ifdef DEBUG_DEFERRED
   _audit(cct);
 #endif
@@ -3395,13 +3549,14 @@ void BlueStore::DeferredBatch::_audit(CephContext *cct)
 #undef dout_prefix
 #define dout_prefix *_dout << "bluestore(" << store->path << ").collection(" << cid << " " << this << ") "
 
-BlueStore::Collection::Collection(BlueStore *store_, Cache *c, coll_t cid)
+BlueStore::Collection::Collection(BlueStore *store_, OnodeCacheShard *oc,
+				  BufferCacheShard *bc, coll_t cid)
   : CollectionImpl(cid),
     store(store_),
-    cache(c),
+    cache(bc),
     lock("BlueStore::Collection::lock", true, false),
     exists(true),
-    onode_map(c),
+    onode_map(oc),
     commit_queue(nullptr)
 {
 }
@@ -3553,9 +3708,7 @@ BlueStore::OnodeRef BlueStore::Collection::get_onode(
     on->exists = true;
     auto p = v.front().begin_deep();
     on->onode.decode(p);
-    for (auto& i : on->onode.attrs) {
-      i.second.reassign_to_mempool(mempool::mempool_bluestore_cache_other);
-    }
+    on->pack_attrs();
 
     // initialize extent_map
     on->extent_map.decode_spanning_blobs(p);
@@ -3577,10 +3730,26 @@ void BlueStore::Collection::split_cache(
 {
   ldout(store->cct, 10) << __func__ << " to " << dest << dendl;
 
-  // lock (one or both) cache shards
-  std::lock(cache->lock, dest->cache->lock);
-  std::lock_guard l(cache->lock, std::adopt_lock);
-  std::lock_guard l2(dest->cache->lock, std::adopt_lock);
+  auto *ocache = get_onode_cache();
+  auto *dest_ocache = dest->get_onode_cache();
+
+  // lock (one or both) onode cache shards, then (one or both) buffer
+  // cache shards.  the shard locks are not recursive, so only take a
+  // shard's lock once if both collections map to it.
+  std::unique_lock l(ocache->lock, std::defer_lock);
+  std::unique_lock l2(dest_ocache->lock, std::defer_lock);
+  if (ocache == dest_ocache) {
+    l.lock();
+  } else {
+    std::lock(l, l2);
+  }
+  std::unique_lock l3(cache->lock, std::defer_lock);
+  std::unique_lock l4(dest->cache->lock, std::defer_lock);
+  if (cache == dest->cache) {
+    l3.lock();
+  } else {
+    std::lock(l3, l4);
+  }
 
   int destbits = dest->cnode.bits;
   spg_t destpg;
@@ -3599,13 +3768,12 @@ void BlueStore::Collection::split_cache(
       ldout(store->cct, 20) << __func__ << " moving " << o << " " << o->oid
 			    << dendl;
 
-      cache->_rm_onode(p->second);
+      ocache->_rm(p->second);
       p = onode_map.onode_map.erase(p);
 
       o->c = dest;
-      dest->cache->_add_onode(o, 1);
+      dest_ocache->_add(o, 1);
       dest->onode_map.onode_map[o->oid] = o;
-      dest->onode_map.cache = dest->cache;
 
       // move over shared blobs and buffers.  cover shared blobs from
       // both extent map and spanning blob map (the full extent map
@@ -3636,7 +3804,7 @@ void BlueStore::Collection::split_cache(
 	    if (!i.second->is_writing()) {
 	      ldout(store->cct, 20) << __func__ << "   moving " << *i.second
 				    << dendl;
-	      dest->cache->_move_buffer(cache, i.second.get());
+	      dest->cache->_move(cache, i.second.get());
 	    }
 	  }
 	}
@@ -3734,7 +3902,8 @@ void BlueStore::MempoolThread::_adjust_cache_settings()
 void BlueStore::MempoolThread::_trim_shards(bool interval_stats)
 {
   auto cct = store->cct;
-  size_t num_shards = store->cache_shards.size();
+  size_t onode_shards = store->onode_cache_shards.size();
+  size_t buffer_shards = store->buffer_cache_shards.size();
 
   int64_t kv_used = store->db->get_cache_usage();
   int64_t meta_used = meta_cache->_get_used_bytes();
@@ -3773,15 +3942,22 @@ void BlueStore::MempoolThread::_trim_shards(bool interval_stats)
                    << " data_used: " << data_used << dendl;
   }
 
+  // split the meta and data allocations that the PriorityCache manager
+  // committed evenly over the onode and buffer shards, respectively
   uint64_t max_shard_onodes = static_cast<uint64_t>(
-      (meta_alloc / (double) num_shards) / meta_cache->get_bytes_per_onode());
-  uint64_t max_shard_buffer = static_cast<uint64_t>(data_alloc / num_shards);
+      (meta_alloc / (double) onode_shards) / meta_cache->get_bytes_per_onode());
+  uint64_t max_shard_buffer = static_cast<uint64_t>(data_alloc / buffer_shards);
 
   ldout(cct, 30) << __func__ << " max_shard_onodes: " << max_shard_onodes
                  << " max_shard_buffer: " << max_shard_buffer << dendl;
 
-  for (auto i : store->cache_shards) {
-    i->trim(max_shard_onodes, max_shard_buffer);
+  for (auto i : store->onode_cache_shards) {
+    i->set_max(max_shard_onodes);
+    i->trim();
+  }
+  for (auto i : store->buffer_cache_shards) {
+    i->set_max(max_shard_buffer);
+    i->trim();
   }
 }
 
@@ -3973,6 +4149,7 @@ BlueStore::BlueStore(CephContext *cct, const string& path)
     deferred_finisher(cct, "defered_finisher", "dfin"),
     finisher(cct, "commit_finisher", "cfin"),
     kv_sync_thread(this),
+    kv_commit_thread(this),
     kv_finalize_thread(this),
     mempool_thread(this)
 {
@@ -3993,6 +4170,7 @@ BlueStore::BlueStore(CephContext *cct,
     deferred_finisher(cct, "defered_finisher", "dfin"),
     finisher(cct, "commit_finisher", "cfin"),
     kv_sync_thread(this),
+    kv_commit_thread(this),
     kv_finalize_thread(this),
     min_alloc_size(_min_alloc_size),
     min_alloc_size_order(ctz(_min_alloc_size)),
@@ -4012,10 +4190,14 @@ BlueStore::~BlueStore()
   ceph_assert(bluefs == NULL);
   ceph_assert(fsid_fd < 0);
   ceph_assert(path_fd < 0);
-  for (auto i : cache_shards) {
+  for (auto i : onode_cache_shards) {
     delete i;
   }
-  cache_shards.clear();
+  for (auto i : buffer_cache_shards) {
+    delete i;
+  }
+  onode_cache_shards.clear();
+  buffer_cache_shards.clear();
 }
 
 const char **BlueStore::get_tracked_conf_keys() const
@@ -4046,6 +4228,9 @@ const char **BlueStore::get_tracked_conf_keys() const
     "bluestore_max_blob_size",
     "bluestore_max_blob_size_ssd",
     "bluestore_max_blob_size_hdd",
+    "bluestore_readahead_max",
+    "bluestore_readahead_max_hdd",
+    "bluestore_readahead_max_ssd",
     "osd_memory_target",
     "osd_memory_target_cgroup_limit_ratio",
     "osd_memory_base",
@@ -4086,6 +4271,13 @@ void BlueStore::handle_conf_change(const ConfigProxy& conf,
       _set_blob_size();
     }
   }
+  if (changed.count("bluestore_readahead_max") ||
+      changed.count("bluestore_readahead_max_hdd") ||
+      changed.count("bluestore_readahead_max_ssd")) {
+    if (bdev) {
+      _set_readahead();
+    }
+  }
   if (changed.count("bluestore_prefer_deferred_size") ||
       changed.count("bluestore_prefer_deferred_size_hdd") ||
       changed.count("bluestore_prefer_deferred_size_ssd") ||
@@ -4218,6 +4410,22 @@ void BlueStore::_set_blob_size()
            << std::dec << dendl;
 }
 
+void BlueStore::_set_readahead()
+{
+  if (cct->_conf->bluestore_readahead_max) {
+    readahead_max = cct->_conf->bluestore_readahead_max;
+  } else {
+    ceph_assert(bdev);
+    if (_use_rotational_settings()) {
+      readahead_max = cct->_conf->bluestore_readahead_max_hdd;
+    } else {
+      readahead_max = cct->_conf->bluestore_readahead_max_ssd;
+    }
+  }
+  dout(10) << __func__ << " readahead_max 0x" << std::hex << readahead_max
+	   << std::dec << dendl;
+}
+
 int BlueStore::_set_cache_sizes()
 {
   // set osd_memory_target *default* based on cgroup limit?
@@ -4342,6 +4550,14 @@ void BlueStore::_init_logger()
   b.add_time_avg(l_bluestore_kv_final_lat, "kv_final_lat",
 		 "Average kv_finalize thread latency",
 		 "kf_l", PerfCountersBuilder::PRIO_INTERESTING);
+  b.add_u64_avg(l_bluestore_kv_sync_batch, "kv_sync_batch",
+		"Average number of transactions per kv_sync cycle");
+  b.add_u64(l_bluestore_kv_commit_queue, "kv_commit_queue",
+	    "kv_sync batches waiting for the kv_commit thread");
+  b.add_u64(l_bluestore_kv_final_queue, "kv_final_queue",
+	    "Transactions waiting for the kv_finalize thread");
+  b.add_u64_avg(l_bluestore_kv_final_batch, "kv_final_batch",
+		"Average number of transactions per kv_finalize cycle");
   b.add_time_avg(l_bluestore_state_prepare_lat, "state_prepare_lat",
     "Average prepare state latency");
   b.add_time_avg(l_bluestore_state_aio_wait_lat, "state_aio_wait_lat",
@@ -4397,6 +4613,12 @@ void BlueStore::_init_logger()
 		    "Sum for deferred write op");
   b.add_u64_counter(l_bluestore_deferred_write_bytes, "deferred_write_bytes",
 		    "Sum for deferred write bytes", "def", 0, unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_bluestore_deferred_write_extents, "deferred_write_extents",
+		    "Sum for deferred write extents queued (before coalescing "
+		    "into deferred_write_ops)");
+  b.add_u64_counter(l_bluestore_deferred_write_merged, "deferred_write_merged",
+		    "Deferred write extents merged into adjacent extents or "
+		    "superseded by later overwrites");
   b.add_u64_counter(l_bluestore_write_penalty_read_ops, "write_penalty_read_ops",
 		    "Sum for write penalty read ops");
   b.add_u64(l_bluestore_allocated, "bluestore_allocated",
@@ -4471,6 +4693,14 @@ void BlueStore::_init_logger()
                     "Read EIO errors propagated to high level callers");
   b.add_u64_counter(l_bluestore_reads_with_retries, "bluestore_reads_with_retries",
                     "Read operations that required at least one retry due to failed checksum validation");
+  b.add_u64_counter(l_bluestore_readahead_ops, "readahead_ops",
+		    "Reads extended with readahead");
+  b.add_u64_counter(l_bluestore_readahead_bytes, "readahead_bytes",
+		    "Bytes read ahead of sequential reads", NULL, 0,
+		    unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_bluestore_readahead_hit_bytes, "readahead_hit_bytes",
+		    "Bytes of sequential reads covered by earlier readahead",
+		    NULL, 0, unit_t(UNIT_BYTES));
   b.add_u64(l_bluestore_fragmentation, "bluestore_fragmentation_micros",
             "How fragmented bluestore free space is (free extents / max possible number of free extents) * 1000");
   b.add_time_avg(l_bluestore_omap_seek_to_first_lat, "omap_seek_to_first_lat",
@@ -4481,6 +4711,12 @@ void BlueStore::_init_logger()
     "Average omap iterator lower_bound call latency");
   b.add_time_avg(l_bluestore_omap_next_lat, "omap_next_lat",
     "Average omap iterator next call latency");
+  b.add_u64(l_bluestore_fsck_objects, "fsck_objects",
+    "Objects checked by the running fsck/repair");
+  b.add_u64(l_bluestore_fsck_collections, "fsck_collections",
+    "Collections checked by the running fsck/repair");
+  b.add_u64(l_bluestore_fsck_collections_total, "fsck_collections_total",
+    "Collections to check in the running fsck/repair");
   logger = b.create_perf_counters();
   cct->get_perfcounters_collection()->add(logger);
 }
@@ -4684,7 +4920,16 @@ int BlueStore::_open_bdev(bool create)
 {
   ceph_assert(bdev == NULL);
   string p = path + "/block";
-  bdev = BlockDevice::create(cct, p, aio_cb, static_cast<void*>(this), discard_cb, static_cast<void*>(this));
+  string cp = path + "/block.cache";
+  struct stat st;
+  if (::stat(cp.c_str(), &st) == 0) {
+    block_cache = new CachedDevice(cct, cp, SUPER_RESERVED,
+				   aio_cb, static_cast<void*>(this),
+				   discard_cb, static_cast<void*>(this));
+    bdev = block_cache;
+  } else {
+    bdev = BlockDevice::create(cct, p, aio_cb, static_cast<void*>(this), discard_cb, static_cast<void*>(this));
+  }
   int r = bdev->open(p);
   if (r < 0)
     goto fail;
@@ -4698,6 +4943,12 @@ int BlueStore::_open_bdev(bool create)
     if (r < 0)
       goto fail_close;
   }
+  if (block_cache) {
+    r = _check_or_set_bdev_label(cp, block_cache->get_cache_size(),
+				 "block cache", create);
+    if (r < 0)
+      goto fail_close;
+  }
 
   // initialize global block parameters
   block_size = bdev->get_block_size();
@@ -4716,6 +4967,7 @@ int BlueStore::_open_bdev(bool create)
  fail:
   delete bdev;
   bdev = NULL;
+  block_cache = nullptr;
   return r;
 }
 
@@ -4742,6 +4994,7 @@ void BlueStore::_close_bdev()
   bdev->close();
   delete bdev;
   bdev = NULL;
+  block_cache = nullptr;
 }
 
 int BlueStore::_open_fm(KeyValueDB::Transaction t)
@@ -4879,6 +5132,18 @@ int BlueStore::_open_alloc()
                << dendl;
     return -EINVAL;
   }
+  auto trace_path = cct->_conf.get_val<std::string>(
+    "bluestore_allocator_trace_path");
+  if (!trace_path.empty()) {
+    dout(1) << __func__ << " tracing allocations to " << trace_path << dendl;
+    alloc = Allocator::create_tracer(cct, alloc,
+				     cct->_conf->bluestore_allocator,
+				     bdev->get_size(), min_alloc_size,
+				     trace_path);
+    if (!alloc) {
+      return -EIO;
+    }
+  }
 
   uint64_t num = 0, bytes = 0;
 
@@ -5316,8 +5581,13 @@ int BlueStore::_open_db_and_around(bool read_only)
     if (r < 0)
       goto out_fm;
   }
+  r = _open_block_cache(read_only);
+  if (r < 0)
+    goto out_alloc;
   return 0;
 
+ out_alloc:
+  _close_alloc();
  out_fm:
   _close_fm();
  out_db:
@@ -5325,8 +5595,54 @@ int BlueStore::_open_db_and_around(bool read_only)
   return r;
 }
 
+int BlueStore::_open_block_cache(bool read_only)
+{
+  if (!block_cache) {
+    KeyValueDB::Iterator it = db->get_iterator(PREFIX_BLOCK_CACHE);
+    it->lower_bound(string());
+    if (it->valid()) {
+      derr << __func__ << " " << path << "/block.cache is missing but holds"
+	   << " data not yet destaged to the main device" << dendl;
+      return -EIO;
+    }
+    return 0;
+  }
+  int r = block_cache->open_meta(db, PREFIX_BLOCK_CACHE, read_only);
+  if (r < 0) {
+    derr << __func__ << " failed to load block cache map: "
+	 << cpp_strerror(r) << dendl;
+    return r;
+  }
+  if (!block_cache->empty()) {
+    // space freed (or gifted to bluefs) shortly before we went down may
+    // still be cached if the release did not make it to disk; make sure
+    // it is never destaged over whatever uses it now.
+    fm->enumerate_reset();
+    uint64_t offset, length;
+    while (fm->enumerate_next(db, &offset, &length)) {
+      block_cache->release(offset, length);
+    }
+    fm->enumerate_reset();
+    for (auto e = bluefs_extents.begin(); e != bluefs_extents.end(); ++e) {
+      block_cache->release(e.get_start(), e.get_len());
+    }
+    if (!read_only) {
+      block_cache->meta_committed(block_cache->submit_meta(true));
+    }
+  }
+  return 0;
+}
+
+void BlueStore::_close_block_cache()
+{
+  if (block_cache) {
+    block_cache->close_meta();
+  }
+}
+
 void BlueStore::_close_db_and_around()
 {
+  _close_block_cache();
   if (bluefs) {
     if (out_of_sync_fm.fetch_and(0)) {
       _sync_bluefs_and_fm();
@@ -5529,14 +5845,17 @@ int BlueStore::_open_db(bool create, bool to_repair_db, bool read_only)
   if (kv_backend == "rocksdb") {
     options = cct->_conf->bluestore_rocksdb_options;
 
-    map<string,string> cf_map;
-    cct->_conf.with_val<string>("bluestore_rocksdb_cfs",
-                                 get_str_map,
-                                 &cf_map,
-                                 " \t");
-    for (auto& i : cf_map) {
-      dout(10) << "column family " << i.first << ": " << i.second << dendl;
-      cfs.push_back(KeyValueDB::ColumnFamily(i.first, i.second));
+    r = KeyValueDB::parse_sharding(
+      cct->_conf.get_val<string>("bluestore_rocksdb_cfs"), &cfs, &err);
+    if (r < 0) {
+      derr << __func__ << " invalid bluestore_rocksdb_cfs: " << err.str()
+	   << dendl;
+      _close_db();
+      return r;
+    }
+    for (auto& i : cfs) {
+      dout(10) << "column family " << i.name << "(" << i.shards << "): "
+	       << i.option << dendl;
     }
   }
 
@@ -5638,6 +5957,10 @@ int BlueStore::allocate_bluefs_freespace(
     } while (size && alloc_len > 0);
     for (auto& e : *extents) {
       dout(5) << __func__ << " gifting " << e << " to bluefs" << dendl;
+      if (block_cache) {
+	// bluefs writes to the main device directly
+	block_cache->release(e.offset, e.length);
+      }
       bluefs_extents.insert(e.offset, e.length);
       ++out_of_sync_fm;
       // apply to bluefs if not requested from outside
@@ -5791,7 +6114,8 @@ int BlueStore::_open_collections(int *errors)
       CollectionRef c(
 	new Collection(
 	  this,
-	  cache_shards[cid.hash_to_shard(cache_shards.size())],
+	  onode_cache_shards[cid.hash_to_shard(onode_cache_shards.size())],
+	  buffer_cache_shards[cid.hash_to_shard(buffer_cache_shards.size())],
 	  cid));
       bufferlist bl = it->value();
       auto p = bl.cbegin();
@@ -6034,6 +6358,12 @@ int BlueStore::mkfs()
 				   cct->_conf->bluestore_block_create);
   if (r < 0)
     goto out_close_fsid;
+  r = _setup_block_symlink_or_file("block.cache",
+				   cct->_conf->bluestore_block_cache_path,
+				   cct->_conf->bluestore_block_cache_size,
+				   cct->_conf->bluestore_block_cache_create);
+  if (r < 0)
+    goto out_close_fsid;
   if (cct->_conf->bluestore_bluefs) {
     r = _setup_block_symlink_or_file("block.wal", cct->_conf->bluestore_block_wal_path,
 	cct->_conf->bluestore_block_wal_size,
@@ -6545,13 +6875,33 @@ int BlueStore::expand_devices(ostream& out)
 
 void BlueStore::set_cache_shards(unsigned num)
 {
-  dout(10) << __func__ << " " << num << dendl;
-  size_t old = cache_shards.size();
-  ceph_assert(num >= old);
-  cache_shards.resize(num);
-  for (unsigned i = old; i < num; ++i) {
-    cache_shards[i] = Cache::create(cct, cct->_conf->bluestore_cache_type,
-				    logger);
+  // by default we get one onode and one buffer shard per op shard, but
+  // either count may be pinned independently of the op shard count
+  unsigned onode_num = cct->_conf.get_val<uint64_t>(
+    "bluestore_cache_onode_shards");
+  unsigned buffer_num = cct->_conf.get_val<uint64_t>(
+    "bluestore_cache_buffer_shards");
+  if (!onode_num) {
+    onode_num = num;
+  }
+  if (!buffer_num) {
+    buffer_num = num;
+  }
+  dout(10) << __func__ << " " << num << " onode shards " << onode_num
+	   << " buffer shards " << buffer_num << dendl;
+
+  size_t oold = onode_cache_shards.size();
+  size_t bold = buffer_cache_shards.size();
+  ceph_assert(onode_num >= oold && buffer_num >= bold);
+  onode_cache_shards.resize(onode_num);
+  buffer_cache_shards.resize(buffer_num);
+  for (unsigned i = oold; i < onode_num; ++i) {
+    onode_cache_shards[i] = OnodeCacheShard::create(
+      cct, cct->_conf->bluestore_cache_type, logger);
+  }
+  for (unsigned i = bold; i < buffer_num; ++i) {
+    buffer_cache_shards[i] = BufferCacheShard::create(
+      cct, cct->_conf->bluestore_cache_type, logger);
   }
 }
 
@@ -6665,9 +7015,21 @@ int BlueStore::umount()
 
   _osr_drain_all();
 
+  int r = 0;
   mounted = false;
   if (!_kv_only) {
     mempool_thread.shutdown();
+    if (block_cache &&
+	cct->_conf.get_val<bool>("bluestore_block_cache_drain_on_umount")) {
+      dout(20) << __func__ << " draining block cache" << dendl;
+      // what is left stays safely in the cache; finish unmounting, but
+      // tell the caller the cache cannot be removed
+      r = block_cache->drain();
+      if (r < 0) {
+	derr << __func__ << " failed to drain block cache: "
+	     << cpp_strerror(r) << dendl;
+      }
+    }
     dout(20) << __func__ << " stopping kv thread" << dendl;
     _kv_stop();
     _flush_cache();
@@ -6688,7 +7050,7 @@ int BlueStore::umount()
       return -EIO;
     }
   }
-  return 0;
+  return r;
 }
 
 static void apply(uint64_t off,
@@ -6852,26 +7214,246 @@ void BlueStore::_fsck_check_pool_statfs(
 	if (repairer) {
 	  repairer->fix_statfs(db, key, stat_it->second);
 	}
-        ++errors;
+        ++errors;
+      }
+      expected_pool_statfs.erase(stat_it);
+    }
+  } // if (it)
+  for( auto s = expected_pool_statfs.begin(); s != expected_pool_statfs.end();
+    ++s) {
+    if (s->second.is_zero()) {
+      // we might lack empty statfs recs in DB
+      continue;
+    }
+    derr << "fsck error: missing Pool StatFS record for pool "
+	  << std::hex << s->first << std::dec << dendl;
+    if (repairer) {
+      string key;
+      get_pool_stat_key(s->first, &key);
+      repairer->fix_statfs(db, key, s->second);
+    }
+    ++errors;
+  }
+}
+
+void BlueStore::_fsck_check_object(
+  FSCK_ObjectCtx& ctx,
+  CollectionRef c,
+  OnodeRef o,
+  store_statfs_t* expected_statfs)
+{
+  const ghobject_t& oid = o->oid;
+  dout(10) << __func__ << "  " << oid << dendl;
+  int errors = 0;
+  uint64_t num_extents = 0;
+  uint64_t num_blobs = 0;
+  store_statfs_t onode_statfs;
+  RWLock::RLocker l(c->lock);
+  if (o->onode.nid) {
+    std::lock_guard fl(ctx.lock);
+    if (o->onode.nid > nid_max) {
+      derr << "fsck error: " << oid << " nid " << o->onode.nid
+	   << " > nid_max " << nid_max << dendl;
+      ++ctx.errors;
+    }
+    if (ctx.used_nids.count(o->onode.nid)) {
+      derr << "fsck error: " << oid << " nid " << o->onode.nid
+	   << " already in use" << dendl;
+      ++ctx.errors;
+      return; // go for next object
+    }
+    ctx.used_nids.insert(o->onode.nid);
+  }
+  o->extent_map.fault_range(db, 0, OBJECT_MAX_SIZE);
+  _dump_onode<30>(cct, *o);
+  // lextents
+  map<BlobRef,bluestore_blob_t::unused_t> referenced;
+  uint64_t pos = 0;
+  mempool::bluestore_fsck::map<BlobRef,
+			       bluestore_blob_use_tracker_t> ref_map;
+  for (auto& l : o->extent_map.extent_map) {
+    dout(20) << __func__ << "    " << l << dendl;
+    if (l.logical_offset < pos) {
+      derr << "fsck error: " << oid << " lextent at 0x"
+	   << std::hex << l.logical_offset
+	   << " overlaps with the previous, which ends at 0x" << pos
+	   << std::dec << dendl;
+      ++errors;
+    }
+    if (o->extent_map.spans_shard(l.logical_offset, l.length)) {
+      derr << "fsck error: " << oid << " lextent at 0x"
+	   << std::hex << l.logical_offset << "~" << l.length
+	   << " spans a shard boundary"
+	   << std::dec << dendl;
+      ++errors;
+    }
+    pos = l.logical_offset + l.length;
+    onode_statfs.data_stored += l.length;
+    ceph_assert(l.blob);
+    const bluestore_blob_t& blob = l.blob->get_blob();
+
+    auto& ref = ref_map[l.blob];
+    if (ref.is_empty()) {
+      uint32_t min_release_size = blob.get_release_size(min_alloc_size);
+      uint32_t l = blob.get_logical_length();
+      ref.init(l, min_release_size);
+    }
+    ref.get(
+      l.blob_offset, 
+      l.length);
+    ++num_extents;
+    if (blob.has_unused()) {
+      auto p = referenced.find(l.blob);
+      bluestore_blob_t::unused_t *pu;
+      if (p == referenced.end()) {
+	pu = &referenced[l.blob];
+      } else {
+	pu = &p->second;
+      }
+      uint64_t blob_len = blob.get_logical_length();
+      ceph_assert((blob_len % (sizeof(*pu)*8)) == 0);
+      ceph_assert(l.blob_offset + l.length <= blob_len);
+      uint64_t chunk_size = blob_len / (sizeof(*pu)*8);
+      uint64_t start = l.blob_offset / chunk_size;
+      uint64_t end =
+	round_up_to(l.blob_offset + l.length, chunk_size) / chunk_size;
+      for (auto i = start; i < end; ++i) {
+	(*pu) |= (1u << i);
+      }
+    }
+  }
+  for (auto &i : referenced) {
+    dout(20) << __func__ << "  referenced 0x" << std::hex << i.second
+	     << std::dec << " for " << *i.first << dendl;
+    const bluestore_blob_t& blob = i.first->get_blob();
+    if (i.second & blob.unused) {
+      derr << "fsck error: " << oid << " blob claims unused 0x"
+	   << std::hex << blob.unused
+	   << " but extents reference 0x" << i.second << std::dec
+	   << " on blob " << *i.first << dendl;
+      ++errors;
+    }
+    if (blob.has_csum()) {
+      uint64_t blob_len = blob.get_logical_length();
+      uint64_t unused_chunk_size = blob_len / (sizeof(blob.unused)*8);
+      unsigned csum_count = blob.get_csum_count();
+      unsigned csum_chunk_size = blob.get_csum_chunk_size();
+      for (unsigned p = 0; p < csum_count; ++p) {
+	unsigned pos = p * csum_chunk_size;
+	unsigned firstbit = pos / unused_chunk_size;    // [firstbit,lastbit]
+	unsigned lastbit = (pos + csum_chunk_size - 1) / unused_chunk_size;
+	unsigned mask = 1u << firstbit;
+	for (unsigned b = firstbit + 1; b <= lastbit; ++b) {
+	  mask |= 1u << b;
+	}
+	if ((blob.unused & mask) == mask) {
+	  // this csum chunk region is marked unused
+	  if (blob.get_csum_item(p) != 0) {
+	    derr << "fsck error: " << oid
+		 << " blob claims csum chunk 0x" << std::hex << pos
+		 << "~" << csum_chunk_size
+		 << " is unused (mask 0x" << mask << " of unused 0x"
+		 << blob.unused << ") but csum is non-zero 0x"
+		 << blob.get_csum_item(p) << std::dec << " on blob "
+		 << *i.first << dendl;
+	    ++errors;
+	  }
+	}
+      }
+    }
+  }
+  for (auto &i : ref_map) {
+    ++num_blobs;
+    const bluestore_blob_t& blob = i.first->get_blob();
+    bool equal = i.first->get_blob_use_tracker().equal(i.second);
+    if (!equal) {
+      derr << "fsck error: " << oid << " blob " << *i.first
+	   << " doesn't match expected ref_map " << i.second << dendl;
+      ++errors;
+    }
+    if (blob.is_compressed()) {
+      onode_statfs.data_compressed += blob.get_compressed_payload_length();
+      onode_statfs.data_compressed_original +=
+	i.first->get_referenced_bytes();
+    }
+    if (blob.is_shared()) {
+      if (i.first->shared_blob->get_sbid() > blobid_max) {
+	derr << "fsck error: " << oid << " blob " << blob
+	     << " sbid " << i.first->shared_blob->get_sbid() << " > blobid_max "
+	     << blobid_max << dendl;
+	++errors;
+      } else if (i.first->shared_blob->get_sbid() == 0) {
+	derr << "fsck error: " << oid << " blob " << blob
+	     << " marked as shared but has uninitialized sbid"
+	     << dendl;
+	++errors;
+      }
+      std::lock_guard fl(ctx.lock);
+      sb_info_t& sbi = ctx.sb_info[i.first->shared_blob->get_sbid()];
+      ceph_assert(sbi.cid == coll_t() || sbi.cid == c->cid);
+      ceph_assert(sbi.pool_id == INT64_MIN ||
+		  sbi.pool_id == oid.hobj.get_logical_pool());
+      sbi.cid = c->cid;
+      sbi.pool_id = oid.hobj.get_logical_pool();
+      sbi.sb = i.first->shared_blob;
+      sbi.oids.push_back(oid);
+      sbi.compressed = blob.is_compressed();
+      for (auto e : blob.get_extents()) {
+	if (e.is_valid()) {
+	  sbi.ref_map.get(e.offset, e.length);
+	}
       }
-      expected_pool_statfs.erase(stat_it);
-    }
-  } // if (it)
-  for( auto s = expected_pool_statfs.begin(); s != expected_pool_statfs.end();
-    ++s) {
-    if (s->second.is_zero()) {
-      // we might lack empty statfs recs in DB
-      continue;
+    } else {
+      std::lock_guard fl(ctx.lock);
+      errors += _fsck_check_extents(c->cid, oid, blob.get_extents(),
+				    blob.is_compressed(),
+				    ctx.used_blocks,
+				    fm->get_alloc_size(),
+				    ctx.repairer,
+				    onode_statfs);
     }
-    derr << "fsck error: missing Pool StatFS record for pool "
-	  << std::hex << s->first << std::dec << dendl;
-    if (repairer) {
-      string key;
-      get_pool_stat_key(s->first, &key);
-      repairer->fix_statfs(db, key, s->second);
+  }
+  if (ctx.deep) {
+    bufferlist bl;
+    uint64_t max_read_block = cct->_conf->bluestore_fsck_read_bytes_cap;
+    uint64_t offset = 0;
+    do {
+      uint64_t l = std::min(uint64_t(o->onode.size - offset), max_read_block);
+      int r = _do_read(c.get(), o, offset, l, bl,
+	CEPH_OSD_OP_FLAG_FADVISE_NOCACHE);
+      if (r < 0) {
+	++errors;
+	derr << "fsck error: " << oid << std::hex
+	     << " error during read: "
+	     << " " << offset << "~" << l
+	     << " " << cpp_strerror(r) << std::dec
+	     << dendl;
+	break;
+      }
+      offset += l;
+    } while (offset < o->onode.size);
+  }
+
+  std::lock_guard fl(ctx.lock);
+  // omap
+  if (o->onode.has_omap()) {
+    auto& m =
+      o->onode.is_pgmeta_omap() ? ctx.used_pgmeta_omap_head : ctx.used_omap_head;
+    if (m.count(o->onode.nid)) {
+      derr << "fsck error: " << oid << " omap_head " << o->onode.nid
+	   << " already in use" << dendl;
+      ++errors;
+    } else {
+      m.insert(o->onode.nid);
     }
-    ++errors;
   }
+  expected_statfs->add(onode_statfs);
+  ++ctx.num_objects;
+  ctx.num_extents += num_extents;
+  ctx.num_blobs += num_blobs;
+  ctx.num_spanning_blobs += o->extent_map.spanning_blob_map.size();
+  ctx.errors += errors;
+  logger->inc(l_bluestore_fsck_objects);
 }
 
 /**
@@ -6919,9 +7501,6 @@ int BlueStore::_fsck(bool deep, bool repair)
   int errors = 0;
   unsigned repaired = 0;
 
-  typedef btree::btree_set<
-    uint64_t,std::less<uint64_t>,
-    mempool::bluestore_fsck::pool_allocator<uint64_t>> uint64_t_btree_t;
   uint64_t_btree_t used_nids;
   uint64_t_btree_t used_omap_head;
   uint64_t_btree_t used_pgmeta_omap_head;
@@ -6932,17 +7511,7 @@ int BlueStore::_fsck(bool deep, bool repair)
   store_statfs_t expected_store_statfs, actual_statfs;
   per_pool_statfs expected_pool_statfs;
 
-  struct sb_info_t {
-    coll_t cid;
-    int64_t pool_id = INT64_MIN;
-    list<ghobject_t> oids;
-    SharedBlobRef sb;
-    bluestore_extent_ref_map_t ref_map;
-    bool compressed = false;
-    bool passed = false;
-    bool updated = false;
-  };
-  mempool::bluestore_fsck::map<uint64_t,sb_info_t> sb_info;
+  sb_info_map_t sb_info;
 
   uint64_t num_objects = 0;
   uint64_t num_extents = 0;
@@ -6955,6 +7524,20 @@ int BlueStore::_fsck(bool deep, bool repair)
   store_statfs_t* expected_statfs = nullptr;
   // in deep mode we need R/W write access to be able to replay deferred ops
   bool read_only = !(repair || deep);
+  FSCK_ObjectCtx ctx = {
+    errors,
+    num_objects,
+    num_extents,
+    num_blobs,
+    num_spanning_blobs,
+    used_blocks,
+    used_nids,
+    used_omap_head,
+    used_pgmeta_omap_head,
+    sb_info,
+    repair ? &repairer : nullptr,
+    deep
+  };
 
   utime_t start = ceph_clock_now();
   const auto& no_pps_mode = cct->_conf->bluestore_no_per_pool_stats_tolerance;
@@ -7079,17 +7662,90 @@ int BlueStore::_fsck(bool deep, bool repair)
 
   // walk PREFIX_OBJ
   dout(1) << __func__ << " walking object keyspace" << dendl;
+  logger->set(l_bluestore_fsck_objects, 0);
+  logger->set(l_bluestore_fsck_collections, 0);
+  logger->set(l_bluestore_fsck_collections_total, coll_map.size());
   it = db->get_iterator(PREFIX_OBJ);
   if (it) {
      //fill global if not overriden below
     expected_statfs = &expected_store_statfs;
 
+    // This thread walks the keys in order, resolving collections and
+    // tracking the extent shard keys each onode expects; the objects
+    // themselves are checked by a pool of workers, in batches.
+    struct fsck_item_t {
+      CollectionRef c;
+      OnodeRef o;
+      store_statfs_t* expected_statfs;
+    };
+    typedef vector<fsck_item_t> fsck_batch_t;
+    const size_t batch_size = 32;
+    const size_t num_threads =
+      cct->_conf.get_val<uint64_t>("bluestore_fsck_threads");
+    ceph::mutex wq_lock = ceph::make_mutex("BlueStore::_fsck::wq_lock");
+    ceph::condition_variable wq_cond;
+    list<fsck_batch_t> wq;
+    bool wq_stop = false;
+    vector<std::thread> workers;
+    fsck_batch_t batch;
+    // the workers add to errors under ctx.lock; count ours apart
+    int walk_errors = 0;
+
+    auto worker = [&]() {
+      std::unique_lock l(wq_lock);
+      while (true) {
+	if (!wq.empty()) {
+	  fsck_batch_t b = std::move(wq.front());
+	  wq.pop_front();
+	  wq_cond.notify_all();
+	  l.unlock();
+	  for (auto& i : b) {
+	    _fsck_check_object(ctx, i.c, i.o, i.expected_statfs);
+	  }
+	  l.lock();
+	} else if (wq_stop) {
+	  break;
+	} else {
+	  wq_cond.wait(l);
+	}
+      }
+    };
+    auto submit_batch = [&]() {
+      if (batch.empty()) {
+	return;
+      }
+      if (workers.empty()) {
+	for (auto& i : batch) {
+	  _fsck_check_object(ctx, i.c, i.o, i.expected_statfs);
+	}
+	batch.clear();
+	return;
+      }
+      std::unique_lock l(wq_lock);
+      // bound the number of onodes pinned in memory
+      wq_cond.wait(l, [&] { return wq.size() < 2 * workers.size(); });
+      wq.push_back(std::move(batch));
+      batch.clear();
+      wq_cond.notify_all();
+    };
+    if (num_threads > 1) {
+      dout(1) << __func__ << " checking objects with " << num_threads
+	      << " threads" << dendl;
+      for (size_t i = 0; i < num_threads; ++i) {
+	workers.push_back(make_named_thread("bstore_fsck", worker));
+      }
+    }
+
     CollectionRef c;
     spg_t pgid;
     mempool::bluestore_fsck::list<string> expecting_shards;
+    uint64_t num_collections = 0;
+    unsigned last_pct = 0;
+    bool aborted = false;
     for (it->lower_bound(string()); it->valid(); it->next()) {
       if (g_conf()->bluestore_debug_fsck_abort) {
-	goto out_scan;
+	aborted = true;
+	break;
       }
       dout(30) << __func__ << " key "
                << pretty_binary_string(it->key()) << dendl;
@@ -7099,7 +7755,7 @@ int BlueStore::_fsck(bool deep, bool repair)
 	  derr << "fsck error: missing shard key "
 	       << pretty_binary_string(expecting_shards.front())
 	       << dendl;
-	  ++errors;
+	  ++walk_errors;
 	  expecting_shards.pop_front();
 	}
 	if (!expecting_shards.empty() &&
@@ -7117,7 +7773,7 @@ int BlueStore::_fsck(bool deep, bool repair)
         if (expecting_shards.empty()) {
           derr << "fsck error: " << pretty_binary_string(it->key())
                << " is unexpected" << dendl;
-          ++errors;
+          ++walk_errors;
           continue;
         }
 	while (expecting_shards.front() > it->key()) {
@@ -7125,7 +7781,7 @@ int BlueStore::_fsck(bool deep, bool repair)
 	       << dendl;
 	  derr << "fsck error:   exp "
 	       << pretty_binary_string(expecting_shards.front()) << dendl;
-	  ++errors;
+	  ++walk_errors;
 	  expecting_shards.pop_front();
 	  if (expecting_shards.empty()) {
 	    break;
@@ -7139,7 +7795,7 @@ int BlueStore::_fsck(bool deep, bool repair)
       if (r < 0) {
         derr << "fsck error: bad object key "
              << pretty_binary_string(it->key()) << dendl;
-	++errors;
+	++walk_errors;
 	continue;
       }
       if (!c ||
@@ -7156,7 +7812,7 @@ int BlueStore::_fsck(bool deep, bool repair)
 	if (!c) {
           derr << "fsck error: stray object " << oid
                << " not owned by any collection" << dendl;
-	  ++errors;
+	  ++walk_errors;
 	  continue;
 	}
 	auto pool_id = c->cid.is_pg(&pgid) ? pgid.pool() : META_POOL_ID;
@@ -7168,6 +7824,17 @@ int BlueStore::_fsck(bool deep, bool repair)
 
 	dout(20) << __func__ << "  collection " << c->cid << " " << c->cnode
 		 << dendl;
+	++num_collections;
+	logger->set(l_bluestore_fsck_collections, num_collections);
+	unsigned pct = std::min<uint64_t>(
+	  100, num_collections * 100 / std::max<size_t>(1, coll_map.size()));
+	if (pct / 10 != last_pct / 10) {
+	  dout(1) << __func__ << " walked " << num_collections << "/"
+		  << coll_map.size() << " collections (" << pct << "%), "
+		  << logger->get(l_bluestore_fsck_objects) << " objects"
+		  << dendl;
+	}
+	last_pct = pct;
       }
 
       if (!expecting_shards.empty()) {
@@ -7175,228 +7842,55 @@ int BlueStore::_fsck(bool deep, bool repair)
 	  derr << "fsck error: missing shard key "
 	       << pretty_binary_string(k) << dendl;
 	}
-	++errors;
+	++walk_errors;
 	expecting_shards.clear();
       }
 
-      dout(10) << __func__ << "  " << oid << dendl;
-      store_statfs_t onode_statfs;
-      RWLock::RLocker l(c->lock);
-      OnodeRef o = c->get_onode(oid, false);
-      if (o->onode.nid) {
-	if (o->onode.nid > nid_max) {
-	  derr << "fsck error: " << oid << " nid " << o->onode.nid
-	       << " > nid_max " << nid_max << dendl;
-	  ++errors;
-	}
-	if (used_nids.count(o->onode.nid)) {
-	  derr << "fsck error: " << oid << " nid " << o->onode.nid
-	       << " already in use" << dendl;
-	  ++errors;
-	  continue; // go for next object
-	}
-	used_nids.insert(o->onode.nid);
+      OnodeRef o;
+      {
+	RWLock::RLocker l(c->lock);
+	o = c->get_onode(oid, false);
       }
-      ++num_objects;
-      num_spanning_blobs += o->extent_map.spanning_blob_map.size();
-      o->extent_map.fault_range(db, 0, OBJECT_MAX_SIZE);
-      _dump_onode<30>(cct, *o);
       // shards
-      if (!o->extent_map.shards.empty()) {
+      if (!o->onode.extent_map_shards.empty()) {
 	++num_sharded_objects;
-	num_object_shards += o->extent_map.shards.size();
+	num_object_shards += o->onode.extent_map_shards.size();
       }
-      for (auto& s : o->extent_map.shards) {
-	dout(20) << __func__ << "    shard " << *s.shard_info << dendl;
+      for (auto& s : o->onode.extent_map_shards) {
+	dout(20) << __func__ << "    shard " << s << dendl;
 	expecting_shards.push_back(string());
-	get_extent_shard_key(o->key, s.shard_info->offset,
-			     &expecting_shards.back());
-	if (s.shard_info->offset >= o->onode.size) {
+	get_extent_shard_key(o->key, s.offset, &expecting_shards.back());
+	if (s.offset >= o->onode.size) {
 	  derr << "fsck error: " << oid << " shard 0x" << std::hex
-	       << s.shard_info->offset << " past EOF at 0x" << o->onode.size
+	       << s.offset << " past EOF at 0x" << o->onode.size
 	       << std::dec << dendl;
-	  ++errors;
-	}
-      }
-      // lextents
-      map<BlobRef,bluestore_blob_t::unused_t> referenced;
-      uint64_t pos = 0;
-      mempool::bluestore_fsck::map<BlobRef,
-				   bluestore_blob_use_tracker_t> ref_map;
-      for (auto& l : o->extent_map.extent_map) {
-	dout(20) << __func__ << "    " << l << dendl;
-	if (l.logical_offset < pos) {
-	  derr << "fsck error: " << oid << " lextent at 0x"
-	       << std::hex << l.logical_offset
-	       << " overlaps with the previous, which ends at 0x" << pos
-	       << std::dec << dendl;
-	  ++errors;
-	}
-	if (o->extent_map.spans_shard(l.logical_offset, l.length)) {
-	  derr << "fsck error: " << oid << " lextent at 0x"
-	       << std::hex << l.logical_offset << "~" << l.length
-	       << " spans a shard boundary"
-	       << std::dec << dendl;
-	  ++errors;
-	}
-	pos = l.logical_offset + l.length;
-	onode_statfs.data_stored += l.length;
-	ceph_assert(l.blob);
-	const bluestore_blob_t& blob = l.blob->get_blob();
-
-        auto& ref = ref_map[l.blob];
-        if (ref.is_empty()) {
-          uint32_t min_release_size = blob.get_release_size(min_alloc_size);
-          uint32_t l = blob.get_logical_length();
-          ref.init(l, min_release_size);
-        }
-	ref.get(
-	  l.blob_offset, 
-	  l.length);
-	++num_extents;
-	if (blob.has_unused()) {
-	  auto p = referenced.find(l.blob);
-	  bluestore_blob_t::unused_t *pu;
-	  if (p == referenced.end()) {
-	    pu = &referenced[l.blob];
-	  } else {
-	    pu = &p->second;
-	  }
-	  uint64_t blob_len = blob.get_logical_length();
-	  ceph_assert((blob_len % (sizeof(*pu)*8)) == 0);
-	  ceph_assert(l.blob_offset + l.length <= blob_len);
-	  uint64_t chunk_size = blob_len / (sizeof(*pu)*8);
-	  uint64_t start = l.blob_offset / chunk_size;
-	  uint64_t end =
-	    round_up_to(l.blob_offset + l.length, chunk_size) / chunk_size;
-	  for (auto i = start; i < end; ++i) {
-	    (*pu) |= (1u << i);
-	  }
-	}
-      }
-      for (auto &i : referenced) {
-	dout(20) << __func__ << "  referenced 0x" << std::hex << i.second
-		 << std::dec << " for " << *i.first << dendl;
-	const bluestore_blob_t& blob = i.first->get_blob();
-	if (i.second & blob.unused) {
-	  derr << "fsck error: " << oid << " blob claims unused 0x"
-	       << std::hex << blob.unused
-	       << " but extents reference 0x" << i.second << std::dec
-	       << " on blob " << *i.first << dendl;
-	  ++errors;
-	}
-	if (blob.has_csum()) {
-	  uint64_t blob_len = blob.get_logical_length();
-	  uint64_t unused_chunk_size = blob_len / (sizeof(blob.unused)*8);
-	  unsigned csum_count = blob.get_csum_count();
-	  unsigned csum_chunk_size = blob.get_csum_chunk_size();
-	  for (unsigned p = 0; p < csum_count; ++p) {
-	    unsigned pos = p * csum_chunk_size;
-	    unsigned firstbit = pos / unused_chunk_size;    // [firstbit,lastbit]
-	    unsigned lastbit = (pos + csum_chunk_size - 1) / unused_chunk_size;
-	    unsigned mask = 1u << firstbit;
-	    for (unsigned b = firstbit + 1; b <= lastbit; ++b) {
-	      mask |= 1u << b;
-	    }
-	    if ((blob.unused & mask) == mask) {
-	      // this csum chunk region is marked unused
-	      if (blob.get_csum_item(p) != 0) {
-		derr << "fsck error: " << oid
-		     << " blob claims csum chunk 0x" << std::hex << pos
-		     << "~" << csum_chunk_size
-		     << " is unused (mask 0x" << mask << " of unused 0x"
-		     << blob.unused << ") but csum is non-zero 0x"
-		     << blob.get_csum_item(p) << std::dec << " on blob "
-		     << *i.first << dendl;
-		++errors;
-	      }
-	    }
-	  }
-	}
-      }
-      for (auto &i : ref_map) {
-	++num_blobs;
-	const bluestore_blob_t& blob = i.first->get_blob();
-	bool equal = i.first->get_blob_use_tracker().equal(i.second);
-	if (!equal) {
-	  derr << "fsck error: " << oid << " blob " << *i.first
-	       << " doesn't match expected ref_map " << i.second << dendl;
-	  ++errors;
+	  ++walk_errors;
 	}
-	if (blob.is_compressed()) {
-	  onode_statfs.data_compressed += blob.get_compressed_payload_length();
-	  onode_statfs.data_compressed_original +=
-	    i.first->get_referenced_bytes();
-	}
-	if (blob.is_shared()) {
-	  if (i.first->shared_blob->get_sbid() > blobid_max) {
-	    derr << "fsck error: " << oid << " blob " << blob
-		 << " sbid " << i.first->shared_blob->get_sbid() << " > blobid_max "
-		 << blobid_max << dendl;
-	    ++errors;
-	  } else if (i.first->shared_blob->get_sbid() == 0) {
-            derr << "fsck error: " << oid << " blob " << blob
-                 << " marked as shared but has uninitialized sbid"
-                 << dendl;
-            ++errors;
-          }
-	  sb_info_t& sbi = sb_info[i.first->shared_blob->get_sbid()];
-	  ceph_assert(sbi.cid == coll_t() || sbi.cid == c->cid);
-	  ceph_assert(sbi.pool_id == INT64_MIN ||
-	              sbi.pool_id == oid.hobj.get_logical_pool());
-	  sbi.cid = c->cid;
-	  sbi.pool_id = oid.hobj.get_logical_pool();
-	  sbi.sb = i.first->shared_blob;
-	  sbi.oids.push_back(oid);
-	  sbi.compressed = blob.is_compressed();
-	  for (auto e : blob.get_extents()) {
-	    if (e.is_valid()) {
-	      sbi.ref_map.get(e.offset, e.length);
-	    }
-	  }
-	} else {
-	  errors += _fsck_check_extents(c->cid, oid, blob.get_extents(),
-					blob.is_compressed(),
-					used_blocks,
-					fm->get_alloc_size(),
-					repair ? &repairer : nullptr,
-					onode_statfs);
-        }
       }
-      if (deep) {
-	bufferlist bl;
-	uint64_t max_read_block = cct->_conf->bluestore_fsck_read_bytes_cap;
-	uint64_t offset = 0;
-	do {
-	  uint64_t l = std::min(uint64_t(o->onode.size - offset), max_read_block);
-	  int r = _do_read(c.get(), o, offset, l, bl,
-	    CEPH_OSD_OP_FLAG_FADVISE_NOCACHE);
-	  if (r < 0) {
-	    ++errors;
-	    derr << "fsck error: " << oid << std::hex
-	         << " error during read: "
-		 << " " << offset << "~" << l
-		 << " " << cpp_strerror(r) << std::dec
-		 << dendl;
-	    break;
-	  }
-	  offset += l;
-	} while (offset < o->onode.size);
-      }
-      // omap
-      if (o->onode.has_omap()) {
-	auto& m =
-	  o->onode.is_pgmeta_omap() ? used_pgmeta_omap_head : used_omap_head;
-	if (m.count(o->onode.nid)) {
-	  derr << "fsck error: " << oid << " omap_head " << o->onode.nid
-	       << " already in use" << dendl;
-	  ++errors;
-	} else {
-	  m.insert(o->onode.nid);
-	}
+      batch.push_back(fsck_item_t{c, o, expected_statfs});
+      if (batch.size() >= batch_size) {
+	submit_batch();
       }
-      expected_statfs->add(onode_statfs);
     } // for (it->lower_bound(string()); it->valid(); it->next())
+
+    if (!aborted) {
+      submit_batch();
+    }
+    {
+      std::lock_guard l(wq_lock);
+      wq_stop = true;
+      if (aborted) {
+	wq.clear();
+      }
+      wq_cond.notify_all();
+    }
+    for (auto& t : workers) {
+      t.join();
+    }
+    errors += walk_errors;
+    if (aborted) {
+      goto out_scan;
+    }
   } // if (it)
 
   dout(1) << __func__ << " checking shared_blobs" << dendl;
@@ -8300,8 +8794,11 @@ void BlueStore::_update_cache_logger()
   uint64_t num_blobs = 0;
   uint64_t num_buffers = 0;
   uint64_t num_buffer_bytes = 0;
-  for (auto c : cache_shards) {
-    c->add_stats(&num_onodes, &num_extents, &num_blobs,
+  for (auto c : onode_cache_shards) {
+    c->add_stats(&num_onodes);
+  }
+  for (auto c : buffer_cache_shards) {
+    c->add_stats(&num_extents, &num_blobs,
 		 &num_buffers, &num_buffer_bytes);
   }
   logger->set(l_bluestore_onodes, num_onodes);
@@ -8325,7 +8822,8 @@ ObjectStore::CollectionHandle BlueStore::create_new_collection(
   RWLock::WLocker l(coll_lock);
   Collection *c = new Collection(
     this,
-    cache_shards[cid.hash_to_shard(cache_shards.size())],
+    onode_cache_shards[cid.hash_to_shard(onode_cache_shards.size())],
+    buffer_cache_shards[cid.hash_to_shard(buffer_cache_shards.size())],
     cid);
   new_coll_map[cid] = c;
   _osr_attach(c);
@@ -8441,7 +8939,19 @@ int BlueStore::read(
     if (offset == length && offset == 0)
       length = o->onode.size;
 
-    r = _do_read(c, o, offset, length, bl, op_flags);
+    uint64_t ra = _get_readahead(c, o.get(), offset, length, op_flags);
+    if (ra) {
+      // extend the read so that the readahead goes out with the same
+      // device io, and keep what we did not ask for in the cache
+      r = _do_read(c, o, offset, length + ra, bl,
+		   op_flags | CEPH_OSD_OP_FLAG_FADVISE_WILLNEED);
+      if (r > (int)length) {
+	bl.splice(length, bl.length() - length);
+	r = length;
+      }
+    } else {
+      r = _do_read(c, o, offset, length, bl, op_flags);
+    }
     if (r == -EIO) {
       logger->inc(l_bluestore_read_eio);
     }
@@ -8513,6 +9023,84 @@ struct read_req_t {
 typedef list<read_req_t> regions2read_t;
 typedef map<BlueStore::BlobRef, regions2read_t> blobs2read_t;
 
+// Holes are handed out as references to a single zeroed buffer instead
+// of being allocated and memset() for every read.  This is safe for the
+// same reason sharing cached buffers with the caller is: read results
+// are never modified in place.
+static const size_t ZERO_BUFFER_SIZE = 64 * 1024;
+
+static void append_zero_shared(bufferlist& bl, uint64_t len)
+{
+  // never freed, so that it does not race the mempool teardown at exit
+  static const bufferptr *zero = [] {
+    auto p = new bufferptr(buffer::create_page_aligned(ZERO_BUFFER_SIZE));
+    p->zero(false);
+    return p;
+  }();
+  while (len > 0) {
+    uint64_t l = std::min<uint64_t>(len, ZERO_BUFFER_SIZE);
+    bl.append(*zero, 0, l);
+    len -= l;
+  }
+}
+
+uint64_t BlueStore::_get_readahead(
+  Collection *c,
+  Onode *o,
+  uint64_t offset,
+  size_t length,
+  uint32_t op_flags)
+{
+  uint64_t max = readahead_max;
+  if (!max || !length ||
+      (op_flags & (CEPH_OSD_OP_FLAG_FADVISE_DONTNEED |
+		   CEPH_OSD_OP_FLAG_FADVISE_NOCACHE |
+		   CEPH_OSD_OP_FLAG_FADVISE_RANDOM |
+		   CEPH_OSD_OP_FLAG_BYPASS_CLEAN_CACHE))) {
+    return 0;
+  }
+  uint64_t end = offset + length;
+  uint64_t expected = o->ra_next.exchange(end);
+  if (offset != expected) {
+    // not sequential (or the first read); start over
+    o->ra_seq = 0;
+    o->ra_window = 0;
+    o->ra_end = 0;
+    return 0;
+  }
+  uint64_t ra_end = o->ra_end;
+  if (offset < ra_end) {
+    logger->inc(l_bluestore_readahead_hit_bytes,
+		std::min(end, ra_end) - offset);
+  }
+  if (++o->ra_seq < cct->_conf->bluestore_readahead_trigger_requests) {
+    return 0;
+  }
+  // don't let a single stream push everything else out of its cache shard
+  max = std::min<uint64_t>(max, c->cache->max / 8);
+  if (end >= o->onode.size || max < block_size) {
+    return 0;
+  }
+  uint64_t window = o->ra_window;
+  if (ra_end > end && ra_end - end >= window / 2) {
+    // enough read ahead already
+    return 0;
+  }
+  // start with the read size, double for every readahead after that
+  window = std::min(max, std::max<uint64_t>(window * 2, length));
+  window = p2roundup(window, (uint64_t)block_size);
+  uint64_t ra_to = std::min<uint64_t>(std::max(end, ra_end) + window,
+				      o->onode.size);
+  o->ra_window = window;
+  o->ra_end = ra_to;
+  dout(20) << __func__ << " " << o->oid << " 0x" << std::hex << offset
+	   << "~" << length << " readahead to 0x" << ra_to
+	   << " window 0x" << window << std::dec << dendl;
+  logger->inc(l_bluestore_readahead_ops);
+  logger->inc(l_bluestore_readahead_bytes, ra_to - std::max(end, ra_end));
+  return ra_to - end;
+}
+
 int BlueStore::_do_read(
   Collection *c,
   OnodeRef o,
@@ -8842,7 +9430,7 @@ int BlueStore::_do_read(
       dout(30) << __func__ << " assemble 0x" << std::hex << pos
 	       << ": zeros for 0x" << (pos + offset) << "~" << l
 	       << std::dec << dendl;
-      bl.append_zero(l);
+      append_zero_shared(bl, l);
       pos += l;
     }
   }
@@ -9351,10 +9939,11 @@ int BlueStore::omap_get(
   {
     const string& prefix =
       o->onode.is_pgmeta_omap() ? PREFIX_PGMETA_OMAP : PREFIX_OMAP;
-    KeyValueDB::Iterator it = db->get_iterator(prefix);
     string head, tail;
     get_omap_header(o->onode.nid, &head);
     get_omap_tail(o->onode.nid, &tail);
+    KeyValueDB::Iterator it = db->get_iterator(
+      prefix, _omap_iterator_hints(head, tail));
     it->lower_bound(head);
     while (it->valid()) {
       if (it->key() == head) {
@@ -9439,10 +10028,11 @@ int BlueStore::omap_get_keys(
   {
     const string& prefix =
       o->onode.is_pgmeta_omap() ? PREFIX_PGMETA_OMAP : PREFIX_OMAP;
-    KeyValueDB::Iterator it = db->get_iterator(prefix);
     string head, tail;
     get_omap_key(o->onode.nid, string(), &head);
     get_omap_tail(o->onode.nid, &tail);
+    KeyValueDB::Iterator it = db->get_iterator(
+      prefix, _omap_iterator_hints(head, tail));
     it->lower_bound(head);
     while (it->valid()) {
       if (it->key() >= tail) {
@@ -9490,15 +10080,23 @@ int BlueStore::omap_get_values(
     o->flush();
     _key_encode_u64(o->onode.nid, &final_key);
     final_key.push_back('.');
-    for (set<string>::const_iterator p = keys.begin(); p != keys.end(); ++p) {
+    // fetch all keys in a single batched lookup
+    set<string> final_keys;
+    for (auto p = keys.begin(); p != keys.end(); ++p) {
       final_key.resize(9); // keep prefix
       final_key += *p;
-      bufferlist val;
-      if (db->get(prefix, final_key, &val) >= 0) {
-	dout(30) << __func__ << "  got " << pretty_binary_string(final_key)
-		 << " -> " << *p << dendl;
-	out->insert(make_pair(*p, val));
-      }
+      final_keys.emplace_hint(final_keys.end(), final_key);
+    }
+    map<string, bufferlist> vals;
+    db->get(prefix, final_keys, &vals);
+    auto hint = out->end();
+    for (auto& [k, v] : vals) {
+      string user_key;
+      decode_omap_key(k, &user_key);
+      dout(30) << __func__ << "  got " << pretty_binary_string(k)
+	       << " -> " << user_key << dendl;
+      hint = out->emplace_hint(hint, std::move(user_key), std::move(v));
+      ++hint;
     }
   }
  out:
@@ -9534,17 +10132,26 @@ int BlueStore::omap_check_keys(
     o->flush();
     _key_encode_u64(o->onode.nid, &final_key);
     final_key.push_back('.');
-    for (set<string>::const_iterator p = keys.begin(); p != keys.end(); ++p) {
+    set<string> final_keys;
+    for (auto p = keys.begin(); p != keys.end(); ++p) {
       final_key.resize(9); // keep prefix
       final_key += *p;
-      bufferlist val;
-      if (db->get(prefix, final_key, &val) >= 0) {
-	dout(30) << __func__ << "  have " << pretty_binary_string(final_key)
-		 << " -> " << *p << dendl;
-	out->insert(*p);
+      final_keys.emplace_hint(final_keys.end(), final_key);
+    }
+    map<string, bufferlist> vals;
+    db->get(prefix, final_keys, &vals);
+    auto hint = out->end();
+    for (auto& k : final_keys) {
+      string user_key;
+      decode_omap_key(k, &user_key);
+      if (vals.count(k)) {
+	dout(30) << __func__ << "  have " << pretty_binary_string(k)
+		 << " -> " << user_key << dendl;
+	hint = out->emplace_hint(hint, std::move(user_key));
+	++hint;
       } else {
-	dout(30) << __func__ << "  miss " << pretty_binary_string(final_key)
-		 << " -> " << *p << dendl;
+	dout(30) << __func__ << "  miss " << pretty_binary_string(k)
+		 << " -> " << user_key << dendl;
       }
     }
   }
@@ -9572,11 +10179,31 @@ ObjectMap::ObjectMapIterator BlueStore::get_omap_iterator(
   }
   o->flush();
   dout(10) << __func__ << " has_omap = " << (int)o->onode.has_omap() <<dendl;
-  KeyValueDB::Iterator it = db->get_iterator(
-    o->onode.is_pgmeta_omap() ? PREFIX_PGMETA_OMAP : PREFIX_OMAP);
+  const string& prefix =
+    o->onode.is_pgmeta_omap() ? PREFIX_PGMETA_OMAP : PREFIX_OMAP;
+  KeyValueDB::Iterator it;
+  if (o->onode.has_omap()) {
+    string head, tail;
+    get_omap_key(o->onode.nid, string(), &head);
+    get_omap_tail(o->onode.nid, &tail);
+    it = db->get_iterator(prefix, _omap_iterator_hints(head, tail));
+  } else {
+    it = db->get_iterator(prefix);
+  }
   return ObjectMap::ObjectMapIterator(new OmapIteratorImpl(c, o, it));
 }
 
+KeyValueDB::IteratorHints BlueStore::_omap_iterator_hints(
+  const string& head,
+  const string& tail)
+{
+  KeyValueDB::IteratorHints hints;
+  hints.lower_bound = head;
+  hints.upper_bound = tail;
+  hints.readahead = cct->_conf->bluestore_omap_readahead;
+  return hints;
+}
+
 // -----------------
 // write helpers
 
@@ -9721,6 +10348,7 @@ int BlueStore::_open_super_meta()
   _set_csum();
   _set_compression();
   _set_blob_size();
+  _set_readahead();
 
   _validate_bdev();
   return 0;
@@ -10108,8 +10736,9 @@ void BlueStore::_txc_applied_kv(TransContext *txc)
       dout(20) << __func__ << " onode " << o << " had " << o->flushing_count
 	       << dendl;
       if (--o->flushing_count == 0) {
-        std::lock_guard l(o->flush_lock);
-	o->flush_cond.notify_all();
+	auto& stripe = _get_onode_flush_stripe(o.get());
+	std::lock_guard l(stripe.lock);
+	stripe.cond.notify_all();
       }
     }
   }
@@ -10222,6 +10851,11 @@ void BlueStore::_txc_finish(TransContext *txc)
 void BlueStore::_txc_release_alloc(TransContext *txc)
 {
   // it's expected we're called with lazy_release_lock already taken!
+  if (block_cache) {
+    for (auto p = txc->released.begin(); p != txc->released.end(); ++p) {
+      block_cache->release(p.get_start(), p.get_len());
+    }
+  }
   if (likely(!cct->_conf->bluestore_debug_no_reuse_blocks)) {
     int r = 0;
     if (cct->_conf->bdev_enable_discard && cct->_conf->bdev_async_discard) {
@@ -10397,13 +11031,24 @@ void BlueStore::_kv_start()
 
   deferred_finisher.start();
   finisher.start();
+  kv_commit_pipeline_depth =
+    cct->_conf.get_val<uint64_t>("bluestore_kv_commit_pipeline_depth");
   kv_sync_thread.create("bstore_kv_sync");
+  if (kv_commit_pipeline_depth) {
+    kv_commit_thread.create("bstore_kv_commit");
+  }
   kv_finalize_thread.create("bstore_kv_final");
+  if (block_cache) {
+    block_cache->start_destage();
+  }
 }
 
 void BlueStore::_kv_stop()
 {
   dout(10) << __func__ << dendl;
+  if (block_cache) {
+    block_cache->stop_destage();
+  }
   {
     std::unique_lock l(kv_lock);
     while (!kv_sync_started) {
@@ -10412,6 +11057,19 @@ void BlueStore::_kv_stop()
     kv_stop = true;
     kv_cond.notify_all();
   }
+  kv_sync_thread.join();
+  if (kv_commit_pipeline_depth) {
+    // kv_sync_thread is gone; let the commit thread drain what it queued
+    {
+      std::unique_lock l(kv_commit_lock);
+      while (!kv_commit_started) {
+	kv_commit_cond.wait(l);
+      }
+      kv_commit_stop = true;
+      kv_commit_cond.notify_all();
+    }
+    kv_commit_thread.join();
+  }
   {
     std::unique_lock l(kv_finalize_lock);
     while (!kv_finalize_started) {
@@ -10420,13 +11078,16 @@ void BlueStore::_kv_stop()
     kv_finalize_stop = true;
     kv_finalize_cond.notify_all();
   }
-  kv_sync_thread.join();
   kv_finalize_thread.join();
   ceph_assert(removed_collections.empty());
   {
     std::lock_guard l(kv_lock);
     kv_stop = false;
   }
+  {
+    std::lock_guard l(kv_commit_lock);
+    kv_commit_stop = false;
+  }
   {
     std::lock_guard l(kv_finalize_lock);
     kv_finalize_stop = false;
@@ -10461,6 +11122,7 @@ void BlueStore::_kv_sync_thread()
       deque<TransContext*> kv_submitting;
       deque<DeferredBatch*> deferred_done, deferred_stable;
       uint64_t aios = 0, costs = 0;
+      KVCommitBatch batch;
 
       dout(20) << __func__ << " committing " << kv_queue.size()
 	       << " submitting " << kv_queue_unsubmitted.size()
@@ -10476,13 +11138,14 @@ void BlueStore::_kv_sync_thread()
       kv_ios = 0;
       kv_throttle_costs = 0;
       l.unlock();
+      logger->inc(l_bluestore_kv_sync_batch, kv_committing.size());
 
       dout(30) << __func__ << " committing " << kv_committing << dendl;
       dout(30) << __func__ << " submitting " << kv_submitting << dendl;
       dout(30) << __func__ << " deferred_done " << deferred_done << dendl;
       dout(30) << __func__ << " deferred_stable " << deferred_stable << dendl;
 
-      auto start = mono_clock::now();
+      batch.start = mono_clock::now();
 
       bool force_flush = false;
       // if bluefs is sharing the same device as data (only), then we
@@ -10517,7 +11180,13 @@ void BlueStore::_kv_sync_thread()
 			       deferred_done.end());
 	deferred_done.clear();
       }
-      auto after_flush = mono_clock::now();
+      batch.after_flush = mono_clock::now();
+
+      // the block cache map must reach the kv store ahead of any txc
+      // referring to data it has absorbed.
+      if (block_cache) {
+	batch.block_cache_gen = block_cache->submit_meta(false);
+      }
 
       // we will use one final transaction to force a sync
       KeyValueDB::Transaction synct = db->get_transaction();
@@ -10577,9 +11246,9 @@ void BlueStore::_kv_sync_thread()
       throttle_bytes.put(costs);
 
       if (bluefs &&
-	  after_flush - bluefs_last_balance >
+	  batch.after_flush - bluefs_last_balance >
 	  ceph::make_timespan(cct->_conf->bluestore_bluefs_balance_interval)) {
-	bluefs_last_balance = after_flush;
+	bluefs_last_balance = batch.after_flush;
 	int r = _balance_bluefs_freespace();
 	ceph_assert(r >= 0);
       }
@@ -10595,90 +11264,147 @@ void BlueStore::_kv_sync_thread()
 	}
       }
 
-      // submit synct synchronously (block and wait for it to commit)
-      int r = cct->_conf->bluestore_debug_omit_kv_commit ? 0 : db->submit_transaction_sync(synct);
-      ceph_assert(r == 0);
-
-      {
-	std::unique_lock m(kv_finalize_lock);
-	if (kv_committing_to_finalize.empty()) {
-	  kv_committing_to_finalize.swap(kv_committing);
-	} else {
-	  kv_committing_to_finalize.insert(
-	      kv_committing_to_finalize.end(),
-	      kv_committing.begin(),
-	      kv_committing.end());
-	  kv_committing.clear();
-	}
-	if (deferred_stable_to_finalize.empty()) {
-	  deferred_stable_to_finalize.swap(deferred_stable);
-	} else {
-	  deferred_stable_to_finalize.insert(
-	      deferred_stable_to_finalize.end(),
-	      deferred_stable.begin(),
-	      deferred_stable.end());
-	  deferred_stable.clear();
-	}
-	kv_finalize_cond.notify_one();
+      batch.committing.swap(kv_committing);
+      batch.deferred_stable.swap(deferred_stable);
+      batch.synct = synct;
+      batch.new_nid_max = new_nid_max;
+      batch.new_blobid_max = new_blobid_max;
+      batch.bluefs_extents_reclaiming.swap(bluefs_extents_reclaiming);
+      if (kv_commit_pipeline_depth) {
+	// hand the sync off and start preparing the next batch while it
+	// is in progress; batches are synced (and finalized) in order.
+	std::unique_lock m(kv_commit_lock);
+	kv_commit_cond.wait(m, [&] {
+	    return kv_commit_queue.size() < kv_commit_pipeline_depth;
+	  });
+	kv_commit_queue.emplace_back(std::move(batch));
+	logger->set(l_bluestore_kv_commit_queue, kv_commit_queue.size());
+	kv_commit_cond.notify_all();
+      } else {
+	_kv_commit_batch(batch);
       }
 
-      if (new_nid_max) {
-	nid_max = new_nid_max;
-	dout(10) << __func__ << " nid_max now " << nid_max << dendl;
-      }
-      if (new_blobid_max) {
-	blobid_max = new_blobid_max;
-	dout(10) << __func__ << " blobid_max now " << blobid_max << dendl;
-      }
+      l.lock();
+      // previously deferred "done" are now "stable" by virtue of this
+      // commit cycle.
+      deferred_stable_queue.swap(deferred_done);
+    }
+  }
+  dout(10) << __func__ << " finish" << dendl;
+  kv_sync_started = false;
+}
 
-      {
-	auto finish = mono_clock::now();
-	ceph::timespan dur_flush = after_flush - start;
-	ceph::timespan dur_kv = finish - after_flush;
-	ceph::timespan dur = finish - start;
-	dout(20) << __func__ << " committed " << kv_committing.size()
-	  << " cleaned " << deferred_stable.size()
-	  << " in " << dur
-	  << " (" << dur_flush << " flush + " << dur_kv << " kv commit)"
-	  << dendl;
-	LOG_LATENCY(logger, cct, "kv_flush",
-	  l_bluestore_kv_flush_lat, dur_flush);
-	LOG_LATENCY(logger, cct, "kv_commit",
-	  l_bluestore_kv_commit_lat, dur_kv);
-	LOG_LATENCY(logger, cct, "kv_sync",
-	  l_bluestore_kv_sync_lat, dur);
-      }
-
-      if (bluefs) {
-	if (!bluefs_extents_reclaiming.empty()) {
-	  dout(0) << __func__ << " releasing old bluefs 0x" << std::hex
-		   << bluefs_extents_reclaiming << std::dec << dendl;
-	  int r = 0;
-	  if (cct->_conf->bdev_enable_discard && cct->_conf->bdev_async_discard) {
-	    r = bdev->queue_discard(bluefs_extents_reclaiming);
-	    if (r == 0) {
-	      goto clear;
-	    }
-	  } else if (cct->_conf->bdev_enable_discard) {
-	    for (auto p = bluefs_extents_reclaiming.begin(); p != bluefs_extents_reclaiming.end(); ++p) {
-	      bdev->discard(p.get_start(), p.get_len());
-	    }
-	  }
+void BlueStore::_kv_commit_batch(KVCommitBatch& b)
+{
+  // submit synct synchronously (block and wait for it to commit)
+  int r = cct->_conf->bluestore_debug_omit_kv_commit ? 0 : db->submit_transaction_sync(b.synct);
+  ceph_assert(r == 0);
+  if (b.block_cache_gen) {
+    block_cache->meta_committed(b.block_cache_gen);
+  }
 
-	  alloc->release(bluefs_extents_reclaiming);
-clear:
-	  bluefs_extents_reclaiming.clear();
+  auto committed = b.committing.size();
+  auto cleaned = b.deferred_stable.size();
+  {
+    std::unique_lock m(kv_finalize_lock);
+    if (kv_committing_to_finalize.empty()) {
+      kv_committing_to_finalize.swap(b.committing);
+    } else {
+      kv_committing_to_finalize.insert(
+	  kv_committing_to_finalize.end(),
+	  b.committing.begin(),
+	  b.committing.end());
+      b.committing.clear();
+    }
+    if (deferred_stable_to_finalize.empty()) {
+      deferred_stable_to_finalize.swap(b.deferred_stable);
+    } else {
+      deferred_stable_to_finalize.insert(
+	  deferred_stable_to_finalize.end(),
+	  b.deferred_stable.begin(),
+	  b.deferred_stable.end());
+      b.deferred_stable.clear();
+    }
+    logger->set(l_bluestore_kv_final_queue, kv_committing_to_finalize.size());
+    kv_finalize_cond.notify_one();
+  }
+
+  if (b.new_nid_max) {
+    nid_max = b.new_nid_max;
+    dout(10) << __func__ << " nid_max now " << nid_max << dendl;
+  }
+  if (b.new_blobid_max) {
+    blobid_max = b.new_blobid_max;
+    dout(10) << __func__ << " blobid_max now " << blobid_max << dendl;
+  }
+
+  {
+    auto finish = mono_clock::now();
+    ceph::timespan dur_flush = b.after_flush - b.start;
+    ceph::timespan dur_kv = finish - b.after_flush;
+    ceph::timespan dur = finish - b.start;
+    dout(20) << __func__ << " committed " << committed
+      << " cleaned " << cleaned
+      << " in " << dur
+      << " (" << dur_flush << " flush + " << dur_kv << " kv commit)"
+      << dendl;
+    LOG_LATENCY(logger, cct, "kv_flush",
+      l_bluestore_kv_flush_lat, dur_flush);
+    LOG_LATENCY(logger, cct, "kv_commit",
+      l_bluestore_kv_commit_lat, dur_kv);
+    LOG_LATENCY(logger, cct, "kv_sync",
+      l_bluestore_kv_sync_lat, dur);
+  }
+
+  if (bluefs) {
+    if (!b.bluefs_extents_reclaiming.empty()) {
+      dout(0) << __func__ << " releasing old bluefs 0x" << std::hex
+	       << b.bluefs_extents_reclaiming << std::dec << dendl;
+      int r = 0;
+      if (cct->_conf->bdev_enable_discard && cct->_conf->bdev_async_discard) {
+	r = bdev->queue_discard(b.bluefs_extents_reclaiming);
+	if (r == 0) {
+	  goto clear;
+	}
+      } else if (cct->_conf->bdev_enable_discard) {
+	for (auto p = b.bluefs_extents_reclaiming.begin(); p != b.bluefs_extents_reclaiming.end(); ++p) {
+	  bdev->discard(p.get_start(), p.get_len());
 	}
       }
 
+      alloc->release(b.bluefs_extents_reclaiming);
+clear:
+      b.bluefs_extents_reclaiming.clear();
+    }
+  }
+}
+
+void BlueStore::_kv_commit_thread()
+{
+  dout(10) << __func__ << " start" << dendl;
+  std::unique_lock l(kv_commit_lock);
+  ceph_assert(!kv_commit_started);
+  kv_commit_started = true;
+  kv_commit_cond.notify_all();
+  while (true) {
+    if (kv_commit_queue.empty()) {
+      if (kv_commit_stop)
+	break;
+      dout(20) << __func__ << " sleep" << dendl;
+      kv_commit_cond.wait(l);
+      dout(20) << __func__ << " wake" << dendl;
+    } else {
+      KVCommitBatch b = std::move(kv_commit_queue.front());
+      kv_commit_queue.pop_front();
+      logger->set(l_bluestore_kv_commit_queue, kv_commit_queue.size());
+      kv_commit_cond.notify_all();  // kv_sync_thread may be waiting for room
+      l.unlock();
+      _kv_commit_batch(b);
       l.lock();
-      // previously deferred "done" are now "stable" by virtue of this
-      // commit cycle.
-      deferred_stable_queue.swap(deferred_done);
     }
   }
   dout(10) << __func__ << " finish" << dendl;
-  kv_sync_started = false;
+  kv_commit_started = false;
 }
 
 void BlueStore::_kv_finalize_thread()
@@ -10704,6 +11430,8 @@ void BlueStore::_kv_finalize_thread()
       kv_committed.swap(kv_committing_to_finalize);
       deferred_stable.swap(deferred_stable_to_finalize);
       l.unlock();
+      logger->set(l_bluestore_kv_final_queue, 0);
+      logger->inc(l_bluestore_kv_final_batch, kv_committed.size());
       dout(20) << __func__ << " kv_committed " << kv_committed << dendl;
       dout(20) << __func__ << " deferred_stable " << deferred_stable << dendl;
 
@@ -10796,12 +11524,22 @@ void BlueStore::deferred_try_submit()
   dout(20) << __func__ << " " << deferred_queue.size() << " osrs, "
 	   << deferred_queue_size << " txcs" << dendl;
   std::lock_guard l(deferred_lock);
-  vector<OpSequencerRef> osrs;
+  // submit the batches in ascending LBA order (of their first extent) so
+  // that a rotational device sees one sweep instead of one seek per osr.
+  vector<pair<uint64_t,OpSequencerRef>> osrs;
   osrs.reserve(deferred_queue.size());
   for (auto& osr : deferred_queue) {
-    osrs.push_back(&osr);
+    uint64_t lba = 0;
+    if (osr.deferred_pending && !osr.deferred_pending->iomap.empty()) {
+      lba = osr.deferred_pending->iomap.begin()->first;
+    }
+    osrs.emplace_back(lba, &osr);
   }
-  for (auto& osr : osrs) {
+  std::stable_sort(osrs.begin(), osrs.end(),
+		   [](const auto& a, const auto& b) {
+		     return a.first < b.first;
+		   });
+  for (auto& [lba, osr] : osrs) {
     if (osr->deferred_pending) {
       if (!osr->deferred_running) {
 	_deferred_submit_unlock(osr.get());
@@ -10836,7 +11574,11 @@ void BlueStore::_deferred_submit_unlock(OpSequencer *osr)
   for (auto& txc : b->txcs) {
     txc.log_state_latency(logger, l_bluestore_state_deferred_queued_lat);
   }
+  // iomap is sorted by offset and has no overlaps (see _discard), so
+  // runs of adjacent extents, possibly from different txcs, go out as
+  // a single sequential write.
   uint64_t start = 0, pos = 0;
+  uint64_t ops = 0;
   bufferlist bl;
   auto i = b->iomap.begin();
   while (true) {
@@ -10845,6 +11587,7 @@ void BlueStore::_deferred_submit_unlock(OpSequencer *osr)
 	dout(20) << __func__ << " write 0x" << std::hex
 		 << start << "~" << bl.length()
 		 << " crc " << bl.crc32c(-1) << std::dec << dendl;
+	++ops;
 	if (!g_conf()->bluestore_debug_omit_block_device_write) {
 	  logger->inc(l_bluestore_deferred_write_ops);
 	  logger->inc(l_bluestore_deferred_write_bytes, bl.length());
@@ -10869,6 +11612,12 @@ void BlueStore::_deferred_submit_unlock(OpSequencer *osr)
     bl.claim_append(i->second.bl);
     ++i;
   }
+  dout(10) << __func__ << " osr " << osr << " " << b->queued_extents
+	   << " extents queued, " << ops << " ios" << dendl;
+  logger->inc(l_bluestore_deferred_write_extents, b->queued_extents);
+  if (b->queued_extents > ops) {
+    logger->inc(l_bluestore_deferred_write_merged, b->queued_extents - ops);
+  }
 
   bdev->aio_submit(&b->ioc);
 }
@@ -13802,7 +14551,11 @@ void BlueStore::generate_db_histogram(Formatter *f)
 void BlueStore::_flush_cache()
 {
   dout(10) << __func__ << dendl;
-  for (auto i : cache_shards) {
+  for (auto i : onode_cache_shards) {
+    i->trim_all();
+    ceph_assert(i->empty());
+  }
+  for (auto i : buffer_cache_shards) {
     i->trim_all();
     ceph_assert(i->empty());
   }
@@ -13828,7 +14581,10 @@ void BlueStore::_flush_cache()
 int BlueStore::flush_cache(ostream *os)
 {
   dout(10) << __func__ << dendl;
-  for (auto i : cache_shards) {
+  for (auto i : onode_cache_shards) {
+    i->trim_all();
+  }
+  for (auto i : buffer_cache_shards) {
     i->trim_all();
   }
 
@@ -19,6 +19,7 @@
 
 #include <unistd.h>
 
+#include <array>
 #include <atomic>
 #include <mutex>
 #include <condition_variable>
@@ -30,6 +31,7 @@
 #include <boost/dynamic_bitset.hpp>
 
 #include "include/ceph_assert.h"
+#include "include/cpp-btree/btree_set.h"
 #include "include/unordered_map.h"
 #include "include/mempool.h"
 #include "common/bloom_filter.hpp"
@@ -46,6 +48,7 @@
 #include "common/EventTrace.h"
 
 class Allocator;
+class CachedDevice;
 class FreelistManager;
 class BlueStoreRepairer;
 
@@ -64,6 +67,10 @@ enum {
   l_bluestore_kv_commit_lat,
   l_bluestore_kv_sync_lat,
   l_bluestore_kv_final_lat,
+  l_bluestore_kv_sync_batch,
+  l_bluestore_kv_commit_queue,
+  l_bluestore_kv_final_queue,
+  l_bluestore_kv_final_batch,
   l_bluestore_state_prepare_lat,
   l_bluestore_state_aio_wait_lat,
   l_bluestore_state_io_done_lat,
@@ -89,6 +96,8 @@ enum {
   l_bluestore_write_pad_bytes,
   l_bluestore_deferred_write_ops,
   l_bluestore_deferred_write_bytes,
+  l_bluestore_deferred_write_extents,
+  l_bluestore_deferred_write_merged,
   l_bluestore_write_penalty_read_ops,
   l_bluestore_allocated,
   l_bluestore_stored,
@@ -122,11 +131,17 @@ enum {
   l_bluestore_gc_merged,
   l_bluestore_read_eio,
   l_bluestore_reads_with_retries,
+  l_bluestore_readahead_ops,
+  l_bluestore_readahead_bytes,
+  l_bluestore_readahead_hit_bytes,
   l_bluestore_fragmentation,
   l_bluestore_omap_seek_to_first_lat,
   l_bluestore_omap_upper_bound_lat,
   l_bluestore_omap_lower_bound_lat,
   l_bluestore_omap_next_lat,
+  l_bluestore_fsck_objects,
+  l_bluestore_fsck_collections,
+  l_bluestore_fsck_collections_total,
   l_bluestore_last
 };
 
@@ -251,7 +266,7 @@ public:
     }
   };
 
-  struct Cache;
+  struct BufferCacheShard;
 
   /// map logical extent range (object) onto buffers
   struct BufferSpace {
@@ -279,7 +294,7 @@ public:
       ceph_assert(writing.empty());
     }
 
-    void _add_buffer(Cache* cache, Buffer *b, int level, Buffer *near) {
+    void _add_buffer(BufferCacheShard* cache, Buffer *b, int level, Buffer *near) {
       cache->_audit("_add_buffer start");
       buffer_map[b->offset].reset(b);
       if (b->is_writing()) {
@@ -299,21 +314,21 @@ public:
         }
       } else {
 	b->data.reassign_to_mempool(mempool::mempool_bluestore_cache_data);
-	cache->_add_buffer(b, level, near);
+	cache->_add(b, level, near);
       }
       cache->_audit("_add_buffer end");
     }
-    void _rm_buffer(Cache* cache, Buffer *b) {
+    void _rm_buffer(BufferCacheShard* cache, Buffer *b) {
       _rm_buffer(cache, buffer_map.find(b->offset));
     }
-    void _rm_buffer(Cache* cache,
+    void _rm_buffer(BufferCacheShard* cache,
 		    map<uint32_t, std::unique_ptr<Buffer>>::iterator p) {
       ceph_assert(p != buffer_map.end());
       cache->_audit("_rm_buffer start");
       if (p->second->is_writing()) {
         writing.erase(writing.iterator_to(*p->second));
       } else {
-	cache->_rm_buffer(p->second.get());
+	cache->_rm(p->second.get());
       }
       buffer_map.erase(p);
       cache->_audit("_rm_buffer end");
@@ -331,16 +346,16 @@ public:
     }
 
     // must be called under protection of the Cache lock
-    void _clear(Cache* cache);
+    void _clear(BufferCacheShard* cache);
 
     // return value is the highest cache_private of a trimmed buffer, or 0.
-    int discard(Cache* cache, uint32_t offset, uint32_t length) {
+    int discard(BufferCacheShard* cache, uint32_t offset, uint32_t length) {
       std::lock_guard l(cache->lock);
       return _discard(cache, offset, length);
     }
-    int _discard(Cache* cache, uint32_t offset, uint32_t length);
+    int _discard(BufferCacheShard* cache, uint32_t offset, uint32_t length);
 
-    void write(Cache* cache, uint64_t seq, uint32_t offset, bufferlist& bl,
+    void write(BufferCacheShard* cache, uint64_t seq, uint32_t offset, bufferlist& bl,
 	       unsigned flags) {
       std::lock_guard l(cache->lock);
       Buffer *b = new Buffer(this, Buffer::STATE_WRITING, seq, offset, bl,
@@ -348,26 +363,26 @@ public:
       b->cache_private = _discard(cache, offset, bl.length());
       _add_buffer(cache, b, (flags & Buffer::FLAG_NOCACHE) ? 0 : 1, nullptr);
     }
-    void _finish_write(Cache* cache, uint64_t seq);
-    void did_read(Cache* cache, uint32_t offset, bufferlist& bl) {
+    void _finish_write(BufferCacheShard* cache, uint64_t seq);
+    void did_read(BufferCacheShard* cache, uint32_t offset, bufferlist& bl) {
       std::lock_guard l(cache->lock);
       Buffer *b = new Buffer(this, Buffer::STATE_CLEAN, 0, offset, bl);
       b->cache_private = _discard(cache, offset, bl.length());
       _add_buffer(cache, b, 1, nullptr);
     }
 
-    void read(Cache* cache, uint32_t offset, uint32_t length,
+    void read(BufferCacheShard* cache, uint32_t offset, uint32_t length,
 	      BlueStore::ready_regions_t& res,
 	      interval_set<uint32_t>& res_intervals,
 	      int flags = 0);
 
-    void truncate(Cache* cache, uint32_t offset) {
+    void truncate(BufferCacheShard* cache, uint32_t offset) {
       discard(cache, offset, (uint32_t)-1 - offset);
     }
 
-    void split(Cache* cache, size_t pos, BufferSpace &r);
+    void split(BufferCacheShard* cache, size_t pos, BufferSpace &r);
 
-    void dump(Cache* cache, Formatter *f) const {
+    void dump(BufferCacheShard* cache, Formatter *f) const {
       std::lock_guard l(cache->lock);
       f->open_array_section("buffers");
       for (auto& i : buffer_map) {
@@ -431,7 +446,7 @@ public:
     friend bool operator==(const SharedBlob &l, const SharedBlob &r) {
       return l.get_sbid() == r.get_sbid();
     }
-    inline Cache* get_cache() {
+    inline BufferCacheShard* get_cache() {
       return coll ? coll->cache : nullptr;
     }
     inline SharedBlobSet* get_parent() {
@@ -1038,6 +1053,22 @@ public:
     MEMPOOL_CLASS_HELPERS();
 
     std::atomic_int nref;  ///< reference count
+    bool exists;              ///< true if object logically exists
+
+    // track txc's that have not been committed to kv store (and whose
+    // effects cannot be read via the kvdb read methods).  waiters block
+    // on the store's onode_flush_stripes rather than a per-onode
+    // mutex/condvar pair, which would cost ~90 bytes per cached onode.
+    std::atomic<int> flushing_count = {0};
+
+    // sequential read detection, see BlueStore::_get_readahead().  these
+    // are updated by concurrent readers without a lock; a race merely
+    // costs us a readahead decision.
+    std::atomic<uint32_t> ra_seq = {0};     ///< sequential reads in a row
+    std::atomic<uint32_t> ra_window = {0};  ///< current readahead window
+    std::atomic<uint64_t> ra_next = {0};    ///< where a sequential read starts
+    std::atomic<uint64_t> ra_end = {0};     ///< end of data read ahead
+
     Collection *c;
 
     ghobject_t oid;
@@ -1048,30 +1079,24 @@ public:
     boost::intrusive::list_member_hook<> lru_item;
 
     bluestore_onode_t onode;  ///< metadata stored as value in kv store
-    bool exists;              ///< true if object logically exists
 
     ExtentMap extent_map;
 
-    // track txc's that have not been committed to kv store (and whose
-    // effects cannot be read via the kvdb read methods)
-    std::atomic<int> flushing_count = {0};
-    /// protect flush_txns
-    ceph::mutex flush_lock = ceph::make_mutex("BlueStore::Onode::flush_lock");
-    ceph::condition_variable flush_cond;   ///< wait here for uncommitted txns
-
     Onode(Collection *c, const ghobject_t& o,
 	  const mempool::bluestore_cache_other::string& k)
       : nref(0),
+	exists(false),
 	c(c),
 	oid(o),
 	key(k),
-	exists(false),
 	extent_map(this) {
     }
 
     void dump(Formatter* f) const;
 
     void flush();
+    /// copy all attr values into one buffer, instead of one per attr
+    void pack_attrs();
     void get() {
       ++nref;
     }
@@ -1083,66 +1108,31 @@ public:
   typedef boost::intrusive_ptr<Onode> OnodeRef;
 
 
-  /// a cache (shard) of onodes and buffers
-  struct Cache {
-    CephContext* cct;
+  /// a generic cache shard
+  struct CacheShard {
+    CephContext *cct;
     PerfCounters *logger;
 
     /// protect lru and other structures
-    ceph::recursive_mutex lock = {
-      ceph::make_recursive_mutex("BlueStore::Cache::lock") };
-
-    std::atomic<uint64_t> num_extents = {0};
-    std::atomic<uint64_t> num_blobs = {0};
+    ceph::mutex lock = ceph::make_mutex("BlueStore::CacheShard::lock");
 
-    std::array<std::pair<ghobject_t, mono_clock::time_point>, 64> dumped_onodes;
-
-    static Cache *create(CephContext* cct, string type, PerfCounters *logger);
-
-    Cache(CephContext* cct) : cct(cct), logger(nullptr) {}
-    virtual ~Cache() {}
-
-    virtual void _add_onode(OnodeRef& o, int level) = 0;
-    virtual void _rm_onode(OnodeRef& o) = 0;
-    virtual void _touch_onode(OnodeRef& o) = 0;
+    std::atomic<uint64_t> max = {0};  ///< trim target, set by MempoolThread
 
-    virtual void _add_buffer(Buffer *b, int level, Buffer *near) = 0;
-    virtual void _rm_buffer(Buffer *b) = 0;
-    virtual void _move_buffer(Cache *src, Buffer *b) = 0;
-    virtual void _adjust_buffer_size(Buffer *b, int64_t delta) = 0;
-    virtual void _touch_buffer(Buffer *b) = 0;
+    CacheShard(CephContext* cct) : cct(cct), logger(nullptr) {}
+    virtual ~CacheShard() {}
 
-    virtual uint64_t _get_num_onodes() = 0;
-    virtual uint64_t _get_buffer_bytes() = 0;
-
-    void add_extent() {
-      ++num_extents;
-    }
-    void rm_extent() {
-      --num_extents;
+    void set_max(uint64_t max_) {
+      max = max_;
     }
 
-    void add_blob() {
-      ++num_blobs;
-    }
-    void rm_blob() {
-      --num_blobs;
+    virtual void _trim_to(uint64_t max) = 0;
+    void trim() {
+      std::lock_guard l(lock);
+      _trim_to(max);
     }
-
-    void trim(uint64_t onode_max, uint64_t buffer_max);
-
-    void trim_all();
-
-    virtual void _trim(uint64_t onode_max, uint64_t buffer_max) = 0;
-
-    virtual void add_stats(uint64_t *onodes, uint64_t *extents,
-			   uint64_t *blobs,
-			   uint64_t *buffers,
-			   uint64_t *bytes) = 0;
-
-    bool empty() {
+    void trim_all() {
       std::lock_guard l(lock);
-      return _get_num_onodes() == 0 && _get_buffer_bytes() == 0;
+      _trim_to(0);
     }
 
 #ifdef DEBUG_CACHE
@@ -1152,196 +1142,75 @@ public:
 #endif
   };
 
-  /// simple LRU cache for onodes and buffers
-  struct LRUCache : public Cache {
-  private:
-    typedef boost::intrusive::list<
-      Onode,
-      boost::intrusive::member_hook<
-        Onode,
-	boost::intrusive::list_member_hook<>,
-	&Onode::lru_item> > onode_lru_list_t;
-    typedef boost::intrusive::list<
-      Buffer,
-      boost::intrusive::member_hook<
-	Buffer,
-	boost::intrusive::list_member_hook<>,
-	&Buffer::lru_item> > buffer_lru_list_t;
+  /// a cache shard of onodes; max is a number of onodes
+  struct OnodeCacheShard : public CacheShard {
+    std::array<std::pair<ghobject_t, mono_clock::time_point>, 64> dumped_onodes;
 
-    onode_lru_list_t onode_lru;
+    static OnodeCacheShard *create(CephContext* cct, string type,
+				   PerfCounters *logger);
 
-    buffer_lru_list_t buffer_lru;
-    uint64_t buffer_size = 0;
+    OnodeCacheShard(CephContext* cct) : CacheShard(cct) {}
 
-  public:
-    LRUCache(CephContext* cct) : Cache(cct) {}
-    uint64_t _get_num_onodes() override {
-      return onode_lru.size();
-    }
-    void _add_onode(OnodeRef& o, int level) override {
-      if (level > 0)
-	onode_lru.push_front(*o);
-      else
-	onode_lru.push_back(*o);
-    }
-    void _rm_onode(OnodeRef& o) override {
-      auto q = onode_lru.iterator_to(*o);
-      onode_lru.erase(q);
-    }
-    void _touch_onode(OnodeRef& o) override;
-
-    uint64_t _get_buffer_bytes() override {
-      return buffer_size;
-    }
-    void _add_buffer(Buffer *b, int level, Buffer *near) override {
-      if (near) {
-	auto q = buffer_lru.iterator_to(*near);
-	buffer_lru.insert(q, *b);
-      } else if (level > 0) {
-	buffer_lru.push_front(*b);
-      } else {
-	buffer_lru.push_back(*b);
-      }
-      buffer_size += b->length;
-    }
-    void _rm_buffer(Buffer *b) override {
-      ceph_assert(buffer_size >= b->length);
-      buffer_size -= b->length;
-      auto q = buffer_lru.iterator_to(*b);
-      buffer_lru.erase(q);
-    }
-    void _move_buffer(Cache *src, Buffer *b) override {
-      src->_rm_buffer(b);
-      _add_buffer(b, 0, nullptr);
-    }
-    void _adjust_buffer_size(Buffer *b, int64_t delta) override {
-      ceph_assert((int64_t)buffer_size + delta >= 0);
-      buffer_size += delta;
-    }
-    void _touch_buffer(Buffer *b) override {
-      auto p = buffer_lru.iterator_to(*b);
-      buffer_lru.erase(p);
-      buffer_lru.push_front(*b);
-      _audit("_touch_buffer end");
-    }
+    virtual void _add(OnodeRef& o, int level) = 0;
+    virtual void _rm(OnodeRef& o) = 0;
+    virtual void _touch(OnodeRef& o) = 0;
 
-    void _trim(uint64_t onode_max, uint64_t buffer_max) override;
+    virtual uint64_t _get_num() = 0;
 
-    void add_stats(uint64_t *onodes, uint64_t *extents,
-		   uint64_t *blobs,
-		   uint64_t *buffers,
-		   uint64_t *bytes) override {
+    virtual void add_stats(uint64_t *onodes) = 0;
+
+    bool empty() {
       std::lock_guard l(lock);
-      *onodes += onode_lru.size();
-      *extents += num_extents;
-      *blobs += num_blobs;
-      *buffers += buffer_lru.size();
-      *bytes += buffer_size;
+      return _get_num() == 0;
     }
-
-#ifdef DEBUG_CACHE
-    void _audit(const char *s) override;
-#endif
   };
 
-  // 2Q cache for buffers, LRU for onodes
-  struct TwoQCache : public Cache {
-  private:
-    // stick with LRU for onodes for now (fixme?)
-    typedef boost::intrusive::list<
-      Onode,
-      boost::intrusive::member_hook<
-        Onode,
-	boost::intrusive::list_member_hook<>,
-	&Onode::lru_item> > onode_lru_list_t;
-    typedef boost::intrusive::list<
-      Buffer,
-      boost::intrusive::member_hook<
-	Buffer,
-	boost::intrusive::list_member_hook<>,
-	&Buffer::lru_item> > buffer_list_t;
+  /// a cache shard of buffers; max is a number of bytes
+  struct BufferCacheShard : public CacheShard {
+    std::atomic<uint64_t> num_extents = {0};
+    std::atomic<uint64_t> num_blobs = {0};
 
-    onode_lru_list_t onode_lru;
+    static BufferCacheShard *create(CephContext* cct, string type,
+				    PerfCounters *logger);
 
-    buffer_list_t buffer_hot;      ///< "Am" hot buffers
-    buffer_list_t buffer_warm_in;  ///< "A1in" newly warm buffers
-    buffer_list_t buffer_warm_out; ///< "A1out" empty buffers we've evicted
-    uint64_t buffer_bytes = 0;     ///< bytes
+    BufferCacheShard(CephContext* cct) : CacheShard(cct) {}
 
-    enum {
-      BUFFER_NEW = 0,
-      BUFFER_WARM_IN,   ///< in buffer_warm_in
-      BUFFER_WARM_OUT,  ///< in buffer_warm_out
-      BUFFER_HOT,       ///< in buffer_hot
-      BUFFER_TYPE_MAX
-    };
+    virtual void _add(Buffer *b, int level, Buffer *near) = 0;
+    virtual void _rm(Buffer *b) = 0;
+    virtual void _move(BufferCacheShard *src, Buffer *b) = 0;
+    virtual void _adjust_size(Buffer *b, int64_t delta) = 0;
+    virtual void _touch(Buffer *b) = 0;
 
-    uint64_t buffer_list_bytes[BUFFER_TYPE_MAX] = {0}; ///< bytes per type
+    virtual uint64_t _get_bytes() = 0;
 
-  public:
-    TwoQCache(CephContext* cct) : Cache(cct) {}
-    uint64_t _get_num_onodes() override {
-      return onode_lru.size();
-    }
-    void _add_onode(OnodeRef& o, int level) override {
-      if (level > 0)
-	onode_lru.push_front(*o);
-      else
-	onode_lru.push_back(*o);
-    }
-    void _rm_onode(OnodeRef& o) override {
-      auto q = onode_lru.iterator_to(*o);
-      onode_lru.erase(q);
-    }
-    void _touch_onode(OnodeRef& o) override;
-
-    uint64_t _get_buffer_bytes() override {
-      return buffer_bytes;
-    }
-    void _add_buffer(Buffer *b, int level, Buffer *near) override;
-    void _rm_buffer(Buffer *b) override;
-    void _move_buffer(Cache *src, Buffer *b) override;
-    void _adjust_buffer_size(Buffer *b, int64_t delta) override;
-    void _touch_buffer(Buffer *b) override {
-      switch (b->cache_private) {
-      case BUFFER_WARM_IN:
-	// do nothing (somewhat counter-intuitively!)
-	break;
-      case BUFFER_WARM_OUT:
-	// move from warm_out to hot LRU
-	ceph_abort_msg("this happens via discard hint");
-	break;
-      case BUFFER_HOT:
-	// move to front of hot LRU
-	buffer_hot.erase(buffer_hot.iterator_to(*b));
-	buffer_hot.push_front(*b);
-	break;
-      }
-      _audit("_touch_buffer end");
+    void add_extent() {
+      ++num_extents;
+    }
+    void rm_extent() {
+      --num_extents;
+    }
+
+    void add_blob() {
+      ++num_blobs;
+    }
+    void rm_blob() {
+      --num_blobs;
     }
 
-    void _trim(uint64_t onode_max, uint64_t buffer_max) override;
+    virtual void add_stats(uint64_t *extents,
+			   uint64_t *blobs,
+			   uint64_t *buffers,
+			   uint64_t *bytes) = 0;
 
-    void add_stats(uint64_t *onodes, uint64_t *extents,
-		   uint64_t *blobs,
-		   uint64_t *buffers,
-		   uint64_t *bytes) override {
+    bool empty() {
       std::lock_guard l(lock);
-      *onodes += onode_lru.size();
-      *extents += num_extents;
-      *blobs += num_blobs;
-      *buffers += buffer_hot.size() + buffer_warm_in.size();
-      *bytes += buffer_bytes;
+      return _get_bytes() == 0;
     }
-
-#ifdef DEBUG_CACHE
-    void _audit(const char *s) override;
-#endif
   };
 
   struct OnodeSpace {
   private:
-    Cache *cache;
+    OnodeCacheShard *cache;
 
     /// forward lookups
     mempool::bluestore_cache_other::unordered_map<ghobject_t,OnodeRef> onode_map;
@@ -1349,7 +1218,7 @@ public:
     friend class Collection; // for split_cache()
 
   public:
-    OnodeSpace(Cache *c) : cache(c) {}
+    OnodeSpace(OnodeCacheShard *c) : cache(c) {}
     ~OnodeSpace() {
       clear();
     }
@@ -1378,7 +1247,7 @@ public:
   struct Collection : public CollectionImpl {
     BlueStore *store;
     OpSequencerRef osr;
-    Cache *cache;       ///< our cache shard
+    BufferCacheShard *cache;       ///< our cache shard
     bluestore_cnode_t cnode;
     RWLock lock;
 
@@ -1431,11 +1300,16 @@ public:
 
     void split_cache(Collection *dest);
 
+    OnodeCacheShard* get_onode_cache() const {
+      return onode_map.cache;
+    }
+
     bool flush_commit(Context *c) override;
     void flush() override;
     void flush_all_but_last();
 
-    Collection(BlueStore *ns, Cache *ca, coll_t c);
+    Collection(BlueStore *ns, OnodeCacheShard *oc, BufferCacheShard *bc,
+	       coll_t c);
   };
 
   class OmapIteratorImpl : public ObjectMap::ObjectMapIteratorImpl {
@@ -1708,6 +1582,8 @@ public:
     IOContext ioc;                   ///< our aios
     /// bytes of pending io for each deferred seq (may be 0)
     map<uint64_t,int> seq_bytes;
+    /// extents queued via prepare_write, before overwrite/adjacency merging
+    uint64_t queued_extents = 0;
 
     void _discard(CephContext *cct, uint64_t offset, uint64_t length);
     void _audit(CephContext *cct);
@@ -1859,6 +1735,14 @@ public:
       return NULL;
     }
   };
+  struct KVCommitThread : public Thread {
+    BlueStore *store;
+    explicit KVCommitThread(BlueStore *s) : store(s) {}
+    void *entry() override {
+      store->_kv_commit_thread();
+      return NULL;
+    }
+  };
   struct KVFinalizeThread : public Thread {
     BlueStore *store;
     explicit KVFinalizeThread(BlueStore *s) : store(s) {}
@@ -1868,6 +1752,18 @@ public:
     }
   };
 
+  /// one kv_sync cycle, prepared by kv_sync_thread and waiting to be synced
+  struct KVCommitBatch {
+    deque<TransContext*> committing;
+    deque<DeferredBatch*> deferred_stable;
+    KeyValueDB::Transaction synct;
+    uint64_t new_nid_max = 0;
+    uint64_t new_blobid_max = 0;
+    interval_set<uint64_t> bluefs_extents_reclaiming;
+    uint64_t block_cache_gen = 0;  ///< block cache meta submitted with it
+    mono_clock::time_point start, after_flush;
+  };
+
   struct DBHistogram {
     struct value_dist {
       uint64_t count;
@@ -1902,6 +1798,7 @@ private:
 
   KeyValueDB *db = nullptr;
   BlockDevice *bdev = nullptr;
+  CachedDevice *block_cache = nullptr;  ///< bdev, if it has a write-back cache
   std::string freelist_type;
   FreelistManager *fm = nullptr;
   Allocator *alloc = nullptr;
@@ -1914,7 +1811,8 @@ private:
   mempool::bluestore_cache_other::unordered_map<coll_t, CollectionRef> coll_map;
   map<coll_t,CollectionRef> new_coll_map;
 
-  vector<Cache*> cache_shards;
+  vector<OnodeCacheShard*> onode_cache_shards;
+  vector<BufferCacheShard*> buffer_cache_shards;
 
   /// protect zombie_osr_set
   ceph::mutex zombie_osr_lock = ceph::make_mutex("BlueStore::zombie_osr_lock");
@@ -1938,6 +1836,18 @@ private:
   atomic_int deferred_aggressive = {0}; ///< aggressive wakeup of kv thread
   Finisher deferred_finisher, finisher;
 
+  /// Onode::flush() waiters, striped by onode address
+  struct OnodeFlushStripe {
+    ceph::mutex lock = ceph::make_mutex("BlueStore::OnodeFlushStripe::lock");
+    ceph::condition_variable cond;
+  };
+  static constexpr unsigned ONODE_FLUSH_STRIPES = 32;
+  std::array<OnodeFlushStripe, ONODE_FLUSH_STRIPES> onode_flush_stripes;
+  OnodeFlushStripe& _get_onode_flush_stripe(const Onode *o) {
+    return onode_flush_stripes[
+      (reinterpret_cast<uintptr_t>(o) / sizeof(Onode)) % ONODE_FLUSH_STRIPES];
+  }
+
   KVSyncThread kv_sync_thread;
   ceph::mutex kv_lock = ceph::make_mutex("BlueStore::kv_lock");
   ceph::condition_variable kv_cond;
@@ -1951,6 +1861,15 @@ private:
   deque<TransContext*> kv_committing;        ///< currently syncing
   deque<DeferredBatch*> deferred_done_queue;   ///< deferred ios done
 
+  /// max batches queued for kv_commit_thread; 0 commits in kv_sync_thread
+  unsigned kv_commit_pipeline_depth = 0;
+  KVCommitThread kv_commit_thread;
+  ceph::mutex kv_commit_lock = ceph::make_mutex("BlueStore::kv_commit_lock");
+  ceph::condition_variable kv_commit_cond;
+  bool kv_commit_started = false;
+  bool kv_commit_stop = false;
+  deque<KVCommitBatch> kv_commit_queue;  ///< submitted, waiting for sync
+
   KVFinalizeThread kv_finalize_thread;
   ceph::mutex kv_finalize_lock = ceph::make_mutex("BlueStore::kv_finalize_lock");
   ceph::condition_variable kv_finalize_cond;
@@ -1997,6 +1916,7 @@ private:
   std::atomic<uint64_t> comp_max_blob_size = {0};
 
   std::atomic<uint64_t> max_blob_size = {0};  ///< maximum blob size
+  std::atomic<uint64_t> readahead_max = {0};  ///< max readahead window, 0=off
 
   uint64_t kv_ios = 0;
   uint64_t kv_throttle_costs = 0;
@@ -2123,8 +2043,8 @@ private:
 
       virtual uint64_t _get_used_bytes() const {
         uint64_t bytes = 0;
-        for (auto i : store->cache_shards) {
-          bytes += i->_get_buffer_bytes();
+        for (auto i : store->buffer_cache_shards) {
+          bytes += i->_get_bytes();
         }
         return bytes; 
       }
@@ -2181,6 +2101,7 @@ private:
   void _close_fsid();
   void _set_alloc_sizes();
   void _set_blob_size();
+  void _set_readahead();
   void _set_finisher_num();
 
   int _open_bdev(bool create);
@@ -2208,6 +2129,9 @@ private:
   */
   int _open_db_and_around(bool read_only);
   void _close_db_and_around();
+  // loads the block cache map; needs db, fm and bluefs_extents
+  int _open_block_cache(bool read_only);
+  void _close_block_cache();
 
   // updates legacy bluefs related recs in DB to a state valid for
   // downgrades from nautilus.
@@ -2294,6 +2218,8 @@ private:
   void _kv_start();
   void _kv_stop();
   void _kv_sync_thread();
+  void _kv_commit_batch(KVCommitBatch& b);
+  void _kv_commit_thread();
   void _kv_finalize_thread();
 
   bluestore_deferred_op_t *_get_deferred_op(TransContext *txc, OnodeRef o);
@@ -2311,6 +2237,48 @@ public:
 			  mempool::bluestore_fsck::pool_allocator<uint64_t>>;
 
 private:
+  typedef btree::btree_set<
+    uint64_t, std::less<uint64_t>,
+    mempool::bluestore_fsck::pool_allocator<uint64_t>> uint64_t_btree_t;
+
+  struct sb_info_t {
+    coll_t cid;
+    int64_t pool_id = INT64_MIN;
+    list<ghobject_t> oids;
+    SharedBlobRef sb;
+    bluestore_extent_ref_map_t ref_map;
+    bool compressed = false;
+    bool passed = false;
+    bool updated = false;
+  };
+  typedef mempool::bluestore_fsck::map<uint64_t, sb_info_t> sb_info_map_t;
+
+  /// state shared by the workers checking objects during fsck
+  struct FSCK_ObjectCtx {
+    int& errors;
+    uint64_t& num_objects;
+    uint64_t& num_extents;
+    uint64_t& num_blobs;
+    uint64_t& num_spanning_blobs;
+
+    mempool_dynamic_bitset& used_blocks;
+    uint64_t_btree_t& used_nids;
+    uint64_t_btree_t& used_omap_head;
+    uint64_t_btree_t& used_pgmeta_omap_head;
+    sb_info_map_t& sb_info;
+
+    BlueStoreRepairer* repairer;
+    bool deep;
+
+    /// protects all of the above when objects are checked in parallel
+    ceph::mutex lock = ceph::make_mutex("BlueStore::FSCK_ObjectCtx::lock");
+  };
+  void _fsck_check_object(
+    FSCK_ObjectCtx& ctx,
+    CollectionRef c,
+    OnodeRef o,
+    store_statfs_t* expected_statfs);
+
   int _fsck_check_extents(
     const coll_t& cid,
     const ghobject_t& oid,
@@ -2445,21 +2413,34 @@ public:
   }
   int _fsck(bool deep, bool repair);
 
+  /// progress of a running fsck or repair, also in the perf counters
+  void get_fsck_progress(uint64_t *objects,
+			 uint64_t *collections,
+			 uint64_t *collections_total) const {
+    *objects = logger->get(l_bluestore_fsck_objects);
+    *collections = logger->get(l_bluestore_fsck_collections);
+    *collections_total = logger->get(l_bluestore_fsck_collections_total);
+  }
+
   void set_cache_shards(unsigned num) override;
   void dump_cache_stats(Formatter *f) override {
     int onode_count = 0, buffers_bytes = 0;
-    for (auto i: cache_shards) {
-      onode_count += i->_get_num_onodes();
-      buffers_bytes += i->_get_buffer_bytes();
+    for (auto i: onode_cache_shards) {
+      onode_count += i->_get_num();
+    }
+    for (auto i: buffer_cache_shards) {
+      buffers_bytes += i->_get_bytes();
     }
     f->dump_int("bluestore_onode", onode_count);
     f->dump_int("bluestore_buffers", buffers_bytes);
   }
   void dump_cache_stats(ostream& ss) override {
     int onode_count = 0, buffers_bytes = 0;
-    for (auto i: cache_shards) {
-      onode_count += i->_get_num_onodes();
-      buffers_bytes += i->_get_buffer_bytes();
+    for (auto i: onode_cache_shards) {
+      onode_count += i->_get_num();
+    }
+    for (auto i: buffer_cache_shards) {
+      buffers_bytes += i->_get_bytes();
     }
     ss << "bluestore_onode: " << onode_count;
     ss << "bluestore_buffers: " << buffers_bytes;
@@ -2529,6 +2510,13 @@ public:
     uint64_t retry_count = 0);
 
 private:
+  uint64_t _get_readahead(
+    Collection *c,
+    Onode *o,
+    uint64_t offset,
+    size_t length,
+    uint32_t op_flags);
+
   int _fiemap(CollectionHandle &c_, const ghobject_t& oid,
  	     uint64_t offset, size_t len, interval_set<uint64_t>& destset);
 public:
@@ -2606,6 +2594,13 @@ public:
     const ghobject_t &oid  ///< [in] object
     ) override;
 
+private:
+  /// iterator hints for an omap scan over [head, tail)
+  KeyValueDB::IteratorHints _omap_iterator_hints(
+    const string& head,
+    const string& tail);
+public:
+
   void set_fsid(uuid_d u) override {
     fsid = u;
   }
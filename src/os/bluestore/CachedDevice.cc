@@ -0,0 +1,1141 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "CachedDevice.h"
+
+#include "common/debug.h"
+#include "common/errno.h"
+#include "include/intarith.h"
+#include "include/scope_guard.h"
+#include "include/stringify.h"
+#include "os/kv.h"
+
+#define dout_context cct
+#define dout_subsys ceph_subsys_bdev
+#undef dout_prefix
+#define dout_prefix *_dout << "bdev-cache(" << cache_path << ") "
+
+CachedDevice::CachedDevice(CephContext* cct, const std::string& cp,
+			   uint64_t reserved,
+			   aio_callback_t cb, void *cbpriv,
+			   aio_callback_t d_cb, void *d_cbpriv)
+  : BlockDevice(cct, cb, cbpriv),
+    cache_path(cp),
+    reserved(reserved),
+    discard_callback(d_cb),
+    discard_callback_priv(d_cbpriv),
+    destage_thread(this)
+{
+}
+
+CachedDevice::~CachedDevice()
+{
+  ceph_assert(!destage_thread.is_started());
+  ceph_assert(!logger);
+}
+
+void CachedDevice::_init_logger()
+{
+  PerfCountersBuilder b(cct, "bluestore_block_cache",
+			l_bdev_cache_first, l_bdev_cache_last);
+  b.add_u64_counter(l_bdev_cache_read_hit_bytes, "read_hit_bytes",
+		    "Bytes read from the cache device",
+		    "rhit", PerfCountersBuilder::PRIO_INTERESTING,
+		    unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_bdev_cache_read_miss_bytes, "read_miss_bytes",
+		    "Bytes read from the main device",
+		    "rmis", PerfCountersBuilder::PRIO_INTERESTING,
+		    unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_bdev_cache_write_bytes, "write_bytes",
+		    "Bytes written to the cache device",
+		    "wr", PerfCountersBuilder::PRIO_INTERESTING,
+		    unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_bdev_cache_write_through_bytes, "write_through_bytes",
+		    "Bytes written straight to the main device",
+		    "wrth", PerfCountersBuilder::PRIO_USEFUL,
+		    unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_bdev_cache_promote_bytes, "promote_bytes",
+		    "Bytes of hot reads copied into the cache",
+		    NULL, 0, unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_bdev_cache_destage_ops, "destage_ops",
+		    "Destage batches written to the main device");
+  b.add_u64_counter(l_bdev_cache_destage_bytes, "destage_bytes",
+		    "Bytes destaged to the main device",
+		    "dstg", PerfCountersBuilder::PRIO_USEFUL,
+		    unit_t(UNIT_BYTES));
+  b.add_time_avg(l_bdev_cache_destage_lat, "destage_lat",
+		 "Average destage batch latency");
+  b.add_u64(l_bdev_cache_dirty_bytes, "dirty_bytes",
+	    "Cached bytes not yet destaged (destage backlog)",
+	    "dirt", PerfCountersBuilder::PRIO_INTERESTING, unit_t(UNIT_BYTES));
+  b.add_u64(l_bdev_cache_used_bytes, "used_bytes",
+	    "Log space in use on the cache device",
+	    "used", PerfCountersBuilder::PRIO_USEFUL, unit_t(UNIT_BYTES));
+  b.add_u64(l_bdev_cache_total_bytes, "total_bytes",
+	    "Log space on the cache device",
+	    NULL, 0, unit_t(UNIT_BYTES));
+  logger = b.create_perf_counters();
+  cct->get_perfcounters_collection()->add(logger);
+  logger->set(l_bdev_cache_total_bytes, log_end - log_start);
+}
+
+void CachedDevice::_shutdown_logger()
+{
+  cct->get_perfcounters_collection()->remove(logger);
+  delete logger;
+  logger = nullptr;
+}
+
+int CachedDevice::open(const std::string& p)
+{
+  dout(1) << __func__ << " main " << p << dendl;
+  main.reset(BlockDevice::create(cct, p, _aio_cb, this,
+				 discard_callback, discard_callback_priv));
+  if (!lock_exclusive) {
+    main->set_no_exclusive_lock();
+  }
+  int r = main->open(p);
+  if (r < 0) {
+    main.reset();
+    return r;
+  }
+  cache.reset(BlockDevice::create(cct, cache_path, _aio_cb, this,
+				  nullptr, nullptr));
+  if (!lock_exclusive) {
+    cache->set_no_exclusive_lock();
+  }
+  r = cache->open(cache_path);
+  if (r < 0) {
+    cache.reset();
+    goto out_main;
+  }
+  size = main->get_size();
+  block_size = main->get_block_size();
+  rotational = main->is_rotational();
+  if (block_size % cache->get_block_size()) {
+    derr << __func__ << " cache block size 0x" << std::hex
+	 << cache->get_block_size() << " does not divide main block size 0x"
+	 << block_size << std::dec << dendl;
+    r = -EINVAL;
+    goto out_cache;
+  }
+  log_start = p2roundup(reserved, block_size);
+  log_end = p2align(cache->get_size(), block_size);
+  if (log_end < log_start + 16 * block_size) {
+    derr << __func__ << " cache device is too small (" << cache->get_size()
+	 << " bytes)" << dendl;
+    r = -EINVAL;
+    goto out_cache;
+  }
+  log_head = log_start;
+  ghost_max = (log_end - log_start) >> 16;
+  _init_logger();
+  dout(1) << __func__ << " log 0x" << std::hex << log_start << "~"
+	  << (log_end - log_start) << std::dec
+	  << " (" << byte_u_t(log_end - log_start) << ")" << dendl;
+  return 0;
+
+ out_cache:
+  cache->close();
+  cache.reset();
+ out_main:
+  main->close();
+  main.reset();
+  return r;
+}
+
+void CachedDevice::close()
+{
+  dout(1) << __func__ << dendl;
+  ceph_assert(!destage_thread.is_started());
+  _shutdown_logger();
+  cache->close();
+  cache.reset();
+  main->close();
+  main.reset();
+  std::lock_guard l(lock);
+  extents.clear();
+  by_log.clear();
+  log_used.clear();
+  dirty_bytes = 0;
+  dirty_keys.clear();
+  pending_writes.clear();
+  pending_aios.clear();
+  releasing.clear();
+}
+
+bool CachedDevice::is_rotational()
+{
+  return main->is_rotational();
+}
+
+bool CachedDevice::get_thin_utilization(uint64_t *total, uint64_t *avail) const
+{
+  return main->get_thin_utilization(total, avail);
+}
+
+int CachedDevice::collect_metadata(const std::string& prefix,
+				   std::map<std::string,std::string> *pm) const
+{
+  int r = main->collect_metadata(prefix, pm);
+  if (r < 0) {
+    return r;
+  }
+  (*pm)[prefix + "cache_path"] = cache_path;
+  (*pm)[prefix + "cache_size"] = stringify(cache->get_size());
+  return cache->collect_metadata(prefix + "cache_", pm);
+}
+
+int CachedDevice::get_devname(std::string *out) const
+{
+  return main->get_devname(out);
+}
+
+int CachedDevice::get_devices(std::set<std::string> *ls) const
+{
+  main->get_devices(ls);
+  return cache->get_devices(ls);
+}
+
+int CachedDevice::get_numa_node(int *node) const
+{
+  return main->get_numa_node(node);
+}
+
+// -----------------
+// extent map
+
+bool CachedDevice::_log_alloc(uint64_t len, uint64_t *off)
+{
+  uint64_t pos = log_head;
+  if (pos + len > log_end) {
+    pos = log_start;  // wrap, leaving the tail of the log unused
+  }
+  if (pos + len > log_end || log_used.intersects(pos, len)) {
+    return false;
+  }
+  log_used.insert(pos, len);
+  log_head = pos + len;
+  *off = pos;
+  logger->set(l_bdev_cache_used_bytes, log_used.size());
+  return true;
+}
+
+void CachedDevice::_log_release(uint64_t off, uint64_t len)
+{
+  // the kv store may still point at this space until the next meta
+  // transaction is committed
+  releasing[meta_gen + 1].insert(off, len);
+}
+
+void CachedDevice::_insert(uint64_t off, uint64_t len, uint64_t log_off,
+			   bool dirty, uint64_t seq, bool pending)
+{
+  extents[off] = extent_t(len, log_off, dirty, seq, pending);
+  by_log[log_off] = off;
+  if (dirty) {
+    dirty_bytes += len;
+    dirty_keys.insert(off);
+  }
+}
+
+void CachedDevice::_erase(std::map<uint64_t, extent_t>::iterator p)
+{
+  by_log.erase(p->second.log_offset);
+  if (p->second.dirty) {
+    dirty_bytes -= p->second.length;
+    dirty_keys.insert(p->first);
+  }
+  extents.erase(p);
+}
+
+void CachedDevice::_punch(uint64_t off, uint64_t len)
+{
+  if (promoting.intersects(off, len)) {
+    interval_set<uint64_t> raced;
+    raced.insert(off, len);
+    raced.intersection_of(promoting);
+    promote_raced.union_of(raced);
+  }
+  uint64_t end = off + len;
+  auto p = extents.lower_bound(off);
+  if (p != extents.begin()) {
+    auto q = std::prev(p);
+    if (q->first + q->second.length > off) {
+      p = q;
+    }
+  }
+  while (p != extents.end() && p->first < end) {
+    uint64_t e_off = p->first;
+    uint64_t e_end = e_off + p->second.length;
+    extent_t e = p->second;
+    _erase(p++);
+    if (e_off < off) {
+      _insert(e_off, off - e_off, e.log_offset, e.dirty, e.seq, e.pending);
+    }
+    if (e_end > end) {
+      _insert(end, e_end - end, e.log_offset + (end - e_off), e.dirty, e.seq,
+	      e.pending);
+    }
+    if (e.pending) {
+      // the write may still land there; _write_finish() releases it
+      continue;
+    }
+    uint64_t a = std::max(e_off, off);
+    uint64_t b = std::min(e_end, end);
+    _log_release(e.log_offset + (a - e_off), b - a);
+  }
+  logger->set(l_bdev_cache_dirty_bytes, dirty_bytes);
+}
+
+bool CachedDevice::_overlaps(uint64_t off, uint64_t len) const
+{
+  auto p = extents.lower_bound(off);
+  if (p != extents.end() && p->first < off + len) {
+    return true;
+  }
+  if (p != extents.begin()) {
+    --p;
+    if (p->first + p->second.length > off) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void CachedDevice::_wait_destaging(std::unique_lock<ceph::mutex>& l,
+				   uint64_t off, uint64_t len)
+{
+  // the main device must not see an older copy land on top of this
+  while (destaging.intersects(off, len)) {
+    dout(20) << __func__ << " 0x" << std::hex << off << "~" << len
+	     << std::dec << " waiting for destage" << dendl;
+    destaged_cond.wait(l);
+  }
+}
+
+bool CachedDevice::_absorb(uint64_t off, uint64_t len, uint64_t *log_off,
+			   uint64_t *seq)
+{
+  if (!db || meta_read_only ||
+      len > cct->_conf.get_val<Option::size_t>(
+	"bluestore_block_cache_max_write")) {
+    return false;
+  }
+  if (!_log_alloc(len, log_off)) {
+    dout(20) << __func__ << " log full" << dendl;
+    destage_cond.notify_one();
+    return false;
+  }
+  *seq = ++write_seq;
+  _punch(off, len);
+  // nobody may look at the log copy until the caller has written it
+  _insert(off, len, *log_off, true, *seq, true);
+  pending_writes[*seq] = pending_write_t{off, len, *log_off};
+  logger->set(l_bdev_cache_dirty_bytes, dirty_bytes);
+  if (_need_destage()) {
+    destage_cond.notify_one();
+  }
+  return true;
+}
+
+void CachedDevice::_write_finish(uint64_t seq, bool failed)
+{
+  auto w = pending_writes.find(seq);
+  ceph_assert(w != pending_writes.end());
+  uint64_t off = w->second.offset, end = off + w->second.length;
+  interval_set<uint64_t> unused;
+  unused.insert(w->second.log_offset, w->second.length);
+  pending_writes.erase(w);
+
+  // what is left of the write (later ones may have overwritten parts of
+  // it) becomes visible, or goes away if it failed
+  auto p = extents.lower_bound(off);
+  if (p != extents.begin()) {
+    auto q = std::prev(p);
+    if (q->first + q->second.length > off) {
+      p = q;
+    }
+  }
+  while (p != extents.end() && p->first < end) {
+    if (p->second.seq != seq) {
+      ++p;
+      continue;
+    }
+    if (failed) {
+      _erase(p++);
+      continue;
+    }
+    p->second.pending = false;
+    dirty_keys.insert(p->first);
+    unused.erase(p->second.log_offset, p->second.length);
+    ++p;
+  }
+  for (auto q = unused.begin(); q != unused.end(); ++q) {
+    _log_release(q.get_start(), q.get_len());
+  }
+  logger->set(l_bdev_cache_dirty_bytes, dirty_bytes);
+  if (_need_destage()) {
+    destage_cond.notify_one();
+  }
+}
+
+void CachedDevice::_aio_finish(void *priv)
+{
+  {
+    std::lock_guard l(lock);
+    auto p = pending_aios.find(priv);
+    if (p != pending_aios.end()) {
+      for (auto seq : p->second) {
+	_write_finish(seq, false);
+      }
+      pending_aios.erase(p);
+    }
+  }
+  aio_callback(aio_callback_priv, priv);
+}
+
+bool CachedDevice::empty()
+{
+  std::lock_guard l(lock);
+  return extents.empty();
+}
+
+void CachedDevice::release(uint64_t off, uint64_t len)
+{
+  std::unique_lock l(lock);
+  if (!_overlaps(off, len) && !promoting.intersects(off, len)) {
+    return;
+  }
+  dout(20) << __func__ << " 0x" << std::hex << off << "~" << len << std::dec
+	   << dendl;
+  _wait_destaging(l, off, len);
+  _punch(off, len);
+}
+
+// -----------------
+// meta
+
+int CachedDevice::open_meta(KeyValueDB *kvdb, const std::string& p,
+			    bool read_only)
+{
+  std::lock_guard ml(meta_lock);
+  std::lock_guard l(lock);
+  ceph_assert(!db);
+  ceph_assert(dirty_keys.empty());
+  extents.clear();
+  by_log.clear();
+  log_used.clear();
+  releasing.clear();
+  dirty_bytes = 0;
+  pending_writes.clear();
+  pending_aios.clear();
+  log_head = log_start;
+
+  KeyValueDB::Iterator it = kvdb->get_iterator(p);
+  for (it->lower_bound(string()); it->valid(); it->next()) {
+    string key = it->key();
+    bufferlist bl = it->value();
+    uint64_t off, len, log_off;
+    try {
+      if (key.size() != 8) {
+	throw buffer::malformed_input("bad key");
+      }
+      _key_decode_u64(key.c_str(), &off);
+      auto bp = bl.cbegin();
+      decode(len, bp);
+      decode(log_off, bp);
+    } catch (buffer::error& e) {
+      derr << __func__ << " failed to decode extent (key length "
+	   << key.size() << "): " << e.what() << dendl;
+      goto corrupt;
+    }
+    if (len == 0 || off + len > size ||
+	log_off < log_start || log_off + len > log_end ||
+	log_used.intersects(log_off, len) || _overlaps(off, len)) {
+      derr << __func__ << " bad extent 0x" << std::hex << off << "~" << len
+	   << " at log 0x" << log_off << std::dec << dendl;
+      goto corrupt;
+    }
+    _insert(off, len, log_off, true, ++write_seq);
+    log_used.insert(log_off, len);
+    log_head = std::max(log_head, log_off + len);
+  }
+  dirty_keys.clear();
+  db = kvdb;
+  prefix = p;
+  meta_read_only = read_only;
+  logger->set(l_bdev_cache_dirty_bytes, dirty_bytes);
+  logger->set(l_bdev_cache_used_bytes, log_used.size());
+  dout(1) << __func__ << " " << extents.size() << " extents, "
+	  << byte_u_t(dirty_bytes) << " dirty" << dendl;
+  return 0;
+
+ corrupt:
+  extents.clear();
+  by_log.clear();
+  log_used.clear();
+  dirty_keys.clear();
+  dirty_bytes = 0;
+  return -EIO;
+}
+
+void CachedDevice::close_meta()
+{
+  if (!meta_read_only) {
+    uint64_t gen = submit_meta(true);
+    meta_committed(gen);
+  }
+  std::lock_guard ml(meta_lock);
+  std::lock_guard l(lock);
+  dirty_keys.clear();
+  db = nullptr;
+}
+
+uint64_t CachedDevice::submit_meta(bool sync)
+{
+  std::lock_guard ml(meta_lock);
+  if (!db || meta_read_only) {
+    return 0;
+  }
+  KeyValueDB::Transaction t = db->get_transaction();
+  uint64_t gen;
+  {
+    std::lock_guard l(lock);
+    gen = ++meta_gen;
+    if (dirty_keys.empty()) {
+      // nothing persistent refers to what this generation releases
+      return gen;
+    }
+    for (auto off : dirty_keys) {
+      string key;
+      _key_encode_u64(off, &key);
+      auto p = extents.find(off);
+      if (p != extents.end() && p->second.dirty && !p->second.pending) {
+	bufferlist bl;
+	encode(p->second.length, bl);
+	encode(p->second.log_offset, bl);
+	t->set(prefix, key, bl);
+      } else {
+	t->rmkey(prefix, key);
+      }
+    }
+    dout(20) << __func__ << " gen " << gen << " " << dirty_keys.size()
+	     << " keys" << dendl;
+    dirty_keys.clear();
+  }
+  int r = sync ? db->submit_transaction_sync(t) : db->submit_transaction(t);
+  ceph_assert(r == 0);
+  return gen;
+}
+
+void CachedDevice::meta_committed(uint64_t gen)
+{
+  if (!gen) {
+    return;
+  }
+  std::lock_guard l(lock);
+  interval_set<uint64_t> freed;
+  auto p = releasing.begin();
+  while (p != releasing.end() && p->first <= gen) {
+    dout(20) << __func__ << " gen " << p->first << " frees log 0x"
+	     << std::hex << p->second << std::dec << dendl;
+    freed.union_of(p->second);
+    p = releasing.erase(p);
+  }
+  if (freed.empty()) {
+    return;
+  }
+  // reads that mapped their extents before now may still be looking at
+  // the freed space; later ones cannot see it
+  retired.emplace_back(read_era++, std::move(freed));
+  _reuse_retired();
+}
+
+void CachedDevice::_finish_read(uint64_t era)
+{
+  auto p = reads_in_flight.find(era);
+  ceph_assert(p != reads_in_flight.end());
+  if (--p->second == 0) {
+    reads_in_flight.erase(p);
+    _reuse_retired();
+  }
+}
+
+uint64_t CachedDevice::_log_in_use() const
+{
+  // retired space is as good as free; it only waits for reads to finish
+  uint64_t used = log_used.size();
+  for (auto& r : retired) {
+    used -= r.second.size();
+  }
+  return used;
+}
+
+void CachedDevice::_reuse_retired()
+{
+  uint64_t oldest = reads_in_flight.empty() ?
+    std::numeric_limits<uint64_t>::max() : reads_in_flight.begin()->first;
+  while (!retired.empty() && retired.front().first < oldest) {
+    log_used.subtract(retired.front().second);
+    retired.pop_front();
+  }
+  logger->set(l_bdev_cache_used_bytes, log_used.size());
+}
+
+// -----------------
+// io
+
+void CachedDevice::aio_submit(IOContext *ioc)
+{
+#if defined(HAVE_LIBAIO) || defined(HAVE_POSIXAIO)
+  int fd = cache_aio_fd.load();
+  std::list<aio_t> cache_aios;
+  if (fd >= 0) {
+    for (auto p = ioc->pending_aios.begin(); p != ioc->pending_aios.end();) {
+      auto q = p++;
+      if (q->fd == fd) {
+	cache_aios.splice(cache_aios.end(), ioc->pending_aios, q);
+      }
+    }
+  }
+  if (cache_aios.empty()) {
+    main->aio_submit(ioc);
+    return;
+  }
+
+  // each device submits through its own queue.  hold the ioc open until
+  // both halves are in flight, or completions of the first could finish
+  // it before the second is submitted.
+  int n = cache_aios.size();
+  ++ioc->num_running;
+  ioc->num_pending -= n;
+  main->aio_submit(ioc);
+  ioc->pending_aios.splice(ioc->pending_aios.end(), cache_aios);
+  ioc->num_pending += n;
+  cache->aio_submit(ioc);
+  if (ioc->priv) {
+    if (--ioc->num_running == 0) {
+      _aio_finish(ioc->priv);
+    }
+  } else {
+    ioc->try_aio_wake();
+  }
+#else
+  main->aio_submit(ioc);
+#endif
+}
+
+bool CachedDevice::_is_hot(uint64_t off)
+{
+  uint64_t chunk = off >> 16;
+  if (ghost.erase(chunk)) {
+    return true;
+  }
+  ghost.insert(chunk);
+  ghost_fifo.push_back(chunk);
+  while (ghost_fifo.size() > ghost_max) {
+    ghost.erase(ghost_fifo.front());
+    ghost_fifo.pop_front();
+  }
+  return false;
+}
+
+void CachedDevice::_map_read(uint64_t off, uint64_t len,
+			     std::vector<read_seg_t> *segs)
+{
+  bool may_promote =
+    cct->_conf.get_val<bool>("bluestore_block_cache_promote_reads");
+  // hot reads must not push dirty data out of the log
+  uint64_t promote_max = (log_end - log_start) *
+    cct->_conf.get_val<double>("bluestore_block_cache_destage_ratio");
+  uint64_t max_write = cct->_conf.get_val<Option::size_t>(
+    "bluestore_block_cache_max_write");
+  uint64_t pos = off, end = off + len;
+  auto p = extents.lower_bound(off);
+  if (p != extents.begin()) {
+    auto q = std::prev(p);
+    if (q->first + q->second.length > off) {
+      p = q;
+    }
+  }
+  while (pos < end) {
+    if (p != extents.end() && p->first <= pos) {
+      uint64_t l = std::min(end, p->first + p->second.length) - pos;
+      if (p->second.pending) {
+	// the log does not hold it yet.  a read racing a write may see
+	// an older copy on any device; it must not see stale log space
+	segs->push_back(read_seg_t{pos, l, -1, false});
+	logger->inc(l_bdev_cache_read_miss_bytes, l);
+      } else {
+	segs->push_back(read_seg_t{
+	    pos, l, (int64_t)(p->second.log_offset + pos - p->first), false});
+	logger->inc(l_bdev_cache_read_hit_bytes, l);
+      }
+      pos += l;
+      ++p;
+    } else {
+      uint64_t next = p == extents.end() ? end : std::min(end, p->first);
+      uint64_t l = next - pos;
+      bool promote = may_promote &&
+	l <= max_write &&
+	log_used.size() + l <= promote_max &&
+	!promoting.intersects(pos, l) &&
+	_is_hot(pos);
+      if (promote) {
+	promoting.insert(pos, l);
+      }
+      segs->push_back(read_seg_t{pos, l, -1, promote});
+      logger->inc(l_bdev_cache_read_miss_bytes, l);
+      pos = next;
+    }
+  }
+}
+
+void CachedDevice::_promote_finish(uint64_t off, uint64_t len)
+{
+  promoting.erase(off, len);
+  if (promote_raced.intersects(off, len)) {
+    interval_set<uint64_t> raced;
+    raced.insert(off, len);
+    raced.intersection_of(promote_raced);
+    promote_raced.subtract(raced);
+  }
+}
+
+void CachedDevice::_promote(uint64_t off, bufferlist& bl)
+{
+  uint64_t len = bl.length();
+  std::unique_lock l(lock);
+  uint64_t log_off;
+  if (promote_raced.intersects(off, len) || !_log_alloc(len, &log_off)) {
+    _promote_finish(off, len);
+    return;
+  }
+  l.unlock();
+  int r = cache->write(log_off, bl, false);
+  l.lock();
+  bool raced = promote_raced.intersects(off, len);
+  _promote_finish(off, len);
+  if (r < 0 || raced || _overlaps(off, len)) {
+    _log_release(log_off, len);
+    return;
+  }
+  dout(20) << __func__ << " 0x" << std::hex << off << "~" << len
+	   << " at log 0x" << log_off << std::dec << dendl;
+  _insert(off, len, log_off, false, ++write_seq);
+  logger->inc(l_bdev_cache_promote_bytes, len);
+}
+
+void CachedDevice::_promote_abort(const std::vector<read_seg_t>& segs,
+				  size_t from)
+{
+  std::lock_guard l(lock);
+  for (size_t i = from; i < segs.size(); ++i) {
+    if (segs[i].promote) {
+      _promote_finish(segs[i].offset, segs[i].length);
+    }
+  }
+}
+
+int CachedDevice::read(uint64_t off, uint64_t len, bufferlist *pbl,
+		       IOContext *ioc,
+		       bool buffered)
+{
+  std::vector<read_seg_t> segs;
+  uint64_t era;
+  {
+    std::lock_guard l(lock);
+    era = _start_read();
+    _map_read(off, len, &segs);
+  }
+  auto finish = make_scope_guard([this, era] {
+    std::lock_guard l(lock);
+    _finish_read(era);
+  });
+  for (size_t i = 0; i < segs.size(); ++i) {
+    auto& s = segs[i];
+    int r;
+    if (s.log_offset >= 0) {
+      r = cache->read(s.log_offset, s.length, pbl, ioc, false);
+    } else {
+      bufferlist t;
+      r = main->read(s.offset, s.length, &t, ioc, buffered);
+      if (r == 0 && s.promote) {
+	s.promote = false;
+	_promote(s.offset, t);
+      }
+      pbl->claim_append(t);
+    }
+    if (r < 0) {
+      _promote_abort(segs, i);
+      return r;
+    }
+  }
+  return 0;
+}
+
+int CachedDevice::aio_read(uint64_t off, uint64_t len, bufferlist *pbl,
+			   IOContext *ioc)
+{
+  std::vector<read_seg_t> segs;
+  uint64_t era;
+  {
+    std::lock_guard l(lock);
+    era = _start_read();
+    _map_read(off, len, &segs);
+  }
+  auto finish = make_scope_guard([this, era] {
+    std::lock_guard l(lock);
+    _finish_read(era);
+  });
+  for (size_t i = 0; i < segs.size(); ++i) {
+    auto& s = segs[i];
+    int r;
+    if (s.log_offset >= 0) {
+      // the log may be reused once we finish, so cache hits are read
+      // synchronously; they are cheap anyway
+      r = cache->read(s.log_offset, s.length, pbl, ioc, false);
+    } else if (s.promote) {
+      // the data must be at hand to promote it
+      bufferlist t;
+      r = main->read(s.offset, s.length, &t, ioc, false);
+      if (r == 0) {
+	s.promote = false;
+	_promote(s.offset, t);
+      }
+      pbl->claim_append(t);
+    } else {
+      r = main->aio_read(s.offset, s.length, pbl, ioc);
+    }
+    if (r < 0) {
+      _promote_abort(segs, i);
+      return r;
+    }
+  }
+  return 0;
+}
+
+int CachedDevice::read_random(uint64_t off, uint64_t len, char *buf,
+			      bool buffered)
+{
+  uint64_t aoff = p2align(off, block_size);
+  uint64_t aend = p2roundup(off + len, block_size);
+  bufferlist bl;
+  IOContext ioc(cct, NULL);
+  int r = read(aoff, aend - aoff, &bl, &ioc, buffered);
+  if (r < 0) {
+    return r;
+  }
+  bl.copy(off - aoff, len, buf);
+  return 0;
+}
+
+int CachedDevice::write(uint64_t off, bufferlist& bl, bool buffered,
+			int write_hint)
+{
+  uint64_t len = bl.length();
+  ceph_assert(is_valid_io(off, len));
+  std::unique_lock l(lock);
+  uint64_t log_off, seq;
+  if (_absorb(off, len, &log_off, &seq)) {
+    l.unlock();
+    logger->inc(l_bdev_cache_write_bytes, len);
+    int r = cache->write(log_off, bl, false);
+    l.lock();
+    _write_finish(seq, r < 0);
+    return r;
+  }
+  _wait_destaging(l, off, len);
+  _punch(off, len);
+  l.unlock();
+  logger->inc(l_bdev_cache_write_through_bytes, len);
+  return main->write(off, bl, buffered, write_hint);
+}
+
+int CachedDevice::aio_write(uint64_t off, bufferlist& bl,
+			    IOContext *ioc,
+			    bool buffered,
+			    int write_hint)
+{
+  uint64_t len = bl.length();
+  ceph_assert(is_valid_io(off, len));
+  std::unique_lock l(lock);
+  uint64_t log_off, seq;
+  if (_absorb(off, len, &log_off, &seq)) {
+    l.unlock();
+    dout(20) << __func__ << " 0x" << std::hex << off << "~" << len
+	     << " at log 0x" << log_off << std::dec << dendl;
+    logger->inc(l_bdev_cache_write_bytes, len);
+    bool queued = false;
+    int r;
+#if defined(HAVE_LIBAIO) || defined(HAVE_POSIXAIO)
+    if (ioc->priv) {
+      size_t n = ioc->pending_aios.size();
+      r = cache->aio_write(log_off, bl, ioc, false);
+      if (ioc->pending_aios.size() > n) {
+	cache_aio_fd = ioc->pending_aios.back().fd;
+	queued = true;
+      }
+    } else {
+      // a waited-for ioc does not call back, so we would not learn
+      // when the write is done
+      r = cache->write(log_off, bl, false);
+    }
+#else
+    // other backends keep per-device state in the ioc
+    r = cache->write(log_off, bl, false);
+#endif
+    l.lock();
+    if (queued && r == 0) {
+      // not submitted before we return, so it cannot have completed
+      pending_aios[ioc->priv].push_back(seq);
+    } else {
+      _write_finish(seq, r < 0);
+    }
+    return r;
+  }
+  _wait_destaging(l, off, len);
+  _punch(off, len);
+  l.unlock();
+  logger->inc(l_bdev_cache_write_through_bytes, len);
+  return main->aio_write(off, bl, ioc, buffered, write_hint);
+}
+
+int CachedDevice::flush()
+{
+  int r = cache->flush();
+  if (r < 0) {
+    return r;
+  }
+  return main->flush();
+}
+
+int CachedDevice::discard(uint64_t offset, uint64_t len)
+{
+  release(offset, len);
+  return main->discard(offset, len);
+}
+
+int CachedDevice::queue_discard(interval_set<uint64_t> &to_release)
+{
+  for (auto p = to_release.begin(); p != to_release.end(); ++p) {
+    release(p.get_start(), p.get_len());
+  }
+  return main->queue_discard(to_release);
+}
+
+void CachedDevice::discard_drain()
+{
+  main->discard_drain();
+}
+
+int CachedDevice::invalidate_cache(uint64_t off, uint64_t len)
+{
+  return main->invalidate_cache(off, len);
+}
+
+// -----------------
+// destage
+
+bool CachedDevice::_need_destage() const
+{
+  if (draining) {
+    return dirty_bytes > 0;
+  }
+  return _log_in_use() > (log_end - log_start) *
+    cct->_conf.get_val<double>("bluestore_block_cache_destage_ratio");
+}
+
+void CachedDevice::start_destage()
+{
+  std::lock_guard l(lock);
+  destage_stop = false;
+  destage_thread.create("bstore_bcache");
+}
+
+void CachedDevice::stop_destage()
+{
+  {
+    std::lock_guard l(lock);
+    destage_stop = true;
+    destage_cond.notify_all();
+  }
+  destage_thread.join();
+}
+
+int CachedDevice::drain()
+{
+  if (!destage_thread.is_started()) {
+    return 0;
+  }
+  // the destage thread retries a failed batch every second; give up
+  // after a few rather than hang whoever is waiting (umount)
+  const unsigned max_failures = 5;
+  std::unique_lock l(lock);
+  dout(1) << __func__ << " " << byte_u_t(dirty_bytes) << " dirty" << dendl;
+  draining = true;
+  destage_failures = 0;
+  destage_cond.notify_all();
+  destaged_cond.wait(l, [this, max_failures] {
+    return dirty_bytes == 0 || destage_stop ||
+      destage_failures >= max_failures;
+  });
+  draining = false;
+  if (dirty_bytes) {
+    int r = destage_error < 0 ? destage_error : -EAGAIN;
+    derr << __func__ << " " << byte_u_t(dirty_bytes) << " left dirty: "
+	 << cpp_strerror(r) << dendl;
+    return r;
+  }
+  return 0;
+}
+
+void CachedDevice::_destage_thread()
+{
+  std::unique_lock l(lock);
+  dout(10) << __func__ << " start" << dendl;
+  while (!destage_stop) {
+    if (!_need_destage()) {
+      destage_cond.wait(l);
+      continue;
+    }
+    uint64_t used = _log_in_use();
+    int r = _destage_batch(l);
+    if (r < 0) {
+      destage_error = r;
+      ++destage_failures;
+      destaged_cond.notify_all();
+    } else {
+      destage_failures = 0;
+    }
+    if (r < 0 || _log_in_use() >= used) {
+      // leave the data in the log and retry later
+      destage_cond.wait_for(l, std::chrono::seconds(1));
+    }
+  }
+  dout(10) << __func__ << " finish" << dendl;
+}
+
+int CachedDevice::_destage_batch(std::unique_lock<ceph::mutex>& l)
+{
+  uint64_t max = cct->_conf.get_val<Option::size_t>(
+    "bluestore_block_cache_destage_batch");
+
+  // the oldest data follows the log head.  take up to a batch of it,
+  // dropping clean extents as we go, and sort what is dirty by main
+  // device offset.
+  std::map<uint64_t, extent_t> batch;
+  uint64_t bytes = 0;
+  auto p = by_log.lower_bound(log_head);
+  for (size_t n = by_log.size(); n > 0 && bytes < max; --n) {
+    if (p == by_log.end()) {
+      p = by_log.begin();
+    }
+    auto e = extents.find(p->second);
+    ceph_assert(e != extents.end());
+    ++p;
+    if (e->second.pending) {
+      // the log does not hold the data yet
+      continue;
+    }
+    if (!e->second.dirty) {
+      _log_release(e->second.log_offset, e->second.length);
+      _erase(e);
+      continue;
+    }
+    batch[e->first] = e->second;
+    destaging.insert(e->first, e->second.length);
+    bytes += e->second.length;
+  }
+  dout(10) << __func__ << " " << batch.size() << " extents, 0x" << std::hex
+	   << bytes << std::dec << " bytes" << dendl;
+
+  int r = 0;
+  if (!batch.empty()) {
+    uint64_t era = _start_read();
+    l.unlock();
+    auto start = mono_clock::now();
+    std::vector<bufferlist> data(batch.size());
+    {
+      IOContext ioc(cct, NULL);
+      size_t i = 0;
+      for (auto& [off, e] : batch) {
+	r = cache->read(e.log_offset, e.length, &data[i++], &ioc, false);
+	if (r < 0) {
+	  break;
+	}
+      }
+    }
+    l.lock();
+    _finish_read(era);
+    l.unlock();
+    // adjacent extents go out as a single sequential write
+    uint64_t run_start = 0, pos = 0;
+    bufferlist run;
+    size_t i = 0;
+    for (auto q = batch.begin(); r == 0 && q != batch.end(); ++q, ++i) {
+      if (run.length() && q->first != pos) {
+	r = main->write(run_start, run, false);
+	run.clear();
+	if (r < 0) {
+	  break;
+	}
+      }
+      if (!run.length()) {
+	run_start = q->first;
+      }
+      run.claim_append(data[i]);
+      pos = q->first + q->second.length;
+    }
+    if (r == 0 && run.length()) {
+      r = main->write(run_start, run, false);
+    }
+    if (r == 0) {
+      r = main->flush();
+    }
+    l.lock();
+    if (r < 0) {
+      derr << __func__ << " destage failed: " << cpp_strerror(r) << dendl;
+    }
+    for (auto& [off, e] : batch) {
+      if (r == 0) {
+	// whatever is left of the extent is now on the main device;
+	// newer data overwriting parts of it has a different seq
+	auto q = extents.lower_bound(off);
+	while (q != extents.end() && q->first < off + e.length) {
+	  if (q->second.seq == e.seq) {
+	    _log_release(q->second.log_offset, q->second.length);
+	    _erase(q++);
+	  } else {
+	    ++q;
+	  }
+	}
+      }
+      destaging.erase(off, e.length);
+    }
+    if (r == 0) {
+      logger->inc(l_bdev_cache_destage_ops);
+      logger->inc(l_bdev_cache_destage_bytes, bytes);
+      logger->tinc(l_bdev_cache_destage_lat, mono_clock::now() - start);
+    }
+    logger->set(l_bdev_cache_dirty_bytes, dirty_bytes);
+    destaged_cond.notify_all();
+  }
+
+  // make the removals durable so the log space can be reused
+  l.unlock();
+  uint64_t gen = submit_meta(true);
+  meta_committed(gen);
+  l.lock();
+  return r;
+}
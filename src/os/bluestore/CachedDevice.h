@@ -0,0 +1,273 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_OS_BLUESTORE_CACHEDDEVICE_H
+#define CEPH_OS_BLUESTORE_CACHEDDEVICE_H
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <unordered_set>
+
+#include "include/interval_set.h"
+#include "common/Thread.h"
+#include "common/perf_counters.h"
+#include "kv/KeyValueDB.h"
+
+#include "BlockDevice.h"
+
+enum {
+  l_bdev_cache_first = 732700,
+  l_bdev_cache_read_hit_bytes,
+  l_bdev_cache_read_miss_bytes,
+  l_bdev_cache_write_bytes,
+  l_bdev_cache_write_through_bytes,
+  l_bdev_cache_promote_bytes,
+  l_bdev_cache_destage_ops,
+  l_bdev_cache_destage_bytes,
+  l_bdev_cache_destage_lat,
+  l_bdev_cache_dirty_bytes,
+  l_bdev_cache_used_bytes,
+  l_bdev_cache_total_bytes,
+  l_bdev_cache_last
+};
+
+/**
+ * write-back cache in front of a slow (rotational) block device
+ *
+ * Writes up to bluestore_block_cache_max_write are appended to a log on
+ * the fast cache device instead of going to the main device.  A
+ * background thread destages the oldest part of the log, sorted by
+ * main device offset, and frees the log space once the main device has
+ * been flushed.  Reads that miss twice on the same region are promoted
+ * into the log as clean (never destaged) extents.  An absorbed write is
+ * pending until its log write completes: reads go to the main device for
+ * it, and it is neither destaged nor persisted before then.
+ *
+ * The map of dirty extents lives in the kv store under a prefix given
+ * by the owner.  Changes are only made durable by submit_meta(), which
+ * the owner must call after flush() and before committing anything that
+ * depends on the data written; log space is not reused until the
+ * change that stopped referencing it has been committed (see
+ * meta_committed()) and reads that might still be looking at it are
+ * done.
+ *
+ * Anything that writes to the main device behind our back (BlueFS, on
+ * extents gifted by BlueStore) must release() the range first, so that
+ * no cached data for it is left to be destaged on top of it.
+ */
+class CachedDevice : public BlockDevice {
+  std::unique_ptr<BlockDevice> main;   ///< the device we are caching
+  std::unique_ptr<BlockDevice> cache;  ///< fast device holding the log
+  std::string cache_path;
+  uint64_t reserved;                   ///< label area at the start of cache
+  aio_callback_t discard_callback;
+  void *discard_callback_priv;
+
+  uint64_t log_start = 0, log_end = 0;
+
+  struct extent_t {
+    uint64_t length = 0;
+    uint64_t log_offset = 0;
+    bool dirty = true;  ///< false for promoted reads: may be dropped any time
+    uint64_t seq = 0;   ///< write that produced it; kept by trimmed pieces
+    bool pending = false;  ///< the write to the log has not completed yet
+    extent_t() {}
+    extent_t(uint64_t l, uint64_t lo, bool d, uint64_t s, bool p)
+      : length(l), log_offset(lo), dirty(d), seq(s), pending(p) {}
+  };
+
+  /// a write to the log that is not known to have completed.  its
+  /// extents are neither read, destaged nor persisted until it has,
+  /// and its log space is not released before then.
+  struct pending_write_t {
+    uint64_t offset;
+    uint64_t length;
+    uint64_t log_offset;
+  };
+
+  ceph::mutex lock = ceph::make_mutex("CachedDevice::lock");
+  ceph::condition_variable destage_cond;   ///< wakes the destage thread
+  ceph::condition_variable destaged_cond;  ///< a destage batch finished
+
+  std::map<uint64_t, extent_t> extents;    ///< main offset -> cached extent
+  std::map<uint64_t, uint64_t> by_log;     ///< log offset -> main offset
+  interval_set<uint64_t> log_used;         ///< log space not reusable yet
+  uint64_t log_head = 0;                   ///< next log append position
+  uint64_t dirty_bytes = 0;
+  uint64_t write_seq = 0;
+  interval_set<uint64_t> destaging;        ///< main ranges being destaged
+  interval_set<uint64_t> promoting;        ///< main ranges being promoted
+  interval_set<uint64_t> promote_raced;    ///< ... and written meanwhile
+  std::map<uint64_t, pending_write_t> pending_writes;  ///< by seq
+  /// seqs of the aio writes of an ioc, by its priv; they complete with it
+  std::map<void*, std::vector<uint64_t>> pending_aios;
+
+  /// ranges recently missed; a second miss promotes them
+  std::unordered_set<uint64_t> ghost;
+  std::deque<uint64_t> ghost_fifo;
+  size_t ghost_max = 0;
+
+  /// main offsets whose kv entry is out of date
+  std::set<uint64_t> dirty_keys;
+  /// log space to free once the meta generation (key) is committed
+  std::map<uint64_t, interval_set<uint64_t>> releasing;
+  uint64_t meta_gen = 0;
+
+  /// serializes building and submitting meta transactions, so that they
+  /// reach the kv store in the order the index changed
+  ceph::mutex meta_lock = ceph::make_mutex("CachedDevice::meta_lock");
+  KeyValueDB *db = nullptr;
+  std::string prefix;
+  bool meta_read_only = false;
+
+  /// reads from the cache device in flight, counted by the era in which
+  /// they mapped their extents.  log space freed in an era is only
+  /// reused once no read of that or an earlier era is left, so that
+  /// meta_committed() (on the kv commit thread) never waits for reads.
+  uint64_t read_era = 0;
+  std::map<uint64_t, unsigned> reads_in_flight;
+  std::deque<std::pair<uint64_t, interval_set<uint64_t>>> retired;
+
+  std::atomic<int> cache_aio_fd = {-1};  ///< fd of the cache device's aios
+
+  bool destage_stop = false;
+  bool draining = false;
+  unsigned destage_failures = 0;  ///< destage batches failed in a row
+  int destage_error = 0;          ///< last destage failure
+  struct DestageThread : public Thread {
+    CachedDevice *dev;
+    explicit DestageThread(CachedDevice *d) : dev(d) {}
+    void *entry() override {
+      dev->_destage_thread();
+      return NULL;
+    }
+  } destage_thread;
+
+  PerfCounters *logger = nullptr;
+
+  void _init_logger();
+  void _shutdown_logger();
+
+  bool _log_alloc(uint64_t len, uint64_t *off);
+  void _log_release(uint64_t off, uint64_t len);
+
+  void _insert(uint64_t off, uint64_t len, uint64_t log_off, bool dirty,
+	       uint64_t seq, bool pending = false);
+  void _erase(std::map<uint64_t, extent_t>::iterator p);
+  void _punch(uint64_t off, uint64_t len);
+  bool _overlaps(uint64_t off, uint64_t len) const;
+  void _wait_destaging(std::unique_lock<ceph::mutex>& l,
+		       uint64_t off, uint64_t len);
+  bool _absorb(uint64_t off, uint64_t len, uint64_t *log_off, uint64_t *seq);
+  void _write_finish(uint64_t seq, bool failed);
+
+  static void _aio_cb(void *handle, void *priv) {
+    static_cast<CachedDevice*>(handle)->_aio_finish(priv);
+  }
+  void _aio_finish(void *priv);
+  bool _is_hot(uint64_t off);
+
+  uint64_t _start_read() {
+    ++reads_in_flight[read_era];
+    return read_era;
+  }
+  void _finish_read(uint64_t era);
+  void _reuse_retired();
+  uint64_t _log_in_use() const;
+
+  struct read_seg_t {
+    uint64_t offset;  ///< on the main device
+    uint64_t length;
+    int64_t log_offset;  ///< on the cache device, or -1 on a miss
+    bool promote;     ///< miss to be promoted once read
+  };
+  void _map_read(uint64_t off, uint64_t len, std::vector<read_seg_t> *segs);
+  void _promote(uint64_t off, bufferlist& bl);
+  void _promote_finish(uint64_t off, uint64_t len);
+  void _promote_abort(const std::vector<read_seg_t>& segs, size_t from);
+
+  bool _need_destage() const;
+  void _destage_thread();
+  int _destage_batch(std::unique_lock<ceph::mutex>& l);
+
+public:
+  CachedDevice(CephContext* cct, const std::string& cache_path,
+	       uint64_t reserved,
+	       aio_callback_t cb, void *cbpriv,
+	       aio_callback_t d_cb, void *d_cbpriv);
+  ~CachedDevice() override;
+
+  const std::string& get_cache_path() const {
+    return cache_path;
+  }
+  uint64_t get_cache_size() const {
+    return cache ? cache->get_size() : 0;
+  }
+
+  /// load the extent map from @p db; must precede any io
+  int open_meta(KeyValueDB *db, const std::string& prefix, bool read_only);
+  /// persist the extent map and stop using the kv store
+  void close_meta();
+  /// queue extent map changes in a kv transaction; returns its generation
+  uint64_t submit_meta(bool sync);
+  /// all meta transactions up to @p gen are durable
+  void meta_committed(uint64_t gen);
+
+  /// true if nothing is cached
+  bool empty();
+
+  /// [off, off+len) is no longer in use; drop anything cached for it
+  void release(uint64_t off, uint64_t len);
+
+  void start_destage();
+  void stop_destage();
+  /// destage all dirty data and wait for it; gives up with the error
+  /// if destaging keeps failing
+  int drain();
+
+  bool supported_bdev_label() override { return true; }
+  bool is_rotational() override;
+  bool get_thin_utilization(uint64_t *total, uint64_t *avail) const override;
+  int collect_metadata(const std::string& prefix,
+		       std::map<std::string,std::string> *pm) const override;
+  int get_devname(std::string *out) const override;
+  int get_devices(std::set<std::string> *ls) const override;
+  int get_numa_node(int *node) const override;
+
+  void aio_submit(IOContext *ioc) override;
+
+  int read(uint64_t off, uint64_t len, bufferlist *pbl,
+	   IOContext *ioc,
+	   bool buffered) override;
+  int aio_read(uint64_t off, uint64_t len, bufferlist *pbl,
+	       IOContext *ioc) override;
+  int read_random(uint64_t off, uint64_t len, char *buf,
+		  bool buffered) override;
+
+  int write(uint64_t off, bufferlist& bl, bool buffered,
+	    int write_hint = WRITE_LIFE_NOT_SET) override;
+  int aio_write(uint64_t off, bufferlist& bl,
+		IOContext *ioc,
+		bool buffered,
+		int write_hint = WRITE_LIFE_NOT_SET) override;
+  int flush() override;
+  int discard(uint64_t offset, uint64_t len) override;
+  int queue_discard(interval_set<uint64_t> &to_release) override;
+  void discard_drain() override;
+
+  int invalidate_cache(uint64_t off, uint64_t len) override;
+  int open(const std::string& path) override;
+  void close() override;
+};
+
+#endif
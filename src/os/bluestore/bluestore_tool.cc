@@ -224,8 +224,10 @@ int main(int argc, char **argv)
   string action;
   string log_file;
   string key, value;
+  string new_sharding;
   int log_level = 30;
   bool fsck_deep = false;
+  bool fsck_progress = false;
   po::options_description po_options("Options");
   po_options.add_options()
     ("help,h", "produce help message")
@@ -237,12 +239,14 @@ int main(int argc, char **argv)
     ("devs-source", po::value<vector<string>>(&devs_source), "bluefs-dev-migrate source device(s)")
     ("dev-target", po::value<string>(&dev_target), "target/resulting device")
     ("deep", po::value<bool>(&fsck_deep), "deep fsck (read all data)")
+    ("progress", po::value<bool>(&fsck_progress), "periodically report fsck/repair progress to stderr")
     ("key,k", po::value<string>(&key), "label metadata key name")
     ("value,v", po::value<string>(&value), "label metadata value")
+    ("sharding", po::value<string>(&new_sharding), "new column family sharding for reshard")
     ;
   po::options_description po_positional("Positional options");
   po_positional.add_options()
-    ("command", po::value<string>(&action), "fsck, repair, bluefs-export, bluefs-bdev-sizes, bluefs-bdev-expand, bluefs-bdev-new-db, bluefs-bdev-new-wal, bluefs-bdev-migrate, show-label, set-label-key, rm-label-key, prime-osd-dir, bluefs-log-dump")
+    ("command", po::value<string>(&action), "fsck, repair, bluefs-export, bluefs-bdev-sizes, bluefs-bdev-expand, bluefs-bdev-new-db, bluefs-bdev-new-wal, bluefs-bdev-migrate, show-label, set-label-key, rm-label-key, prime-osd-dir, bluefs-log-dump, reshard")
     ;
   po::options_description po_all("All options");
   po_all.add(po_options).add(po_positional);
@@ -342,6 +346,16 @@ int main(int argc, char **argv)
     }
     inferring_bluefs_devices(devs, path);
   }
+  if (action == "reshard") {
+    if (path.empty()) {
+      cerr << "must specify bluestore path" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    if (new_sharding.empty()) {
+      cerr << "must specify the new sharding with --sharding" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
   if (action == "bluefs-bdev-migrate") {
     if (path.empty()) {
       cerr << "must specify bluestore path" << std::endl;
@@ -385,12 +399,41 @@ int main(int argc, char **argv)
       action == "repair") {
     validate_path(cct.get(), path, false);
     BlueStore bluestore(cct.get(), path);
+    ceph::mutex progress_lock = ceph::make_mutex("bluestore_tool::progress_lock");
+    ceph::condition_variable progress_cond;
+    bool progress_stop = false;
+    std::thread progress_thread;
+    if (fsck_progress) {
+      progress_thread = std::thread([&] {
+	std::unique_lock l(progress_lock);
+	while (!progress_cond.wait_for(l, std::chrono::seconds(5),
+				       [&] { return progress_stop; })) {
+	  uint64_t objects, collections, collections_total;
+	  bluestore.get_fsck_progress(&objects, &collections,
+				      &collections_total);
+	  if (collections_total) {
+	    cerr << action << " progress: " << collections << "/"
+		 << collections_total << " collections ("
+		 << collections * 100 / collections_total << "%), "
+		 << objects << " objects" << std::endl;
+	  }
+	}
+      });
+    }
     int r;
     if (action == "fsck") {
       r = bluestore.fsck(fsck_deep);
     } else {
       r = bluestore.repair(fsck_deep);
     }
+    if (progress_thread.joinable()) {
+      {
+	std::lock_guard l(progress_lock);
+	progress_stop = true;
+      }
+      progress_cond.notify_all();
+      progress_thread.join();
+    }
     if (r < 0) {
       cerr << "error from fsck: " << cpp_strerror(r) << std::endl;
       exit(EXIT_FAILURE);
@@ -535,6 +578,24 @@ int main(int argc, char **argv)
       exit(EXIT_FAILURE);
     }
   }
+  else if (action == "reshard") {
+    BlueStore bluestore(cct.get(), path);
+    KeyValueDB *db_ptr;
+    // set up the db without opening it; reshard opens every column family
+    // itself
+    int r = bluestore.start_kv_only(&db_ptr, false);
+    if (r < 0) {
+      cerr << "error preparing db for resharding: " << cpp_strerror(r)
+	   << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    r = db_ptr->reshard(new_sharding, cout);
+    bluestore.umount();
+    if (r < 0) {
+      cerr << "failed to reshard: " << cpp_strerror(r) << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
   else if (action == "bluefs-export") {
     BlueFS *fs = open_bluefs(cct.get(), path, devs);
 
@@ -0,0 +1,309 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "io_uring.h"
+
+#if defined(HAVE_LIBURING)
+
+#include <map>
+#include <sys/epoll.h>
+#include <liburing.h>
+
+#include "common/ceph_mutex.h"
+#include "include/compat.h"
+
+struct ioring_data {
+  struct io_uring io_uring;
+  ceph::mutex cq_mutex = ceph::make_mutex("ioring_data::cq_mutex");
+  ceph::mutex sq_mutex = ceph::make_mutex("ioring_data::sq_mutex");
+  int epoll_fd = -1;
+  std::map<int, int> fixed_fds_map;  ///< real fd -> registered file index
+};
+
+static int ioring_get_cqe(struct ioring_data *d, unsigned int max,
+			  struct aio_t **paio)
+{
+  struct io_uring *ring = &d->io_uring;
+  struct io_uring_cqe *cqe;
+
+  unsigned nr = 0;
+  unsigned head;
+  io_uring_for_each_cqe(ring, head, cqe) {
+    struct aio_t *io = (struct aio_t *)(uintptr_t) io_uring_cqe_get_data(cqe);
+    io->rval = cqe->res;
+
+    paio[nr++] = io;
+
+    if (nr == max)
+      break;
+  }
+  io_uring_cq_advance(ring, nr);
+
+  return nr;
+}
+
+static int find_fixed_fd(struct ioring_data *d, int real_fd)
+{
+  auto it = d->fixed_fds_map.find(real_fd);
+  if (it == d->fixed_fds_map.end())
+    return -1;
+
+  return it->second;
+}
+
+static void init_sqe(struct ioring_data *d, struct io_uring_sqe *sqe,
+		     struct aio_t *io)
+{
+  int fixed_fd = find_fixed_fd(d, io->fd);
+
+  ceph_assert(fixed_fd != -1);
+
+  // aio_t::pwritev()/preadv() prepared the libaio iocb; reuse its opcode
+  if (io->iocb.aio_lio_opcode == IO_CMD_PWRITEV)
+    io_uring_prep_writev(sqe, fixed_fd, &io->iov[0],
+			 io->iov.size(), io->offset);
+  else if (io->iocb.aio_lio_opcode == IO_CMD_PREADV)
+    io_uring_prep_readv(sqe, fixed_fd, &io->iov[0],
+			io->iov.size(), io->offset);
+  else
+    ceph_abort_msg("unexpected aio opcode");
+
+  io_uring_sqe_set_data(sqe, io);
+  io_uring_sqe_set_flags(sqe, IOSQE_FIXED_FILE);
+}
+
+/*
+ * Fill as many sqes as the submission ring has room for and submit
+ * them.  Returns the number of aios consumed from [*beg, end) (and
+ * advances *beg accordingly), or a negative error code.  If the kernel
+ * pushed back with EAGAIN/EBUSY the prepared sqes stay in the ring and
+ * *need_submit is set so that the caller retries the submission.
+ */
+static int ioring_queue(struct ioring_data *d, void *priv,
+			io_queue_t::aio_iter *beg, io_queue_t::aio_iter end,
+			bool *need_submit)
+{
+  struct io_uring *ring = &d->io_uring;
+  int queued = 0;
+
+  while (*beg != end) {
+    struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
+    if (!sqe)
+      break;
+
+    struct aio_t *io = &**beg;
+    io->priv = priv;
+    init_sqe(d, sqe, io);
+    ++queued;
+    ++(*beg);
+  }
+
+  if (queued == 0 && !*need_submit)
+    return 0;
+
+  int r = io_uring_submit(ring);
+  if (r == -EAGAIN || r == -EBUSY) {
+    *need_submit = true;
+  } else if (r < 0) {
+    return r;
+  } else {
+    *need_submit = false;
+  }
+  return queued;
+}
+
+static void build_fixed_fds_map(struct ioring_data *d,
+				std::vector<int> &fds)
+{
+  int fixed_fd = 0;
+  for (int real_fd : fds) {
+    d->fixed_fds_map[real_fd] = fixed_fd++;
+  }
+}
+
+ioring_queue_t::ioring_queue_t(unsigned iodepth_, bool sq_thread_) :
+  d(std::make_unique<ioring_data>()),
+  iodepth(iodepth_),
+  sq_thread(sq_thread_)
+{
+}
+
+ioring_queue_t::~ioring_queue_t()
+{
+}
+
+int ioring_queue_t::init(std::vector<int> &fds)
+{
+  unsigned flags = 0;
+
+  if (sq_thread)
+    flags |= IORING_SETUP_SQPOLL;
+
+  int ret = io_uring_queue_init(iodepth, &d->io_uring, flags);
+  if (ret < 0)
+    return ret;
+
+  // registered files save the per-io fget/fput in the kernel, and are
+  // required for SQPOLL on older kernels
+  ret = io_uring_register_files(&d->io_uring,
+				&fds[0], fds.size());
+  if (ret < 0) {
+    goto close_ring_fd;
+  }
+
+  build_fixed_fds_map(d.get(), fds);
+
+  d->epoll_fd = epoll_create1(0);
+  if (d->epoll_fd < 0) {
+    ret = -errno;
+    goto close_ring_fd;
+  }
+
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.ptr = nullptr;
+  ret = epoll_ctl(d->epoll_fd, EPOLL_CTL_ADD, d->io_uring.ring_fd, &ev);
+  if (ret < 0) {
+    ret = -errno;
+    goto close_epoll_fd;
+  }
+
+  return 0;
+
+close_epoll_fd:
+  VOID_TEMP_FAILURE_RETRY(::close(d->epoll_fd));
+  d->epoll_fd = -1;
+close_ring_fd:
+  d->fixed_fds_map.clear();
+  io_uring_queue_exit(&d->io_uring);
+
+  return ret;
+}
+
+void ioring_queue_t::shutdown()
+{
+  d->fixed_fds_map.clear();
+  VOID_TEMP_FAILURE_RETRY(::close(d->epoll_fd));
+  d->epoll_fd = -1;
+  io_uring_queue_exit(&d->io_uring);
+}
+
+int ioring_queue_t::submit_batch(aio_iter beg, aio_iter end,
+				 uint16_t aios_size, void *priv,
+				 int *retries)
+{
+  // same backoff as aio_queue_t: 2^16 * 125us = ~8 seconds
+  int attempts = 16;
+  int delay = 125;
+  int done = 0;
+  bool need_submit = false;
+
+  while (beg != end || need_submit) {
+    int r;
+    {
+      std::lock_guard l(d->sq_mutex);
+      r = ioring_queue(d.get(), priv, &beg, end, &need_submit);
+    }
+    if (r < 0) {
+      return r;
+    }
+    done += r;
+    if (r > 0 && !need_submit) {
+      attempts = 16;
+      delay = 125;
+      continue;
+    }
+    // submission ring is full or the kernel pushed back (e.g., the
+    // completion ring overflowed); give the completion side a chance
+    // to catch up
+    if (attempts-- == 0) {
+      return -EAGAIN;
+    }
+    usleep(delay);
+    delay *= 2;
+    (*retries)++;
+  }
+  ceph_assert(done <= aios_size);
+  return done;
+}
+
+int ioring_queue_t::get_next_completed(int timeout_ms, aio_t **paio, int max)
+{
+  while (true) {
+    int events;
+    {
+      std::lock_guard l(d->cq_mutex);
+      events = ioring_get_cqe(d.get(), max, paio);
+    }
+    if (events > 0) {
+      return events;
+    }
+
+    struct epoll_event ev;
+    int ret = epoll_wait(d->epoll_fd, &ev, 1, timeout_ms);
+    if (ret < 0) {
+      if (errno == EINTR)
+	continue;
+      return -errno;
+    }
+    if (ret == 0) {
+      // timed out
+      return 0;
+    }
+    // time to reap
+  }
+}
+
+bool ioring_queue_t::supported()
+{
+  struct io_uring ring;
+  int ret = io_uring_queue_init(16, &ring, 0);
+  if (ret) {
+    return false;
+  }
+  io_uring_queue_exit(&ring);
+  return true;
+}
+
+#else // #if defined(HAVE_LIBURING)
+
+struct ioring_data {};
+
+ioring_queue_t::ioring_queue_t(unsigned iodepth_, bool sq_thread_)
+{
+  ceph_assert(0);
+}
+
+ioring_queue_t::~ioring_queue_t()
+{
+  ceph_assert(0);
+}
+
+int ioring_queue_t::init(std::vector<int> &fds)
+{
+  ceph_assert(0);
+}
+
+void ioring_queue_t::shutdown()
+{
+  ceph_assert(0);
+}
+
+int ioring_queue_t::submit_batch(aio_iter beg, aio_iter end,
+				 uint16_t aios_size, void *priv,
+				 int *retries)
+{
+  ceph_assert(0);
+}
+
+int ioring_queue_t::get_next_completed(int timeout_ms, aio_t **paio, int max)
+{
+  ceph_assert(0);
+}
+
+bool ioring_queue_t::supported()
+{
+  return false;
+}
+
+#endif // #if defined(HAVE_LIBURING)
@@ -154,8 +154,11 @@ ostream &operator<<(ostream &lhs, const ECBackend::Op &rhs)
       << " pending_apply=" << rhs.pending_apply
       << " pending_commit=" << rhs.pending_commit
       << " plan.to_read=" << rhs.plan.to_read
-      << " plan.will_write=" << rhs.plan.will_write
-      << ")";
+      << " plan.will_write=" << rhs.plan.will_write;
+  if (rhs.delta_write) {
+    lhs << " delta_write";
+  }
+  lhs << ")";
   return lhs;
 }
 
@@ -1845,7 +1848,8 @@ void ECBackend::start_rmw(Op *op, PGTransactionUPtr &&t)
       }
       return ref;
     },
-    get_parent()->get_dpp());
+    get_parent()->get_dpp(),
+    parity_delta_enabled() ? ec_impl->get_coding_chunk_count() : 0);
 
   dout(10) << __func__ << ": " << *op << dendl;
 
@@ -1853,6 +1857,113 @@ void ECBackend::start_rmw(Op *op, PGTransactionUPtr &&t)
   check_ops();
 }
 
+bool ECBackend::parity_delta_enabled()
+{
+  return cct->_conf.get_val<bool>("osd_ec_parity_delta_writes") &&
+    get_parent()->get_pool().allows_ecoverwrites() &&
+    ec_impl->supports_parity_delta() &&
+    ec_impl->get_chunk_mapping().empty() &&
+    ec_impl->get_sub_chunk_count() == 1;
+}
+
+bool ECBackend::object_write_in_flight(
+  const hobject_t &hoid,
+  bool uncached_only) const
+{
+  for (auto &&l : {&waiting_reads, &waiting_commit}) {
+    for (auto &&op : *l) {
+      if ((!uncached_only || !op.using_cache) &&
+	  op.plan.will_write.count(hoid)) {
+	return true;
+      }
+    }
+  }
+  return false;
+}
+
+bool ECBackend::can_delta_write(const Op &op)
+{
+  if (op.plan.delta.empty()) {
+    return false;
+  }
+  // A delta write reads straight from the shards and doesn't populate
+  // the extent cache, so nothing else may be in flight on its objects.
+  for (auto &&hpair : op.plan.will_write) {
+    if (object_write_in_flight(hpair.first, false)) {
+      return false;
+    }
+  }
+  for (auto &&hpair : op.plan.delta) {
+    set<int> have;
+    map<shard_id_t, pg_shard_t> shards;
+    get_all_avail_shards(hpair.first, set<pg_shard_t>(), have, shards, false);
+    for (int shard : hpair.second.read_shards) {
+      if (!have.count(shard)) {
+	dout(20) << __func__ << ": shard " << shard << " of " << hpair.first
+		 << " unavailable" << dendl;
+	return false;
+      }
+    }
+  }
+  return true;
+}
+
+void ECBackend::start_remote_reads(Op *op)
+{
+  ceph_assert(get_parent()->get_pool().allows_ecoverwrites());
+  objects_read_async_no_cache(
+    op->remote_read,
+    [this, op](map<hobject_t,pair<int, extent_map> > &&results) {
+      for (auto &&i: results) {
+	op->remote_read_result.emplace(i.first, i.second.second);
+      }
+      check_ops();
+    });
+}
+
+void ECBackend::start_delta_reads(Op *op)
+{
+  ceph_assert(op->delta_write);
+  op->delta_reads_pending = op->plan.delta.size();
+  for (auto &&hpair : op->plan.delta) {
+    extent_set stripes;
+    for (auto &&p : hpair.second.stripes) {
+      stripes.insert(p.first, sinfo.get_stripe_width());
+    }
+    hobject_t hoid = hpair.first;
+    objects_read_chunks(
+      hoid,
+      stripes,
+      hpair.second.read_shards,
+      make_gen_lambda_context<
+        pair<int, ECTransaction::stripe_chunks_t> &&>(
+	  [this, op, hoid](pair<int, ECTransaction::stripe_chunks_t> &&r) {
+	    if (r.first < 0) {
+	      dout(10) << __func__ << ": delta read of " << hoid
+		       << " failed: " << cpp_strerror(r.first) << dendl;
+	      op->delta_read_failed = true;
+	    } else {
+	      op->delta_read_result.emplace(hoid, std::move(r.second));
+	    }
+	    ceph_assert(op->delta_reads_pending > 0);
+	    if (--op->delta_reads_pending > 0) {
+	      return;
+	    }
+	    if (op->delta_read_failed) {
+	      // nothing else reads or writes these objects until we are done
+	      // (see object_write_in_flight), so read the full stripes instead
+	      get_parent()->get_logger()->inc(l_osd_ec_delta_write_fallback);
+	      op->delta_write = false;
+	      op->delta_read_result.clear();
+	      op->remote_read = op->plan.to_read;
+	      start_remote_reads(op);
+	      return;
+	    }
+	    check_ops();
+	  }));
+  }
+}
+
 bool ECBackend::try_state_to_reads()
 {
   if (waiting_state.empty())
@@ -1868,7 +1979,21 @@ bool ECBackend::try_state_to_reads()
     return false;
   }
 
-  if (!pipeline_state.caching_enabled()) {
+  if (op->requires_rmw()) {
+    for (auto &&hpair : op->plan.to_read) {
+      if (object_write_in_flight(hpair.first, true)) {
+	dout(20) << __func__ << ": blocking " << *op
+		 << " because it requires an rmw of " << hpair.first
+		 << " behind an uncached write" << dendl;
+	return false;
+      }
+    }
+  }
+
+  if (can_delta_write(*op)) {
+    op->using_cache = false;
+    op->delta_write = true;
+  } else if (!pipeline_state.caching_enabled()) {
     op->using_cache = false;
   } else if (op->invalidates_cache()) {
     dout(20) << __func__ << ": invalidating cache after this op"
@@ -1879,7 +2004,9 @@ bool ECBackend::try_state_to_reads()
   waiting_state.pop_front();
   waiting_reads.push_back(*op);
 
-  if (op->using_cache) {
+  if (op->delta_write) {
+    // read by start_delta_reads below
+  } else if (op->using_cache) {
     cache.open_write_pin(op->pin);
 
     extent_set empty;
@@ -1912,16 +2039,10 @@ bool ECBackend::try_state_to_reads()
 
   dout(10) << __func__ << ": " << *op << dendl;
 
-  if (!op->remote_read.empty()) {
-    ceph_assert(get_parent()->get_pool().allows_ecoverwrites());
-    objects_read_async_no_cache(
-      op->remote_read,
-      [this, op](map<hobject_t,pair<int, extent_map> > &&results) {
-	for (auto &&i: results) {
-	  op->remote_read_result.emplace(i.first, i.second.second);
-	}
-	check_ops();
-      });
+  if (op->delta_write) {
+    start_delta_reads(op);
+  } else if (!op->remote_read.empty()) {
+    start_remote_reads(op);
   }
 
   return true;
@@ -1975,6 +2096,7 @@ bool ECBackend::try_reads_to_commit()
       get_parent()->get_info().pgid.pgid,
       sinfo,
       op->remote_read_result,
+      op->delta_read_result,
       op->log_entries,
       &written,
       &trans,
@@ -2003,7 +2125,19 @@ bool ECBackend::try_reads_to_commit()
     written_set[i.first] = i.second.get_interval_set();
   }
   dout(20) << __func__ << ": written_set: " << written_set << dendl;
-  ceph_assert(written_set == op->plan.will_write);
+  if (op->delta_write) {
+    // delta writes never have whole stripes to show for themselves
+    auto will_write = op->plan.will_write;
+    for (auto &&i: op->delta_read_result) {
+      ceph_assert(written_set[i.first].empty());
+      written_set.erase(i.first);
+      will_write.erase(i.first);
+    }
+    ceph_assert(written_set == will_write);
+    get_parent()->get_logger()->inc(l_osd_ec_delta_write);
+  } else {
+    ceph_assert(written_set == op->plan.will_write);
+  }
 
   if (op->using_cache) {
     for (auto &&hpair: written) {
@@ -2013,6 +2147,7 @@ bool ECBackend::try_reads_to_commit()
   }
   op->remote_read.clear();
   op->remote_read_result.clear();
+  op->delta_read_result.clear();
 
   ObjectStore::Transaction empty;
   bool should_write_local = false;
@@ -2328,6 +2463,97 @@ out:
   }
 };
 
+struct CallChunkReadContext :
+  public GenContext<pair<RecoveryMessages*, ECBackend::read_result_t& > &> {
+  set<int> shards;
+  list<boost::tuple<uint64_t, uint64_t, uint32_t> > to_read;
+  GenContextURef<pair<int, ECTransaction::stripe_chunks_t> &&> func;
+  CallChunkReadContext(
+    const set<int> &shards,
+    const list<boost::tuple<uint64_t, uint64_t, uint32_t> > &to_read,
+    GenContextURef<pair<int, ECTransaction::stripe_chunks_t> &&> &&func)
+    : shards(shards), to_read(to_read), func(std::move(func)) {}
+  void finish(pair<RecoveryMessages *, ECBackend::read_result_t &> &in) override {
+    ECBackend::read_result_t &res = in.second;
+    ECTransaction::stripe_chunks_t chunks;
+    int r = res.r;
+    if (r == 0 && res.returned.size() != to_read.size()) {
+      r = -EIO;
+    }
+    for (auto &&read: to_read) {
+      if (r < 0)
+	break;
+      auto &stripe = chunks[read.get<0>()];
+      for (auto &&j: res.returned.front().get<2>()) {
+	stripe[j.first.shard].claim(j.second);
+      }
+      // reconstructed reads are no use, we need these very shards
+      for (int shard : shards) {
+	if (!stripe.count(shard)) {
+	  r = -EIO;
+	}
+      }
+      res.returned.pop_front();
+    }
+    if (r < 0) {
+      chunks.clear();
+    }
+    func.release()->complete(make_pair(r, std::move(chunks)));
+  }
+};
+
+void ECBackend::objects_read_chunks(
+  const hobject_t &hoid,
+  const extent_set &stripes,
+  const set<int> &shards,
+  GenContextURef<pair<int, ECTransaction::stripe_chunks_t> &&> &&func)
+{
+  list<boost::tuple<uint64_t, uint64_t, uint32_t> > to_read;
+  for (auto &&extent : stripes) {
+    ceph_assert(sinfo.logical_offset_is_stripe_aligned(extent.first));
+    ceph_assert(sinfo.logical_offset_is_stripe_aligned(extent.second));
+    for (uint64_t off = extent.first;
+	 off < extent.first + extent.second;
+	 off += sinfo.get_stripe_width()) {
+      to_read.push_back(boost::make_tuple(off, sinfo.get_stripe_width(), 0));
+    }
+  }
+
+  set<int> have;
+  map<shard_id_t, pg_shard_t> avail;
+  get_all_avail_shards(hoid, set<pg_shard_t>(), have, avail, false);
+  map<pg_shard_t, vector<pair<int, int>>> need;
+  vector<pair<int, int>> subchunks;
+  subchunks.push_back(make_pair(0, ec_impl->get_sub_chunk_count()));
+  for (int shard : shards) {
+    auto i = avail.find(shard_id_t(shard));
+    if (i == avail.end()) {
+      func.release()->complete(
+	make_pair(-EIO, ECTransaction::stripe_chunks_t()));
+      return;
+    }
+    need[i->second] = subchunks;
+  }
+
+  map<hobject_t, set<int>> want_to_read;
+  want_to_read[hoid] = shards;
+  map<hobject_t, read_request_t> for_read_op;
+  for_read_op.insert(
+    make_pair(
+      hoid,
+      read_request_t(
+	to_read,
+	need,
+	false,
+	new CallChunkReadContext(shards, to_read, std::move(func)))));
+  start_read_op(
+    CEPH_MSG_PRIO_DEFAULT,
+    want_to_read,
+    for_read_op,
+    OpRequestRef(),
+    false, false);
+}
+
 void ECBackend::objects_read_and_reconstruct(
   const map<hobject_t,
     std::list<boost::tuple<uint64_t, uint64_t, uint32_t> >
@@ -2486,19 +2712,15 @@ int ECBackend::be_deep_scrub(
     stride += sinfo.get_chunk_size() - (stride % sinfo.get_chunk_size());
 
   bufferlist bl;
-  r = store->read(
-    ch,
-    ghobject_t(
-      poid, ghobject_t::NO_GEN, get_parent()->whoami_shard().shard),
-    pos.data_pos,
-    stride, bl,
-    fadvise_flags);
+  r = be_scrub_read(poid, pos, pos.data_pos, stride, fadvise_flags, bl);
   if (r < 0) {
     dout(20) << __func__ << "  " << poid << " got "
 	     << r << " on read, read_error" << dendl;
     o.read_error = true;
     return 0;
   }
+  be_scrub_readahead(pos, (uint64_t)r < stride, pos.data_pos, stride,
+		     fadvise_flags);
   if (bl.length() % sinfo.get_chunk_size()) {
     dout(20) << __func__ << "  " << poid << " got "
 	     << r << " on read, not chunk size " << sinfo.get_chunk_size() << " aligned"
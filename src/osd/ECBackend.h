@@ -143,6 +143,19 @@ public:
     GenContextURef<map<hobject_t,pair<int, extent_map> > &&> &&func);
 
   friend struct CallClientContexts;
+
+  /**
+   * Read the given shards' chunks of whole stripes as they are, without
+   * reconstructing anything.  Fails unless every shard can be read.
+   * Used by parity delta writes.
+   */
+  void objects_read_chunks(
+    const hobject_t &hoid,
+    const extent_set &stripes,
+    const set<int> &shards,
+    GenContextURef<pair<int, ECTransaction::stripe_chunks_t> &&> &&func);
+
+  friend struct CallChunkReadContext;
   struct ClientAsyncReadStatus {
     unsigned objects_to_read;
     GenContextURef<map<hobject_t,pair<int, extent_map> > &&> func;
@@ -485,8 +498,16 @@ public:
     map<hobject_t,extent_set> pending_read; // subset already being read
     map<hobject_t,extent_set> remote_read;  // subset we must read
     map<hobject_t,extent_map> remote_read_result;
+
+    /// Parity delta write state, see ECTransaction::WritePlan::delta
+    bool delta_write = false;
+    unsigned delta_reads_pending = 0;
+    bool delta_read_failed = false;
+    map<hobject_t,ECTransaction::stripe_chunks_t> delta_read_result;
+
     bool read_in_progress() const {
-      return !remote_read.empty() && remote_read_result.empty();
+      return (!remote_read.empty() && remote_read_result.empty()) ||
+	delta_reads_pending > 0;
     }
 
     /// In progress write state.
@@ -565,7 +586,13 @@ public:
   eversion_t completed_to;
   eversion_t committed_to;
   void start_rmw(Op *op, PGTransactionUPtr &&t);
+  bool parity_delta_enabled();
   bool try_state_to_reads();
+  void start_remote_reads(Op *op);
+  bool object_write_in_flight(const hobject_t &hoid,
+			      bool uncached_only) const;
+  bool can_delta_write(const Op &op);
+  void start_delta_reads(Op *op);
   bool try_reads_to_commit();
   bool try_finish_rmw();
   void check_ops();
@@ -81,6 +81,132 @@ void encode_and_write(
   }
 }
 
+void delta_encode_and_write(
+  pg_t pgid,
+  const hobject_t &oid,
+  const ECUtil::stripe_info_t &sinfo,
+  ErasureCodeInterfaceRef &ecimpl,
+  const ECTransaction::DeltaPlan &delta,
+  const ECTransaction::stripe_chunks_t &old_chunks,
+  const extent_map &to_write,
+  uint32_t flags,
+  map<shard_id_t, ObjectStore::Transaction> *transactions,
+  DoutPrefixProvider *dpp) {
+  const uint64_t chunk_size = sinfo.get_chunk_size();
+  const int k = ecimpl->get_data_chunk_count();
+
+  for (auto &&[stripe_off, shards] : delta.stripes) {
+    auto old_iter = old_chunks.find(stripe_off);
+    ceph_assert(old_iter != old_chunks.end());
+    const map<int, bufferlist> &old_stripe = old_iter->second;
+
+    map<int, bufferlist> old_data, new_data, parity;
+    for (int shard : shards) {
+      ceph_assert(shard < k);
+      const bufferlist &old_bl = old_stripe.at(shard);
+      ceph_assert(old_bl.length() == chunk_size);
+      old_data[shard] = old_bl;
+
+      // lay the updates over the old chunk contents
+      const uint64_t chunk_start = stripe_off + shard * chunk_size;
+      bufferlist &new_bl = new_data[shard];
+      uint64_t pos = 0;
+      for (auto &&extent : to_write.intersect(chunk_start, chunk_size)) {
+	uint64_t off = extent.get_off() - chunk_start;
+	if (off > pos) {
+	  bufferlist keep;
+	  keep.substr_of(old_bl, pos, off - pos);
+	  new_bl.claim_append(keep);
+	}
+	new_bl.append(extent.get_val());
+	pos = off + extent.get_len();
+      }
+      if (pos < chunk_size) {
+	bufferlist keep;
+	keep.substr_of(old_bl, pos, chunk_size - pos);
+	new_bl.claim_append(keep);
+      }
+      ceph_assert(new_bl.length() == chunk_size);
+    }
+    for (auto &&p : old_stripe) {
+      if (p.first >= k) {
+	parity[p.first] = p.second;
+      }
+    }
+    ceph_assert(parity.size() == ecimpl->get_coding_chunk_count());
+
+    int r = ECUtil::encode_parity_delta(
+      sinfo, ecimpl, old_data, new_data, &parity);
+    ceph_assert(r == 0);
+
+    ldpp_dout(dpp, 20) << __func__ << ": " << oid
+		       << " stripe " << stripe_off
+		       << " writing data shards " << shards
+		       << " and " << parity.size() << " coding shards"
+		       << dendl;
+
+    const uint64_t chunk_off =
+      sinfo.aligned_logical_offset_to_chunk_offset(stripe_off);
+    auto write_shard = [&](int shard, bufferlist &bl) {
+      auto t = transactions->find(shard_id_t(shard));
+      if (t == transactions->end())
+	return;
+      t->second.write(
+	coll_t(spg_t(pgid, t->first)),
+	ghobject_t(oid, ghobject_t::NO_GEN, t->first),
+	chunk_off,
+	bl.length(),
+	bl,
+	flags);
+    };
+    for (auto &&p : new_data) {
+      write_shard(p.first, p.second);
+    }
+    for (auto &&p : parity) {
+      write_shard(p.first, p.second);
+    }
+  }
+}
+
+bool ECTransaction::plan_parity_delta(
+  const ECUtil::stripe_info_t &sinfo,
+  unsigned coding_chunks,
+  const extent_set &raw_write_set,
+  DeltaPlan *delta)
+{
+  const uint64_t chunk_size = sinfo.get_chunk_size();
+  const unsigned k = sinfo.get_stripe_width() / chunk_size;
+
+  map<uint64_t, set<int>> stripes;
+  for (auto &&extent : raw_write_set) {
+    uint64_t end = extent.first + extent.second;
+    for (uint64_t off = extent.first; off < end; ) {
+      uint64_t stripe_off = sinfo.logical_to_prev_stripe_offset(off);
+      int shard = (off - stripe_off) / chunk_size;
+      stripes[stripe_off].insert(shard);
+      off = stripe_off + (shard + 1) * chunk_size;
+    }
+  }
+
+  // A full rewrite reads k chunks and writes k + m, a delta reads and
+  // writes the changed chunks plus m.
+  for (auto &&p : stripes) {
+    if (2 * p.second.size() + coding_chunks >= 2 * k) {
+      return false;
+    }
+  }
+
+  delta->read_shards.clear();
+  for (auto &&p : stripes) {
+    delta->read_shards.insert(p.second.begin(), p.second.end());
+  }
+  for (unsigned i = k; i < k + coding_chunks; ++i) {
+    delta->read_shards.insert(i);
+  }
+  delta->stripes.swap(stripes);
+  return true;
+}
+
 bool ECTransaction::requires_overwrite(
   uint64_t prev_size,
   const PGTransaction::ObjectOperation &op) {
@@ -100,6 +226,7 @@ void ECTransaction::generate_transactions(
   pg_t pgid,
   const ECUtil::stripe_info_t &sinfo,
   const map<hobject_t,extent_map> &partial_extents,
+  const map<hobject_t,stripe_chunks_t> &delta_chunks,
   vector<pg_log_entry_t> &entries,
   map<hobject_t,extent_map> *written_map,
   map<shard_id_t, ObjectStore::Transaction> *transactions,
@@ -546,6 +673,52 @@ void ECTransaction::generate_transactions(
       ldpp_dout(dpp, 20) << __func__ << ": to_overwrite: "
 			 << to_overwrite
 			 << dendl;
+      auto delta_iter = delta_chunks.find(oid);
+      if (delta_iter != delta_chunks.end()) {
+	// Only the changed data shards and the coding shards are written,
+	// but every shard saves the extent for rollback so that rolling
+	// back stays uniform across shards.
+	auto plan_iter = plan.delta.find(oid);
+	ceph_assert(plan_iter != plan.delta.end());
+	ceph_assert(entry);
+	for (auto &&p : plan_iter->second.stripes) {
+	  uint64_t restore_from =
+	    sinfo.aligned_logical_offset_to_chunk_offset(p.first);
+	  uint64_t restore_len = sinfo.get_chunk_size();
+	  ldpp_dout(dpp, 20) << __func__ << ": delta overwriting "
+			     << restore_from << "~" << restore_len
+			     << dendl;
+	  if (rollback_extents.empty()) {
+	    for (auto &&st : *transactions) {
+	      st.second.touch(
+		coll_t(spg_t(pgid, st.first)),
+		ghobject_t(oid, entry->version.version, st.first));
+	    }
+	  }
+	  rollback_extents.emplace_back(make_pair(restore_from, restore_len));
+	  for (auto &&st : *transactions) {
+	    st.second.clone_range(
+	      coll_t(spg_t(pgid, st.first)),
+	      ghobject_t(oid, ghobject_t::NO_GEN, st.first),
+	      ghobject_t(oid, entry->version.version, st.first),
+	      restore_from,
+	      restore_len,
+	      restore_from);
+	  }
+	}
+	delta_encode_and_write(
+	  pgid,
+	  oid,
+	  sinfo,
+	  ecimpl,
+	  plan_iter->second,
+	  delta_iter->second,
+	  to_overwrite,
+	  fadvise_flags,
+	  transactions,
+	  dpp);
+	to_overwrite.clear();
+      }
       for (auto &&extent: to_overwrite) {
 	ceph_assert(extent.get_off() + extent.get_len() <= append_after);
 	ceph_assert(sinfo.logical_offset_is_stripe_aligned(extent.get_off()));
@@ -23,6 +23,20 @@
 #include "ExtentCache.h"
 
 namespace ECTransaction {
+  /// chunks of a set of stripes, by logical stripe offset and shard
+  using stripe_chunks_t = map<uint64_t, map<int, bufferlist>>;
+
+  /**
+   * An overwrite that only changes some data chunks of each stripe it
+   * touches can skip the full-stripe read-modify-write: read just the
+   * changed data chunks and the coding chunks, update the coding chunks
+   * from the data delta and write only those shards.
+   */
+  struct DeltaPlan {
+    map<uint64_t, set<int>> stripes; ///< stripe offset -> data shards changed
+    set<int> read_shards;            ///< changed data shards + coding shards
+  };
+
   struct WritePlan {
     PGTransactionUPtr t;
     bool invalidates_cache = false; // Yes, both are possible
@@ -30,8 +44,19 @@ namespace ECTransaction {
     map<hobject_t,extent_set> will_write; // superset of to_read
 
     map<hobject_t,ECUtil::HashInfoRef> hash_infos;
+
+    // Alternative to to_read, covering the same objects; empty unless
+    // every object in to_read qualifies.
+    map<hobject_t,DeltaPlan> delta;
   };
 
+  /// fill in plan.delta[oid] if the write is cheaper done as a delta
+  bool plan_parity_delta(
+    const ECUtil::stripe_info_t &sinfo,
+    unsigned coding_chunks,
+    const extent_set &raw_write_set,
+    DeltaPlan *delta);
+
   bool requires_overwrite(
     uint64_t prev_size,
     const PGTransaction::ObjectOperation &op);
@@ -41,7 +66,8 @@ namespace ECTransaction {
     const ECUtil::stripe_info_t &sinfo,
     PGTransactionUPtr &&t,
     F &&get_hinfo,
-    DoutPrefixProvider *dpp) {
+    DoutPrefixProvider *dpp,
+    unsigned delta_coding_chunks = 0) { ///< non-zero to plan parity deltas
     WritePlan plan;
     t->safe_create_traverse(
       [&](pair<const hobject_t, PGTransaction::ObjectOperation> &i) {
@@ -170,6 +196,25 @@ namespace ECTransaction {
 	  sinfo,
 	  projected_size);
 
+	// pure overwrite of partial stripes only
+	auto to_read_iter = plan.to_read.find(i.first);
+	if (delta_coding_chunks &&
+	    to_read_iter != plan.to_read.end() &&
+	    !i.first.is_temp() &&
+	    i.second.is_none() &&
+	    !i.second.deletes_first() &&
+	    !i.second.truncate &&
+	    to_read_iter->second == will_write &&
+	    will_write.range_end() <= orig_size) {
+	  DeltaPlan delta;
+	  if (plan_parity_delta(sinfo, delta_coding_chunks, raw_write_set,
+				&delta)) {
+	    ldpp_dout(dpp, 20) << __func__ << ": parity delta possible for "
+			       << delta.stripes << dendl;
+	    plan.delta[i.first] = std::move(delta);
+	  }
+	}
+
 	/* validate post conditions:
 	 * to_read should have an entry for i.first iff it isn't empty
 	 * and if we are reading from i.first, we can't be renaming or
@@ -178,6 +223,9 @@ namespace ECTransaction {
 	       (!plan.to_read.at(i.first).empty() &&
 		!i.second.has_source()));
       });
+    if (plan.delta.size() != plan.to_read.size()) {
+      plan.delta.clear();
+    }
     plan.t = std::move(t);
     return plan;
   }
@@ -188,6 +236,7 @@ namespace ECTransaction {
     pg_t pgid,
     const ECUtil::stripe_info_t &sinfo,
     const map<hobject_t,extent_map> &partial_extents,
+    const map<hobject_t,stripe_chunks_t> &delta_chunks,
     vector<pg_log_entry_t> &entries,
     map<hobject_t,extent_map> *written,
     map<shard_id_t, ObjectStore::Transaction> *transactions,
@@ -158,6 +158,75 @@ int ECUtil::encode(
   return 0;
 }
 
+static bufferlist xor_chunks(const bufferlist &a, const bufferlist &b)
+{
+  ceph_assert(a.length() == b.length());
+  bufferlist ac(a), bc(b);
+  const char *pa = ac.c_str();
+  const char *pb = bc.c_str();
+  bufferptr out = buffer::create_page_aligned(a.length());
+  char *po = out.c_str();
+  unsigned i = 0;
+  for (; i + sizeof(uint64_t) <= a.length(); i += sizeof(uint64_t)) {
+    uint64_t x, y;
+    memcpy(&x, pa + i, sizeof(x));
+    memcpy(&y, pb + i, sizeof(y));
+    x ^= y;
+    memcpy(po + i, &x, sizeof(x));
+  }
+  for (; i < a.length(); ++i) {
+    po[i] = pa[i] ^ pb[i];
+  }
+  bufferlist bl;
+  bl.append(std::move(out));
+  return bl;
+}
+
+int ECUtil::encode_parity_delta(
+  const stripe_info_t &sinfo,
+  ErasureCodeInterfaceRef &ec_impl,
+  const map<int, bufferlist> &old_data,
+  const map<int, bufferlist> &new_data,
+  map<int, bufferlist> *parity) {
+  ceph_assert(parity);
+  ceph_assert(ec_impl->supports_parity_delta());
+  ceph_assert(ec_impl->get_chunk_mapping().empty());
+  ceph_assert(old_data.size() == new_data.size());
+
+  const uint64_t chunk_size = sinfo.get_chunk_size();
+  const unsigned k = ec_impl->get_data_chunk_count();
+
+  // the delta stripe is zero wherever the data did not change
+  bufferlist delta;
+  for (unsigned i = 0; i < k; ++i) {
+    auto o = old_data.find(i);
+    if (o == old_data.end()) {
+      delta.append_zero(chunk_size);
+      continue;
+    }
+    auto n = new_data.find(i);
+    ceph_assert(n != new_data.end());
+    ceph_assert(o->second.length() == chunk_size);
+    bufferlist d = xor_chunks(o->second, n->second);
+    delta.claim_append(d);
+  }
+
+  set<int> want;
+  for (auto &&p : *parity) {
+    ceph_assert(p.first >= (int)k);
+    ceph_assert(p.second.length() == chunk_size);
+    want.insert(p.first);
+  }
+  map<int, bufferlist> encoded;
+  int r = encode(sinfo, ec_impl, delta, want, &encoded);
+  if (r < 0)
+    return r;
+  for (auto &&p : *parity) {
+    p.second = xor_chunks(p.second, encoded[p.first]);
+  }
+  return 0;
+}
+
 void ECUtil::HashInfo::append(uint64_t old_size,
 			      map<int, bufferlist> &to_append) {
   ceph_assert(old_size == total_chunk_size);
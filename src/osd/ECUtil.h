@@ -98,6 +98,20 @@ int encode(
   const std::set<int> &want,
   std::map<int, bufferlist> *out);
 
+/**
+ * Recompute the coding chunks of one stripe after some of its data
+ * chunks change, without the unchanged data chunks.  old_data and
+ * new_data hold the changed data chunks keyed by shard, parity holds
+ * the old coding chunks and is updated in place.  Only valid if
+ * ec_impl->supports_parity_delta() and the code does not remap chunks.
+ */
+int encode_parity_delta(
+  const stripe_info_t &sinfo,
+  ErasureCodeInterfaceRef &ec_impl,
+  const std::map<int, bufferlist> &old_data,
+  const std::map<int, bufferlist> &new_data,
+  std::map<int, bufferlist> *parity);
+
 class HashInfo {
   uint64_t total_chunk_size = 0;
   std::vector<uint32_t> cumulative_shard_hashes;
@@ -19,6 +19,7 @@
 #include <fstream>
 #include <iostream>
 #include <iterator>
+#include <thread>
 
 #include <unistd.h>
 #include <sys/stat.h>
@@ -233,6 +234,12 @@ OSDService::OSDService(OSD *osd) :
   max_oldest_map(0),
   sched_scrub_lock("OSDService::sched_scrub_lock"), scrubs_pending(0),
   scrubs_active(0),
+  scrub_readahead_wq("OSD::scrub_readahead_wq", 0, &osd->scrub_readahead_tp),
+  scrub_readahead_throttle(
+    cct, "osd_deep_scrub_readahead",
+    cct->_conf.get_val<Option::size_t>("osd_deep_scrub_readahead_bytes")),
+  osd_deep_scrub_readahead_client_ops(cct->_conf,
+    "osd_deep_scrub_readahead_client_ops"),
   agent_lock("OSDService::agent_lock"),
   agent_valid_iterator(false),
   agent_ops(0),
@@ -1241,6 +1248,26 @@ void OSDService::dec_scrubs_active()
   sched_scrub_lock.Unlock();
 }
 
+bool OSDService::queue_scrub_readahead(uint64_t bytes, Context *c)
+{
+  if (scrub_readahead_throttle.get_max() == 0) {
+    return false;
+  }
+  uint64_t max_ops = osd_deep_scrub_readahead_client_ops;
+  if (max_ops &&
+      logger->get(l_osd_op_wip) > max_ops) {
+    return false;
+  }
+  if (!scrub_readahead_throttle.get_or_fail(bytes)) {
+    return false;
+  }
+  scrub_readahead_wq.queue(new LambdaContext([this, bytes, c]() {
+	c->complete(0);
+	scrub_readahead_throttle.put(bytes);
+      }));
+  return true;
+}
+
 void OSDService::retrieve_epochs(epoch_t *_boot_epoch, epoch_t *_up_epoch,
                                  epoch_t *_bind_epoch) const
 {
@@ -1545,7 +1572,11 @@ OSDMapRef OSDService::try_get_map(epoch_t epoch)
       delete map;
       return OSDMapRef();
     }
-    map->decode(bl);
+    OSDMapRef base;
+    if (cct->_conf->osd_map_dedup) {
+      base = map_cache.lower_bound(epoch);
+    }
+    map->decode(bl, base.get());
   } else {
     dout(20) << "get_map " << epoch << " - return initial " << map << dendl;
   }
@@ -2094,6 +2125,8 @@ OSD::OSD(CephContext *cct_, ObjectStore *store_,
   osd_op_tp(cct, "OSD::osd_op_tp", "tp_osd_tp",
 	    get_num_op_threads()),
   command_tp(cct, "OSD::command_tp", "tp_osd_cmd",  1),
+  scrub_readahead_tp(cct, "OSD::scrub_readahead_tp", "tp_osd_scrub_ra",
+    cct->_conf.get_val<uint64_t>("osd_deep_scrub_readahead_threads")),
   session_waiting_lock("OSD::session_waiting_lock"),
   osdmap_subscribe_lock("OSD::osdmap_subscribe_lock"),
   heartbeat_lock("OSD::heartbeat_lock"),
@@ -2161,6 +2194,11 @@ OSD::OSD(CephContext *cct_, ObjectStore *store_,
   trace_endpoint.copy_name(ss.str());
 #endif
 
+  if (op_queue == io_queue::mclock_opclass ||
+      op_queue == io_queue::mclock_client) {
+    mclock_cost_model = std::make_unique<ceph::mclock::OpCostModel>(cct);
+  }
+
   // initialize shards
   num_shards = get_num_op_shards();
   for (uint32_t i = 0; i < num_shards; i++) {
@@ -2170,7 +2208,8 @@ OSD::OSD(CephContext *cct_, ObjectStore *store_,
       this,
       cct->_conf->osd_op_pq_max_tokens_per_priority,
       cct->_conf->osd_op_pq_min_cost,
-      op_queue);
+      op_queue,
+      mclock_cost_model.get());
     shards.push_back(one_shard);
   }
 }
@@ -2925,6 +2964,10 @@ int OSD::init()
   dout(0) << "using " << op_queue << " op queue with priority op cut off at " <<
     op_prio_cutoff << "." << dendl;
 
+  if (mclock_cost_model && mclock_cost_model->is_adaptive()) {
+    calibrate_mclock_cost_model();
+  }
+
   create_logger();
 
   // prime osd stats
@@ -3025,6 +3068,7 @@ int OSD::init()
 
   osd_op_tp.start();
   command_tp.start();
+  scrub_readahead_tp.start();
 
   // start the heartbeat
   heartbeat_thread.create("osd_srv_heartbt");
@@ -3108,6 +3152,165 @@ out:
   return r;
 }
 
+int OSD::measure_store_writes(uint64_t bsize, unsigned depth, double duration,
+			      uint64_t max_bytes,
+			      double *iops, double *bandwidth, double *latency)
+{
+  // Keep 'depth' writes of 'bsize' in flight for 'duration' seconds, or
+  // until 'max_bytes' have been written.
+  // Writes append to a fixed set of scratch objects in the meta
+  // collection so that a fast device doesn't leave behind (and then
+  // have to remove) an object per write.
+  constexpr unsigned num_objects = 1024;
+  bufferlist bl;
+  bufferptr bp(bsize);
+  bp.zero();
+  bl.push_back(std::move(bp));
+  bl.rebuild_page_aligned();
+
+  ceph::mutex lock = ceph::make_mutex("OSD::measure_store_writes");
+  ceph::condition_variable cond;
+  unsigned in_flight = 0;
+  uint64_t done = 0;
+  double latency_sum = 0;
+
+  auto start = ceph::mono_clock::now();
+  auto stop = start + ceph::make_timespan(duration);
+  uint64_t i;
+  for (i = 0; ceph::mono_clock::now() < stop && i * bsize < max_bytes; ++i) {
+    {
+      std::unique_lock l{lock};
+      cond.wait(l, [&] { return in_flight < depth; });
+      ++in_flight;
+    }
+    char nm[40];
+    snprintf(nm, sizeof(nm), "mclock_calibration_%u",
+	     (unsigned)(i % num_objects));
+    hobject_t soid(sobject_t(object_t(nm), 0));
+    ObjectStore::Transaction t;
+    t.write(coll_t::meta(), ghobject_t(soid), (i / num_objects) * bsize,
+	    bsize, bl);
+    auto issued = ceph::mono_clock::now();
+    t.register_on_commit(new LambdaContext([&, issued]() {
+      std::lock_guard l{lock};
+      latency_sum += std::chrono::duration<double>(
+	ceph::mono_clock::now() - issued).count();
+      ++done;
+      --in_flight;
+      cond.notify_all();
+    }));
+    store->queue_transaction(service.meta_ch, std::move(t));
+  }
+  {
+    std::unique_lock l{lock};
+    cond.wait(l, [&] { return in_flight == 0; });
+  }
+  double elapsed = std::chrono::duration<double>(
+    ceph::mono_clock::now() - start).count();
+
+  ObjectStore::Transaction cleanupt;
+  for (uint64_t j = 0; j < std::min<uint64_t>(i, num_objects); ++j) {
+    char nm[40];
+    snprintf(nm, sizeof(nm), "mclock_calibration_%u", (unsigned)j);
+    hobject_t soid(sobject_t(object_t(nm), 0));
+    cleanupt.remove(coll_t::meta(), ghobject_t(soid));
+  }
+  store->queue_transaction(service.meta_ch, std::move(cleanupt));
+  {
+    C_SaferCond waiter;
+    if (!service.meta_ch->flush_commit(&waiter)) {
+      waiter.wait();
+    }
+  }
+
+  if (done == 0 || elapsed <= 0) {
+    return -EIO;
+  }
+  *iops = done / elapsed;
+  *bandwidth = done * bsize / elapsed;
+  *latency = latency_sum / done;
+  dout(10) << __func__ << " " << done << " writes of " << byte_u_t(bsize)
+	   << " at depth " << depth << " in " << elapsed << " sec: "
+	   << *iops << " iops " << byte_u_t(*bandwidth) << "/s"
+	   << " latency " << *latency << dendl;
+  return 0;
+}
+
+void OSD::calibrate_mclock_cost_model()
+{
+  double iops = cct->_conf.get_val<double>("osd_op_queue_mclock_device_iops");
+  uint64_t bandwidth =
+    cct->_conf.get_val<Option::size_t>("osd_op_queue_mclock_device_bandwidth");
+  unsigned depth =
+    cct->_conf.get_val<uint64_t>("osd_op_queue_mclock_calibration_queue_depth");
+  double duration =
+    cct->_conf.get_val<double>("osd_op_queue_mclock_calibration_duration");
+  uint64_t small_size = cct->_conf.get_val<Option::size_t>(
+    "osd_op_queue_mclock_calibration_small_size");
+  uint64_t large_size = cct->_conf.get_val<Option::size_t>(
+    "osd_op_queue_mclock_calibration_large_size");
+
+  // Bound what each run may write the way 'osd bench' does, and leave the
+  // store short of its failsafe full ratio: a full store would fail the
+  // OSD at startup.  Each run removes its objects before the next.
+  auto max_bytes = [this, duration](uint64_t bsize) -> uint64_t {
+    if (bsize < (1 << 20)) {
+      return bsize * duration * cct->_conf->osd_bench_small_size_max_iops;
+    }
+    return cct->_conf->osd_bench_large_size_max_throughput * duration;
+  };
+  uint64_t small_max = max_bytes(small_size);
+  uint64_t large_max = bandwidth == 0 ? max_bytes(large_size) : 0;
+  {
+    struct store_statfs_t stbuf;
+    osd_alert_list_t alerts;
+    int r = store->statfs(&stbuf, &alerts);
+    if (r < 0) {
+      derr << __func__ << " unable to statfs: " << cpp_strerror(r) << dendl;
+      return;
+    }
+    uint64_t reserved =
+      stbuf.total * (1.0 - cct->_conf->osd_failsafe_full_ratio);
+    uint64_t room = stbuf.available > reserved ?
+      stbuf.available - reserved : 0;
+    if (room < std::max(small_max, large_max)) {
+      derr << __func__ << " only " << byte_u_t(room) << " free of "
+	   << byte_u_t(stbuf.total) << ", not measuring the device; set"
+	   << " osd_op_queue_mclock_device_iops and"
+	   << " osd_op_queue_mclock_device_bandwidth" << dendl;
+      return;
+    }
+  }
+
+  // The latency at the calibrated depth is what we compare the store's
+  // commit latency against later on, so the small write run happens even
+  // if the IOPS are configured.
+  double small_iops, small_bw, latency;
+  int r = measure_store_writes(
+    small_size, depth, duration, small_max, &small_iops, &small_bw, &latency);
+  if (r < 0) {
+    derr << __func__ << " unable to measure small writes: "
+	 << cpp_strerror(r) << dendl;
+    return;
+  }
+  if (iops <= 0) {
+    iops = small_iops;
+  }
+  if (bandwidth == 0) {
+    double large_iops, large_bw, large_latency;
+    r = measure_store_writes(
+      large_size, depth, duration, large_max,
+      &large_iops, &large_bw, &large_latency);
+    if (r < 0) {
+      derr << __func__ << " unable to measure large writes: "
+	   << cpp_strerror(r) << dendl;
+      return;
+    }
+    bandwidth = large_bw;
+  }
+  mclock_cost_model->set_capacity(iops, bandwidth, latency);
+}
+
 void OSD::final_init()
 {
   AdminSocket *admin_socket = cct->get_admin_socket();
@@ -3447,6 +3650,10 @@ int OSD::shutdown()
   command_tp.stop();
   dout(10) << "command tp stopped" << dendl;
 
+  scrub_readahead_tp.drain();
+  scrub_readahead_tp.stop();
+  dout(10) << "scrub read-ahead tp stopped" << dendl;
+
   dout(10) << "stopping agent" << dendl;
   service.agent_stop();
 
@@ -7380,6 +7587,10 @@ MPGStats* OSD::collect_pg_stats()
 
   osd_stat_t cur_stat = service.get_osd_stat();
   cur_stat.os_perf_stat = store->get_cur_stats();
+  if (mclock_cost_model) {
+    mclock_cost_model->update_latency(
+      cur_stat.os_perf_stat.os_commit_latency_ns / 1000000000.0);
+  }
 
   auto m = new MPGStats(monc->get_fsid(), osdmap->get_epoch());
   m->osd_stat = cur_stat;
@@ -7716,7 +7927,12 @@ void OSD::handle_osd_map(MOSDMap *m)
       OSDMap *o = new OSDMap;
       bufferlist& bl = p->second;
 
-      o->decode(bl);
+      OSDMapRef base;
+      if (cct->_conf->osd_map_dedup) {
+	auto q = added_maps.find(e - 1);
+	base = q != added_maps.end() ? q->second : get_osdmap();
+      }
+      o->decode(bl, base.get());
 
       purged_snaps[e] = o->get_new_purged_snaps();
 
@@ -7737,14 +7953,25 @@ void OSD::handle_osd_map(MOSDMap *m)
 
       OSDMap *o = new OSDMap;
       if (e > 1) {
-	bufferlist obl;
-        bool got = get_map_bl(e - 1, obl);
-	if (!got) {
-	  auto p = added_maps_bl.find(e - 1);
-	  ceph_assert(p != added_maps_bl.end());
-	  obl = p->second;
+	OSDMapRef prev;
+	if (cct->_conf->osd_map_dedup) {
+	  auto q = added_maps.find(e - 1);
+	  prev = q != added_maps.end() ? q->second : service.try_get_map(e - 1);
+	}
+	if (prev) {
+	  // start from the previous map, sharing whatever the incremental
+	  // leaves alone, rather than decoding it all over again
+	  o->shared_copy_from(*prev);
+	} else {
+	  bufferlist obl;
+	  bool got = get_map_bl(e - 1, obl);
+	  if (!got) {
+	    auto p = added_maps_bl.find(e - 1);
+	    ceph_assert(p != added_maps_bl.end());
+	    obl = p->second;
+	  }
+	  o->decode(obl);
 	}
-	o->decode(obl);
       }
 
       OSDMap::Incremental inc;
@@ -10061,6 +10288,80 @@ void OSD::get_perf_reports(
 #undef dout_prefix
 #define dout_prefix *_dout << "osd." << osd->get_nodeid() << ":" << shard_id << "." << __func__ << " "
 
+bool OSDShard::enqueue_lockless(OpQueueItem&& item)
+{
+  if (!lockless_enqueue) {
+    return false;
+  }
+  // a slot is ours to fill when its seq equals our position, and the
+  // consumer's to drain once we bump seq to position + 1
+  uint64_t pos = incoming_tail.load(std::memory_order_relaxed);
+  incoming_slot_t *slot;
+  while (true) {
+    slot = &incoming[pos & (incoming_size - 1)];
+    uint64_t seq = slot->seq.load(std::memory_order_acquire);
+    if (seq == pos) {
+      if (incoming_tail.compare_exchange_weak(pos, pos + 1,
+					      std::memory_order_relaxed)) {
+	break;
+      }
+    } else if (seq < pos) {
+      return false;  // full
+    } else {
+      pos = incoming_tail.load(std::memory_order_relaxed);
+    }
+  }
+  slot->item.emplace(std::move(item));
+  slot->seq.store(pos + 1, std::memory_order_release);
+  ++num_incoming;
+  return true;
+}
+
+void OSDShard::_drain_incoming(unsigned cutoff, bool all)
+{
+  // a producer may have claimed a slot and still be filling it; with
+  // @p all we wait for it (and drain what follows it) rather than stop
+  uint64_t tail = all ? incoming_tail.load(std::memory_order_acquire) : 0;
+  while (true) {
+    auto& slot = incoming[incoming_head & (incoming_size - 1)];
+    if (slot.seq.load(std::memory_order_acquire) != incoming_head + 1) {
+      if (incoming_head < tail) {
+	std::this_thread::yield();
+	continue;
+      }
+      break;
+    }
+    --num_incoming;
+    OpQueueItem& item = *slot.item;
+    unsigned priority = item.get_priority();
+    unsigned cost = item.get_cost();
+    if (priority >= cutoff)
+      pqueue->enqueue_strict(
+	item.get_owner(), priority, std::move(item));
+    else
+      pqueue->enqueue(
+	item.get_owner(), priority, cost, std::move(item));
+    slot.item.reset();
+    slot.seq.store(incoming_head + incoming_size, std::memory_order_release);
+    ++incoming_head;
+  }
+}
+
+bool OSDShard::spin_for_work()
+{
+  if (spin_time == ceph::timespan::zero()) {
+    return false;
+  }
+  ++num_spinning;
+  auto until = mono_clock::now() + spin_time;
+  bool found;
+  while (!(found = has_incoming()) && mono_clock::now() < until) {
+    std::this_thread::yield();
+  }
+  --num_spinning;
+  return found;
+}
+
 void OSDShard::_attach_pg(OSDShardPGSlot *slot, PG *pg)
 {
   dout(10) << pg->pg_id << " " << pg << dendl;
@@ -10495,19 +10796,38 @@ void OSD::ShardedOpWQ::_process(uint32_t thread_index, heartbeat_handle_d *hb)
 
   // peek at spg_t
   sdata->shard_lock.lock();
+  sdata->_drain_incoming(osd->op_prio_cutoff);
+  if (sdata->pqueue->empty() &&
+      (!is_smallest_thread_index || sdata->context_queue.empty())) {
+    // under load the next op is usually only microseconds away; catch
+    // it here rather than pay for going to sleep and being woken up.
+    sdata->shard_lock.unlock();
+    if (sdata->spin_for_work()) {
+      osd->logger->inc(l_osd_op_wq_spin_hit);
+    }
+    sdata->shard_lock.lock();
+    sdata->_drain_incoming(osd->op_prio_cutoff);
+  }
   if (sdata->pqueue->empty() &&
       (!is_smallest_thread_index || sdata->context_queue.empty())) {
     std::unique_lock wait_lock{sdata->sdata_wait_lock};
     if (is_smallest_thread_index && !sdata->context_queue.empty()) {
       // we raced with a context_queue addition, don't wait
       wait_lock.unlock();
+    } else if (sdata->has_incoming()) {
+      // we raced with a lockless enqueue, which notifies under
+      // sdata_wait_lock only, don't wait
+      wait_lock.unlock();
+      sdata->_drain_incoming(osd->op_prio_cutoff);
     } else if (!sdata->stop_waiting) {
       dout(20) << __func__ << " empty q, waiting" << dendl;
+      osd->logger->inc(l_osd_op_wq_sleep);
       osd->cct->get_heartbeat_map()->clear_timeout(hb);
       sdata->shard_lock.unlock();
       sdata->sdata_cond.wait(wait_lock);
       wait_lock.unlock();
       sdata->shard_lock.lock();
+      sdata->_drain_incoming(osd->op_prio_cutoff);
       if (sdata->pqueue->empty() &&
          !(is_smallest_thread_index && !sdata->context_queue.empty())) {
 	sdata->shard_lock.unlock();
@@ -10781,11 +11101,22 @@ void OSD::ShardedOpWQ::_enqueue(OpQueueItem&& item) {
 
   OSDShard* sdata = osd->shards[shard_index];
   assert (NULL != sdata);
+  dout(20) << __func__ << " " << item << dendl;
+  if (sdata->enqueue_lockless(std::move(item))) {
+    // a spinning worker will see it without being woken up
+    if (sdata->num_spinning.load() == 0) {
+      std::lock_guard l{sdata->sdata_wait_lock};
+      sdata->sdata_cond.notify_one();
+    }
+    return;
+  }
+
   unsigned priority = item.get_priority();
   unsigned cost = item.get_cost();
   sdata->shard_lock.lock();
-
-  dout(20) << __func__ << " " << item << dendl;
+  // the ring was full: our earlier ops for the same pg may still sit in
+  // it, and must reach the pqueue before this one
+  sdata->_drain_incoming(osd->op_prio_cutoff, true);
   if (priority >= osd->op_prio_cutoff)
     sdata->pqueue->enqueue_strict(
       item.get_owner(), priority, std::move(item));
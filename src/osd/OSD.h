@@ -21,6 +21,7 @@
 
 #include "common/Mutex.h"
 #include "common/RWLock.h"
+#include "common/Throttle.h"
 #include "common/Timer.h"
 #include "common/WorkQueue.h"
 #include "common/AsyncReserver.h"
@@ -47,6 +48,7 @@
 #include <atomic>
 #include <map>
 #include <memory>
+#include <optional>
 #include <string>
 
 #include "include/unordered_map.h"
@@ -277,6 +279,11 @@ private:
   int scrubs_pending;
   int scrubs_active;
 
+  // -- deep scrub read-ahead --
+  ContextWQ scrub_readahead_wq;
+  Throttle scrub_readahead_throttle;  ///< bytes being read ahead
+  md_config_cacher_t<uint64_t> osd_deep_scrub_readahead_client_ops;
+
 public:
   struct ScrubJob {
     CephContext* cct;
@@ -356,6 +363,11 @@ public:
   void dec_scrubs_pending();
   void dec_scrubs_active();
 
+  /// run @p c, which reads ahead @p bytes for a deep scrub, on the
+  /// read-ahead threads; false (and @p c is not taken) if read-ahead is
+  /// off, over its budget or too many writes are in flight
+  bool queue_scrub_readahead(uint64_t bytes, Context *c);
+
   void reply_op_error(OpRequestRef op, int err);
   void reply_op_error(OpRequestRef op, int err, eversion_t v, version_t uv);
   void handle_misdirected_op(PG *pg, OpRequestRef op);
@@ -1018,6 +1030,24 @@ struct OSDShard {
   /// priority queue
   std::unique_ptr<OpQueue<OpQueueItem, uint64_t>> pqueue;
 
+  /// items enqueued without taking shard_lock, in a bounded ring that
+  /// holds them in place (multi-producer, and the only consumer is
+  /// whoever holds shard_lock).  _process moves them into pqueue before
+  /// looking at it, so relative to each other and to pqueue they are
+  /// ordered as if enqueued there directly.
+  struct incoming_slot_t {
+    std::atomic<uint64_t> seq;  ///< tells producers and consumer whose turn
+    std::optional<OpQueueItem> item;
+  };
+  static constexpr uint64_t incoming_size = 256;  ///< power of two
+  std::unique_ptr<incoming_slot_t[]> incoming;
+  std::atomic<uint64_t> incoming_tail = {0};  ///< next slot to fill
+  uint64_t incoming_head = 0;                 ///< next slot to drain
+  std::atomic<int> num_incoming = {0};  ///< may lag behind incoming
+  std::atomic<unsigned> num_spinning = {0};  ///< threads in spin_for_work()
+  const bool lockless_enqueue;
+  const ceph::timespan spin_time;
+
   bool stop_waiting = false;
 
   ContextQueue context_queue;
@@ -1035,6 +1065,18 @@ struct OSDShard {
 	priority, cost, std::move(item));
   }
 
+  /// queue @p item without shard_lock; false (and @p item untouched)
+  /// if we are not doing that or the ring is full
+  bool enqueue_lockless(OpQueueItem&& item);
+  bool has_incoming() const {
+    return num_incoming.load() > 0;
+  }
+  /// move incoming items into pqueue; with @p all, also those still
+  /// being queued by other threads
+  void _drain_incoming(unsigned cutoff, bool all = false);
+  /// busy-wait up to spin_time for a lockless enqueue; true if one came
+  bool spin_for_work();
+
   void _attach_pg(OSDShardPGSlot *slot, PG *pg);
   void _detach_pg(OSDShardPGSlot *slot);
 
@@ -1069,7 +1111,8 @@ struct OSDShard {
     CephContext *cct,
     OSD *osd,
     uint64_t max_tok_per_prio, uint64_t min_cost,
-    io_queue opqueue)
+    io_queue opqueue,
+    ceph::mclock::OpCostModel *cost_model = nullptr)
     : shard_id(id),
       cct(cct),
       osd(osd),
@@ -1080,6 +1123,11 @@ struct OSDShard {
       osdmap_lock{make_mutex(osdmap_lock_name)},
       shard_lock_name(shard_name + "::shard_lock"),
       shard_lock{make_mutex(shard_lock_name)},
+      incoming(new incoming_slot_t[incoming_size]),
+      lockless_enqueue(
+	cct->_conf.get_val<bool>("osd_op_queue_lockless_enqueue")),
+      spin_time(std::chrono::microseconds(
+	cct->_conf.get_val<uint64_t>("osd_op_thread_spin_us"))),
       context_queue(sdata_wait_lock, sdata_cond) {
     if (opqueue == io_queue::weightedpriority) {
       pqueue = std::make_unique<
@@ -1090,9 +1138,12 @@ struct OSDShard {
 	PrioritizedQueue<OpQueueItem,uint64_t>>(
 	  max_tok_per_prio, min_cost);
     } else if (opqueue == io_queue::mclock_opclass) {
-      pqueue = std::make_unique<ceph::mClockOpClassQueue>(cct);
+      pqueue = std::make_unique<ceph::mClockOpClassQueue>(cct, cost_model);
     } else if (opqueue == io_queue::mclock_client) {
-      pqueue = std::make_unique<ceph::mClockClientQueue>(cct);
+      pqueue = std::make_unique<ceph::mClockClientQueue>(cct, cost_model);
+    }
+    for (uint64_t i = 0; i < incoming_size; ++i) {
+      incoming[i].seq = i;
     }
   }
 };
@@ -1322,6 +1373,7 @@ private:
 
   ShardedThreadPool osd_op_tp;
   ThreadPool command_tp;
+  ThreadPool scrub_readahead_tp;
 
   void get_latest_osdmap();
 
@@ -1549,16 +1601,24 @@ public:
   const unsigned int op_prio_cutoff;
 protected:
 
+  // shared by the mclock queues of all shards
+  std::unique_ptr<ceph::mclock::OpCostModel> mclock_cost_model;
+  int measure_store_writes(uint64_t bsize, unsigned depth, double duration,
+			   uint64_t max_bytes,
+			   double *iops, double *bandwidth, double *latency);
+  void calibrate_mclock_cost_model();
+
   /*
    * The ordered op delivery chain is:
    *
-   *   fast dispatch -> pqueue back
-   *                    pqueue front <-> to_process back
-   *                                     to_process front  -> RunVis(item)
-   *                                                      <- queue_front()
+   *   fast dispatch -> incoming -> pqueue back
+   *                                pqueue front <-> to_process back
+   *                                                 to_process front  -> RunVis(item)
+   *                                                                  <- queue_front()
    *
-   * The pqueue is per-shard, and to_process is per pg_slot.  Items can be
-   * pushed back up into to_process and/or pqueue while order is preserved.
+   * The incoming and pqueue are per-shard, and to_process is per pg_slot.
+   * Items can be pushed back up into to_process and/or pqueue while order
+   * is preserved.
    *
    * Multiple worker threads can operate on each shard.
    *
@@ -1632,6 +1692,7 @@ protected:
 	std::scoped_lock l{sdata->shard_lock};
 	f->open_object_section(queue_name);
 	sdata->pqueue->dump(f);
+	f->dump_int("incoming", sdata->num_incoming.load());
 	f->close_section();
       }
     }
@@ -1641,6 +1702,9 @@ protected:
       auto &&sdata = osd->shards[shard_index];
       ceph_assert(sdata);
       std::lock_guard l(sdata->shard_lock);
+      if (sdata->has_incoming()) {
+	return false;
+      }
       if (thread_index < osd->num_shards) {
 	return sdata->pqueue->empty() && sdata->context_queue.empty();
       } else {
@@ -2038,6 +2102,7 @@ private:
     case MSG_OSD_PG_UPDATE_LOG_MISSING_REPLY:
     case MSG_OSD_PG_RECOVERY_DELETE:
     case MSG_OSD_PG_RECOVERY_DELETE_REPLY:
+    case MSG_OSD_PG_LEASE:
       return true;
     default:
       return false;
@@ -1670,10 +1670,12 @@ void OSDMap::dedup(const OSDMap *o, OSDMap *n)
 
   int diff = 0;
 
-  // do addrs match?
-  if (o->max_osd != n->max_osd)
+  // do addrs match?  if n's are already shared (see shared_copy_from()),
+  // another map may be reading them, so leave them be.
+  bool addrs_shared = n->osd_addrs.use_count() > 1;
+  if (o->max_osd != n->max_osd || addrs_shared)
     diff++;
-  for (int i = 0; i < o->max_osd && i < n->max_osd; i++) {
+  for (int i = 0; !addrs_shared && i < o->max_osd && i < n->max_osd; i++) {
     if ( n->osd_addrs->client_addrs[i] &&  o->osd_addrs->client_addrs[i] &&
 	*n->osd_addrs->client_addrs[i] == *o->osd_addrs->client_addrs[i])
       n->osd_addrs->client_addrs[i] = o->osd_addrs->client_addrs[i];
@@ -1701,27 +1703,46 @@ void OSDMap::dedup(const OSDMap *o, OSDMap *n)
   }
 
   // does crush match?
-  ceph::buffer::list oc, nc;
-  encode(*o->crush, oc, CEPH_FEATURES_SUPPORTED_DEFAULT);
-  encode(*n->crush, nc, CEPH_FEATURES_SUPPORTED_DEFAULT);
-  if (oc.contents_equal(nc)) {
-    n->crush = o->crush;
+  if (o->crush == n->crush) {
+    // already shared
+  } else if (o->crush_bl.length() && n->crush_bl.length()) {
+    // both were decoded; compare what they were decoded from
+    if (o->crush_bl.contents_equal(n->crush_bl)) {
+      n->crush = o->crush;
+      n->crush_bl = o->crush_bl;
+    }
+  } else {
+    ceph::buffer::list oc, nc;
+    encode(*o->crush, oc, CEPH_FEATURES_SUPPORTED_DEFAULT);
+    encode(*n->crush, nc, CEPH_FEATURES_SUPPORTED_DEFAULT);
+    if (oc.contents_equal(nc)) {
+      n->crush = o->crush;
+    }
   }
 
   // does pg_temp match?
-  if (*o->pg_temp == *n->pg_temp)
+  if (o->pg_temp != n->pg_temp &&
+      *o->pg_temp == *n->pg_temp)
     n->pg_temp = o->pg_temp;
 
   // does primary_temp match?
-  if (o->primary_temp->size() == n->primary_temp->size()) {
+  if (o->primary_temp != n->primary_temp &&
+      o->primary_temp->size() == n->primary_temp->size()) {
     if (*o->primary_temp == *n->primary_temp)
       n->primary_temp = o->primary_temp;
   }
 
   // do uuids match?
-  if (o->osd_uuid->size() == n->osd_uuid->size() &&
+  if (o->osd_uuid != n->osd_uuid &&
+      o->osd_uuid->size() == n->osd_uuid->size() &&
       *o->osd_uuid == *n->osd_uuid)
     n->osd_uuid = o->osd_uuid;
+
+  // does primary affinity match?
+  if (o->osd_primary_affinity && n->osd_primary_affinity &&
+      o->osd_primary_affinity != n->osd_primary_affinity &&
+      *o->osd_primary_affinity == *n->osd_primary_affinity)
+    n->osd_primary_affinity = o->osd_primary_affinity;
 }
 
 void OSDMap::clean_temps(CephContext *cct,
@@ -1984,6 +2005,14 @@ bool OSDMap::clean_pg_upmaps(
   return any_change;
 }
 
+template<typename T>
+static void unshare(std::shared_ptr<T>& p)
+{
+  if (p && p.use_count() > 1) {
+    p = std::make_shared<T>(*p);
+  }
+}
+
 int OSDMap::apply_incremental(const Incremental &inc)
 {
   new_blacklist_entries = false;
@@ -2005,6 +2034,28 @@ int OSDMap::apply_incremental(const Incremental &inc)
   }
 
   // nope, incremental.
+
+  // clone the sections we are about to change if they are shared with
+  // another map (see shared_copy_from())
+  bool osds_change = inc.new_max_osd >= 0 || !inc.new_state.empty();
+  if (osds_change ||
+      !inc.new_up_client.empty() ||
+      !inc.new_up_cluster.empty()) {
+    unshare(osd_addrs);
+  }
+  if (osds_change || !inc.new_uuid.empty()) {
+    unshare(osd_uuid);
+  }
+  if (osds_change || !inc.new_primary_affinity.empty()) {
+    unshare(osd_primary_affinity);
+  }
+  if (!inc.new_pg_temp.empty()) {
+    unshare(pg_temp);
+  }
+  if (!inc.new_primary_temp.empty()) {
+    unshare(primary_temp);
+  }
+
   if (inc.new_flags >= 0) {
     flags = inc.new_flags;
     // the below is just to cover a newly-upgraded luminous mon
@@ -2258,6 +2309,9 @@ int OSDMap::apply_incremental(const Incremental &inc)
     auto blp = bl.cbegin();
     crush.reset(new CrushWrapper);
     crush->decode(blp);
+    // a copy, so that we do not pin the buffer the incremental came in
+    crush_bl = bl;
+    crush_bl.rebuild();
     if (require_osd_release >= ceph_release_t::luminous) {
       // only increment if this is a luminous-encoded osdmap, lest
       // the mon's crush_version diverge from what the osds or others
@@ -2585,7 +2639,8 @@ void OSDMap::pg_to_raw_up(pg_t pg, vector<int> *up, int *primary) const
 void OSDMap::_pg_to_up_acting_osds(
   const pg_t& pg, vector<int> *up, int *up_primary,
   vector<int> *acting, int *acting_primary,
-  bool raw_pg_to_pg) const
+  bool raw_pg_to_pg,
+  vector<int> *raw_upmap) const
 {
   const pg_pool_t *pool = get_pg_pool(pg.pool());
   if (!pool ||
@@ -2598,6 +2653,8 @@ void OSDMap::_pg_to_up_acting_osds(
       acting->clear();
     if (acting_primary)
       *acting_primary = -1;
+    if (raw_upmap)
+      raw_upmap->clear();
     return;
   }
   vector<int> raw;
@@ -2607,9 +2664,11 @@ void OSDMap::_pg_to_up_acting_osds(
   int _acting_primary;
   ps_t pps;
   _get_temp_osds(*pool, pg, &_acting, &_acting_primary);
-  if (_acting.empty() || up || up_primary) {
+  if (_acting.empty() || up || up_primary || raw_upmap) {
     _pg_to_raw_osds(*pool, pg, &raw, &pps);
     _apply_upmap(*pool, pg, &raw);
+    if (raw_upmap)
+      *raw_upmap = raw;
     _raw_to_up_osds(*pool, raw, &_up);
     _up_primary = _pick_primary(_up);
     _apply_primary_affinity(pps, *pool, &_up, &_up_primary);
@@ -3012,10 +3071,10 @@ void OSDMap::encode(ceph::buffer::list& bl, uint64_t features) const
  * refer to
  *    doc/dev/osd_internals/osdmap_versions.txt
  */
-void OSDMap::decode(ceph::buffer::list& bl)
+void OSDMap::decode(ceph::buffer::list& bl, const OSDMap *base)
 {
   auto p = bl.cbegin();
-  decode(p);
+  decode(p, base);
 }
 
 void OSDMap::decode_classic(ceph::buffer::list::const_iterator& p)
@@ -3139,9 +3198,25 @@ void OSDMap::decode_classic(ceph::buffer::list::const_iterator& p)
   post_decode();
 }
 
-void OSDMap::decode(ceph::buffer::list::const_iterator& bl)
+void OSDMap::decode(ceph::buffer::list::const_iterator& bl,
+		    const OSDMap *base)
 {
   using ceph::decode;
+  std::shared_ptr<CrushWrapper> base_crush;
+  ceph::buffer::list base_crush_bl;
+  if (base && base->crush_bl.length()) {
+    base_crush = base->crush;
+    base_crush_bl = base->crush_bl;
+  }
+  // start from fresh sections; the old ones may be shared with other
+  // maps (see dedup() and shared_copy_from())
+  osd_addrs = std::make_shared<addrs_s>();
+  pg_temp = std::make_shared<PGTempMap>();
+  primary_temp = std::make_shared<mempool::osdmap::map<pg_t,int32_t>>();
+  osd_uuid = std::make_shared<mempool::osdmap::vector<uuid_d>>();
+  crush = std::make_shared<CrushWrapper>();
+  crush_bl.clear();
+
   /**
    * Older encodings of the OSDMap had a single struct_v which
    * covered the whole encoding, and was prior to our modern
@@ -3206,8 +3281,18 @@ void OSDMap::decode(ceph::buffer::list::const_iterator& bl)
     // crush
     ceph::buffer::list cbl;
     decode(cbl, bl);
-    auto cblp = cbl.cbegin();
-    crush->decode(cblp);
+    if (base_crush && cbl.contents_equal(base_crush_bl)) {
+      // unchanged; rebuilding the crush map is the costliest part of
+      // decoding a large map
+      crush = base_crush;
+      crush_bl = base_crush_bl;
+    } else {
+      auto cblp = cbl.cbegin();
+      crush->decode(cblp);
+      // a copy, so that we do not pin the buffer the map came in
+      crush_bl = cbl;
+      crush_bl.rebuild();
+    }
     // added in firefly; version increased in luminous, so it affects
     // giant, hammer, infernallis, jewel, and kraken. probably should be left
     // alone until we require clients to be all luminous?
@@ -614,8 +614,12 @@ private:
   std::shared_ptr<CrushWrapper> crush;       // hierarchical map
 private:
   uint32_t crush_version = 1;
+  /// the encoding crush was decoded from, if known; lets a later
+  /// decode() or dedup() share crush when it is byte for byte the same
+  ceph::buffer::list crush_bl;
 
   friend class OSDMonitor;
+  friend class OSDMapMapping;
 
  public:
   OSDMap() : epoch(0), 
@@ -659,7 +663,20 @@ public:
     osd_addrs.reset(new addrs_s(*o.osd_addrs));
 
     // NOTE: we do not copy crush.  note that apply_incremental will
-    // allocate a new CrushWrapper, though.
+    // allocate a new CrushWrapper, though.  the copy's crush may be
+    // changed in place, so stop vouching for what it was decoded from.
+    crush_bl.clear();
+  }
+
+  /**
+   * Copy o, sharing its refcounted sections (crush, addrs, uuids,
+   * pg_temp, primary_temp and primary affinity) instead of copying them.
+   * apply_incremental() clones a shared section before it changes it;
+   * nothing else does, so the result must only be advanced with
+   * apply_incremental().
+   */
+  void shared_copy_from(const OSDMap& o) {
+    *this = o;
   }
 
   // map info
@@ -1077,8 +1094,14 @@ private:
   void post_decode();
 public:
   void encode(ceph::buffer::list& bl, uint64_t features=CEPH_FEATURES_ALL) const;
-  void decode(ceph::buffer::list& bl);
-  void decode(ceph::buffer::list::const_iterator& bl);
+  /**
+   * Decode a full map.  If base is given, sections whose encoding is
+   * unchanged from what base was decoded from are shared with base
+   * rather than decoded again; base may be this map.
+   */
+  void decode(ceph::buffer::list& bl, const OSDMap *base = nullptr);
+  void decode(ceph::buffer::list::const_iterator& bl,
+	      const OSDMap *base = nullptr);
 
 
   /****   mapping facilities   ****/
@@ -1184,7 +1207,8 @@ private:
    */
   void _pg_to_up_acting_osds(const pg_t& pg, std::vector<int> *up, int *up_primary,
                              std::vector<int> *acting, int *acting_primary,
-			     bool raw_pg_to_pg = true) const;
+			     bool raw_pg_to_pg = true,
+			     std::vector<int> *raw_upmap = nullptr) const;
 
 public:
   /***
@@ -1224,6 +1248,17 @@ public:
     int up_primary, acting_primary;
     pg_to_up_acting_osds(pg, &up, &up_primary, &acting, &acting_primary);
   }
+  /**
+   * pg_to_up_acting_osds() that also returns the crush and upmap result
+   * the up set was derived from (see pg_to_raw_upmap()).
+   */
+  void pg_to_raw_up_acting_osds(pg_t pg, std::vector<int> *raw_upmap,
+				std::vector<int> *up, int *up_primary,
+				std::vector<int> *acting,
+				int *acting_primary) const {
+    _pg_to_up_acting_osds(pg, up, up_primary, acting, acting_primary, true,
+			  raw_upmap);
+  }
   bool pg_is_ec(pg_t pg) const {
     auto i = pools.find(pg.pool());
     ceph_assert(i != pools.end());
@@ -4,6 +4,8 @@
 #include "OSDMapMapping.h"
 #include "OSDMap.h"
 
+#include <algorithm>
+
 #define dout_subsys ceph_subsys_mon
 
 #include "common/debug.h"
@@ -13,7 +15,8 @@ MEMPOOL_DEFINE_OBJECT_FACTORY(OSDMapMapping, osdmapmapping,
 
 // ensure that we have a PoolMappings for each pool and that
 // the dimensions (pg_num and size) match up.
-void OSDMapMapping::_init_mappings(const OSDMap& osdmap)
+void OSDMapMapping::_init_mappings(const OSDMap& osdmap,
+				   std::set<int64_t> *reset_pools)
 {
   num_pgs = 0;
   auto q = pools.begin();
@@ -37,6 +40,9 @@ void OSDMapMapping::_init_mappings(const OSDMap& osdmap)
     pools.emplace(p.first, PoolMapping(p.second.get_size(),
 				       p.second.get_pg_num(),
 				       p.second.is_erasure()));
+    if (reset_pools) {
+      reset_pools->insert(p.first);
+    }
   }
   pools.erase(q, pools.end());
   ceph_assert(pools.size() == osdmap.get_pools().size());
@@ -57,6 +63,224 @@ void OSDMapMapping::update(const OSDMap& osdmap, pg_t pgid)
   _update_range(osdmap, pgid.pool(), pgid.ps(), pgid.ps() + 1);
 }
 
+bool OSDMapMapping::can_update(const OSDMap& osdmap,
+			       const OSDMap::Incremental& inc) const
+{
+  return epoch != 0 &&
+    epoch + 1 == osdmap.get_epoch() &&
+    inc.epoch == osdmap.get_epoch() &&
+    !inc.fullmap.length() &&
+    !inc.crush.length() &&
+    inc.new_max_osd < 0;
+}
+
+void OSDMapMapping::_init_incremental(
+  const OSDMap& osdmap,
+  const OSDMap::Incremental& inc,
+  incremental_t *changes)
+{
+  // pools that are new, resized or otherwise changed are redone whole
+  std::set<int64_t>& redo_pools = changes->pools;
+  _init_mappings(osdmap, &redo_pools);
+  for (auto& p : inc.new_pools) {
+    redo_pools.insert(p.first);
+  }
+
+  // in/out weight and existence feed crush itself, so any pg whose rule
+  // can reach such an osd may move.  up/down and primary affinity only
+  // filter the crush + upmap result, which we keep for each pg.  (the
+  // monitor only lets existing osds boot, so new_up_client never creates
+  // one.)
+  std::set<int> crush_osds;
+  std::vector<bool>& filter_osds = changes->filter_osds;
+  filter_osds.assign(osdmap.get_max_osd(), false);
+  auto set_filter = [&](int osd) {
+    if (osd >= 0 && osd < (int)filter_osds.size()) {
+      filter_osds[osd] = true;
+      changes->any_filter_osds = true;
+    }
+  };
+  for (auto& w : inc.new_weight) {
+    crush_osds.insert(w.first);
+  }
+  for (auto& st : inc.new_state) {
+    uint32_t s = st.second ? st.second : CEPH_OSD_UP;
+    if (s & CEPH_OSD_EXISTS) {
+      crush_osds.insert(st.first);
+    }
+    if (s & CEPH_OSD_UP) {
+      set_filter(st.first);
+    }
+  }
+  for (auto& c : inc.new_up_client) {
+    set_filter(c.first);
+  }
+  for (auto& a : inc.new_primary_affinity) {
+    set_filter(a.first);
+  }
+
+  if (!crush_osds.empty()) {
+    for (auto& p : osdmap.get_pools()) {
+      if (redo_pools.count(p.first)) {
+	continue;
+      }
+      int ruleno = osdmap.crush->find_rule(p.second.get_crush_rule(),
+					   p.second.get_type(),
+					   p.second.get_size());
+      if (ruleno < 0) {
+	continue;
+      }
+      std::set<int> roots;
+      osdmap.crush->find_takes_by_rule(ruleno, &roots);
+      for (auto root : roots) {
+	if (std::any_of(crush_osds.begin(), crush_osds.end(),
+			[&](int osd) {
+			  return osdmap.crush->subtree_contains(root, osd);
+			})) {
+	  redo_pools.insert(p.first);
+	  break;
+	}
+      }
+    }
+  }
+
+  // individual pgs
+  std::set<pg_t>& redo_pgs = changes->pgs;
+  for (auto& p : inc.new_pg_temp) {
+    redo_pgs.insert(p.first);
+  }
+  for (auto& p : inc.new_primary_temp) {
+    redo_pgs.insert(p.first);
+  }
+  for (auto& p : inc.new_pg_upmap) {
+    redo_pgs.insert(p.first);
+  }
+  for (auto& p : inc.new_pg_upmap_items) {
+    redo_pgs.insert(p.first);
+  }
+  redo_pgs.insert(inc.old_pg_upmap.begin(), inc.old_pg_upmap.end());
+  redo_pgs.insert(inc.old_pg_upmap_items.begin(),
+		  inc.old_pg_upmap_items.end());
+
+  if (!crush_osds.empty() || changes->any_filter_osds) {
+    std::vector<bool> all_osds(filter_osds);
+    for (auto osd : crush_osds) {
+      if (osd >= 0 && osd < (int)all_osds.size()) {
+	all_osds[osd] = true;
+      }
+    }
+    auto changed = [&all_osds](int osd) {
+      return osd >= 0 && osd < (int)all_osds.size() && all_osds[osd];
+    };
+    // pg_temp members are filtered by up/down too
+    for (auto p = osdmap.pg_temp->begin(); p != osdmap.pg_temp->end(); ++p) {
+      if (std::any_of(p->second.begin(), p->second.end(), changed)) {
+	redo_pgs.insert(p->first);
+      }
+    }
+    // upmap targets that are marked out are ignored
+    for (auto& p : osdmap.pg_upmap) {
+      if (std::any_of(p.second.begin(), p.second.end(), changed)) {
+	redo_pgs.insert(p.first);
+      }
+    }
+    for (auto& p : osdmap.pg_upmap_items) {
+      for (auto& r : p.second) {
+	if (changed(r.first) || changed(r.second)) {
+	  redo_pgs.insert(p.first);
+	  break;
+	}
+      }
+    }
+  }
+  // the table is a mix of epochs until _finish()
+  epoch = 0;
+}
+
+uint64_t OSDMapMapping::_update_incremental(
+  const OSDMap& osdmap,
+  const incremental_t& changes,
+  int64_t pool,
+  unsigned ps_begin,
+  unsigned ps_end)
+{
+  if (changes.pools.count(pool)) {
+    _update_range(osdmap, pool, ps_begin, ps_end);
+    return ps_end - ps_begin;
+  }
+  auto i = pools.find(pool);
+  ceph_assert(i != pools.end());
+  uint64_t n = 0;
+  for (unsigned ps = ps_begin; ps < ps_end; ++ps) {
+    // each pg only looks at (and rewrites) its own row, so ranges of the
+    // same pool may be done in parallel
+    if ((changes.any_filter_osds &&
+	 i->second.raw_contains_any(ps, changes.filter_osds)) ||
+	changes.pgs.count(pg_t(ps, pool))) {
+      _update_range(osdmap, pool, ps, ps + 1);
+      ++n;
+    }
+  }
+  return n;
+}
+
+void OSDMapMapping::_get_incremental_pgs(const incremental_t& changes,
+					 std::vector<pg_t> *pgs) const
+{
+  pgs->clear();
+  for (auto pool : changes.pools) {
+    auto p = pools.find(pool);
+    if (p == pools.end()) {
+      continue;
+    }
+    for (unsigned ps = 0; ps < p->second.pg_num; ++ps) {
+      pgs->push_back(pg_t(ps, pool));
+    }
+  }
+  for (auto& pgid : changes.pgs) {
+    if (changes.pools.count(pgid.pool())) {
+      continue;
+    }
+    auto p = pools.find(pgid.pool());
+    if (p == pools.end() || pgid.ps() >= p->second.pg_num) {
+      continue;
+    }
+    pgs->push_back(pgid);
+  }
+}
+
+uint64_t OSDMapMapping::update(const OSDMap& osdmap,
+			      const OSDMap::Incremental& inc)
+{
+  if (!can_update(osdmap, inc)) {
+    update(osdmap);
+    return num_pgs;
+  }
+  incremental_t changes;
+  _init_incremental(osdmap, inc, &changes);
+  uint64_t n = 0;
+  if (changes.any_filter_osds) {
+    for (auto& p : pools) {
+      n += _update_incremental(osdmap, changes, p.first, 0, p.second.pg_num);
+    }
+  } else {
+    std::vector<pg_t> redo;
+    _get_incremental_pgs(changes, &redo);
+    _update_pgs(osdmap, redo);
+    n = redo.size();
+  }
+  _finish(osdmap);
+  return n;
+}
+
+void OSDMapMapping::_update_pgs(const OSDMap& osdmap,
+				const std::vector<pg_t>& pgs)
+{
+  for (auto& pgid : pgs) {
+    _update_range(osdmap, pgid.pool(), pgid.ps(), pgid.ps() + 1);
+  }
+}
+
 void OSDMapMapping::_build_rmap(const OSDMap& osdmap)
 {
   acting_rmap.resize(osdmap.get_max_osd());
@@ -113,13 +337,12 @@ void OSDMapMapping::_update_range(
   ceph_assert(pg_begin <= pg_end);
   ceph_assert(pg_end <= i->second.pg_num);
   for (unsigned ps = pg_begin; ps < pg_end; ++ps) {
-    std::vector<int> up, acting;
+    std::vector<int> raw, up, acting;
     int up_primary, acting_primary;
-    osdmap.pg_to_up_acting_osds(
+    osdmap.pg_to_raw_up_acting_osds(
       pg_t(ps, pool),
-      &up, &up_primary, &acting, &acting_primary);
-    i->second.set(ps, std::move(up), up_primary,
-		  std::move(acting), acting_primary);
+      &raw, &up, &up_primary, &acting, &acting_primary);
+    i->second.set(ps, raw, up, up_primary, acting, acting_primary);
   }
 }
 
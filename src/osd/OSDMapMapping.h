@@ -9,11 +9,10 @@
 #include <map>
 
 #include "osd/osd_types.h"
+#include "osd/OSDMap.h"
 #include "common/WorkQueue.h"
 #include "common/Cond.h"
 
-class OSDMap;
-
 /// work queue to perform work on batches of pgids on multiple CPUs
 class ParallelPGMapper {
 public:
@@ -191,7 +190,9 @@ private:
 	1 + // num acting
 	1 + // num up
 	size + // acting
-	size;  // up
+	size + // up
+	1 + // num raw
+	size;  // raw (crush + upmap), which up is filtered from
     }
 
     PoolMapping(int s, int p, bool e)
@@ -227,7 +228,21 @@ private:
       }
     }
 
+    /// true if the raw mapping of ps has any of the osds set in @p osds
+    bool raw_contains_any(size_t ps, const std::vector<bool>& osds) const {
+      const int32_t *row = &table[row_size() * ps];
+      const int32_t *raw = row + 4 + 2 * size;
+      for (int i = 0; i < raw[0]; ++i) {
+	if (raw[1 + i] >= 0 && raw[1 + i] < (int)osds.size() &&
+	    osds[raw[1 + i]]) {
+	  return true;
+	}
+      }
+      return false;
+    }
+
     void set(size_t ps,
+	     const std::vector<int>& raw,
 	     const std::vector<int>& up,
 	     int up_primary,
 	     const std::vector<int>& acting,
@@ -246,6 +261,11 @@ private:
       for (int i = 0; i < row[3]; ++i) {
 	row[4 + size + i] = up[i];
       }
+      int32_t *row_raw = row + 4 + 2 * size;
+      row_raw[0] = std::min<int32_t>(raw.size(), size);
+      for (int i = 0; i < row_raw[0]; ++i) {
+	row_raw[1 + i] = raw[i];
+      }
     }
   };
 
@@ -256,7 +276,28 @@ private:
   epoch_t epoch = 0;
   uint64_t num_pgs = 0;
 
-  void _init_mappings(const OSDMap& osdmap);
+  void _init_mappings(const OSDMap& osdmap,
+		      std::set<int64_t> *reset_pools = nullptr);
+  /// what an incremental may have moved; see update(map, inc)
+  struct incremental_t {
+    std::set<int64_t> pools;  ///< recomputed whole
+    std::set<pg_t> pgs;       ///< recomputed one by one
+    /// by osd id: osds that went up or down or changed primary affinity.
+    /// finding the pgs whose raw mapping has one of them means looking
+    /// at every pg, which is left to _update_incremental().
+    std::vector<bool> filter_osds;
+    bool any_filter_osds = false;
+  };
+  void _init_incremental(const OSDMap& osdmap,
+			 const OSDMap::Incremental& inc,
+			 incremental_t *changes);
+  uint64_t _update_incremental(const OSDMap& osdmap,
+			       const incremental_t& changes,
+			       int64_t pool,
+			       unsigned ps_begin, unsigned ps_end);
+  void _get_incremental_pgs(const incremental_t& changes,
+			    std::vector<pg_t> *pgs) const;
+  void _update_pgs(const OSDMap& osdmap, const std::vector<pg_t>& pgs);
   void _update_range(
     const OSDMap& map,
     int64_t pool,
@@ -266,6 +307,9 @@ private:
 
   void _start(const OSDMap& osdmap) {
     _init_mappings(osdmap);
+    // the table is a mix of epochs until _finish(); don't let an
+    // incremental update build on it
+    epoch = 0;
   }
   void _finish(const OSDMap& osdmap);
 
@@ -288,6 +332,25 @@ private:
     }
   };
 
+  struct IncrementalMappingJob : public ParallelPGMapper::Job {
+    OSDMapMapping *mapping;
+    incremental_t changes;
+    IncrementalMappingJob(const OSDMap *osdmap, OSDMapMapping *m,
+			  const OSDMap::Incremental& inc)
+      : Job(osdmap), mapping(m) {
+      mapping->_init_incremental(*osdmap, inc, &changes);
+    }
+    void process(const vector<pg_t>& pgs) override {
+      mapping->_update_pgs(*osdmap, pgs);
+    }
+    void process(int64_t pool, unsigned ps_begin, unsigned ps_end) override {
+      mapping->_update_incremental(*osdmap, changes, pool, ps_begin, ps_end);
+    }
+    void complete() override {
+      mapping->_finish(*osdmap);
+    }
+  };
+
 public:
   void get(pg_t pgid,
 	   std::vector<int> *up,
@@ -330,6 +393,19 @@ public:
   void update(const OSDMap& map);
   void update(const OSDMap& map, pg_t pgid);
 
+  /**
+   * Bring a mapping of epoch inc.epoch - 1 up to date with map, the
+   * result of applying inc, recomputing only the PGs that inc may move:
+   * pools it changes, PGs whose temp or upmap entries it changes, PGs
+   * that went through an OSD changing state or primary affinity, and
+   * pools whose crush rule reaches an OSD whose weight or existence
+   * changed.  Falls back to a full update() for a new crush map, a new
+   * max_osd, or a mapping of any other epoch.
+   *
+   * @return the number of PGs recomputed
+   */
+  uint64_t update(const OSDMap& map, const OSDMap::Incremental& inc);
+
   std::unique_ptr<MappingJob> start_update(
     const OSDMap& map,
     ParallelPGMapper& mapper,
@@ -338,6 +414,35 @@ public:
     mapper.queue(job.get(), pgs_per_item, {});
     return job;
   }
+  /// true if update(map, inc) need not recompute every PG
+  bool can_update(const OSDMap& map, const OSDMap::Incremental& inc) const;
+
+  /**
+   * start_update() that only recomputes the PGs inc may have moved;
+   * see update(map, inc).  The caller checks can_update() first.
+   */
+  std::unique_ptr<ParallelPGMapper::Job> start_update(
+    const OSDMap& map,
+    const OSDMap::Incremental& inc,
+    ParallelPGMapper& mapper,
+    unsigned pgs_per_item) {
+    ceph_assert(can_update(map, inc));
+    std::unique_ptr<IncrementalMappingJob> job(
+      new IncrementalMappingJob(&map, this, inc));
+    if (job->changes.any_filter_osds) {
+      // every pg has to be looked at; do it on the mapper's threads
+      mapper.queue(job.get(), pgs_per_item, {});
+      return job;
+    }
+    std::vector<pg_t> redo;
+    _get_incremental_pgs(job->changes, &redo);
+    if (redo.empty()) {
+      job->complete();
+    } else {
+      mapper.queue(job.get(), pgs_per_item, redo);
+    }
+    return job;
+  }
 
   epoch_t get_epoch() const {
     return epoch;
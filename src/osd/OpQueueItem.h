@@ -90,6 +90,7 @@ private:
   utime_t start_time;
   uint64_t owner;  ///< global id (e.g., client.XXX)
   epoch_t map_epoch;    ///< an epoch we expect the PG to exist in
+  unsigned qos_cost = 0;  ///< what an mClock queue charged for it
 
 public:
   OpQueueItem(
@@ -135,6 +136,8 @@ public:
   }
   unsigned get_priority() const { return priority; }
   int get_cost() const { return cost; }
+  unsigned get_qos_cost() const { return qos_cost; }
+  void set_qos_cost(unsigned c) { qos_cost = c; }
   utime_t get_start_time() const { return start_time; }
   uint64_t get_owner() const { return owner; }
   epoch_t get_map_epoch() const { return map_epoch; }
@@ -55,6 +55,7 @@
 #include "messages/MOSDRepScrubMap.h"
 #include "messages/MOSDPGRecoveryDelete.h"
 #include "messages/MOSDPGRecoveryDeleteReply.h"
+#include "messages/MOSDPGLease.h"
 
 #include "common/BackTrace.h"
 #include "common/EventTrace.h"
@@ -948,8 +949,15 @@ void PG::prepare_write(
   }
   pglog.write_log_and_missing(
     t, &km, coll, pgmeta_oid, pool.info.require_rollback());
-  if (!km.empty())
+  if (!km.empty()) {
+    uint64_t bytes = 0;
+    for (auto& [key, val] : km) {
+      bytes += key.length() + val.length();
+    }
+    osd->logger->inc(l_osd_pg_meta_keys, km.size());
+    osd->logger->inc(l_osd_pg_meta_bytes, bytes);
     t.omap_setkeys(coll, pgmeta_oid, km);
+  }
 }
 
 #pragma GCC diagnostic ignored "-Wpragmas"
@@ -1932,6 +1940,193 @@ void PG::handle_scrub_reserve_release(OpRequestRef op)
   clear_scrub_reserved();
 }
 
+double PG::get_read_lease_interval() const
+{
+  // replicas of an ec pool only hold chunks; and older peers do not
+  // understand lease messages
+  if (!pool.info.is_replicated() ||
+      get_osdmap()->require_osd_release < ceph_release_t::octopus) {
+    return 0;
+  }
+  double interval = 0;
+  pool.info.opts.get(pool_opts_t::READ_LEASE_INTERVAL, &interval);
+  return interval;
+}
+
+bool PG::can_serve_replica_read(const hobject_t& oid)
+{
+  double interval = get_read_lease_interval();
+  if (interval <= 0) {
+    // no leases; the client promised the data is immutable
+    return true;
+  }
+  auto now = ceph::mono_clock::now();
+  if (now >= read_lease_until) {
+    dout(20) << __func__ << " no read lease" << dendl;
+    request_read_lease(now, interval);
+    return false;
+  }
+  if (read_lease_until - now < ceph::make_timespan(interval / 2)) {
+    // renew before the lease runs out under a steady stream of reads
+    request_read_lease(now, interval);
+  }
+
+  hobject_t head = oid.get_head();
+  const PGLog &pg_log = recovery_state.get_pg_log();
+  if (!info.last_backfill.is_max() ||
+      pg_log.get_missing().is_missing(head) ||
+      pg_log.get_missing().is_missing(oid)) {
+    dout(20) << __func__ << " " << oid << " is not recovered" << dendl;
+    return false;
+  }
+  // a write the primary has not yet reported committed on every replica
+  // may still be rolled back, or not yet be visible on the primary
+  auto p = pg_log.get_log().objects.find(head);
+  if (p != pg_log.get_log().objects.end() &&
+      p->second->version > pg_log.get_can_rollback_to()) {
+    dout(20) << __func__ << " " << oid << " has an uncommitted write "
+	     << p->second->version << " > " << pg_log.get_can_rollback_to()
+	     << dendl;
+    return false;
+  }
+  return true;
+}
+
+void PG::request_read_lease(ceph::mono_time now, double interval)
+{
+  if (read_lease_requested != ceph::mono_time() &&
+      now - read_lease_requested < ceph::make_timespan(interval)) {
+    return;
+  }
+  // the lease is measured from here, which is before the primary grants
+  // it, so it never outlives what the primary believes it handed out
+  read_lease_requested = now;
+  ++read_lease_seq;
+  pg_shard_t primary = get_primary();
+  dout(10) << __func__ << " seq " << read_lease_seq << " from "
+	   << primary << dendl;
+  osd->send_message_osd_cluster(
+    primary.osd,
+    new MOSDPGLease(spg_t(info.pgid.pgid, primary.shard),
+		    get_osdmap_epoch(),
+		    MOSDPGLease::REQUEST,
+		    pg_whoami,
+		    info.history.same_interval_since,
+		    read_lease_seq),
+    get_osdmap_epoch());
+}
+
+void PG::handle_read_lease_request(OpRequestRef op)
+{
+  dout(7) << __func__ << " " << *op->get_req() << dendl;
+  op->mark_started();
+  const MOSDPGLease *m = static_cast<const MOSDPGLease*>(op->get_req());
+  double interval = get_read_lease_interval();
+  if (!is_primary() || !is_active() || interval <= 0 ||
+      m->interval_start != info.history.same_interval_since ||
+      !is_acting(m->from)) {
+    dout(10) << __func__ << " not granting lease to " << m->from << dendl;
+    return;
+  }
+  utime_t duration;
+  duration.set_from_double(interval);
+  osd->logger->inc(l_osd_lease_grant);
+  Message *reply = new MOSDPGLease(
+    spg_t(info.pgid.pgid, m->from.shard),
+    get_osdmap_epoch(),
+    MOSDPGLease::GRANT,
+    pg_whoami,
+    m->interval_start,
+    m->seq,
+    duration);
+  osd->send_message_osd_cluster(reply, op->get_req()->get_connection());
+}
+
+void PG::handle_read_lease_grant(OpRequestRef op)
+{
+  dout(7) << __func__ << " " << *op->get_req() << dendl;
+  op->mark_started();
+  const MOSDPGLease *m = static_cast<const MOSDPGLease*>(op->get_req());
+  if (is_primary() ||
+      read_lease_requested == ceph::mono_time() ||
+      m->seq != read_lease_seq ||
+      m->interval_start != info.history.same_interval_since) {
+    dout(10) << __func__ << " ignoring stale grant" << dendl;
+    return;
+  }
+  read_lease_until = read_lease_requested +
+    ceph::make_timespan((double)m->duration);
+  read_lease_requested = ceph::mono_time();
+}
+
+void PG::start_prior_lease_wait()
+{
+  double interval = get_read_lease_interval();
+  if (interval <= 0) {
+    return;
+  }
+  // everyone who peered with us has seen the new interval and dropped
+  // its lease, but a member of a prior interval that is now down may
+  // still be serving reads from what it had
+  const OSDMapRef& osdmap = get_osdmap();
+  for (auto& s : get_past_intervals().get_all_probe(false)) {
+    if (!osdmap->is_up(s.osd)) {
+      prior_lease_until =
+	ceph::mono_clock::now() + ceph::make_timespan(interval);
+      dout(10) << __func__ << " osd." << s.osd << " is down, holding writes"
+	       << " for " << interval << "s" << dendl;
+      return;
+    }
+  }
+}
+
+bool PG::wait_for_prior_lease(OpRequestRef op)
+{
+  auto now = ceph::mono_clock::now();
+  if (now >= prior_lease_until) {
+    return false;
+  }
+  dout(10) << __func__ << " " << op << dendl;
+  osd->logger->inc(l_osd_lease_wait);
+  waiting_for_prior_lease.push_back(op);
+  op->mark_delayed("waiting for prior read leases");
+  if (!prior_lease_wakeup_queued) {
+    prior_lease_wakeup_queued = true;
+    OSDService *osds = osd;
+    spg_t pgid = get_pgid();
+    epoch_t epoch = get_osdmap_epoch();
+    auto wakeup = new FunctionContext([osds, pgid, epoch](int r) {
+	PGRef pg = osds->osd->lookup_lock_pg(pgid);
+	if (pg == nullptr) {
+	  return;
+	}
+	if (!pg->pg_has_reset_since(epoch)) {
+	  pg->prior_lease_wakeup_queued = false;
+	  pg->requeue_ops(pg->waiting_for_prior_lease);
+	}
+	pg->unlock();
+      });
+    std::lock_guard l(osd->sleep_lock);
+    osd->sleep_timer.add_event_after(
+      std::chrono::duration<double>(prior_lease_until - now).count(),
+      wakeup);
+  }
+  return true;
+}
+
+void PG::clear_read_lease()
+{
+  read_lease_until = ceph::mono_time();
+  read_lease_requested = ceph::mono_time();
+  prior_lease_until = ceph::mono_time();
+  prior_lease_wakeup_queued = false;
+  if (is_primary()) {
+    requeue_ops(waiting_for_prior_lease);
+  } else {
+    waiting_for_prior_lease.clear();
+  }
+}
+
 // Compute pending backfill data
 static int64_t pending_backfill(CephContext *cct, int64_t bf_bytes, int64_t local_bytes)
 {
@@ -2291,6 +2486,10 @@ int PG::build_scrub_map_chunk(
   // finish
   dout(20) << __func__ << " finishing" << dendl;
   ceph_assert(pos.done());
+  if (pos.data_bytes) {
+    osd->logger->inc(l_osd_scrub_deep_bytes, pos.data_bytes);
+    scrubber.deep_bytes += pos.data_bytes;
+  }
   _repair_oinfo_oid(map);
   if (!is_primary()) {
     ScrubMap for_meta_scrub;
@@ -2482,6 +2681,8 @@ void PG::scrub(epoch_t queued, ThreadPool::TPHandle &handle)
     ceph_assert(recovery_state.get_backfill_targets().empty());
 
     scrubber.deep = state_test(PG_STATE_DEEP_SCRUB);
+    scrubber.deep_bytes = 0;
+    scrubber.deep_start = ceph_clock_now();
 
     dout(10) << "starting a new chunky scrub" << dendl;
   }
@@ -3148,6 +3349,11 @@ void PG::scrub_finish()
   }
   bool deep_scrub = state_test(PG_STATE_DEEP_SCRUB);
   const char *mode = (repair ? "repair": (deep_scrub ? "deep-scrub" : "scrub"));
+  if (deep_scrub) {
+    dout(10) << __func__ << " read " << byte_u_t(scrubber.deep_bytes)
+	     << " at " << byte_u_t(scrubber.get_deep_bytes_per_sec()) << "/s"
+	     << dendl;
+  }
 
   // if a regular scrub had errors within the limit, do a deep scrub to auto repair.
   if (scrubber.deep_scrub_on_error
@@ -3534,6 +3740,8 @@ bool PG::can_discard_request(OpRequestRef& op)
     return can_discard_replica_op<MOSDRepScrub, MSG_OSD_REP_SCRUB>(op);
   case MSG_OSD_SCRUB_RESERVE:
     return can_discard_replica_op<MOSDScrubReserve, MSG_OSD_SCRUB_RESERVE>(op);
+  case MSG_OSD_PG_LEASE:
+    return can_discard_replica_op<MOSDPGLease, MSG_OSD_PG_LEASE>(op);
   case MSG_OSD_REP_SCRUBMAP:
     return can_discard_replica_op<MOSDRepScrubMap, MSG_OSD_REP_SCRUBMAP>(op);
   case MSG_OSD_PG_UPDATE_LOG_MISSING:
@@ -3671,6 +3879,11 @@ void PG::handle_query_state(Formatter *f)
     f->dump_stream("scrubber.max_end") << scrubber.max_end;
     f->dump_stream("scrubber.subset_last_update") << scrubber.subset_last_update;
     f->dump_bool("scrubber.deep", scrubber.deep);
+    if (scrubber.deep) {
+      f->dump_unsigned("scrubber.deep_bytes", scrubber.deep_bytes);
+      f->dump_float("scrubber.deep_bytes_per_sec",
+		    scrubber.get_deep_bytes_per_sec());
+    }
     {
       f->open_array_section("scrubber.waiting_on_whom");
       for (set<pg_shard_t>::iterator p = scrubber.waiting_on_whom.begin();
@@ -451,6 +451,9 @@ public:
     snap_trimq = snaps;
     release_pg_backoffs();
     projected_last_update = info.last_update;
+    if (is_primary()) {
+      start_prior_lease_wait();
+    }
   }
 
   void on_activate_committed() override;
@@ -950,6 +953,7 @@ protected:
   list<OpRequestRef>            waiting_for_active;
   list<OpRequestRef>            waiting_for_flush;
   list<OpRequestRef>            waiting_for_scrub;
+  list<OpRequestRef>            waiting_for_prior_lease;
 
   list<OpRequestRef>            waiting_for_cache_not_full;
   list<OpRequestRef>            waiting_for_clean_to_primary_repair;
@@ -1192,6 +1196,13 @@ public:
     bool deep;
     int preempt_left;
     int preempt_divisor;
+    uint64_t deep_bytes = 0;  ///< object data we read so far
+    utime_t deep_start;
+
+    double get_deep_bytes_per_sec() const {
+      double elapsed = (ceph_clock_now() - deep_start).to_nsec() / 1e9;
+      return elapsed > 0 ? deep_bytes / elapsed : 0;
+    }
 
     list<Context*> callbacks;
     void add_callback(Context *context) {
@@ -1256,6 +1267,8 @@ public:
       fixed = 0;
       omap_stats = (const struct omap_stat_t){ 0 };
       deep = false;
+      deep_bytes = 0;
+      deep_start = utime_t();
       run_callbacks();
       inconsistent.clear();
       missing.clear();
@@ -1345,6 +1358,26 @@ protected:
   void handle_scrub_reserve_reject(OpRequestRef op, pg_shard_t from);
   void handle_scrub_reserve_release(OpRequestRef op);
 
+  // -- read leases --
+  // On pools with read_lease_interval set, a replica serves balanced
+  // and localized reads only while it holds a lease from the primary of
+  // the current interval, and a new primary holds writes back until any
+  // lease of the prior interval may have run out.
+  ceph::mono_time read_lease_until;     ///< replica: our lease runs out
+  ceph::mono_time read_lease_requested; ///< replica: pending request sent at
+  uint64_t read_lease_seq = 0;
+  ceph::mono_time prior_lease_until;    ///< primary: prior leases run out
+  bool prior_lease_wakeup_queued = false;
+
+  double get_read_lease_interval() const;
+  bool can_serve_replica_read(const hobject_t& oid);
+  void request_read_lease(ceph::mono_time now, double interval);
+  void handle_read_lease_request(OpRequestRef op);
+  void handle_read_lease_grant(OpRequestRef op);
+  void start_prior_lease_wait();
+  bool wait_for_prior_lease(OpRequestRef op);
+  void clear_read_lease();
+
   // -- recovery state --
 
   struct QueuePeeringEvt : Context {
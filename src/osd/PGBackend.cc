@@ -617,6 +617,99 @@ int PGBackend::be_scan_list(
   return 0;
 }
 
+struct ScrubReadahead {
+  hobject_t oid;
+  uint64_t off, len;
+  ceph::mutex lock = ceph::make_mutex("ScrubReadahead::lock");
+  ceph::condition_variable cond;
+  bool done = false;
+  int r = 0;
+  bufferlist bl;
+
+  ScrubReadahead(const hobject_t& oid, uint64_t off, uint64_t len)
+    : oid(oid), off(off), len(len) {}
+};
+
+int PGBackend::be_scrub_read(
+  const hobject_t &oid,
+  ScrubMapBuilder &pos,
+  uint64_t off,
+  uint64_t len,
+  uint32_t fadvise_flags,
+  bufferlist &bl)
+{
+  auto ra = std::move(pos.readahead);
+  if (ra) {
+    if (ra->oid == oid && ra->off == off && ra->len == len) {
+      std::unique_lock l(ra->lock);
+      ra->cond.wait(l, [&ra] { return ra->done; });
+      // errors are retried below so they are reported as usual
+      if (ra->r >= 0) {
+	get_parent()->get_logger()->inc(l_osd_scrub_readahead_hit);
+	bl.claim(ra->bl);
+	pos.data_bytes += ra->r;
+	return ra->r;
+      }
+    }
+    get_parent()->get_logger()->inc(l_osd_scrub_readahead_miss);
+  }
+  int r = store->read(
+    ch,
+    ghobject_t(oid, ghobject_t::NO_GEN, get_parent()->whoami_shard().shard),
+    off, len, bl, fadvise_flags);
+  if (r > 0) {
+    pos.data_bytes += r;
+  }
+  return r;
+}
+
+void PGBackend::be_scrub_readahead(
+  ScrubMapBuilder &pos,
+  bool done,
+  uint64_t off,
+  uint64_t len,
+  uint32_t fadvise_flags)
+{
+  ceph_assert(!pos.readahead);
+  size_t i = pos.pos;
+  if (done) {
+    // the next object is still within the chunk, so writes to it are
+    // blocked until we are through with it
+    ++i;
+    off = 0;
+  } else {
+    off += len;
+  }
+  if (i >= pos.ls.size()) {
+    return;
+  }
+  auto ra = std::make_shared<ScrubReadahead>(pos.ls[i], off, len);
+  ObjectStore *store = this->store;
+  ObjectStore::CollectionHandle c = ch;
+  ghobject_t goid(ra->oid, ghobject_t::NO_GEN,
+		  get_parent()->whoami_shard().shard);
+  if (!get_parent()->queue_scrub_readahead(
+	len,
+	new LambdaContext([ra, store, c, goid, fadvise_flags]() mutable {
+	  bufferlist bl;
+	  int r = store->read(c, goid, ra->off, ra->len, bl, fadvise_flags);
+	  if (r > 0) {
+	    // leaves the crc cached in the buffers, so all the scrub
+	    // thread has to do is adjust it for its running seed
+	    bl.crc32c(-1);
+	  }
+	  std::lock_guard l(ra->lock);
+	  ra->r = r;
+	  ra->bl.claim(bl);
+	  ra->done = true;
+	  ra->cond.notify_all();
+	}))) {
+    return;
+  }
+  dout(20) << __func__ << " " << ra->oid << " " << off << "~" << len << dendl;
+  pos.readahead = std::move(ra);
+}
+
 bool PGBackend::be_compare_scrub_objects(
   pg_shard_t auth_shard,
   const ScrubMap::object &auth,
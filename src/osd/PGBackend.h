@@ -301,6 +301,9 @@ typedef std::shared_ptr<const OSDMap> OSDMapRef;
      virtual void pg_add_num_bytes(int64_t num_bytes) = 0;
      virtual void pg_sub_num_bytes(int64_t num_bytes) = 0;
      virtual bool maybe_preempt_replica_scrub(const hobject_t& oid) = 0;
+     /// run @p c off the op threads to read @p bytes ahead for deep
+     /// scrub; false (and @p c is not taken) if we should not
+     virtual bool queue_scrub_readahead(uint64_t bytes, Context *c) = 0;
      virtual ~Listener() {}
    };
    Listener *parent;
@@ -609,6 +612,24 @@ typedef std::shared_ptr<const OSDMap> OSDMapRef;
      ScrubMap &map,
      ScrubMapBuilder &pos,
      ScrubMap::object &o) = 0;
+   /// read [off, off+len) of @p oid for deep scrub, using pos.readahead
+   /// when it covers exactly that
+   int be_scrub_read(
+     const hobject_t &oid,
+     ScrubMapBuilder &pos,
+     uint64_t off,
+     uint64_t len,
+     uint32_t fadvise_flags,
+     bufferlist &bl);
+   /// start reading what be_deep_scrub will want after [off, off+len)
+   /// of the current object: its next stride, or the start of the next
+   /// object once @p done
+   void be_scrub_readahead(
+     ScrubMapBuilder &pos,
+     bool done,
+     uint64_t off,
+     uint64_t len,
+     uint32_t fadvise_flags);
    void be_omap_checks(
      const map<pg_shard_t,ScrubMap*> &maps,
      const set<hobject_t> &master_set,
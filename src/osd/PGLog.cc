@@ -38,8 +38,8 @@ void PGLog::IndexedLog::split_out_child(
 {
   unindex();
   *target = IndexedLog(pg_log_t::split_out_child(child_pgid, split_bits));
-  index();
-  target->index();
+  reindex();
+  target->reindex();
   reset_rollback_info_trimmed_to_riter();
 }
 
@@ -148,9 +148,7 @@ ostream& PGLog::IndexedLog::print(ostream& out) const
     ceph_assert(!p->reqid_is_indexed() || logged_req(p->reqid));
   }
 
-  for (list<pg_log_dup_t>::const_iterator p = dups.begin();
-       p != dups.end();
-       ++p) {
+  for (auto p = dups.begin(); p != dups.end(); ++p) {
     out << *p << std::endl;
   }
 
@@ -531,19 +529,18 @@ bool PGLog::merge_log_dups(const pg_log_t& olog) {
 
 	auto log_tail_version = log.dups.back().version;
 
-	auto insert_cursor = log.dups.end();
-	eversion_t last_shared = eversion_t::max();
-	for (auto i = olog.dups.crbegin(); i != olog.dups.crend(); ++i) {
-	  if (i->version <= log_tail_version) break;
-	  log.dups.insert(insert_cursor, *i);
-	  last_shared = i->version;
-
-	  auto prev = insert_cursor;
-	  --prev;
+	// only append and prepend to log.dups so that the pointers the
+	// index holds into it stay valid
+	auto first_new = olog.dups.cend();
+	while (first_new != olog.dups.cbegin() &&
+	       std::prev(first_new)->version > log_tail_version) {
+	  --first_new;
+	}
+	eversion_t last_shared = first_new->version;
+	for (auto i = first_new; i != olog.dups.cend(); ++i) {
+	  log.dups.push_back(*i);
 	  // be sure to pass reference of copy in log.dups
-	  log.index(*prev);
-
-	  --insert_cursor; // make sure we insert in reverse order
+	  log.index(log.dups.back());
 	}
 	mark_dirty_from_dups(last_shared);
       }
@@ -554,16 +551,18 @@ bool PGLog::merge_log_dups(const pg_log_t& olog) {
 	  olog.dups.front().version << dendl;
 	changed = true;
 
-	eversion_t last;
-	auto insert_cursor = log.dups.begin();
-	for (auto i = olog.dups.cbegin(); i != olog.dups.cend(); ++i) {
-	  if (i->version >= insert_cursor->version) break;
-	  log.dups.insert(insert_cursor, *i);
-	  last = i->version;
-	  auto prev = insert_cursor;
-	  --prev;
+	auto log_head_version = log.dups.front().version;
+	auto end_new = olog.dups.cbegin();
+	while (end_new != olog.dups.cend() &&
+	       end_new->version < log_head_version) {
+	  ++end_new;
+	}
+	eversion_t last = std::prev(end_new)->version;
+	for (auto i = end_new; i != olog.dups.cbegin(); ) {
+	  --i;
+	  log.dups.push_front(*i);
 	  // be sure to pass address of copy in log.dups
-	  log.index(*prev);
+	  log.index(log.dups.front());
 	}
 	mark_dirty_to_dups(last);
       }
@@ -785,7 +784,7 @@ void PGLog::_write_log_and_missing_wo_missing(
     (*km)[entry.get_key_name()].claim(bl);
   }
 
-  for (list<pg_log_dup_t>::reverse_iterator p = log.dups.rbegin();
+  for (auto p = log.dups.rbegin();
        p != log.dups.rend() &&
 	 (p->version >= dirty_from_dups || p->version >= write_from_dups) &&
 	 p->version >= dirty_to_dups;
@@ -914,7 +913,7 @@ void PGLog::_write_log_and_missing(
     (*km)[entry.get_key_name()].claim(bl);
   }
 
-  for (list<pg_log_dup_t>::reverse_iterator p = log.dups.rbegin();
+  for (auto p = log.dups.rbegin();
        p != log.dups.rend() &&
 	 (p->version >= dirty_from_dups || p->version >= write_from_dups) &&
 	 p->version >= dirty_to_dups;
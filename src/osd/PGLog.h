@@ -36,6 +36,10 @@ constexpr auto PGLOG_INDEXED_ALL              = PGLOG_INDEXED_OBJECTS
                                               | PGLOG_INDEXED_CALLER_OPS 
                                               | PGLOG_INDEXED_EXTRA_CALLER_OPS 
                                               | PGLOG_INDEXED_DUPS;
+// recovery looks objects up directly; the request indexes only serve
+// dup op detection and are built on the first lookup that needs them,
+// so PGs that see no writes never pay for them
+constexpr auto PGLOG_INDEXED_EAGER            = PGLOG_INDEXED_OBJECTS;
 
 class CephContext;
 
@@ -73,10 +77,10 @@ public:
    * plus some methods to manipulate it all.
    */
   struct IndexedLog : public pg_log_t {
-    mutable ceph::unordered_map<hobject_t,pg_log_entry_t*> objects;  // ptrs into log.  be careful!
-    mutable ceph::unordered_map<osd_reqid_t,pg_log_entry_t*> caller_ops;
-    mutable ceph::unordered_multimap<osd_reqid_t,pg_log_entry_t*> extra_caller_ops;
-    mutable ceph::unordered_map<osd_reqid_t,pg_log_dup_t*> dup_index;
+    mutable mempool::osd_pglog::unordered_map<hobject_t,pg_log_entry_t*> objects;  // ptrs into log.  be careful!
+    mutable mempool::osd_pglog::unordered_map<osd_reqid_t,pg_log_entry_t*> caller_ops;
+    mutable mempool::osd_pglog::unordered_multimap<osd_reqid_t,pg_log_entry_t*> extra_caller_ops;
+    mutable mempool::osd_pglog::unordered_map<osd_reqid_t,pg_log_dup_t*> dup_index;
 
     // recovery pointers
     list<pg_log_entry_t>::iterator complete_to; // not inclusive of referenced item
@@ -146,7 +150,7 @@ public:
       rollback_info_trimmed_to_riter(log.rbegin())
     {
       reset_rollback_info_trimmed_to_riter();
-      index();
+      index(PGLOG_INDEXED_EAGER);
     }
 
     IndexedLog(const IndexedLog &rhs) :
@@ -160,12 +164,39 @@ public:
       index(rhs.indexed_data);
     }
 
+    // the entries and dups move without being copied, so the index
+    // pointers into them stay valid
+    IndexedLog(IndexedLog &&rhs) :
+      pg_log_t(std::move(rhs)),
+      objects(std::move(rhs.objects)),
+      caller_ops(std::move(rhs.caller_ops)),
+      extra_caller_ops(std::move(rhs.extra_caller_ops)),
+      dup_index(std::move(rhs.dup_index)),
+      complete_to(log.end()),
+      last_requested(rhs.last_requested),
+      indexed_data(rhs.indexed_data),
+      rollback_info_trimmed_to_riter(log.rbegin())
+    {
+      reset_rollback_info_trimmed_to_riter();
+      rhs.log.clear();
+      rhs.dups.clear();
+      rhs.unindex();
+      rhs.rollback_info_trimmed_to_riter = rhs.log.rbegin();
+      rhs.reset_recovery_pointers();
+    }
+
     IndexedLog &operator=(const IndexedLog &rhs) {
       this->~IndexedLog();
       new (this) IndexedLog(rhs);
       return *this;
     }
 
+    IndexedLog &operator=(IndexedLog &&rhs) {
+      this->~IndexedLog();
+      new (this) IndexedLog(std::move(rhs));
+      return *this;
+    }
+
     void trim_rollback_info_to(eversion_t to, LogEntryHandler *h) {
       advance_can_rollback_to(
 	to,
@@ -187,7 +218,7 @@ public:
 
     mempool::osd_pglog::list<pg_log_entry_t> rewind_from_head(eversion_t newhead) {
       auto divergent = pg_log_t::rewind_from_head(newhead);
-      index();
+      reindex();
       reset_rollback_info_trimmed_to_riter();
       return divergent;
     }
@@ -216,7 +247,7 @@ public:
       *this = IndexedLog(o);
 
       skip_can_rollback_to_to_head();
-      index();
+      reindex();
     }
 
     void split_out_child(
@@ -272,7 +303,7 @@ public:
       ceph_assert(version);
       ceph_assert(user_version);
       ceph_assert(return_code);
-      ceph::unordered_map<osd_reqid_t,pg_log_entry_t*>::const_iterator p;
+      decltype(caller_ops)::const_iterator p;
       if (!(indexed_data & PGLOG_INDEXED_CALLER_OPS)) {
         index_caller_ops();
       }
@@ -430,6 +461,11 @@ public:
       index(PGLOG_INDEXED_DUPS);
     }
 
+    /// rebuild the indexes in use, e.g. after entries were removed
+    void reindex() const {
+      index(indexed_data | PGLOG_INDEXED_EAGER);
+    }
+
     void index(pg_log_entry_t& e) {
       if ((indexed_data & PGLOG_INDEXED_OBJECTS) && e.object_is_indexed()) {
         if (objects.count(e.soid) == 0 ||
@@ -478,8 +514,7 @@ public:
         for (auto j = e.extra_reqids.begin();
              j != e.extra_reqids.end();
              ++j) {
-          for (ceph::unordered_multimap<osd_reqid_t,pg_log_entry_t*>::iterator k =
-		 extra_caller_ops.find(j->first);
+          for (auto k = extra_caller_ops.find(j->first);
                k != extra_caller_ops.end() && k->first == j->first;
                ++k) {
             if (k->second == &e) {
@@ -1373,8 +1408,9 @@ public:
     map<eversion_t, hobject_t> divergent_priors;
     bool must_rebuild = false;
     missing.may_include_deletes = false;
-    list<pg_log_entry_t> entries;
-    list<pg_log_dup_t> dups;
+    // built in the containers the log keeps so they move into it
+    mempool::osd_pglog::list<pg_log_entry_t> entries;
+    mempool::osd_pglog::deque<pg_log_dup_t> dups;
     if (p) {
       for (p->seek_to_first(); p->valid() ; p->next()) {
 	// non-log pgmeta_oid keys are prefixed with _; skip those
@@ -1621,8 +1657,8 @@ public:
 
     std::map<eversion_t, hobject_t> divergent_priors;
     bool must_rebuild = false;
-    std::list<pg_log_entry_t> entries;
-    std::list<pg_log_dup_t> dups;
+    mempool::osd_pglog::list<pg_log_entry_t> entries;
+    mempool::osd_pglog::deque<pg_log_dup_t> dups;
 
     std::optional<std::string> next;
 
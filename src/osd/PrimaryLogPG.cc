@@ -41,6 +41,7 @@
 #include "messages/MOSDPGUpdateLogMissingReply.h"
 #include "messages/MCommandReply.h"
 #include "messages/MOSDScrubReserve.h"
+#include "messages/MOSDPGLease.h"
 #include "mds/inode_backtrace.h" // Ugh
 #include "common/EventTrace.h"
 
@@ -76,6 +77,7 @@ static ostream& _prefix(std::ostream *_dout, T *pg) {
 #include <errno.h>
 
 MEMPOOL_DEFINE_OBJECT_FACTORY(PrimaryLogPG, replicatedpg, osd);
+MEMPOOL_DEFINE_OBJECT_FACTORY(ObjectContext, object_context, osd);
 
 PGLSFilter::PGLSFilter() : cct(nullptr)
 {
@@ -700,7 +702,7 @@ bool PrimaryLogPG::maybe_await_blocked_head(
 {
   ObjectContextRef obc;
   obc = object_contexts.lookup(hoid.get_head());
-  if (obc) {
+  if (obc && !obc->negative) {
     if (obc->is_blocked()) {
       wait_for_blocked_object(obc->obs.oi.soid, op);
       return true;
@@ -1714,6 +1716,20 @@ void PrimaryLogPG::do_request(
     }
     break;
 
+  case MSG_OSD_PG_LEASE:
+    {
+      const MOSDPGLease *m = static_cast<const MOSDPGLease*>(op->get_req());
+      switch (m->type) {
+      case MOSDPGLease::REQUEST:
+	handle_read_lease_request(op);
+	break;
+      case MOSDPGLease::GRANT:
+	handle_read_lease_grant(op);
+	break;
+      }
+    }
+    break;
+
   case MSG_OSD_REP_SCRUB:
     replica_scrub(op, handle);
     break;
@@ -1819,6 +1835,16 @@ void PrimaryLogPG::do_op(OpRequestRef& op)
       osd->handle_misdirected_op(this, op);
       return;
     }
+    if (!is_primary()) {
+      if (!can_serve_replica_read(m->get_hobj())) {
+	dout(20) << __func__ << " sending " << m->get_hobj()
+		 << " back to the primary" << dendl;
+	osd->logger->inc(l_osd_replica_read_redirect);
+	osd->reply_op_error(op, -EAGAIN);
+	return;
+      }
+      osd->logger->inc(l_osd_replica_read);
+    }
   } else {
     // normal case; must be primary
     if (!is_primary()) {
@@ -1905,6 +1931,9 @@ void PrimaryLogPG::do_op(OpRequestRef& op)
     dout(10) << __func__ << " fail-safe full check failed, dropping request." << dendl;
     return;
   }
+  if (write_ordered && wait_for_prior_lease(op)) {
+    return;
+  }
   int64_t poolid = get_pgid().pool();
   if (op->may_write()) {
 
@@ -10819,11 +10848,21 @@ ObjectContextRef PrimaryLogPG::get_object_context(
       pg_log_entry_t::LOST_REVERT));
   ObjectContextRef obc = object_contexts.lookup(soid);
   osd->logger->inc(l_osd_object_ctx_cache_total);
-  if (obc) {
+  if (obc && obc->negative && !attrs) {
+    osd->logger->inc(l_osd_object_ctx_cache_negative_hit);
+    if (!can_create) {
+      dout(10) << __func__ << ": " << soid << " known not to exist" << dendl;
+      return ObjectContextRef();   // -ENOENT!
+    }
+    dout(10) << __func__ << ": found negative obc in cache, creating: "
+	     << obc << dendl;
+    obc->negative = false;
+  } else if (obc && !obc->negative) {
     osd->logger->inc(l_osd_object_ctx_cache_hit);
     dout(10) << __func__ << ": found obc in cache: " << obc
 	     << dendl;
   } else {
+    // obc may be a negative entry for an object being recovered (attrs)
     dout(10) << __func__ << ": obc NOT found in cache: " << soid << dendl;
     // check disk
     bufferlist bv;
@@ -10838,6 +10877,18 @@ ObjectContextRef PrimaryLogPG::get_object_context(
 	  dout(10) << __func__ << ": no obc for soid "
 		   << soid << " and !can_create"
 		   << dendl;
+	  // temp objects are written without going through an obc.  only
+	  // the primary sees every write; repops do not touch a replica's
+	  // obcs, so a negative entry there would outlive the create.
+	  if (r == -ENOENT && is_primary() && soid.is_head() &&
+	      !soid.is_temp() &&
+	      cct->_conf.get_val<bool>("osd_pg_object_context_cache_negative")) {
+	    SnapSetContext *ssc = get_snapset_context(soid, true, 0, false);
+	    ceph_assert(ssc);
+	    obc = create_object_context(object_info_t(soid), ssc);
+	    obc->negative = true;
+	    osd->logger->inc(l_osd_object_ctx_cache_negative);
+	  }
 	  return ObjectContextRef();   // -ENOENT!
 	}
 
@@ -10870,8 +10921,17 @@ ObjectContextRef PrimaryLogPG::get_object_context(
 
     ceph_assert(oi.soid.pool == (int64_t)info.pgid.pool());
 
-    obc = object_contexts.lookup_or_create(oi.soid);
-    obc->destructor_callback = new C_PG_ObjectContext(this, obc.get());
+    if (obc) {
+      // the snapset we remembered for the nonexistent object is stale too
+      obc->negative = false;
+      if (obc->ssc) {
+	put_snapset_context(obc->ssc);
+	obc->ssc = nullptr;
+      }
+    } else {
+      obc = object_contexts.lookup_or_create(oi.soid);
+      obc->destructor_callback = new C_PG_ObjectContext(this, obc.get());
+    }
     obc->obs.oi = oi;
     obc->obs.exists = true;
 
@@ -11706,7 +11766,7 @@ void PrimaryLogPG::mark_all_unfound_lost(
 	// of racing with new creation.  This can happen if
 	// object lost and EIO at primary.
 	obc = object_contexts.lookup(oid);
-	if (obc)
+	if (obc && !obc->negative)
 	  obc->obs.exists = false;
 
 	++v.version;
@@ -11997,6 +12057,7 @@ void PrimaryLogPG::on_change(ObjectStore::Transaction &t)
 
   // requeue everything in the reverse order they should be
   // reexamined.
+  clear_read_lease();
   requeue_ops(waiting_for_peered);
   requeue_ops(waiting_for_flush);
   requeue_ops(waiting_for_active);
@@ -13239,7 +13300,7 @@ void PrimaryLogPG::scan_range(
     ObjectContextRef obc;
     if (is_primary())
       obc = object_contexts.lookup(*p);
-    if (obc) {
+    if (obc && !obc->negative) {
       bi->objects[*p] = obc->obs.oi.version;
       dout(20) << "  " << *p << " " << obc->obs.oi.version << dendl;
     } else {
@@ -14448,7 +14509,8 @@ bool PrimaryLogPG::_range_available_for_scrub(
   next.first = begin;
   bool more = true;
   while (more && next.first < end) {
-    if (next.second && next.second->is_blocked()) {
+    if (next.second && !next.second->negative &&
+	next.second->is_blocked()) {
       next.second->requeue_scrub_on_unblock = true;
       dout(10) << __func__ << ": scrub delayed, "
 	       << next.first << " is blocked"
@@ -1901,6 +1901,9 @@ public:
   bool maybe_preempt_replica_scrub(const hobject_t& oid) override {
     return write_blocked_by_scrub(oid);
   }
+  bool queue_scrub_readahead(uint64_t bytes, Context *c) override {
+    return osd->queue_scrub_readahead(bytes, c);
+  }
   int rep_repair_primary_object(const hobject_t& soid, OpContext *ctx);
 
   // attr cache handling
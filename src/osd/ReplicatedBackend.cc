@@ -619,24 +619,21 @@ int ReplicatedBackend::be_deep_scrub(
     }
 
     bufferlist bl;
-    r = store->read(
-      ch,
-      ghobject_t(
-	poid, ghobject_t::NO_GEN, get_parent()->whoami_shard().shard),
-      pos.data_pos,
-      cct->_conf->osd_deep_scrub_stride, bl,
-      fadvise_flags);
+    uint64_t stride = cct->_conf->osd_deep_scrub_stride;
+    r = be_scrub_read(poid, pos, pos.data_pos, stride, fadvise_flags, bl);
     if (r < 0) {
       dout(20) << __func__ << "  " << poid << " got "
 	       << r << " on read, read_error" << dendl;
       o.read_error = true;
       return 0;
     }
+    be_scrub_readahead(pos, (uint64_t)r < stride, pos.data_pos, stride,
+		       fadvise_flags);
     if (r > 0) {
       pos.data_hash << bl;
     }
     pos.data_pos += r;
-    if (r == cct->_conf->osd_deep_scrub_stride) {
+    if ((uint64_t)r == stride) {
       dout(20) << __func__ << "  " << poid << " more data, digest so far 0x"
 	       << std::hex << pos.data_hash.digest() << std::dec << dendl;
       return -EINPROGRESS;
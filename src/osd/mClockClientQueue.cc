@@ -33,10 +33,13 @@ namespace ceph {
    * class mClockClientQueue
    */
 
-  mClockClientQueue::mClockClientQueue(CephContext *cct) :
+  mClockClientQueue::mClockClientQueue(
+    CephContext *cct,
+    ceph::mclock::OpCostModel *cost_model) :
     queue(std::bind(&mClockClientQueue::op_class_client_info_f, this, _1),
 	  cct->_conf->osd_op_queue_mclock_anticipation_timeout),
-    client_info_mgr(cct)
+    client_info_mgr(cct),
+    cost_model(cost_model)
   {
     // empty
   }
@@ -56,11 +59,17 @@ namespace ceph {
   // Formatted output of the queue
   inline void mClockClientQueue::dump(ceph::Formatter *f) const {
     queue.dump(f);
+    if (cost_model) {
+      f->open_object_section("cost_model");
+      cost_model->dump(f);
+      f->close_section();
+    }
   }
 
   inline void mClockClientQueue::enqueue_strict(Client cl,
 						unsigned priority,
 						Request&& item) {
+    item.set_qos_cost(0);
     queue.enqueue_strict(get_inner_client(cl, item), priority,
 			 std::move(item));
   }
@@ -69,6 +78,7 @@ namespace ceph {
   inline void mClockClientQueue::enqueue_strict_front(Client cl,
 						      unsigned priority,
 						      Request&& item) {
+    item.set_qos_cost(0);
     queue.enqueue_strict_front(get_inner_client(cl, item), priority,
 			       std::move(item));
   }
@@ -78,7 +88,9 @@ namespace ceph {
 					 unsigned priority,
 					 unsigned cost,
 					 Request&& item) {
-    queue.enqueue(get_inner_client(cl, item), priority, 1u, std::move(item));
+    unsigned c = get_cost(item);
+    item.set_qos_cost(c);
+    queue.enqueue(get_inner_client(cl, item), priority, c, std::move(item));
   }
 
   // Enqueue the op in the front of the regular queue
@@ -86,12 +98,20 @@ namespace ceph {
 					       unsigned priority,
 					       unsigned cost,
 					       Request&& item) {
-    queue.enqueue_front(get_inner_client(cl, item), priority, 1u,
+    // the front queue goes ahead of the mClock tags, so charges nothing
+    unsigned c = get_cost(item);
+    item.set_qos_cost(0);
+    queue.enqueue_front(get_inner_client(cl, item), priority, c,
 			std::move(item));
   }
 
   // Return an op to be dispatched
   inline Request mClockClientQueue::dequeue() {
-    return queue.dequeue();
+    Request r = queue.dequeue();
+    if (cost_model) {
+      cost_model->note_dequeue(client_info_mgr.osd_op_type(r),
+			       r.get_qos_cost());
+    }
+    return r;
   }
 } // namespace ceph
@@ -47,9 +47,13 @@ namespace ceph {
 
     ceph::mclock::OpClassClientInfoMgr client_info_mgr;
 
+    // shared with the other shards; null means every item costs 1
+    ceph::mclock::OpCostModel *cost_model;
+
   public:
 
-    mClockClientQueue(CephContext *cct);
+    mClockClientQueue(CephContext *cct,
+		      ceph::mclock::OpCostModel *cost_model = nullptr);
 
     const crimson::dmclock::ClientInfo* op_class_client_info_f(const InnerClient& client);
 
@@ -106,6 +110,10 @@ namespace ceph {
   protected:
 
     InnerClient get_inner_client(const Client& cl, const Request& request);
+
+    unsigned get_cost(const Request& item) const {
+      return cost_model ? cost_model->get_cost(item) : 1u;
+    }
   }; // class mClockClientAdapter
 
 } // namespace ceph
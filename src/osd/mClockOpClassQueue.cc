@@ -33,10 +33,13 @@ namespace ceph {
    * class mClockOpClassQueue
    */
 
-  mClockOpClassQueue::mClockOpClassQueue(CephContext *cct) :
+  mClockOpClassQueue::mClockOpClassQueue(
+    CephContext *cct,
+    ceph::mclock::OpCostModel *cost_model) :
     queue(std::bind(&mClockOpClassQueue::op_class_client_info_f, this, _1),
 	  cct->_conf->osd_op_queue_mclock_anticipation_timeout),
-    client_info_mgr(cct)
+    client_info_mgr(cct),
+    cost_model(cost_model)
   {
     // empty
   }
@@ -50,5 +53,10 @@ namespace ceph {
   // Formatted output of the queue
   void mClockOpClassQueue::dump(ceph::Formatter *f) const {
     queue.dump(f);
+    if (cost_model) {
+      f->open_object_section("cost_model");
+      cost_model->dump(f);
+      f->close_section();
+    }
   }
 } // namespace ceph
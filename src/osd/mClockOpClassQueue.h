@@ -45,9 +45,17 @@ namespace ceph {
 
     ceph::mclock::OpClassClientInfoMgr client_info_mgr;
 
+    // shared with the other shards; null means every item costs 1
+    ceph::mclock::OpCostModel *cost_model;
+
+    unsigned get_cost(const Request& item) const {
+      return cost_model ? cost_model->get_cost(item) : 1u;
+    }
+
   public:
 
-    mClockOpClassQueue(CephContext *cct);
+    mClockOpClassQueue(CephContext *cct,
+		       ceph::mclock::OpCostModel *cost_model = nullptr);
 
     const crimson::dmclock::ClientInfo*
     op_class_client_info_f(const osd_op_type_t& op_type);
@@ -73,6 +81,7 @@ namespace ceph {
     inline void enqueue_strict(Client cl,
 			       unsigned priority,
 			       Request&& item) override final {
+      item.set_qos_cost(0);
       queue.enqueue_strict(client_info_mgr.osd_op_type(item),
 			   priority,
 			   std::move(item));
@@ -82,6 +91,7 @@ namespace ceph {
     inline void enqueue_strict_front(Client cl,
 				     unsigned priority,
 				     Request&& item) override final {
+      item.set_qos_cost(0);
       queue.enqueue_strict_front(client_info_mgr.osd_op_type(item),
 				 priority,
 				 std::move(item));
@@ -92,9 +102,11 @@ namespace ceph {
 			unsigned priority,
 			unsigned cost,
 			Request&& item) override final {
+      unsigned c = get_cost(item);
+      item.set_qos_cost(c);
       queue.enqueue(client_info_mgr.osd_op_type(item),
 		    priority,
-		    1u,
+		    c,
 		    std::move(item));
     }
 
@@ -103,9 +115,12 @@ namespace ceph {
 			      unsigned priority,
 			      unsigned cost,
 			      Request&& item) override final {
+      // the front queue goes ahead of the mClock tags, so charges nothing
+      unsigned c = get_cost(item);
+      item.set_qos_cost(0);
       queue.enqueue_front(client_info_mgr.osd_op_type(item),
 			  priority,
-			  1u,
+			  c,
 			  std::move(item));
     }
 
@@ -116,7 +131,12 @@ namespace ceph {
 
     // Return an op to be dispatch
     inline Request dequeue() override final {
-      return queue.dequeue();
+      Request r = queue.dequeue();
+      if (cost_model) {
+	cost_model->note_dequeue(client_info_mgr.osd_op_type(r),
+				 r.get_qos_cost());
+      }
+      return r;
     }
 
     // Formatted output of the queue
@@ -13,7 +13,11 @@
  */
 
 
+#include <algorithm>
+#include <limits>
+
 #include "common/dout.h"
+#include "common/perf_counters.h"
 #include "osd/mClockOpClassSupport.h"
 #include "osd/OpQueueItem.h"
 
@@ -113,5 +117,149 @@ namespace ceph {
 	MSG_OSD_EC_READ == mtype ||
 	MSG_OSD_EC_READ_REPLY == mtype;
     }
+
+    OpCostModel::OpCostModel(CephContext *cct) :
+      cct(cct),
+      adaptive(cct->_conf.get_val<std::string>(
+		 "osd_op_queue_mclock_cost_model") == "adaptive"),
+      max_item_bytes(cct->_conf->osd_recovery_max_chunk),
+      max_scale(std::max(1.0, cct->_conf.get_val<double>(
+			   "osd_op_queue_mclock_cost_max_scale")))
+    {
+      PerfCountersBuilder b(cct, "mclock", l_mclock_first, l_mclock_last);
+      b.set_prio_default(PerfCountersBuilder::PRIO_USEFUL);
+      b.add_u64_counter(l_mclock_client_op, "client_op",
+			"Client ops admitted by mclock", "cli");
+      b.add_u64_counter(l_mclock_client_op_cost, "client_op_cost",
+			"Cost charged for admitted client ops");
+      b.add_u64_counter(l_mclock_osd_rep_op, "osd_rep_op",
+			"Replication ops admitted by mclock", "rep");
+      b.add_u64_counter(l_mclock_osd_rep_op_cost, "osd_rep_op_cost",
+			"Cost charged for admitted replication ops");
+      b.add_u64_counter(l_mclock_snaptrim, "snaptrim",
+			"Snap trim items admitted by mclock", "snap");
+      b.add_u64_counter(l_mclock_snaptrim_cost, "snaptrim_cost",
+			"Cost charged for admitted snap trim items");
+      b.add_u64_counter(l_mclock_recovery, "recovery",
+			"Recovery items admitted by mclock", "recv");
+      b.add_u64_counter(l_mclock_recovery_cost, "recovery_cost",
+			"Cost charged for admitted recovery items");
+      b.add_u64_counter(l_mclock_scrub, "scrub",
+			"Scrub items admitted by mclock", "scrb");
+      b.add_u64_counter(l_mclock_scrub_cost, "scrub_cost",
+			"Cost charged for admitted scrub items");
+      b.add_u64_counter(l_mclock_pg_delete, "pg_delete",
+			"PG delete items admitted by mclock", "pgdl");
+      b.add_u64_counter(l_mclock_pg_delete_cost, "pg_delete_cost",
+			"Cost charged for admitted PG delete items");
+      b.add_u64_counter(l_mclock_peering_event, "peering_event",
+			"Peering events admitted by mclock", "peer");
+      b.add_u64_counter(l_mclock_peering_event_cost, "peering_event_cost",
+			"Cost charged for admitted peering events");
+      b.add_u64(l_mclock_device_iops, "device_iops",
+		"Small write IOPS the cost model assumes");
+      b.add_u64(l_mclock_device_bandwidth, "device_bandwidth",
+		"Write bandwidth (bytes/sec) the cost model assumes",
+		NULL, 0, unit_t(UNIT_BYTES));
+      b.add_u64(l_mclock_cost_scale, "cost_scale",
+		"Latency scale applied to costs, in thousandths");
+      logger = b.create_perf_counters();
+      logger->set(l_mclock_cost_scale, 1000);
+      cct->get_perfcounters_collection()->add(logger);
+    }
+
+    OpCostModel::~OpCostModel()
+    {
+      cct->get_perfcounters_collection()->remove(logger);
+      delete logger;
+    }
+
+    void OpCostModel::set_capacity(double iops,
+				   uint64_t bandwidth,
+				   double latency)
+    {
+      if (iops < 1.0 || bandwidth == 0) {
+	lgeneric_subdout(cct, osd, 0) << "mClock cost model: ignoring bogus "
+				      << "capacity " << iops << " iops "
+				      << bandwidth << " B/s" << dendl;
+	return;
+      }
+      bytes_per_io = std::max<uint64_t>(1, bandwidth / iops);
+      ref_latency = latency;
+      logger->set(l_mclock_device_iops, static_cast<uint64_t>(iops));
+      logger->set(l_mclock_device_bandwidth, bandwidth);
+      lgeneric_subdout(cct, osd, 1) << "mClock cost model: " << iops
+				    << " iops " << byte_u_t(bandwidth) << "/s"
+				    << " (" << bytes_per_io << " bytes/io)"
+				    << " commit latency " << latency << dendl;
+    }
+
+    void OpCostModel::update_latency(double latency)
+    {
+      if (!adaptive || ref_latency <= 0 || latency <= 0) {
+	return;
+      }
+      // Only a store slower than at calibration makes ops dearer; an
+      // idle store committing faster doesn't buy extra capacity.
+      double target = std::clamp(latency / ref_latency, 1.0, max_scale);
+      double s = (scale.load() + target) / 2;
+      scale = s;
+      logger->set(l_mclock_cost_scale, static_cast<uint64_t>(s * 1000));
+      lgeneric_subdout(cct, osd, 20) << "mClock cost model: commit latency "
+				     << latency << " scale " << s << dendl;
+    }
+
+    unsigned OpCostModel::get_cost(const OpQueueItem& item) const
+    {
+      uint64_t per_io = bytes_per_io;
+      if (!adaptive || per_io == 0) {
+	return 1u;
+      }
+      // Background items carry the WPQ token cost (e.g. osd_recovery_cost)
+      // rather than their I/O size; none moves more than a recovery chunk.
+      uint64_t bytes = std::min<uint64_t>(item.get_cost(), max_item_bytes);
+      double cost = (1.0 + double(bytes) / per_io) * scale;
+      return std::clamp<double>(cost, 1.0, std::numeric_limits<int>::max());
+    }
+
+    void OpCostModel::note_dequeue(osd_op_type_t type, unsigned cost)
+    {
+      int idx;
+      switch (type) {
+      case osd_op_type_t::client_op:
+	idx = l_mclock_client_op;
+	break;
+      case osd_op_type_t::osd_rep_op:
+	idx = l_mclock_osd_rep_op;
+	break;
+      case osd_op_type_t::bg_snaptrim:
+	idx = l_mclock_snaptrim;
+	break;
+      case osd_op_type_t::bg_recovery:
+	idx = l_mclock_recovery;
+	break;
+      case osd_op_type_t::bg_scrub:
+	idx = l_mclock_scrub;
+	break;
+      case osd_op_type_t::bg_pg_delete:
+	idx = l_mclock_pg_delete;
+	break;
+      case osd_op_type_t::peering_event:
+	idx = l_mclock_peering_event;
+	break;
+      default:
+	ceph_abort();
+      }
+      logger->inc(idx);
+      logger->inc(idx + 1, cost);
+    }
+
+    void OpCostModel::dump(Formatter *f) const
+    {
+      f->dump_string("model", adaptive ? "adaptive" : "static");
+      f->dump_unsigned("bytes_per_io", bytes_per_io.load());
+      f->dump_float("ref_commit_latency", ref_latency);
+      f->dump_float("scale", scale.load());
+    }
   } // namespace mclock
 } // namespace ceph
@@ -15,12 +15,36 @@
 
 #pragma once
 
+#include <atomic>
 #include <bitset>
 
 #include "dmclock/src/dmclock_server.h"
 #include "osd/OpRequest.h"
 #include "osd/OpQueueItem.h"
 
+class PerfCounters;
+
+enum {
+  l_mclock_first = 21000,
+  l_mclock_client_op,
+  l_mclock_client_op_cost,
+  l_mclock_osd_rep_op,
+  l_mclock_osd_rep_op_cost,
+  l_mclock_snaptrim,
+  l_mclock_snaptrim_cost,
+  l_mclock_recovery,
+  l_mclock_recovery_cost,
+  l_mclock_scrub,
+  l_mclock_scrub_cost,
+  l_mclock_pg_delete,
+  l_mclock_pg_delete_cost,
+  l_mclock_peering_event,
+  l_mclock_peering_event_cost,
+  l_mclock_device_iops,
+  l_mclock_device_bandwidth,
+  l_mclock_cost_scale,
+  l_mclock_last,
+};
 
 namespace ceph {
   namespace mclock {
@@ -99,5 +123,49 @@ namespace ceph {
       // with rep_op_msg_bitmap
       static bool is_rep_op(uint16_t);
     }; // OpClassClientInfoMgr
+
+    // Translates queue items into mclock costs.  With the static model
+    // every item costs 1, as it always has.  With the adaptive model an
+    // item costs its estimated device time, in units of one small random
+    // write on the calibrated device: 1 + bytes / (bandwidth / iops).
+    // That cost is then inflated by how much slower the store commits
+    // than it did at calibration, so reservations and limits track what
+    // the device can actually deliver.  The model is shared by all op
+    // shards of an OSD.
+    class OpCostModel {
+      CephContext *cct;
+      const bool adaptive;
+      const uint64_t max_item_bytes;
+      const double max_scale;
+
+      std::atomic<uint64_t> bytes_per_io = {0};
+      std::atomic<double> scale = {1.0};
+      double ref_latency = 0;  // seconds; commit latency at calibration
+
+      PerfCounters *logger = nullptr;
+
+    public:
+
+      OpCostModel(CephContext *cct);
+      ~OpCostModel();
+
+      bool is_adaptive() const {
+	return adaptive;
+      }
+
+      // device capacity, either configured or measured at startup
+      void set_capacity(double iops, uint64_t bandwidth, double latency);
+
+      // feed the average store commit latency (seconds) seen lately
+      void update_latency(double latency);
+
+      unsigned get_cost(const OpQueueItem& item) const;
+
+      // account for an item leaving the queue; @cost is what it was
+      // charged when queued, whatever the scale is now
+      void note_dequeue(osd_op_type_t type, unsigned cost);
+
+      void dump(Formatter *f) const;
+    }; // OpCostModel
   } // namespace mclock
 } // namespace ceph
@@ -42,6 +42,8 @@ struct ObjectState {
 typedef std::shared_ptr<ObjectContext> ObjectContextRef;
 
 struct ObjectContext {
+  MEMPOOL_CLASS_HELPERS();
+
   ObjectState obs;
 
   SnapSetContext *ssc;  // may be null
@@ -297,7 +299,7 @@ public:
   ObjectContext()
     : ssc(NULL),
       destructor_callback(0),
-      blocked(false), requeue_scrub_on_unblock(false) {}
+      blocked(false), requeue_scrub_on_unblock(false), negative(false) {}
 
   ~ObjectContext() {
     ceph_assert(rwstate.empty());
@@ -320,6 +322,9 @@ public:
   /// in-progress copyfrom ops for this object
   bool blocked:1;
   bool requeue_scrub_on_unblock:1;    // true if we need to requeue scrub on unblock
+  /// cached only to remember that the object does not exist; lookups
+  /// that may not create it treat it as a miss
+  bool negative:1;
 
 };
 
@@ -123,6 +123,12 @@ PerfCounters *build_osd_logger(CephContext *cct) {
     "Latency of IO before calling queue(before really queue into ShardedOpWq)"); // client io before queue op_wq latency
   osd_plb.add_time_avg(l_osd_op_before_dequeue_op_lat, "op_before_dequeue_op_lat",
     "Latency of IO before calling dequeue_op(already dequeued and get PG lock)"); // client io before dequeue_op latency
+  osd_plb.add_u64_counter(
+    l_osd_op_wq_spin_hit, "op_wq_spin_hit",
+    "Op queue worker found new work while spinning");
+  osd_plb.add_u64_counter(
+    l_osd_op_wq_sleep, "op_wq_sleep",
+    "Op queue worker went to sleep waiting for work");
 
   osd_plb.add_u64_counter(
     l_osd_sop, "subop", "Suboperations");
@@ -259,6 +265,12 @@ PerfCounters *build_osd_logger(CephContext *cct) {
     l_osd_object_ctx_cache_hit, "object_ctx_cache_hit", "Object context cache hits");
   osd_plb.add_u64_counter(
     l_osd_object_ctx_cache_total, "object_ctx_cache_total", "Object context cache lookups");
+  osd_plb.add_u64_counter(
+    l_osd_object_ctx_cache_negative, "object_ctx_cache_negative",
+    "Nonexistent objects remembered by the object context cache");
+  osd_plb.add_u64_counter(
+    l_osd_object_ctx_cache_negative_hit, "object_ctx_cache_negative_hit",
+    "Object context cache hits on nonexistent objects");
 
   osd_plb.add_u64_counter(l_osd_op_cache_hit, "op_cache_hit");
   osd_plb.add_time_avg(
@@ -275,6 +287,42 @@ PerfCounters *build_osd_logger(CephContext *cct) {
     "PG updated its info using fastinfo attr");
   osd_plb.add_u64_counter(
     l_osd_pg_biginfo, "osd_pg_biginfo", "PG updated its biginfo attr");
+  osd_plb.add_u64_counter(
+    l_osd_pg_meta_keys, "osd_pg_meta_keys",
+    "PG log, missing and info omap keys written");
+  osd_plb.add_u64_counter(
+    l_osd_pg_meta_bytes, "osd_pg_meta_bytes",
+    "PG log, missing and info omap bytes written", NULL, 0,
+    unit_t(UNIT_BYTES));
+
+  osd_plb.add_u64_counter(
+    l_osd_scrub_deep_bytes, "osd_scrub_deep_bytes",
+    "Object data read by deep scrub", NULL, 0, unit_t(UNIT_BYTES));
+  osd_plb.add_u64_counter(
+    l_osd_scrub_readahead_hit, "osd_scrub_readahead_hit",
+    "Deep scrub reads served by read-ahead");
+  osd_plb.add_u64_counter(
+    l_osd_scrub_readahead_miss, "osd_scrub_readahead_miss",
+    "Deep scrub read-ahead that could not be used");
+
+  osd_plb.add_u64_counter(
+    l_osd_replica_read, "replica_read",
+    "Client reads served by a replica");
+  osd_plb.add_u64_counter(
+    l_osd_replica_read_redirect, "replica_read_redirect",
+    "Client reads a replica sent back to the primary");
+  osd_plb.add_u64_counter(
+    l_osd_lease_grant, "lease_grant", "Read leases granted to replicas");
+  osd_plb.add_u64_counter(
+    l_osd_lease_wait, "lease_wait",
+    "Writes delayed until read leases of a prior interval expired");
+
+  osd_plb.add_u64_counter(
+    l_osd_ec_delta_write, "ec_delta_write",
+    "EC overwrites applied as parity deltas");
+  osd_plb.add_u64_counter(
+    l_osd_ec_delta_write_fallback, "ec_delta_write_fallback",
+    "EC parity delta writes that fell back to a full stripe read");
 
   return osd_plb.create_perf_counters();
 }
@@ -37,6 +37,8 @@ enum {
 
   l_osd_op_before_queue_op_lat,
   l_osd_op_before_dequeue_op_lat,
+  l_osd_op_wq_spin_hit,
+  l_osd_op_wq_sleep,
 
   l_osd_sop,
   l_osd_sop_inb,
@@ -107,6 +109,8 @@ enum {
 
   l_osd_object_ctx_cache_hit,
   l_osd_object_ctx_cache_total,
+  l_osd_object_ctx_cache_negative,
+  l_osd_object_ctx_cache_negative_hit,
 
   l_osd_op_cache_hit,
   l_osd_tier_flush_lat,
@@ -116,6 +120,20 @@ enum {
   l_osd_pg_info,
   l_osd_pg_fastinfo,
   l_osd_pg_biginfo,
+  l_osd_pg_meta_keys,
+  l_osd_pg_meta_bytes,
+
+  l_osd_scrub_deep_bytes,
+  l_osd_scrub_readahead_hit,
+  l_osd_scrub_readahead_miss,
+
+  l_osd_replica_read,
+  l_osd_replica_read_redirect,
+  l_osd_lease_grant,
+  l_osd_lease_wait,
+
+  l_osd_ec_delta_write,
+  l_osd_ec_delta_write_fallback,
 
   l_osd_last,
 };
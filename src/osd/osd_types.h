@@ -1044,6 +1044,7 @@ public:
     TARGET_SIZE_BYTES,  // total bytes in pool
     TARGET_SIZE_RATIO,  // fraction of total cluster
     PG_AUTOSCALE_BIAS,
+    READ_LEASE_INTERVAL, // seconds a replica may serve reads on its own
   };
 
   enum type_t {
@@ -4017,8 +4018,10 @@ public:
   // the actual log
   mempool::osd_pglog::list<pg_log_entry_t> log;
 
-  // entries just for dup op detection ordered oldest to newest
-  mempool::osd_pglog::list<pg_log_dup_t> dups;
+  // entries just for dup op detection ordered oldest to newest; there
+  // are many more of these than log entries, so they are kept in
+  // contiguous chunks rather than one list node each
+  mempool::osd_pglog::deque<pg_log_dup_t> dups;
 
   pg_log_t() = default;
   pg_log_t(const eversion_t &last_update,
@@ -4026,7 +4029,7 @@ public:
 	   const eversion_t &can_rollback_to,
 	   const eversion_t &rollback_info_trimmed_to,
 	   mempool::osd_pglog::list<pg_log_entry_t> &&entries,
-	   mempool::osd_pglog::list<pg_log_dup_t> &&dup_entries)
+	   mempool::osd_pglog::deque<pg_log_dup_t> &&dup_entries)
     : head(last_update), tail(log_tail), can_rollback_to(can_rollback_to),
       rollback_info_trimmed_to(rollback_info_trimmed_to),
       log(std::move(entries)), dups(std::move(dup_entries)) {}
@@ -5580,6 +5583,8 @@ struct ScrubMap {
 WRITE_CLASS_ENCODER(ScrubMap::object)
 WRITE_CLASS_ENCODER(ScrubMap)
 
+struct ScrubReadahead;
+
 struct ScrubMapBuilder {
   bool deep = false;
   std::vector<hobject_t> ls;
@@ -5590,6 +5595,9 @@ struct ScrubMapBuilder {
   ceph::buffer::hash data_hash, omap_hash;  ///< accumulatinng hash value
   uint64_t omap_keys = 0;
   uint64_t omap_bytes = 0;
+  uint64_t data_bytes = 0;  ///< object data read by deep scrub
+  /// data being read ahead of pos; dropped whenever we start over
+  std::shared_ptr<ScrubReadahead> readahead;
 
   bool empty() {
     return ls.empty();
@@ -161,6 +161,9 @@ enum {
   l_osdc_osdop_omap_rd,
   l_osdc_osdop_omap_del,
 
+  l_osdc_op_replica,
+  l_osdc_op_replica_bounce,
+
   l_osdc_last,
 };
 
@@ -169,6 +172,7 @@ enum {
 
 static const char *config_keys[] = {
   "crush_location",
+  "objecter_replica_read_policy",
   NULL
 };
 
@@ -240,6 +244,9 @@ void Objecter::handle_conf_change(const ConfigProxy& conf,
   if (changed.count("crush_location")) {
     update_crush_location();
   }
+  if (changed.count("objecter_replica_read_policy")) {
+    update_replica_read_policy();
+  }
 }
 
 void Objecter::update_crush_location()
@@ -248,6 +255,22 @@ void Objecter::update_crush_location()
   crush_location = cct->crush_location.get_location();
 }
 
+void Objecter::update_replica_read_policy()
+{
+  auto policy = cct->_conf.get_val<std::string>(
+    "objecter_replica_read_policy");
+  ldout(cct, 10) << __func__ << " " << policy << dendl;
+  // kept apart from global_op_flags, which belong to our user (e.g.
+  // Client::set_filer_flags() for ceph_localize_reads)
+  if (policy == "balance") {
+    replica_read_flags = CEPH_OSD_FLAG_BALANCE_READS;
+  } else if (policy == "localize") {
+    replica_read_flags = CEPH_OSD_FLAG_LOCALIZE_READS;
+  } else {
+    replica_read_flags = 0;
+  }
+}
+
 // messages ------------------------------
 
 /*
@@ -377,6 +400,11 @@ void Objecter::init()
     pcb.add_u64_counter(l_osdc_osdop_omap_del, "omap_del",
 			"OSD OMAP delete operations");
 
+    pcb.add_u64_counter(l_osdc_op_replica, "op_replica",
+			"Read operations sent to a replica");
+    pcb.add_u64_counter(l_osdc_op_replica_bounce, "op_replica_bounce",
+			"Replica reads resent to the primary");
+
     logger = pcb.create_perf_counters();
     cct->get_perfcounters_collection()->add(logger);
   }
@@ -396,6 +424,7 @@ void Objecter::init()
   }
 
   update_crush_location();
+  update_replica_read_policy();
 
   cct->_conf.add_observer(this);
 
@@ -1206,7 +1235,7 @@ void Objecter::handle_osd_map(MOSDMap *m)
 	else if (m->maps.count(e)) {
 	  ldout(cct, 3) << "handle_osd_map decoding full epoch " << e << dendl;
           auto new_osdmap = std::make_unique<OSDMap>();
-          new_osdmap->decode(m->maps[e]);
+          new_osdmap->decode(m->maps[e], osdmap.get());
 
           emit_blacklist_events(*osdmap, *new_osdmap);
           osdmap = std::move(new_osdmap);
@@ -1269,7 +1298,7 @@ void Objecter::handle_osd_map(MOSDMap *m)
 	}
 	ldout(cct, 3) << "handle_osd_map decoding full epoch "
 		      << m->get_last() << dendl;
-	osdmap->decode(m->maps[m->get_last()]);
+	osdmap->decode(m->maps[m->get_last()], osdmap.get());
         prune_pg_mapping(osdmap->get_pools());
 
 	_scan_requests(homeless_session, false, false, NULL,
@@ -2261,6 +2290,9 @@ void Objecter::op_submit(Op *op, ceph_tid_t *ptid, int *ctx_budget)
   if (!ptid)
     ptid = &tid;
   op->trace.event("op submit");
+  if (op->target.flags & CEPH_OSD_FLAG_READ) {
+    op->target.flags |= replica_read_flags;
+  }
   _op_submit_with_budget(op, rl, ptid, ctx_budget);
 }
 
@@ -2956,35 +2988,48 @@ int Objecter::_calc_target(op_target_t *t, Connection *con, bool any_change)
       int osd;
       bool read = is_read && !is_write;
       if (read && (t->flags & CEPH_OSD_FLAG_BALANCE_READS)) {
+	// pick two members at random and go to the one with fewer of our
+	// ops in flight
 	int p = rand() % acting.size();
+	if (acting.size() > 1) {
+	  int q = (p + 1 + rand() % (acting.size() - 1)) % acting.size();
+	  if (_get_osd_load(acting[q]) < _get_osd_load(acting[p]))
+	    p = q;
+	}
 	if (p)
 	  t->used_replica = true;
 	osd = acting[p];
-	ldout(cct, 10) << " chose random osd." << osd << " of " << acting
+	ldout(cct, 10) << " chose osd." << osd << " of " << acting
 		       << dendl;
       } else if (read && (t->flags & CEPH_OSD_FLAG_LOCALIZE_READS) &&
 		 acting.size() > 1) {
-	// look for a local replica.  prefer the primary if the
-	// distance is the same.
+	// look for a local replica.  among replicas at the same distance
+	// prefer the one with fewer of our ops in flight, and the primary
+	// if that is a tie too.
 	int best = -1;
 	int best_locality = 0;
+	uint32_t best_load = 0;
 	for (unsigned i = 0; i < acting.size(); ++i) {
 	  int locality = osdmap->crush->get_common_ancestor_distance(
 		 cct, acting[i], crush_location);
+	  uint32_t load = _get_osd_load(acting[i]);
 	  ldout(cct, 20) << __func__ << " localize: rank " << i
 			 << " osd." << acting[i]
-			 << " locality " << locality << dendl;
+			 << " locality " << locality
+			 << " load " << load << dendl;
 	  if (i == 0 ||
 	      (locality >= 0 && best_locality >= 0 &&
 	       locality < best_locality) ||
-	      (best_locality < 0 && locality >= 0)) {
+	      (best_locality < 0 && locality >= 0) ||
+	      (locality == best_locality && load < best_load)) {
 	    best = i;
 	    best_locality = locality;
-	    if (i)
-	      t->used_replica = true;
+	    best_load = load;
 	  }
 	}
 	ceph_assert(best >= 0);
+	if (best)
+	  t->used_replica = true;
 	osd = acting[best];
       } else {
 	osd = acting_primary;
@@ -3011,6 +3056,15 @@ int Objecter::_map_session(op_target_t *target, OSDSession **s,
   return _get_session(target->osd, s, sul);
 }
 
+uint32_t Objecter::_get_osd_load(int osd)
+{
+  // rwlock is locked
+  auto p = osd_sessions.find(osd);
+  if (p == osd_sessions.end())
+    return 0;
+  return p->second->num_ops;
+}
+
 void Objecter::_session_op_assign(OSDSession *to, Op *op)
 {
   // to->lock is locked
@@ -3020,6 +3074,7 @@ void Objecter::_session_op_assign(OSDSession *to, Op *op)
   get_session(to);
   op->session = to;
   to->ops[op->tid] = op;
+  to->num_ops = to->ops.size();
 
   if (to->is_homeless()) {
     num_homeless_ops++;
@@ -3038,6 +3093,7 @@ void Objecter::_session_op_remove(OSDSession *from, Op *op)
   }
 
   from->ops.erase(op->tid);
+  from->num_ops = from->ops.size();
   put_session(from);
   op->session = NULL;
 
@@ -3279,6 +3335,9 @@ void Objecter::_send_op(Op *op)
   ldout(cct, 15) << "_send_op " << op->tid << " to "
 		 << op->target.actual_pgid << " on osd." << op->session->osd
 		 << dendl;
+  if (op->target.used_replica) {
+    logger->inc(l_osdc_op_replica);
+  }
 
   ConnectionRef con = op->session->con;
   ceph_assert(con);
@@ -3464,6 +3523,9 @@ void Objecter::handle_osd_op_reply(MOSDOpReply *m)
 
   if (rc == -EAGAIN) {
     ldout(cct, 7) << " got -EAGAIN, resubmitting" << dendl;
+    if (op->target.used_replica) {
+      logger->inc(l_osdc_op_replica_bounce);
+    }
     if (op->onfinish)
       num_in_flight--;
     _session_op_remove(s, op);
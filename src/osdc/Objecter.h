@@ -1241,6 +1241,7 @@ private:
   uint64_t max_linger_id{0};
   std::atomic<unsigned> num_in_flight{0};
   std::atomic<int> global_op_flags{0}; // flags which are applied to each IO op
+  std::atomic<int> replica_read_flags{0}; // from objecter_replica_read_policy
   bool keep_balanced_budget = false;
   bool honor_osdmap_full = true;
   bool osdmap_full_try = false;
@@ -1331,6 +1332,7 @@ private:
   void start_tick();
   void tick();
   void update_crush_location();
+  void update_replica_read_policy();
 
   class RequestStateHook;
 
@@ -1912,6 +1914,7 @@ public:
 
     // pending ops
     std::map<ceph_tid_t,Op*> ops;
+    std::atomic<uint32_t> num_ops{0}; ///< ops.size(), readable without lock
     std::map<uint64_t, LingerOp*> linger_ops;
     std::map<ceph_tid_t,CommandOp*> command_ops;
 
@@ -2003,6 +2006,7 @@ public:
     Op *op);
 
   bool target_should_be_paused(op_target_t *op);
+  uint32_t _get_osd_load(int osd);
   int _calc_target(op_target_t *t, Connection *con,
 		   bool any_change = false);
   int _map_session(op_target_t *op, OSDSession **s,
@@ -107,6 +107,8 @@
      --show-mappings       show mappings
      --show-bad-mappings   show bad mappings
      --show-choose-tries   show choose tries histogram
+     --show-mapping-rate   show mappings per second, mapping one x
+                           at a time and in batches
      --output-name name
                            prepend the data file(s) generated during the
                            testing routine with name
@@ -17,6 +17,9 @@
      --with-default-pool     include default pool when creating map
      --clear-temp            clear pg_temp and primary_temp
      --test-random           do random placements
+     --test-mapping-incremental <num>
+                             apply <num> random incrementals, comparing
+                             incremental and full pg mapping updates
      --test-map-pg <pgid>    map a pgid to osds
      --test-map-object <objectname> [--pool <poolid>] map an object to osds
      --upmap-cleanup <file>  clean up pg_upmap[_items] entries, writing
@@ -637,3 +637,57 @@ TEST(CRUSH, straw2_reweight) {
     cout << "     vs " << estddev << std::endl;
   }
 }
+
+TEST(CRUSH, hash32_3_vec) {
+  // the vectorized hash must match the scalar one lane for lane,
+  // including the tail that does not fill a whole vector
+  std::vector<__u32> b(70), out(70);
+  for (unsigned n = 0; n <= b.size(); ++n) {
+    __u32 a = rand(), c = rand();
+    for (unsigned i = 0; i < n; ++i)
+      b[i] = rand() - 1000;
+    crush_hash32_3_vec(CRUSH_HASH_RJENKINS1, a, b.data(), c, out.data(), n);
+    for (unsigned i = 0; i < n; ++i)
+      ASSERT_EQ(crush_hash32_3(CRUSH_HASH_RJENKINS1, a, b[i], c), out[i]);
+  }
+}
+
+TEST(CRUSH, do_rule_batch) {
+  // more items than bucket_straw2_choose hashes at once
+  int n = 45;
+  std::unique_ptr<CrushWrapper> c(new CrushWrapper);
+  c->set_type_name(1, "root");
+  c->set_type_name(0, "osd");
+  c->set_max_devices(n);
+
+  int items[n], weights[n];
+  for (int i = 0; i < n; ++i) {
+    items[i] = i;
+    weights[i] = 0x10000 * (1 + i % 3);
+  }
+  int root;
+  crush_bucket *b = crush_make_bucket(c->get_crush_map(),
+				      CRUSH_BUCKET_STRAW2, CRUSH_HASH_RJENKINS1,
+				      1, n, items, weights);
+  EXPECT_EQ(0, crush_add_bucket(c->get_crush_map(), 0, b, &root));
+  EXPECT_EQ(0, c->set_item_name(root, "root"));
+  int rule = c->add_simple_rule("rule", "root", "osd", "",
+				"firstn", pg_pool_t::TYPE_REPLICATED);
+  EXPECT_EQ(0, rule);
+  c->finalize();
+
+  vector<unsigned> reweight(n, 0x10000);
+  reweight[3] = 0;
+  vector<int> xs;
+  for (int x = 0; x < 2000; ++x)
+    xs.push_back(x * 2654435761u);
+  vector<vector<int>> batched;
+  c->do_rule_batch(rule, xs, &batched, 3, reweight, 0);
+  ASSERT_EQ(xs.size(), batched.size());
+  for (unsigned i = 0; i < xs.size(); ++i) {
+    vector<int> out;
+    c->do_rule(rule, xs[i], out, 3, reweight, 0);
+    ASSERT_EQ(out, batched[i]);
+    ASSERT_EQ(3u, out.size());
+  }
+}
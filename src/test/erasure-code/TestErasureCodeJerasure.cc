@@ -227,6 +227,58 @@ TYPED_TEST(ErasureCodeTest, minimum_to_decode)
   }
 }
 
+TYPED_TEST(ErasureCodeTest, parity_delta)
+{
+  TypeParam jerasure;
+  ErasureCodeProfile profile;
+  profile["k"] = "2";
+  profile["m"] = "2";
+  profile["packetsize"] = "8";
+  jerasure.init(profile, &cerr);
+  if (!jerasure.supports_parity_delta())
+    return;
+
+  //
+  // Codes that support parity delta updates are linear: the coding
+  // chunks of a XOR b are the XOR of the coding chunks of a and b.
+  //
+  unsigned length = jerasure.get_chunk_size(LARGE_ENOUGH) * 2;
+  bufferptr a(buffer::create_page_aligned(length));
+  bufferptr b(buffer::create_page_aligned(length));
+  bufferptr a_xor_b(buffer::create_page_aligned(length));
+  for (unsigned i = 0; i < length; i++) {
+    a[i] = 'A' + i % 26;
+    b[i] = i * 7;
+    a_xor_b[i] = a[i] ^ b[i];
+  }
+  set<int> want_to_encode = { 2, 3 };
+  map<int,bufferlist> encoded_a, encoded_b, encoded_a_xor_b;
+  {
+    bufferlist in;
+    in.push_back(a);
+    EXPECT_EQ(0, jerasure.encode(want_to_encode, in, &encoded_a));
+  }
+  {
+    bufferlist in;
+    in.push_back(b);
+    EXPECT_EQ(0, jerasure.encode(want_to_encode, in, &encoded_b));
+  }
+  {
+    bufferlist in;
+    in.push_back(a_xor_b);
+    EXPECT_EQ(0, jerasure.encode(want_to_encode, in, &encoded_a_xor_b));
+  }
+  for (int chunk : want_to_encode) {
+    ASSERT_EQ(encoded_a[chunk].length(), encoded_a_xor_b[chunk].length());
+    const char *pa = encoded_a[chunk].c_str();
+    const char *pb = encoded_b[chunk].c_str();
+    const char *pab = encoded_a_xor_b[chunk].c_str();
+    for (unsigned i = 0; i < encoded_a[chunk].length(); i++) {
+      ASSERT_EQ((char)(pa[i] ^ pb[i]), pab[i]);
+    }
+  }
+}
+
 TEST(ErasureCodeTest, encode)
 {
   ErasureCodeJerasureReedSolomonVandermonde jerasure;
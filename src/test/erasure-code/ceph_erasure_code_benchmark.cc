@@ -33,6 +33,7 @@
 #include "include/utime.h"
 #include "erasure-code/ErasureCodePlugin.h"
 #include "erasure-code/ErasureCode.h"
+#include "osd/ECUtil.h"
 #include "ceph_erasure_code_benchmark.h"
 
 namespace po = boost::program_options;
@@ -50,7 +51,12 @@ int ErasureCodeBench::setup(int argc, char** argv) {
     ("plugin,p", po::value<string>()->default_value("jerasure"),
      "erasure code plugin name")
     ("workload,w", po::value<string>()->default_value("encode"),
-     "run either encode or decode")
+     "run encode, decode, or one of the partial stripe overwrite "
+     "workloads: rmw (re-encode the whole stripe) or delta (update the "
+     "coding chunks with the encoded difference)")
+    ("write-size", po::value<int>()->default_value(4096),
+     "bytes overwritten at the start of the stripe by the rmw and "
+     "delta workloads")
     ("erasures,e", po::value<int>()->default_value(1),
      "number of erasures when decoding")
     ("erased", po::value<vector<int> >(),
@@ -110,6 +116,7 @@ int ErasureCodeBench::setup(int argc, char** argv) {
   }
 
   in_size = vm["size"].as<int>();
+  write_size = vm["write-size"].as<int>();
   max_iterations = vm["iterations"].as<int>();
   plugin = vm["plugin"].as<string>();
   workload = vm["workload"].as<string>();
@@ -144,6 +151,8 @@ int ErasureCodeBench::run() {
 
   if (workload == "encode")
     return encode();
+  else if (workload == "rmw" || workload == "delta")
+    return overwrite();
   else
     return decode();
 }
@@ -180,6 +189,119 @@ int ErasureCodeBench::encode()
   return 0;
 }
 
+/*
+ * Overwrite the first write_size bytes of a stripe of in_size bytes
+ * and bring the coding chunks up to date, either the way a full
+ * stripe read-modify-write does (rmw) or by encoding the difference
+ * of the changed data chunks only (delta).
+ */
+int ErasureCodeBench::overwrite()
+{
+  ErasureCodePluginRegistry &instance = ErasureCodePluginRegistry::instance();
+  ErasureCodeInterfaceRef erasure_code;
+  stringstream messages;
+  int code = instance.factory(plugin,
+			      g_conf().get_val<std::string>("erasure_code_dir"),
+			      profile, &erasure_code, &messages);
+  if (code) {
+    cerr << messages.str() << endl;
+    return code;
+  }
+  if (workload == "delta" &&
+      (!erasure_code->supports_parity_delta() ||
+       !erasure_code->get_chunk_mapping().empty())) {
+    cerr << "plugin " << plugin << " with this profile does not support "
+	 << "parity delta updates" << endl;
+    return -EINVAL;
+  }
+
+  unsigned chunk_size = erasure_code->get_chunk_size(in_size);
+  unsigned stripe_width = chunk_size * k;
+  if (write_size <= 0 || (unsigned)write_size > stripe_width) {
+    cerr << "--write-size " << write_size << " must be in (0, "
+	 << stripe_width << "]" << endl;
+    return -EINVAL;
+  }
+  ECUtil::stripe_info_t sinfo(k, stripe_width);
+
+  bufferlist old_stripe;
+  old_stripe.append(string(stripe_width, 'X'));
+  old_stripe.rebuild_aligned(ErasureCode::SIMD_ALIGN);
+  bufferlist new_stripe;
+  new_stripe.append(string(write_size, 'Y'));
+  new_stripe.append(string(stripe_width - write_size, 'X'));
+  new_stripe.rebuild_aligned(ErasureCode::SIMD_ALIGN);
+
+  set<int> want_to_encode;
+  for (int i = 0; i < k + m; i++) {
+    want_to_encode.insert(i);
+  }
+  map<int,bufferlist> old_chunks;
+  code = erasure_code->encode(want_to_encode, old_stripe, &old_chunks);
+  if (code)
+    return code;
+  map<int,bufferlist> new_chunks;
+  code = erasure_code->encode(want_to_encode, new_stripe, &new_chunks);
+  if (code)
+    return code;
+
+  unsigned changed = (write_size + chunk_size - 1) / chunk_size;
+  map<int,bufferlist> old_data, new_data;
+  for (unsigned i = 0; i < changed; i++) {
+    old_data[i] = old_chunks[i];
+    new_data[i] = new_chunks[i];
+  }
+
+  utime_t begin_time = ceph_clock_now();
+  for (int i = 0; i < max_iterations; i++) {
+    if (workload == "rmw") {
+      map<int,bufferlist> encoded;
+      code = erasure_code->encode(want_to_encode, new_stripe, &encoded);
+      if (code)
+	return code;
+    } else {
+      map<int,bufferlist> parity;
+      for (int j = k; j < k + m; j++) {
+	parity[j] = old_chunks[j];
+      }
+      code = ECUtil::encode_parity_delta(
+	sinfo, erasure_code, old_data, new_data, &parity);
+      if (code)
+	return code;
+    }
+  }
+  utime_t end_time = ceph_clock_now();
+
+  if (workload == "delta") {
+    map<int,bufferlist> parity;
+    for (int j = k; j < k + m; j++) {
+      parity[j] = old_chunks[j];
+    }
+    code = ECUtil::encode_parity_delta(
+      sinfo, erasure_code, old_data, new_data, &parity);
+    if (code)
+      return code;
+    for (int j = k; j < k + m; j++) {
+      if (!parity[j].contents_equal(new_chunks[j])) {
+	cerr << "chunk " << j << " differs from a full encode" << endl;
+	return -1;
+      }
+    }
+  }
+  if (verbose) {
+    // shard I/O per overwrite: the rmw path reads the whole stripe and
+    // rewrites every shard, the delta path only touches the changed data
+    // chunks and the coding chunks
+    unsigned reads = workload == "rmw" ? k : changed + m;
+    unsigned writes = workload == "rmw" ? k + m : changed + m;
+    cout << "chunk size " << chunk_size << ", " << changed
+	 << " data chunks changed, " << reads << " chunks read, "
+	 << writes << " chunks written" << endl;
+  }
+  cout << (end_time - begin_time) << "\t" << (max_iterations * (write_size / 1024)) << endl;
+  return 0;
+}
+
 static void display_chunks(const map<int,bufferlist> &chunks,
 			   unsigned int chunk_count) {
   cout << "chunks ";
@@ -231,6 +231,38 @@ TEST_F(LibRadosIoPP, RoundTripPP2)
   ASSERT_EQ(0, memcmp(bl.c_str(), "ceph", 4));
 }
 
+TEST_F(LibRadosIoPP, BalanceReadAfterCreatePP) {
+  // misses on the primary and on replicas, then a create replicated to
+  // all of them: none of them may keep answering -ENOENT afterwards
+  for (int i = 0; i < 20; ++i) {
+    ObjectReadOperation op;
+    op.stat(nullptr, nullptr, nullptr);
+    AioCompletion *completion = cluster.aio_create_completion();
+    ASSERT_EQ(0, ioctx.aio_operate("foo", completion, &op,
+				   OPERATION_BALANCE_READS, nullptr));
+    completion->wait_for_complete();
+    ASSERT_EQ(-ENOENT, completion->get_return_value());
+    completion->release();
+  }
+
+  bufferlist bl;
+  bl.append("ceph");
+  ASSERT_EQ(0, ioctx.write_full("foo", bl));
+
+  for (int i = 0; i < 20; ++i) {
+    ObjectReadOperation op;
+    op.read(0, bl.length(), nullptr, nullptr);
+    bufferlist out;
+    AioCompletion *completion = cluster.aio_create_completion();
+    ASSERT_EQ(0, ioctx.aio_operate("foo", completion, &op,
+				   OPERATION_BALANCE_READS, &out));
+    completion->wait_for_complete();
+    ASSERT_EQ(0, completion->get_return_value());
+    completion->release();
+    ASSERT_TRUE(bl.contents_equal(out));
+  }
+}
+
 TEST_F(LibRadosIoPP, Checksum) {
   char buf[128];
   Rados cluster;
@@ -37,9 +37,10 @@ class MessengerClient {
   class ClientDispatcher : public Dispatcher {
     uint64_t think_time;
     ClientThread *thread;
+    int worker_hint;
 
    public:
-    ClientDispatcher(uint64_t delay, ClientThread *t): Dispatcher(g_ceph_context), think_time(delay), thread(t) {}
+    ClientDispatcher(uint64_t delay, ClientThread *t, int hint): Dispatcher(g_ceph_context), think_time(delay), thread(t), worker_hint(hint) {}
     bool ms_can_fast_dispatch_any() const override { return true; }
     bool ms_can_fast_dispatch(const Message *m) const override {
       switch (m->get_type()) {
@@ -60,6 +61,9 @@ class MessengerClient {
     int ms_handle_authentication(Connection *con) override {
       return 1;
     }
+    int ms_get_worker_hint(int peer_type, const entity_addrvec_t& addrs) override {
+      return worker_hint;
+    }
   };
 
   class ClientThread : public Thread {
@@ -80,14 +84,17 @@ class MessengerClient {
     Cond cond;
     uint64_t inflight;
 
-    ClientThread(Messenger *m, int c, ConnectionRef con, int len, int ops, int think_time_us):
-        msgr(m), concurrent(c), conn(con), oid("object-name"), oloc(1, 1), msg_len(len), ops(ops),
-        dispatcher(think_time_us, this), lock("MessengerBenchmark::ClientThread::lock"), inflight(0) {
+    ClientThread(Messenger *m, int c, int len, int ops, int think_time_us, int worker_hint):
+        msgr(m), concurrent(c), oid("object-name"), oloc(1, 1), msg_len(len), ops(ops),
+        dispatcher(think_time_us, this, worker_hint), lock("MessengerBenchmark::ClientThread::lock"), inflight(0) {
       m->add_dispatcher_head(&dispatcher);
       bufferptr ptr(msg_len);
       memset(ptr.c_str(), 0, msg_len);
       data.append(ptr);
     }
+    void set_connection(ConnectionRef con) {
+      conn = con;
+    }
     void *entry() override {
       lock.Lock();
       for (int i = 0; i < ops; ++i) {
@@ -113,13 +120,14 @@ class MessengerClient {
   string type;
   string serveraddr;
   int think_time_us;
+  bool spread_workers;
   vector<Messenger*> msgrs;
   vector<ClientThread*> clients;
   DummyAuthClientServer dummy_auth;
 
  public:
-  MessengerClient(const string &t, const string &addr, int delay):
-      type(t), serveraddr(addr), think_time_us(delay),
+  MessengerClient(const string &t, const string &addr, int delay, bool spread):
+      type(t), serveraddr(addr), think_time_us(delay), spread_workers(spread),
       dummy_auth(g_ceph_context) {
   }
   ~MessengerClient() {
@@ -140,9 +148,11 @@ class MessengerClient {
       msgr->set_default_policy(Messenger::Policy::lossless_client(0));
       msgr->set_auth_client(&dummy_auth);
       msgr->start();
+      // with --spread-workers, job i's connection goes to worker i
+      ClientThread *t = new ClientThread(msgr, c, msg_len, ops, think_time_us,
+                                         spread_workers ? i : -1);
       entity_addrvec_t addrs(addr);
-      ConnectionRef conn = msgr->connect_to_osd(addrs);
-      ClientThread *t = new ClientThread(msgr, c, conn, msg_len, ops, think_time_us);
+      t->set_connection(msgr->connect_to_osd(addrs));
       msgrs.push_back(msgr);
       clients.push_back(t);
     }
@@ -166,13 +176,16 @@ void MessengerClient::ClientDispatcher::ms_fast_dispatch(Message *m) {
 
 
 void usage(const string &name) {
-  cerr << "Usage: " << name << " [server ip:port] [numjobs] [concurrency] [ios] [thinktime us] [msg length]" << std::endl;
+  cerr << "Usage: " << name << " [server ip:port] [numjobs] [concurrency] [ios] [thinktime us] [msg length] [--spread-workers]" << std::endl;
   cerr << "       [server ip:port]: connect to the ip:port pair" << std::endl;
   cerr << "       [numjobs]: how much client threads spawned and do benchmark" << std::endl;
   cerr << "       [concurrency]: the max inflight messages(like iodepth in fio)" << std::endl;
   cerr << "       [ios]: how much messages sent for each client" << std::endl;
   cerr << "       [thinktime]: sleep time when do fast dispatching(match client logic)" << std::endl;
   cerr << "       [msg length]: message data bytes" << std::endl;
+  cerr << "       [--spread-workers]: give each job's connection its own messenger worker" << std::endl;
+  cerr << "       (busy polling and worker pinning are set with --ms_async_busy_poll_us," << std::endl;
+  cerr << "       --ms_async_affinity_cores and --ms_async_numa_node)" << std::endl;
 }
 
 int main(int argc, char **argv)
@@ -186,6 +199,15 @@ int main(int argc, char **argv)
   common_init_finish(g_ceph_context);
   g_ceph_context->_conf.apply_changes(nullptr);
 
+  bool spread_workers = false;
+  for (auto i = args.begin(); i != args.end(); ) {
+    if (ceph_argparse_flag(args, i, "--spread-workers", (char*)NULL)) {
+      spread_workers = true;
+    } else {
+      ++i;
+    }
+  }
+
   if (args.size() < 6) {
     usage(argv[0]);
     return 1;
@@ -206,15 +228,23 @@ int main(int argc, char **argv)
   cerr << "       ios " << ios << std::endl;
   cerr << "       thinktime(us) " << think_time << std::endl;
   cerr << "       message data bytes " << len << std::endl;
+  cerr << "       spread workers " << spread_workers << std::endl;
+  cerr << "       busy poll(us) "
+       << g_ceph_context->_conf.get_val<uint64_t>("ms_async_busy_poll_us")
+       << std::endl;
 
-  MessengerClient client(public_msgr_type, args[0], think_time);
+  MessengerClient client(public_msgr_type, args[0], think_time, spread_workers);
 
   client.ready(concurrent, numjobs, ios, len);
   Cycles::init();
   uint64_t start = Cycles::rdtsc();
   client.start();
   uint64_t stop = Cycles::rdtsc();
-  cerr << " Total op " << ios << " run time " << Cycles::to_microseconds(stop - start) << "us." << std::endl;
+  uint64_t us = Cycles::to_microseconds(stop - start);
+  cerr << " Total op " << ios << " run time " << us << "us." << std::endl;
+  if (us) {
+    cerr << " " << (uint64_t)numjobs * ios * 1000000 / us << " ops/s" << std::endl;
+  }
 
   return 0;
 }
@@ -140,6 +140,8 @@ void usage(const string &name) {
   cerr << "       [bind ip:port]: The ip:port pair to bind, client need to specify this pair to connect" << std::endl;
   cerr << "       [server worker threads]: threads will process incoming messages and reply(matching pg threads)" << std::endl;
   cerr << "       [thinktime]: sleep time when do dispatching(match fast dispatch logic in OSD.cc)" << std::endl;
+  cerr << "       (busy polling and worker pinning are set with --ms_async_busy_poll_us," << std::endl;
+  cerr << "       --ms_async_affinity_cores and --ms_async_numa_node)" << std::endl;
 }
 
 int main(int argc, char **argv)
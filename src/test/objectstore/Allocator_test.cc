@@ -365,6 +365,50 @@ TEST_P(AllocTest, test_alloc_big3)
   EXPECT_TRUE(extents[0].length > 0);
 }
 
+TEST_P(AllocTest, test_dump_fragmentation_score)
+{
+  int64_t block_size = 4096;
+  int64_t blocks = 1024;
+  init_alloc(blocks * block_size, block_size);
+  alloc->init_add_free(0, blocks * block_size);
+
+  auto dump = [&]() {
+    interval_set<uint64_t> free;
+    alloc->dump([&](uint64_t offset, uint64_t length) {
+	free.insert(offset, length);
+      });
+    return free;
+  };
+  // a single free extent is not fragmented at all
+  interval_set<uint64_t> free = dump();
+  ASSERT_EQ(1u, free.num_intervals());
+  ASSERT_EQ((uint64_t)blocks * block_size, free.size());
+  EXPECT_EQ(0.0, alloc->get_fragmentation_score(block_size));
+
+  // free every other block; the rest stays allocated
+  PExtentVector extents;
+  EXPECT_EQ(blocks * block_size,
+	    alloc->allocate(blocks * block_size, block_size, 0, &extents));
+  interval_set<uint64_t> release_set;
+  for (int64_t i = 0; i < blocks; i += 2) {
+    release_set.insert(i * block_size, block_size);
+  }
+  alloc->release(release_set);
+  free = dump();
+  ASSERT_EQ(release_set, free);
+  EXPECT_EQ(1.0, alloc->get_fragmentation_score(block_size));
+
+  // and in between once the 16K chunks are free as well
+  release_set.clear();
+  for (int64_t i = 1; i < blocks; i += 8) {
+    release_set.insert(i * block_size, block_size);
+  }
+  alloc->release(release_set);
+  double score = alloc->get_fragmentation_score(block_size);
+  EXPECT_GT(score, 0.0);
+  EXPECT_LT(score, 1.0);
+}
+
 INSTANTIATE_TEST_SUITE_P(
   Allocator,
   AllocTest,
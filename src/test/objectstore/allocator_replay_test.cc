@@ -0,0 +1,441 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Allocator trace replay benchmark.
+ *
+ * Replays a trace recorded with bluestore_allocator_trace_path against
+ * one or more allocator implementations, optionally ages them further
+ * with random overwrite churn shaped like the trace, and reports
+ * allocation latency percentiles, CPU per allocation and fragmentation.
+ */
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <time.h>
+
+#include "common/ceph_argparse.h"
+#include "common/ceph_time.h"
+#include "common/debug.h"
+#include "global/global_init.h"
+#include "os/bluestore/Allocator.h"
+
+struct trace_op_t {
+  enum {
+    OP_ADD,
+    OP_RM,
+    OP_ALLOC,
+    OP_FREE,
+  } type;
+  uint64_t want = 0;
+  uint64_t unit = 0;
+  uint64_t max = 0;
+  int64_t hint = 0;
+  int64_t r = 0;
+  PExtentVector extents;
+};
+
+struct trace_t {
+  string type;
+  uint64_t size = 0;
+  uint64_t block_size = 0;
+  vector<trace_op_t> ops;
+};
+
+static bool parse_extents(istringstream& is, PExtentVector *extents)
+{
+  string token;
+  while (is >> token) {
+    auto p = token.find('~');
+    if (p == string::npos) {
+      return false;
+    }
+    extents->emplace_back(strtoull(token.c_str(), nullptr, 10),
+			  strtoull(token.c_str() + p + 1, nullptr, 10));
+  }
+  return true;
+}
+
+static int load_trace(const char *fname, trace_t *t)
+{
+  std::ifstream in(fname);
+  if (!in) {
+    std::cerr << "error: unable to open " << fname << std::endl;
+    return -1;
+  }
+  string line;
+  unsigned lineno = 0;
+  while (std::getline(in, line)) {
+    ++lineno;
+    istringstream is(line);
+    string cmd;
+    if (!(is >> cmd)) {
+      continue;
+    }
+    trace_op_t op;
+    bool ok = true;
+    if (cmd == "init") {
+      ok = bool(is >> t->type >> t->size >> t->block_size);
+      if (ok) {
+	continue;
+      }
+    } else if (cmd == "add" || cmd == "rm") {
+      op.type = cmd == "add" ? trace_op_t::OP_ADD : trace_op_t::OP_RM;
+      ok = parse_extents(is, &op.extents) && op.extents.size() == 1;
+    } else if (cmd == "alloc") {
+      op.type = trace_op_t::OP_ALLOC;
+      ok = (is >> op.want >> op.unit >> op.max >> op.hint >> op.r) &&
+	parse_extents(is, &op.extents);
+    } else if (cmd == "free") {
+      op.type = trace_op_t::OP_FREE;
+      ok = parse_extents(is, &op.extents);
+    } else {
+      ok = false;
+    }
+    if (!ok || !t->size) {
+      std::cerr << "error: " << fname << ":" << lineno << ": bad line: "
+		<< line << std::endl;
+      return -1;
+    }
+    t->ops.push_back(std::move(op));
+  }
+  return 0;
+}
+
+/*
+ * The allocator being benchmarked hands out different extents than the
+ * one the trace was recorded with; keep track of where each traced extent
+ * ended up so that later releases free the right space.
+ */
+class ExtentRemap {
+  struct piece_t {
+    uint64_t length;
+    uint64_t to;
+  };
+  std::map<uint64_t, piece_t> m;  ///< traced offset -> piece
+
+public:
+  void add(const PExtentVector& from, const PExtentVector& to) {
+    auto f = from.begin();
+    auto t = to.begin();
+    uint64_t f_pos = 0, t_pos = 0;
+    while (f != from.end() && t != to.end()) {
+      uint64_t l = std::min<uint64_t>(f->length - f_pos, t->length - t_pos);
+      m[f->offset + f_pos] = piece_t{l, t->offset + t_pos};
+      f_pos += l;
+      t_pos += l;
+      if (f_pos == f->length) {
+	++f;
+	f_pos = 0;
+      }
+      if (t_pos == t->length) {
+	++t;
+	t_pos = 0;
+      }
+    }
+  }
+
+  /// unmap a traced range; returns the number of bytes that were mapped
+  uint64_t remove(uint64_t off, uint64_t len, interval_set<uint64_t> *to) {
+    uint64_t end = off + len;
+    uint64_t found = 0;
+    auto p = m.upper_bound(off);
+    if (p != m.begin()) {
+      --p;
+    }
+    while (p != m.end() && p->first < end) {
+      uint64_t ps = p->first;
+      uint64_t pe = ps + p->second.length;
+      if (pe <= off) {
+	++p;
+	continue;
+      }
+      uint64_t s = std::max(ps, off);
+      uint64_t e = std::min(pe, end);
+      piece_t piece = p->second;
+      to->insert(piece.to + (s - ps), e - s);
+      found += e - s;
+      p = m.erase(p);
+      if (ps < s) {
+	m[ps] = piece_t{s - ps, piece.to};
+      }
+      if (e < pe) {
+	m[e] = piece_t{pe - e, piece.to + (e - ps)};
+      }
+    }
+    return found;
+  }
+
+  int64_t map_hint(int64_t hint) const {
+    auto p = m.upper_bound(hint);
+    if (p == m.begin()) {
+      return hint;
+    }
+    --p;
+    if ((uint64_t)hint >= p->first + p->second.length) {
+      return hint;
+    }
+    return p->second.to + (hint - p->first);
+  }
+
+  /// pick the mapped piece at or after @pos (wrapping around)
+  bool pick(uint64_t pos, uint64_t *off, uint64_t *len) const {
+    if (m.empty()) {
+      return false;
+    }
+    auto p = m.lower_bound(pos);
+    if (p == m.end()) {
+      p = m.begin();
+    }
+    *off = p->first;
+    *len = p->second.length;
+    return true;
+  }
+};
+
+static uint64_t thread_cpu_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+struct phase_stats_t {
+  vector<uint64_t> alloc_lat;    ///< ns
+  vector<uint64_t> release_lat;  ///< ns
+  uint64_t alloc_cpu = 0;        ///< ns
+  uint64_t alloc_bytes = 0;
+  uint64_t failed = 0;           ///< allocations that came up short
+  uint64_t unmapped = 0;         ///< released bytes we never allocated
+
+  static uint64_t percentile(const vector<uint64_t>& v, double p) {
+    if (v.empty()) {
+      return 0;
+    }
+    return v[std::min<size_t>(v.size() - 1, v.size() * p)];
+  }
+
+  void report(const string& name, Allocator *alloc, uint64_t unit) {
+    std::sort(alloc_lat.begin(), alloc_lat.end());
+    std::sort(release_lat.begin(), release_lat.end());
+    uint64_t extents = 0;
+    alloc->dump([&](uint64_t, uint64_t) { ++extents; });
+    std::cout << name << ": " << alloc_lat.size() << " allocations ("
+	      << byte_u_t(alloc_bytes) << "), " << failed << " short, "
+	      << release_lat.size() << " releases";
+    if (unmapped) {
+      std::cout << ", " << byte_u_t(unmapped) << " released unmapped";
+    }
+    std::cout << "\n";
+    for (auto& i : {std::make_pair("allocate", &alloc_lat),
+		    std::make_pair("release", &release_lat)}) {
+      std::cout << "  " << i.first << " latency ns:"
+		<< " p50 " << percentile(*i.second, .5)
+		<< " p90 " << percentile(*i.second, .9)
+		<< " p99 " << percentile(*i.second, .99)
+		<< " p99.9 " << percentile(*i.second, .999)
+		<< " max " << (i.second->empty() ? 0 : i.second->back())
+		<< "\n";
+    }
+    std::cout << "  cpu ns per allocation: "
+	      << (alloc_lat.empty() ? 0 : alloc_cpu / alloc_lat.size()) << "\n"
+	      << "  free " << byte_u_t(alloc->get_free())
+	      << " in " << extents << " extents"
+	      << ", fragmentation " << alloc->get_fragmentation(unit)
+	      << ", fragmentation score " << alloc->get_fragmentation_score(unit)
+	      << std::endl;
+    *this = phase_stats_t();
+  }
+};
+
+static int64_t timed_allocate(Allocator *alloc, phase_stats_t& stats,
+			      uint64_t want, uint64_t unit, uint64_t max,
+			      int64_t hint, PExtentVector *extents)
+{
+  auto cpu = thread_cpu_ns();
+  auto start = ceph::mono_clock::now();
+  int64_t r = alloc->allocate(want, unit, max, hint, extents);
+  auto lat = ceph::mono_clock::now() - start;
+  stats.alloc_cpu += thread_cpu_ns() - cpu;
+  stats.alloc_lat.push_back(
+    std::chrono::duration_cast<std::chrono::nanoseconds>(lat).count());
+  if (r < (int64_t)want) {
+    ++stats.failed;
+  }
+  if (r > 0) {
+    stats.alloc_bytes += r;
+  }
+  return r;
+}
+
+static void timed_release(Allocator *alloc, phase_stats_t& stats,
+			  const interval_set<uint64_t>& release_set)
+{
+  if (release_set.empty()) {
+    return;
+  }
+  auto start = ceph::mono_clock::now();
+  alloc->release(release_set);
+  auto lat = ceph::mono_clock::now() - start;
+  stats.release_lat.push_back(
+    std::chrono::duration_cast<std::chrono::nanoseconds>(lat).count());
+}
+
+static int replay(const trace_t& t, const string& type, uint64_t age,
+		  uint64_t seed)
+{
+  std::unique_ptr<Allocator> alloc(
+    Allocator::create(g_ceph_context, type, t.size, t.block_size));
+  if (!alloc) {
+    std::cerr << "error: unknown allocator " << type << std::endl;
+    return -1;
+  }
+  std::cout << "== " << type << " (traced with " << t.type << ", "
+	    << byte_u_t(t.size) << ", block size " << t.block_size << ")"
+	    << std::endl;
+
+  ExtentRemap remap;
+  phase_stats_t stats;
+  // allocation requests seen in the trace, to shape the aging churn on
+  vector<const trace_op_t*> requests;
+  PExtentVector tmp;
+  for (auto& op : t.ops) {
+    switch (op.type) {
+    case trace_op_t::OP_ADD:
+      alloc->init_add_free(op.extents[0].offset, op.extents[0].length);
+      break;
+    case trace_op_t::OP_RM:
+      alloc->init_rm_free(op.extents[0].offset, op.extents[0].length);
+      break;
+    case trace_op_t::OP_ALLOC:
+      {
+	tmp.clear();
+	int64_t r = timed_allocate(alloc.get(), stats, op.want, op.unit,
+				   op.max, remap.map_hint(op.hint), &tmp);
+	if (op.r < 0 && r > 0) {
+	  // the traced allocator failed this one, so nothing will free it
+	  alloc->release(tmp);
+	} else {
+	  remap.add(op.extents, tmp);
+	}
+	requests.push_back(&op);
+      }
+      break;
+    case trace_op_t::OP_FREE:
+      {
+	interval_set<uint64_t> release_set;
+	for (auto& e : op.extents) {
+	  stats.unmapped += e.length - remap.remove(e.offset, e.length,
+						    &release_set);
+	}
+	timed_release(alloc.get(), stats, release_set);
+      }
+      break;
+    }
+  }
+  stats.report("replay", alloc.get(), t.block_size);
+
+  if (age && !requests.empty()) {
+    std::mt19937_64 rng(seed);
+    // churn allocations get traced offsets past the end of the device
+    uint64_t next_from = t.size;
+    uint64_t aged = 0;
+    while (aged < age) {
+      auto& req = *requests[rng() % requests.size()];
+      // overwrite: release roughly as much as we are about to allocate
+      interval_set<uint64_t> release_set;
+      uint64_t released = 0;
+      while (released < req.want) {
+	uint64_t off, len;
+	if (!remap.pick(rng() % next_from, &off, &len)) {
+	  break;
+	}
+	len = std::min(len, req.want - released);
+	released += remap.remove(off, len, &release_set);
+      }
+      timed_release(alloc.get(), stats, release_set);
+
+      tmp.clear();
+      int64_t r = timed_allocate(alloc.get(), stats, req.want, req.unit,
+				 req.max, 0, &tmp);
+      if (r <= 0) {
+	std::cout << "out of space after aging " << byte_u_t(aged)
+		  << std::endl;
+	break;
+      }
+      remap.add(PExtentVector{bluestore_pextent_t(next_from, r)}, tmp);
+      next_from += r;
+      aged += r;
+    }
+    stats.report("aged", alloc.get(), t.block_size);
+  }
+  alloc->shutdown();
+  return 0;
+}
+
+void usage(const string &name) {
+  cerr << "Usage: " << name << " <trace> [options]\n"
+       << "  --allocators <a,b,...>  allocators to replay against "
+       << "(default stupid,bitmap)\n"
+       << "  --age <bytes>           after the replay, overwrite this much "
+       << "more data at random\n"
+       << "  --seed <n>              random seed for aging\n"
+       << std::endl;
+}
+
+int main(int argc, const char **argv)
+{
+  vector<const char*> args;
+  argv_to_vec(argc, argv, args);
+  auto cct = global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT,
+			 CODE_ENVIRONMENT_UTILITY,
+			 CINIT_FLAG_NO_DEFAULT_CONFIG_FILE);
+  common_init_finish(g_ceph_context);
+  g_ceph_context->_conf.apply_changes(nullptr);
+
+  string allocators = "stupid,bitmap";
+  uint64_t age = 0;
+  uint64_t seed = time(NULL);
+  string fname;
+  for (auto i = args.begin(); i != args.end();) {
+    string val;
+    if (ceph_argparse_double_dash(args, i)) {
+      break;
+    } else if (ceph_argparse_witharg(args, i, &val,
+				     "--allocators", (char*)NULL)) {
+      allocators = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--age", (char*)NULL)) {
+      age = strtoull(val.c_str(), NULL, 10);
+    } else if (ceph_argparse_witharg(args, i, &val, "--seed", (char*)NULL)) {
+      seed = strtoull(val.c_str(), NULL, 10);
+    } else if (ceph_argparse_flag(args, i, "--help", (char*)NULL)) {
+      usage(argv[0]);
+      return 0;
+    } else if (fname.empty()) {
+      fname = *i++;
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (fname.empty()) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  trace_t t;
+  if (load_trace(fname.c_str(), &t) < 0) {
+    return 1;
+  }
+  std::cout << "loaded " << t.ops.size() << " ops from " << fname
+	    << ", aging seed " << seed << std::endl;
+  std::stringstream ss(allocators);
+  string type;
+  while (std::getline(ss, type, ',')) {
+    if (replay(t, type, age, seed) < 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,201 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * RocksDB column family sharding write-amplification benchmark.
+ *
+ * Runs the same BlueStore-shaped metadata workload (onode overwrites,
+ * omap inserts and deletes as seen on bucket index OSDs, short lived
+ * deferred write records, allocator updates) against RocksDBStore once
+ * per sharding definition and reports how many bytes flushes and
+ * compactions wrote for every byte the workload wrote.
+ */
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <time.h>
+#if __has_include(<filesystem>)
+#include <filesystem>
+namespace fs = std::filesystem;
+#elif __has_include(<experimental/filesystem>)
+#include <experimental/filesystem>
+namespace fs = std::experimental::filesystem;
+#endif
+
+#include "common/ceph_argparse.h"
+#include "common/ceph_context.h"
+#include "common/ceph_time.h"
+#include "common/errno.h"
+#include "global/global_context.h"
+#include "global/global_init.h"
+#include "include/stringify.h"
+#include "kv/KeyValueDB.h"
+
+static void usage(const char *name)
+{
+  std::cout << "usage: " << name << " [options]\n"
+	    << "  --sharding <def>   sharding to compare (repeatable; \"\" is\n"
+	    << "                     the default column family only)\n"
+	    << "  --ops <n>          transactions to submit (default 200000)\n"
+	    << "  --objects <n>      distinct onodes (default 100000)\n"
+	    << "  --path <dir>       scratch directory (default kv_sharding_bench)\n"
+	    << "  --seed <n>         random seed\n"
+	    << std::endl;
+}
+
+/// find "<name> COUNT : <n>" in the rocksdb statistics dump
+static uint64_t get_ticker(const string& stats, const string& name)
+{
+  string needle = name + " COUNT : ";
+  auto p = stats.find(needle);
+  if (p == string::npos) {
+    return 0;
+  }
+  return strtoull(stats.c_str() + p + needle.size(), NULL, 10);
+}
+
+static string make_key(std::mt19937_64& rng, uint64_t range)
+{
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%016llx",
+	   (unsigned long long)(rng() % range));
+  return buf;
+}
+
+static int run(const string& sharding, const string& path,
+	       uint64_t ops, uint64_t objects, uint64_t seed)
+{
+  std::vector<KeyValueDB::ColumnFamily> cfs;
+  std::ostringstream err;
+  if (KeyValueDB::parse_sharding(sharding, &cfs, &err) < 0) {
+    std::cerr << "bad sharding '" << sharding << "': " << err.str()
+	      << std::endl;
+    return -EINVAL;
+  }
+  std::error_code ec;
+  fs::remove_all(path, ec);
+  if (ec || !fs::create_directory(path, ec)) {
+    std::cerr << "unable to reset " << path << ": " << ec.message()
+	      << std::endl;
+    return -EIO;
+  }
+  std::unique_ptr<KeyValueDB> db(
+    KeyValueDB::create(g_ceph_context, "rocksdb", path));
+  if (!db ||
+      db->init(g_conf()->bluestore_rocksdb_options) < 0 ||
+      db->create_and_open(std::cerr, cfs) < 0) {
+    std::cerr << "unable to create rocksdb in " << path << std::endl;
+    return -EIO;
+  }
+
+  std::mt19937_64 rng(seed);
+  bufferlist onode, omap, deferred, alloc;
+  onode.append(string(300, 'o'));
+  omap.append(string(250, 'm'));
+  deferred.append(string(4096, 'l'));
+  alloc.append(string(8, 'b'));
+  uint64_t user_bytes = 0;
+  uint64_t deferred_seq = 0;
+  auto start = mono_clock::now();
+  for (uint64_t i = 0; i < ops; ++i) {
+    KeyValueDB::Transaction t = db->get_transaction();
+    string o = make_key(rng, objects);
+    t->set("O", o, onode);
+    user_bytes += o.size() + onode.length();
+    // bucket index: mostly new entries, some removals
+    string m = make_key(rng, ops * 4);
+    if (rng() % 4) {
+      t->set("M", m, omap);
+      user_bytes += m.size() + omap.length();
+    } else {
+      t->rmkey("M", m);
+      user_bytes += m.size();
+    }
+    // deferred records live for a few transactions only
+    string l = stringify(deferred_seq++);
+    t->set("L", l, deferred);
+    user_bytes += l.size() + deferred.length();
+    if (deferred_seq > 16) {
+      t->rmkey("L", stringify(deferred_seq - 17));
+    }
+    string b = make_key(rng, objects / 8 + 1);
+    t->set("b", b, alloc);
+    user_bytes += b.size() + alloc.length();
+    db->submit_transaction(t);
+  }
+  db->compact();
+  double elapsed = std::chrono::duration<double>(
+    mono_clock::now() - start).count();
+
+  std::ostringstream os;
+  {
+    std::unique_ptr<Formatter> f(Formatter::create("json"));
+    db->get_statistics(f.get());
+    f->flush(os);
+  }
+  string stats = os.str();
+  uint64_t flushed = get_ticker(stats, "rocksdb.flush.write.bytes");
+  uint64_t compacted = get_ticker(stats, "rocksdb.compact.write.bytes");
+  std::cout << "sharding '" << sharding << "': "
+	    << ops << " txns in " << elapsed << "s, "
+	    << byte_u_t(user_bytes) << " written by user, "
+	    << byte_u_t(flushed) << " flushed, "
+	    << byte_u_t(compacted) << " compacted, "
+	    << "write amplification "
+	    << (user_bytes ? (double)(flushed + compacted) / user_bytes : 0)
+	    << std::endl;
+  return 0;
+}
+
+int main(int argc, const char **argv)
+{
+  vector<const char*> args;
+  argv_to_vec(argc, argv, args);
+  auto cct = global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT,
+			 CODE_ENVIRONMENT_UTILITY,
+			 CINIT_FLAG_NO_DEFAULT_CONFIG_FILE);
+  common_init_finish(g_ceph_context);
+  // the statistics dump is what we measure with
+  g_ceph_context->_conf.set_val("rocksdb_perf", "true");
+  g_ceph_context->_conf.set_val("rocksdb_collect_extended_stats", "true");
+  g_ceph_context->_conf.apply_changes(nullptr);
+
+  std::vector<string> shardings;
+  uint64_t ops = 200000;
+  uint64_t objects = 100000;
+  uint64_t seed = time(NULL);
+  string path = "kv_sharding_bench";
+  for (auto i = args.begin(); i != args.end();) {
+    string val;
+    if (ceph_argparse_double_dash(args, i)) {
+      break;
+    } else if (ceph_argparse_witharg(args, i, &val,
+				     "--sharding", (char*)NULL)) {
+      shardings.push_back(val);
+    } else if (ceph_argparse_witharg(args, i, &val, "--ops", (char*)NULL)) {
+      ops = strtoull(val.c_str(), NULL, 10);
+    } else if (ceph_argparse_witharg(args, i, &val,
+				     "--objects", (char*)NULL)) {
+      objects = std::max<uint64_t>(1, strtoull(val.c_str(), NULL, 10));
+    } else if (ceph_argparse_witharg(args, i, &val, "--path", (char*)NULL)) {
+      path = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--seed", (char*)NULL)) {
+      seed = strtoull(val.c_str(), NULL, 10);
+    } else if (ceph_argparse_flag(args, i, "--help", (char*)NULL)) {
+      usage(argv[0]);
+      return 0;
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (shardings.empty()) {
+    shardings = { "", "M L O b", "O(4,0-8) M(4) L b" };
+  }
+  std::cout << "seed " << seed << std::endl;
+  for (auto& s : shardings) {
+    if (run(s, path, ops, objects, seed) < 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -2471,6 +2471,50 @@ TEST_P(StoreTest, BigWriteBigZero) {
   }
 }
 
+TEST_P(StoreTest, ReadHoles) {
+  int r;
+  coll_t cid;
+  ghobject_t a(hobject_t(sobject_t("Object 1", CEPH_NOSNAP)));
+  auto ch = store->create_new_collection(cid);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    cerr << "Creating collection " << cid << std::endl;
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  // two data extents around a hole larger than any single zero buffer
+  bufferlist bl;
+  bl.append(std::string(4096, 'a'));
+  {
+    ObjectStore::Transaction t;
+    t.write(cid, a, 0, bl.length(), bl);
+    t.write(cid, a, 307200, bl.length(), bl);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  for (unsigned i = 0; i < 2; ++i) {
+    bufferlist inbl;
+    r = store->read(ch, a, 0, 307200 + 4096, inbl);
+    ASSERT_EQ(r, 307200 + 4096);
+    bufferlist head, hole, tail;
+    head.substr_of(inbl, 0, 4096);
+    hole.substr_of(inbl, 4096, 307200 - 4096);
+    tail.substr_of(inbl, 307200, 4096);
+    ASSERT_TRUE(bl_eq(bl, head));
+    ASSERT_TRUE(hole.is_zero());
+    ASSERT_TRUE(bl_eq(bl, tail));
+  }
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, a);
+    t.remove_collection(cid);
+    cerr << "Cleaning" << std::endl;
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+}
+
 TEST_P(StoreTest, MiscFragmentTests) {
   int r;
   coll_t cid;
@@ -4778,6 +4822,7 @@ TEST_P(StoreTestSpecificAUSize, SyntheticMatrixPreferDeferred) {
     { "bluestore_max_blob_size", "262144", 0 },
     { "bluestore_compression_mode", "force", "none", 0},
     { "bluestore_prefer_deferred_size", "32768", "0", 0},
+    { "bluestore_kv_commit_pipeline_depth", "0", "2", 0},
     { 0 },
   };
   do_matrix(m, std::bind(&StoreTest::doSyntheticTest, this, _1, _2, _3, _4));
@@ -6573,6 +6618,155 @@ TEST_P(StoreTestSpecificAUSize, BlobReuseOnOverwrite) {
   }
 }
 
+TEST_P(StoreTestSpecificAUSize, SequentialReadahead) {
+
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  size_t block_size = 4096;
+  StartDeferred(block_size);
+  SetVal(g_conf(), "bluestore_readahead_max", "65536");
+  SetVal(g_conf(), "bluestore_readahead_trigger_requests", "2");
+  g_conf().apply_changes(nullptr);
+
+  int r;
+  coll_t cid;
+  ghobject_t hoid(hobject_t("test_readahead", "", CEPH_NOSNAP, 0, -1, ""));
+  const PerfCounters* logger = store->get_perf_counters();
+  const size_t obj_size = block_size * 64;
+
+  auto ch = store->create_new_collection(cid);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  bufferlist data;
+  for (unsigned i = 0; i < obj_size / block_size; ++i) {
+    data.append(string(block_size, 'a' + i % 26));
+  }
+  {
+    ObjectStore::Transaction t;
+    t.write(cid, hoid, 0, data.length(), data);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  // let the mempool thread size the cache shards
+  sleep(1);
+
+  auto ra_ops = logger->get(l_bluestore_readahead_ops);
+  auto ra_hits = logger->get(l_bluestore_readahead_hit_bytes);
+  for (size_t off = 0; off < obj_size; off += block_size) {
+    bufferlist bl, expected;
+    r = store->read(ch, hoid, off, block_size, bl);
+    ASSERT_EQ(r, (int)block_size);
+    expected.substr_of(data, off, block_size);
+    ASSERT_TRUE(bl_eq(expected, bl));
+  }
+  ASSERT_GT(logger->get(l_bluestore_readahead_ops), ra_ops);
+  ASSERT_GT(logger->get(l_bluestore_readahead_hit_bytes), ra_hits);
+
+  // random reads don't trigger readahead
+  ra_ops = logger->get(l_bluestore_readahead_ops);
+  for (size_t off : {block_size * 40, block_size * 3, block_size * 17}) {
+    bufferlist bl;
+    r = store->read(ch, hoid, off, block_size, bl);
+    ASSERT_EQ(r, (int)block_size);
+  }
+  ASSERT_EQ(logger->get(l_bluestore_readahead_ops), ra_ops);
+
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, hoid);
+    t.remove_collection(cid);
+    cerr << "Cleaning" << std::endl;
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+}
+
+TEST_P(StoreTestSpecificAUSize, BlockCacheWriteBack) {
+
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  size_t block_size = 4096;
+  SetVal(g_conf(), "bluestore_block_cache_create", "true");
+  SetVal(g_conf(), "bluestore_block_cache_size", "67108864");
+  // keep everything in the cache until the umount drains it
+  SetVal(g_conf(), "bluestore_block_cache_destage_ratio", "1");
+  StartDeferred(block_size);
+
+  int r;
+  coll_t cid;
+  ghobject_t hoid(hobject_t("test_block_cache", "", CEPH_NOSNAP, 0, -1, ""));
+  const size_t obj_size = block_size * 64;
+
+  auto ch = store->create_new_collection(cid);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  bufferlist data;
+  for (unsigned i = 0; i < obj_size / block_size; ++i) {
+    data.append(string(block_size, 'a' + i % 26));
+  }
+  {
+    ObjectStore::Transaction t;
+    t.write(cid, hoid, 0, data.length(), data);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  // small overwrites land on top of the cached extents
+  for (size_t off : {block_size * 3, block_size * 40, block_size * 41}) {
+    bufferlist bl;
+    bl.append(string(block_size, 'Z'));
+    ObjectStore::Transaction t;
+    t.write(cid, hoid, off, bl.length(), bl);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+    data.copy_in(off, block_size, bl.c_str());
+  }
+  auto verify = [&]() {
+    bufferlist bl;
+    r = store->read(ch, hoid, 0, obj_size, bl);
+    ASSERT_EQ(r, (int)obj_size);
+    ASSERT_TRUE(bl_eq(data, bl));
+  };
+  verify();
+
+  // dirty data and its map survive a remount
+  ch.reset();
+  EXPECT_EQ(store->umount(), 0);
+  ASSERT_EQ(store->fsck(false), 0);
+  EXPECT_EQ(store->mount(), 0);
+  ch = store->open_collection(cid);
+  verify();
+
+  // once drained, the main device is self-contained
+  SetVal(g_conf(), "bluestore_block_cache_drain_on_umount", "true");
+  g_conf().apply_changes(nullptr);
+  ch.reset();
+  EXPECT_EQ(store->umount(), 0);
+  string cache_path = string(GetParam()) + ".test_temp_dir/block.cache";
+  ASSERT_EQ(::unlink(cache_path.c_str()), 0);
+  EXPECT_EQ(store->mount(), 0);
+  ch = store->open_collection(cid);
+  verify();
+
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, hoid);
+    t.remove_collection(cid);
+    cerr << "Cleaning" << std::endl;
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+}
+
 TEST_P(StoreTestSpecificAUSize, BlobReuseOnOverwriteReverse) {
 
   if (string(GetParam()) != "bluestore")
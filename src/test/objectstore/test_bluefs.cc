@@ -579,6 +579,130 @@ TEST(BlueFS, test_compaction_async) {
   rm_temp_bdev(fn);
 }
 
+// readers, appenders and fsyncers all running against the same fs;
+// none of them should be stuck behind another's log sync.
+void read_files(BlueFS &fs, const string& dir, int nfiles,
+		std::atomic<bool> &stop, std::atomic<uint64_t> &ops)
+{
+    std::default_random_engine e(std::hash<std::thread::id>()(
+      std::this_thread::get_id()));
+    char buf[ALLOC_SIZE];
+    while (!stop) {
+      string file = "file.";
+      file.append(to_string(e() % nfiles));
+      BlueFS::FileReader *h;
+      ASSERT_EQ(0, fs.open_for_read(dir, file, &h, true));
+      for (int i = 0; i < 16; i++) {
+	uint64_t off = (e() % (1048576 / ALLOC_SIZE)) * ALLOC_SIZE;
+	ASSERT_EQ(ALLOC_SIZE, fs.read_random(h, off, ALLOC_SIZE, buf));
+	++ops;
+      }
+      delete h;
+    }
+}
+
+void append_files(BlueFS &fs, bool do_fsync,
+		  std::atomic<bool> &stop, std::atomic<uint64_t> &ops)
+{
+    stringstream ss;
+    string dir = "dir.append.";
+    ss << std::this_thread::get_id();
+    dir.append(ss.str());
+    ASSERT_EQ(0, fs.mkdir(dir));
+    std::unique_ptr<char[]> buf = gen_buffer(ALLOC_SIZE);
+    int j = 0;
+    while (!stop) {
+      string file = "file.";
+      file.append(to_string(j++));
+      BlueFS::FileWriter *h;
+      ASSERT_EQ(0, fs.open_for_write(dir, file, &h, false));
+      for (int i = 0; i < 64 && !stop; i++) {
+	h->append(buf.get(), ALLOC_SIZE);
+	if (do_fsync) {
+	  ASSERT_EQ(0, fs.fsync(h));
+	} else {
+	  fs.flush(h);
+	}
+	++ops;
+      }
+      fs.fsync(h);
+      fs.close_writer(h);
+      // keep the fs from filling up
+      if (j >= 5) {
+	file = "file.";
+	file.append(to_string(j - 5));
+	ASSERT_EQ(0, fs.unlink(dir, file));
+      }
+    }
+}
+
+TEST(BlueFS, test_concurrent_read_append_fsync) {
+  uint64_t size = 1048576 * 256;
+  string fn = get_temp_bdev(size);
+  g_ceph_context->_conf.set_val(
+    "bluefs_alloc_size",
+    "65536");
+  g_ceph_context->_conf.apply_changes(nullptr);
+
+  BlueFS fs(g_ceph_context);
+  ASSERT_EQ(0, fs.add_block_device(BlueFS::BDEV_DB, fn, false));
+  fs.add_block_extent(BlueFS::BDEV_DB, 1048576, size - 1048576);
+  uuid_d fsid;
+  ASSERT_EQ(0, fs.mkfs(fsid));
+  ASSERT_EQ(0, fs.mount());
+  const string read_dir = "dir.read";
+  const int num_read_files = 8;
+  {
+    ASSERT_EQ(0, fs.mkdir(read_dir));
+    std::unique_ptr<char[]> buf = gen_buffer(1048576);
+    for (int i = 0; i < num_read_files; i++) {
+      string file = "file.";
+      file.append(to_string(i));
+      BlueFS::FileWriter *h;
+      ASSERT_EQ(0, fs.open_for_write(read_dir, file, &h, false));
+      h->append(buf.get(), 1048576);
+      ASSERT_EQ(0, fs.fsync(h));
+      fs.close_writer(h);
+    }
+  }
+  {
+    std::atomic<bool> stop = {false};
+    std::atomic<uint64_t> read_ops = {0}, append_ops = {0}, fsync_ops = {0};
+    std::vector<std::thread> threads;
+    for (int i = 0; i < NUM_WRITERS; i++) {
+      threads.push_back(std::thread(read_files, std::ref(fs), read_dir,
+				    num_read_files, std::ref(stop),
+				    std::ref(read_ops)));
+    }
+    threads.push_back(std::thread(append_files, std::ref(fs), false,
+				  std::ref(stop), std::ref(append_ops)));
+    threads.push_back(std::thread(append_files, std::ref(fs), true,
+				  std::ref(stop), std::ref(fsync_ops)));
+    writes_done = false;
+    std::vector<std::thread> sync_threads;
+    for (int i=0; i<NUM_SYNC_THREADS; i++) {
+      sync_threads.push_back(std::thread(sync_fs, std::ref(fs)));
+    }
+
+    const int seconds = 5;
+    sleep(seconds);
+    stop = true;
+    join_all(threads);
+    writes_done = true;
+    join_all(sync_threads);
+
+    std::cout << "read " << read_ops.load() / seconds << " ops/s, "
+	      << "append " << append_ops.load() / seconds << " ops/s, "
+	      << "append+fsync " << fsync_ops.load() / seconds << " ops/s"
+	      << std::endl;
+    ASSERT_GT(read_ops.load(), 0u);
+    ASSERT_GT(append_ops.load(), 0u);
+    ASSERT_GT(fsync_ops.load(), 0u);
+  }
+  fs.umount();
+  rm_temp_bdev(fn);
+}
+
 TEST(BlueFS, test_replay) {
   uint64_t size = 1048576 * 128;
   string fn = get_temp_bdev(size);
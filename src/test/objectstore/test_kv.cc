@@ -465,6 +465,211 @@ TEST_P(KVTest, RocksDBCFMerge) {
   fini();
 }
 
+TEST_P(KVTest, RocksDBShardedCF) {
+  if(string(GetParam()) != "rocksdb")
+    return;
+
+  std::vector<KeyValueDB::ColumnFamily> cfs;
+  ASSERT_EQ(0, KeyValueDB::parse_sharding("cf1(4,0-3) cf2=", &cfs));
+  ASSERT_EQ(2u, cfs.size());
+  ASSERT_EQ(4u, cfs[0].shards);
+  ASSERT_EQ(3u, cfs[0].hash_h);
+  ASSERT_EQ("cf1(4,0-3)= cf2=", KeyValueDB::print_sharding(cfs));
+  std::vector<KeyValueDB::ColumnFamily> bad;
+  ASSERT_EQ(-EINVAL, KeyValueDB::parse_sharding("cf1(0)", &bad));
+  ASSERT_EQ(-EINVAL, KeyValueDB::parse_sharding("cf1(2,5-1)", &bad));
+
+  ASSERT_EQ(0, db->init(g_conf()->bluestore_rocksdb_options));
+  ASSERT_EQ(0, db->create_and_open(cout, cfs));
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    for (unsigned i = 0; i < 100; ++i) {
+      bufferlist bl;
+      bl.append(stringify(i));
+      char k[8];
+      snprintf(k, sizeof(k), "%03u", i);
+      t->set("cf1", k, bl);
+    }
+    ASSERT_EQ(0, db->submit_transaction_sync(t));
+  }
+  fini();
+
+  // the layout is remembered; no column families need to be passed
+  init();
+  ASSERT_EQ(0, db->open(cout));
+  {
+    bufferlist v;
+    ASSERT_EQ(0, db->get("cf1", "042", &v));
+    ASSERT_EQ("42", _bl_to_str(v));
+  }
+  {
+    cout << "iterating the shards in key order" << std::endl;
+    KeyValueDB::Iterator iter = db->get_iterator("cf1");
+    unsigned n = 0;
+    for (iter->seek_to_first(); iter->valid(); iter->next(), ++n) {
+      char k[8];
+      snprintf(k, sizeof(k), "%03u", n);
+      ASSERT_EQ(k, iter->key());
+    }
+    ASSERT_EQ(100u, n);
+    iter->upper_bound("049");
+    ASSERT_TRUE(iter->valid());
+    ASSERT_EQ("050", iter->key());
+    ASSERT_EQ(0, iter->prev());
+    ASSERT_EQ("049", iter->key());
+    ASSERT_EQ(0, iter->prev());
+    ASSERT_EQ("048", iter->key());
+    ASSERT_EQ(0, iter->next());
+    ASSERT_EQ("049", iter->key());
+    iter->seek_to_last();
+    ASSERT_EQ("099", iter->key());
+  }
+  {
+    // compaction goes to the shards, which hold the keys without prefix
+    db->compact_range("cf1", "020", "030");
+    db->compact_prefix("cf1");
+    db->compact_range("cf2", "", "z");
+    bufferlist v;
+    ASSERT_EQ(0, db->get("cf1", "025", &v));
+    ASSERT_EQ("25", _bl_to_str(v));
+  }
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    t->rm_range_keys("cf1", "010", "090");
+    ASSERT_EQ(0, db->submit_transaction_sync(t));
+    unsigned n = 0;
+    KeyValueDB::Iterator iter = db->get_iterator("cf1");
+    for (iter->seek_to_first(); iter->valid(); iter->next()) {
+      ++n;
+    }
+    ASSERT_EQ(20u, n);
+  }
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    t->rmkeys_by_prefix("cf1");
+    ASSERT_EQ(0, db->submit_transaction_sync(t));
+    KeyValueDB::Iterator iter = db->get_iterator("cf1");
+    iter->seek_to_first();
+    ASSERT_FALSE(iter->valid());
+  }
+  fini();
+}
+
+TEST_P(KVTest, RocksDBReshard) {
+  if(string(GetParam()) != "rocksdb")
+    return;
+
+  shared_ptr<KeyValueDB::MergeOperator> p(new AppendMOP);
+  db->set_merge_operator("A", p);
+  ASSERT_EQ(0, db->init(g_conf()->bluestore_rocksdb_options));
+  ASSERT_EQ(0, db->create_and_open(cout));
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    for (unsigned i = 0; i < 50; ++i) {
+      bufferlist bl;
+      bl.append(stringify(i));
+      t->set("A", stringify(i), bl);
+      t->set("B", stringify(i), bl);
+    }
+    ASSERT_EQ(0, db->submit_transaction_sync(t));
+  }
+  fini();
+
+  auto check = [&](const string& sharding) {
+    init();
+    db->set_merge_operator("A", p);
+    ASSERT_EQ(0, db->init(g_conf()->bluestore_rocksdb_options));
+    cout << "resharding to '" << sharding << "'" << std::endl;
+    ASSERT_EQ(0, db->reshard(sharding, cout));
+    ASSERT_EQ(0, db->open(cout));
+    for (auto prefix : { "A", "B" }) {
+      unsigned n = 0;
+      KeyValueDB::Iterator iter = db->get_iterator(prefix);
+      for (iter->seek_to_first(); iter->valid(); iter->next()) {
+	ASSERT_EQ(iter->key(), _bl_to_str(iter->value()));
+	++n;
+      }
+      ASSERT_EQ(50u, n);
+    }
+    {
+      KeyValueDB::Transaction t = db->get_transaction();
+      bufferlist bl;
+      bl.append("x");
+      t->merge("A", "7", bl);
+      ASSERT_EQ(0, db->submit_transaction_sync(t));
+      bufferlist v;
+      ASSERT_EQ(0, db->get("A", "7", &v));
+      ASSERT_EQ("7x", _bl_to_str(v));
+      t = db->get_transaction();
+      bl.clear();
+      bl.append("7");
+      t->set("A", "7", bl);
+      ASSERT_EQ(0, db->submit_transaction_sync(t));
+    }
+    fini();
+  };
+  check("A(3) B");
+  check("A(2,0-1) B(2)");
+  check("B");
+  check("");
+}
+
+TEST_P(KVTest, RocksDBMultiGetAndBounds) {
+  if(string(GetParam()) != "rocksdb")
+    return;
+
+  std::vector<KeyValueDB::ColumnFamily> cfs;
+  cfs.push_back(KeyValueDB::ColumnFamily("cf1", ""));
+  ASSERT_EQ(0, db->init(g_conf()->bluestore_rocksdb_options));
+  ASSERT_EQ(0, db->create_and_open(cout, cfs));
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    for (auto prefix : { "A", "B", "cf1" }) {
+      for (unsigned i = 0; i < 10; ++i) {
+	bufferlist bl;
+	bl.append(stringify(i));
+	t->set(prefix, stringify(i), bl);
+      }
+    }
+    ASSERT_EQ(0, db->submit_transaction_sync(t));
+  }
+  for (auto prefix : { "A", "cf1" }) {
+    cout << "multi-key get from " << prefix << std::endl;
+    std::map<string, bufferlist> out;
+    ASSERT_EQ(0, db->get(prefix, { "1", "5", "9", "x" }, &out));
+    ASSERT_EQ(3u, out.size());
+    for (auto& [k, v] : out) {
+      ASSERT_EQ(k, _bl_to_str(v));
+    }
+
+    cout << "bounded iteration over " << prefix << std::endl;
+    KeyValueDB::IteratorHints hints;
+    hints.lower_bound = "3";
+    hints.upper_bound = "6";
+    KeyValueDB::Iterator iter = db->get_iterator(prefix, hints);
+    std::vector<string> keys;
+    for (iter->lower_bound("3"); iter->valid(); iter->next()) {
+      ASSERT_EQ(prefix, iter->raw_key().first);
+      keys.push_back(iter->key());
+    }
+    ASSERT_EQ(std::vector<string>({ "3", "4", "5" }), keys);
+    iter->seek_to_last();
+    ASSERT_TRUE(iter->valid());
+    ASSERT_EQ("5", iter->key());
+  }
+  {
+    // without an upper bound we still stop at the end of the prefix
+    KeyValueDB::Iterator iter =
+      db->get_iterator("A", KeyValueDB::IteratorHints());
+    unsigned n = 0;
+    for (iter->seek_to_first(); iter->valid(); iter->next()) {
+      ++n;
+    }
+    ASSERT_EQ(10u, n);
+  }
+  fini();
+}
+
 INSTANTIATE_TEST_SUITE_P(
   KeyValueDB,
   KVTest,
@@ -182,3 +182,57 @@ TEST_F(MClockOpClassQueueTest, TestRemoveByClass) {
   r = q.dequeue();
   ASSERT_EQ(104u, r.get_map_epoch());
 }
+
+
+TEST_F(MClockOpClassQueueTest, TestCostModel) {
+  using ceph::mclock::OpCostModel;
+
+  auto item = [](uint64_t cost) {
+    return OpQueueItem(
+      unique_ptr<OpQueueItem::OpQueueable>(new PGScrub(spg_t(), 100)),
+      cost, 12, utime_t(), 1001, 100);
+  };
+
+  {
+    OpCostModel m(g_ceph_context);
+    ASSERT_FALSE(m.is_adaptive());
+    m.set_capacity(1000, 4096000, 0.001);
+    ASSERT_EQ(1u, m.get_cost(item(1 << 20)));
+  }
+
+  g_ceph_context->_conf.set_val_or_die("osd_op_queue_mclock_cost_model",
+				       "adaptive");
+  OpCostModel m(g_ceph_context);
+  g_ceph_context->_conf.set_val_or_die("osd_op_queue_mclock_cost_model",
+				       "static");
+  ASSERT_TRUE(m.is_adaptive());
+
+  // uncalibrated
+  ASSERT_EQ(1u, m.get_cost(item(8192)));
+
+  // 4096 bytes per io
+  m.set_capacity(1000, 4096000, 0.001);
+  ASSERT_EQ(1u, m.get_cost(item(12)));
+  ASSERT_EQ(3u, m.get_cost(item(8192)));
+
+  // committing faster than at calibration doesn't make ops cheaper
+  m.update_latency(0.0005);
+  ASSERT_EQ(3u, m.get_cost(item(8192)));
+
+  // 4x slower moves the scale halfway there
+  m.update_latency(0.004);
+  ASSERT_EQ(7u, m.get_cost(item(8192)));
+
+  mClockOpClassQueue cq(g_ceph_context, &m);
+  cq.enqueue(client1, 12, 1, item(8192));
+  cq.enqueue(client1, 12, 1, item(12));
+  ASSERT_EQ(2u, cq.get_size_slow());
+
+  // items are accounted with what they were charged when queued
+  m.update_latency(0.004);
+  ASSERT_LT(7u, m.get_cost(item(8192)));
+  unsigned charged = cq.dequeue().get_qos_cost();
+  charged += cq.dequeue().get_qos_cost();
+  ASSERT_EQ(8u, charged);
+  ASSERT_TRUE(cq.empty());
+}
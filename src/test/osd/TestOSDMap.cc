@@ -1397,6 +1397,226 @@ TEST_F(OSDMapTest, BUG_40104) {
   }
 }
 
+TEST_F(OSDMapTest, SharedCopy) {
+  set_up_map();
+  uint64_t features = CEPH_FEATURES_SUPPORTED_DEFAULT | CEPH_FEATURE_RESERVED;
+  bufferlist bl;
+  osdmap.encode(bl, features);
+
+  // an unchanged crush map is shared with the base rather than decoded
+  OSDMap base;
+  base.decode(bl);
+  OSDMap decoded;
+  decoded.decode(bl, &base);
+  ASSERT_EQ(base.crush, decoded.crush);
+  // and so is one decoded over itself
+  auto crush = decoded.crush;
+  decoded.decode(bl, &decoded);
+  ASSERT_EQ(crush, decoded.crush);
+
+  // a changed crush map is decoded, even if its encoding is the same size
+  {
+    CrushWrapper newcrush;
+    bufferlist cbl;
+    base.crush->encode(cbl, features);
+    auto p = cbl.cbegin();
+    newcrush.decode(p);
+    newcrush.set_choose_total_tries(base.crush->get_choose_total_tries() + 1);
+    OSDMap changed;
+    changed.deepish_copy_from(base);
+    OSDMap::Incremental cinc(base.get_epoch() + 1);
+    cinc.fsid = base.get_fsid();
+    newcrush.encode(cinc.crush, features);
+    ASSERT_EQ(0, changed.apply_incremental(cinc));
+    bufferlist changed_bl;
+    changed.encode(changed_bl, features);
+    OSDMap d;
+    d.decode(changed_bl, &base);
+    ASSERT_NE(base.crush, d.crush);
+    ASSERT_EQ(base.crush->get_choose_total_tries() + 1,
+	      d.crush->get_choose_total_tries());
+  }
+
+  bufferlist base_bl;
+  base.encode(base_bl, features);
+
+  OSDMap::Incremental inc(base.get_epoch() + 1);
+  inc.fsid = base.get_fsid();
+  pg_t pgid(0, my_rep_pool);
+  inc.new_pg_temp[pgid] = mempool::osdmap::vector<int>({0, 1, 2});
+  inc.new_primary_temp[pgid] = 1;
+  inc.new_state[0] = CEPH_OSD_UP;
+  inc.new_primary_affinity[1] = CEPH_OSD_DEFAULT_PRIMARY_AFFINITY / 2;
+  uuid_d uuid;
+  uuid.generate_random();
+  inc.new_uuid[2] = uuid;
+
+  OSDMap next;
+  next.shared_copy_from(base);
+  ASSERT_EQ(0, next.apply_incremental(inc));
+  ASSERT_EQ(base.crush, next.crush);
+  ASSERT_TRUE(next.is_down(0));
+  ASSERT_TRUE(base.is_up(0));
+
+  // the base is untouched...
+  bufferlist after_bl;
+  base.encode(after_bl, features);
+  ASSERT_TRUE(base_bl.contents_equal(after_bl));
+
+  // ...and the result matches a deep copy advanced the same way
+  OSDMap deep;
+  deep.deepish_copy_from(base);
+  ASSERT_EQ(0, deep.apply_incremental(inc));
+  bufferlist next_bl, deep_bl;
+  next.encode(next_bl, features);
+  deep.encode(deep_bl, features);
+  ASSERT_TRUE(next_bl.contents_equal(deep_bl));
+}
+
+TEST_F(OSDMapTest, IncrementalMapping) {
+  set_up_map(20);
+  mapping.update(osdmap);
+  ASSERT_EQ(osdmap.get_epoch(), mapping.get_epoch());
+  srand(1234);
+  for (int round = 0; round < 200; ++round) {
+    OSDMap::Incremental pending_inc(osdmap.get_epoch() + 1);
+    pending_inc.fsid = osdmap.get_fsid();
+    int osd = rand() % get_num_osds();
+    int64_t pool = (rand() % 2) ? my_ec_pool : my_rep_pool;
+    pg_t pgid(rand() % osdmap.get_pg_pool(pool)->get_pg_num(), pool);
+    switch (rand() % 8) {
+    case 0:
+      pending_inc.new_weight[osd] =
+	osdmap.is_out(osd) ? CEPH_OSD_IN : CEPH_OSD_OUT;
+      break;
+    case 1:
+      if (osdmap.is_up(osd)) {
+	pending_inc.new_state[osd] = CEPH_OSD_UP;
+      } else {
+	pending_inc.new_up_client[osd] = osdmap.get_addrs(osd);
+      }
+      break;
+    case 2:
+      pending_inc.new_primary_affinity[osd] = rand() % 2 ?
+	CEPH_OSD_DEFAULT_PRIMARY_AFFINITY : CEPH_OSD_MAX_PRIMARY_AFFINITY / 4;
+      break;
+    case 3:
+      {
+	vector<int> up;
+	int up_primary;
+	osdmap.pg_to_raw_up(pgid, &up, &up_primary);
+	if (!up.empty() && up[0] != osd &&
+	    std::find(up.begin(), up.end(), osd) == up.end()) {
+	  pending_inc.new_pg_upmap_items[pgid] =
+	    mempool::osdmap::vector<pair<int32_t,int32_t>>(
+	      1, make_pair(up[0], osd));
+	}
+      }
+      break;
+    case 4:
+      {
+	vector<pg_t> upmap_pgs;
+	osdmap.get_upmap_pgs(&upmap_pgs);
+	if (!upmap_pgs.empty()) {
+	  pending_inc.old_pg_upmap_items.insert(upmap_pgs[0]);
+	}
+      }
+      break;
+    case 5:
+      {
+	vector<int> acting;
+	for (int i = 0; i < 3; ++i) {
+	  acting.push_back((osd + i) % get_num_osds());
+	}
+	pending_inc.new_pg_temp[pgid] =
+	  mempool::osdmap::vector<int>(acting.begin(), acting.end());
+      }
+      break;
+    case 6:
+      pending_inc.new_primary_temp[pgid] = rand() % 2 ? osd : -1;
+      break;
+    case 7:
+      if (pool == my_rep_pool) {
+	pg_pool_t *p = pending_inc.get_new_pool(pool,
+						osdmap.get_pg_pool(pool));
+	p->set_pg_num(p->get_pg_num() + 8);
+	p->set_pgp_num(p->get_pgp_num() + 8);
+      }
+      break;
+    }
+    ASSERT_EQ(0, osdmap.apply_incremental(pending_inc));
+    uint64_t redone = mapping.update(osdmap, pending_inc);
+    ASSERT_LE(redone, mapping.get_num_pgs());
+    ASSERT_EQ(osdmap.get_epoch(), mapping.get_epoch());
+
+    OSDMapMapping full;
+    full.update(osdmap);
+    ASSERT_EQ(full.get_num_pgs(), mapping.get_num_pgs());
+    for (auto& p : osdmap.get_pools()) {
+      for (unsigned ps = 0; ps < p.second.get_pg_num(); ++ps) {
+	pg_t pg(ps, p.first);
+	vector<int> up, acting, up2, acting2;
+	int up_primary, acting_primary, up_primary2, acting_primary2;
+	full.get(pg, &up, &up_primary, &acting, &acting_primary);
+	mapping.get(pg, &up2, &up_primary2, &acting2, &acting_primary2);
+	ASSERT_EQ(up, up2) << pg << " round " << round;
+	ASSERT_EQ(up_primary, up_primary2) << pg << " round " << round;
+	ASSERT_EQ(acting, acting2) << pg << " round " << round;
+	ASSERT_EQ(acting_primary, acting_primary2) << pg << " round " << round;
+      }
+    }
+    for (int i = 0; i < (int)get_num_osds(); ++i) {
+      ASSERT_EQ(full.get_osd_acting_pgs(i), mapping.get_osd_acting_pgs(i));
+    }
+  }
+}
+
+TEST_F(OSDMapTest, IncrementalMappingJob) {
+  set_up_map(20);
+  mapping.update(osdmap);
+  ThreadPool tp(g_ceph_context, "IncrementalMappingJob::tp", "tp_mapping", 4);
+  tp.start();
+  ParallelPGMapper mapper(g_ceph_context, &tp);
+  for (int round = 0; round < 6; ++round) {
+    OSDMap::Incremental pending_inc(osdmap.get_epoch() + 1);
+    pending_inc.fsid = osdmap.get_fsid();
+    // a "host" of osds going down, then coming back
+    for (int osd = 4; osd < 8; ++osd) {
+      if (osdmap.is_up(osd)) {
+	pending_inc.new_state[osd] = CEPH_OSD_UP;
+      } else {
+	pending_inc.new_up_client[osd] = osdmap.get_addrs(osd);
+      }
+    }
+    if (round == 2) {
+      pending_inc.new_pg_temp[pg_t(3, my_rep_pool)] =
+	mempool::osdmap::vector<int>({5, 6, 7});
+    }
+    ASSERT_EQ(0, osdmap.apply_incremental(pending_inc));
+    ASSERT_TRUE(mapping.can_update(osdmap, pending_inc));
+    auto job = mapping.start_update(osdmap, pending_inc, mapper, 16);
+    job->wait();
+    ASSERT_EQ(osdmap.get_epoch(), mapping.get_epoch());
+
+    OSDMapMapping full;
+    full.update(osdmap);
+    for (auto& p : osdmap.get_pools()) {
+      for (unsigned ps = 0; ps < p.second.get_pg_num(); ++ps) {
+	pg_t pg(ps, p.first);
+	vector<int> up, acting, up2, acting2;
+	int up_primary, acting_primary, up_primary2, acting_primary2;
+	full.get(pg, &up, &up_primary, &acting, &acting_primary);
+	mapping.get(pg, &up2, &up_primary2, &acting2, &acting_primary2);
+	ASSERT_EQ(up, up2) << pg << " round " << round;
+	ASSERT_EQ(up_primary, up_primary2) << pg << " round " << round;
+	ASSERT_EQ(acting, acting2) << pg << " round " << round;
+	ASSERT_EQ(acting_primary, acting_primary2) << pg << " round " << round;
+      }
+    }
+  }
+  tp.stop();
+}
+
 TEST(PGTempMap, basic)
 {
   PGTempMap m;
@@ -22,6 +22,7 @@
 #include <stdio.h>
 #include <signal.h>
 #include <gtest/gtest.h>
+#include "include/stringify.h"
 #include "osd/OSD.h"
 #include "os/ObjectStore.h"
 #include "mon/MonClient.h"
@@ -49,6 +50,13 @@ public:
   bool scrub_time_permit(utime_t now) {
     return OSD::scrub_time_permit(now);
   }
+
+  void set_op_wip(uint64_t ops) {
+    if (!logger) {
+      create_logger();
+    }
+    logger->set(l_osd_op_wip, ops);
+  }
 };
 
 TEST(TestOSDScrub, scrub_time_permit) {
@@ -142,6 +150,59 @@ TEST(TestOSDScrub, scrub_time_permit) {
 
 }
 
+TEST(TestOSDScrub, scrub_readahead_throttle) {
+  ObjectStore *store = ObjectStore::create(g_ceph_context,
+             g_conf()->osd_objectstore,
+             g_conf()->osd_data,
+             g_conf()->osd_journal);
+  std::string cluster_msgr_type = g_conf()->ms_cluster_type.empty() ? g_conf().get_val<std::string>("ms_type") : g_conf()->ms_cluster_type;
+  Messenger *ms = Messenger::create(g_ceph_context, cluster_msgr_type,
+				    entity_name_t::OSD(0), "make_checker",
+				    getpid(), 0);
+  ms->set_cluster_protocol(CEPH_OSD_PROTOCOL);
+  ms->set_default_policy(Messenger::Policy::stateless_server(0));
+  ms->bind(g_conf()->public_addr);
+  MonClient mc(g_ceph_context);
+  mc.build_initial_monmap();
+  TestOSDScrub* osd = new TestOSDScrub(g_ceph_context, store, 0, ms, ms, ms, ms, ms, ms, ms, &mc, "", "");
+
+  // the read-ahead threads are not running, so whatever is admitted
+  // keeps its share of osd_deep_scrub_readahead_bytes
+  uint64_t budget =
+    g_conf().get_val<Option::size_t>("osd_deep_scrub_readahead_bytes");
+  ASSERT_GT(budget, 0u);
+  uint64_t max_ops =
+    g_conf().get_val<uint64_t>("osd_deep_scrub_readahead_client_ops");
+  ASSERT_GT(max_ops, 0u);
+
+  // skipped while more ops than the limit are in flight
+  osd->set_op_wip(max_ops + 1);
+  Context *c = new LambdaContext([]() {});
+  ASSERT_FALSE(osd->service.queue_scrub_readahead(budget / 2, c));
+  delete c;
+
+  osd->set_op_wip(max_ops);
+  ASSERT_TRUE(osd->service.queue_scrub_readahead(
+    budget / 2, new LambdaContext([]() {})));
+
+  // 0 disables the op check
+  g_ceph_context->_conf.set_val("osd_deep_scrub_readahead_client_ops", "0");
+  g_ceph_context->_conf.apply_changes(nullptr);
+  osd->set_op_wip(max_ops + 1);
+  ASSERT_TRUE(osd->service.queue_scrub_readahead(
+    budget - budget / 2, new LambdaContext([]() {})));
+
+  // throttled once the byte budget is used up, whatever the op count
+  osd->set_op_wip(0);
+  c = new LambdaContext([]() {});
+  ASSERT_FALSE(osd->service.queue_scrub_readahead(1, c));
+  delete c;
+
+  g_ceph_context->_conf.set_val("osd_deep_scrub_readahead_client_ops",
+				stringify(max_ops));
+  g_ceph_context->_conf.apply_changes(nullptr);
+}
+
 // Local Variables:
 // compile-command: "cd ../.. ; make unittest_osdscrub ; ./unittest_osdscrub --log-to-stderr=true  --debug-osd=20 # --gtest_filter=*.* "
 // End:
@@ -2671,6 +2671,64 @@ TEST_F(PGLogMergeDupsTest, Superset) {
   check_index();
 }
 
+TEST_F(PGLogMergeDupsTest, TrimRoundtrip) {
+  auto& conf = g_ceph_context->_conf;
+  string dups_tracked = std::to_string(conf->osd_pg_log_dups_tracked);
+  hobject_t hoid;
+  hoid.pool = 1;
+  hoid.oid = "log";
+  ghobject_t log_oid(hoid);
+  auto ch = store->open_collection(test_coll);
+  auto write = [&]() {
+    ObjectStore::Transaction t;
+    map<string, bufferlist> km;
+    write_log_and_missing(t, &km, test_coll, log_oid, false);
+    if (!km.empty()) {
+      t.omap_setkeys(test_coll, log_oid, km);
+    }
+    ASSERT_EQ(0, store->queue_transaction(ch, std::move(t)));
+  };
+  auto count_keys = [&](const string& prefix) {
+    set<string> keys;
+    store->omap_get_keys(ch, log_oid, &keys);
+    return std::count_if(keys.begin(), keys.end(), [&](const string& k) {
+      return k.compare(0, prefix.size(), prefix) == 0;
+    });
+  };
+  entity_name_t client = entity_name_t::CLIENT(777);
+  auto add_entries = [&](unsigned from, unsigned to) {
+    for (unsigned i = from; i <= to; ++i) {
+      add(PGLogTestBase::mk_ple_mod(
+	    PGLogTestBase::mk_obj(i), PGLogTestBase::mk_evt(10, i),
+	    PGLogTestBase::mk_evt(10, i - 1), osd_reqid_t(client, 8, i)));
+    }
+    log.skip_can_rollback_to_to_head();
+  };
+  pg_info_t info;
+
+  add_entries(1, 10);
+  write();
+  EXPECT_EQ(10, count_keys("0000000010."));
+
+  // the trimmed entries are removed and only kept as dups
+  trim(PGLogTestBase::mk_evt(10, 6), info, false, false);
+  write();
+  EXPECT_EQ(4, count_keys("0000000010."));
+  EXPECT_EQ(6, count_keys("dup_"));
+
+  // same for trimmed dups
+  conf.set_val_or_die("osd_pg_log_dups_tracked", "6");
+  add_entries(11, 12);
+  trim(PGLogTestBase::mk_evt(10, 10), info, false, false);
+  conf.set_val_or_die("osd_pg_log_dups_tracked", dups_tracked);
+  write();
+  EXPECT_EQ(2, count_keys("0000000010."));
+  EXPECT_EQ(4, count_keys("dup_"));
+  ASSERT_EQ(4u, log.dups.size());
+  EXPECT_EQ(PGLogTestBase::mk_evt(10, 7), log.dups.front().version);
+  EXPECT_EQ(PGLogTestBase::mk_evt(10, 10), log.dups.back().version);
+}
+
 
 struct PGLogTrimTest :
   public ::testing::Test,
@@ -2906,6 +2964,60 @@ TEST_F(PGLogTrimTest, TestGetRequest) {
   EXPECT_FALSE(result);
 }
 
+TEST_F(PGLogTrimTest, TestLazyRequestIndex) {
+  SetUp(100);
+  PGLog::IndexedLog log;
+  log.head = mk_evt(20, 0);
+  log.skip_can_rollback_to_to_head();
+  log.head = mk_evt(9, 0);
+
+  entity_name_t client = entity_name_t::CLIENT(777);
+
+  log.add(mk_ple_mod(mk_obj(1), mk_evt(10, 100), mk_evt(8, 70),
+		     osd_reqid_t(client, 8, 1)));
+  log.add(mk_ple_mod(mk_obj(2), mk_evt(15, 150), mk_evt(10, 100),
+		     osd_reqid_t(client, 8, 2)));
+  log.add(mk_ple_mod(mk_obj(3), mk_evt(20, 160), mk_evt(15, 150),
+		     osd_reqid_t(client, 8, 3)));
+  log.trim(cct, mk_evt(15, 150), nullptr, nullptr, nullptr);
+  ASSERT_EQ(1u, log.log.size());
+  ASSERT_EQ(2u, log.dups.size());
+
+  mempool::osd_pglog::list<pg_log_entry_t> entries(log.log);
+  mempool::osd_pglog::deque<pg_log_dup_t> dups(log.dups);
+  PGLog::IndexedLog loaded(log.head, log.tail, log.get_can_rollback_to(),
+			   log.get_rollback_info_trimmed_to(),
+			   std::move(entries), std::move(dups));
+
+  // only the objects index is built up front
+  EXPECT_EQ(1u, loaded.objects.size());
+  EXPECT_TRUE(loaded.caller_ops.empty());
+  EXPECT_TRUE(loaded.dup_index.empty());
+
+  eversion_t version;
+  version_t user_version;
+  int return_code;
+  EXPECT_TRUE(loaded.get_request(osd_reqid_t(client, 8, 1),
+				 &version, &user_version, &return_code));
+  EXPECT_EQ(mk_evt(10, 100), version);
+  EXPECT_EQ(1u, loaded.caller_ops.size());
+  EXPECT_EQ(2u, loaded.dup_index.size());
+
+  // moving keeps the indexes pointing at the moved entries
+  PGLog::IndexedLog moved(std::move(loaded));
+  EXPECT_TRUE(loaded.log.empty());
+  EXPECT_TRUE(loaded.dups.empty());
+  EXPECT_TRUE(loaded.dup_index.empty());
+  EXPECT_EQ(2u, moved.dup_index.size());
+  EXPECT_TRUE(moved.get_request(osd_reqid_t(client, 8, 2),
+				&version, &user_version, &return_code));
+  EXPECT_EQ(mk_evt(15, 150), version);
+  EXPECT_TRUE(moved.get_request(osd_reqid_t(client, 8, 3),
+				&version, &user_version, &return_code));
+  EXPECT_EQ(mk_evt(20, 160), version);
+  EXPECT_TRUE(moved.logged_object(mk_obj(3)));
+}
+
 TEST_F(PGLogTest, _merge_object_divergent_entries) {
   {
     // Test for issue 20843
@@ -0,0 +1,200 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * PG log memory and cpu benchmark.
+ *
+ * Builds the in-memory logs of many PGs the way a busy OSD holds them
+ * (osd_min_pg_log_entries entries plus osd_pg_log_dups_tracked dup
+ * entries each), then looks up requests, keeps trimming while new
+ * entries come in, and merges pairs of PGs.  Reports the time each
+ * phase took and what the osd_pglog mempool holds after it.
+ */
+#include <iostream>
+#include <random>
+#include <time.h>
+
+#include "common/ceph_argparse.h"
+#include "common/ceph_context.h"
+#include "common/ceph_time.h"
+#include "global/global_context.h"
+#include "global/global_init.h"
+#include "include/stringify.h"
+#include "osd/PGLog.h"
+
+static void usage(const char *name)
+{
+  std::cout << "usage: " << name << " [options]\n"
+	    << "  --pgs <n>          PGs to build logs for (default 200)\n"
+	    << "  --entries <n>      log entries per PG (default\n"
+	    << "                     osd_min_pg_log_entries)\n"
+	    << "  --objects <n>      distinct objects per PG (default 1000)\n"
+	    << "  --lookups <n>      request lookups per PG (default 100)\n"
+	    << "  --seed <n>         random seed\n"
+	    << "the number of dups kept is osd_pg_log_dups_tracked\n"
+	    << std::endl;
+}
+
+static void report(const char *phase, mono_time start, uint64_t pgs)
+{
+  double elapsed = std::chrono::duration<double>(
+    mono_clock::now() - start).count();
+  size_t bytes = mempool::osd_pglog::allocated_bytes();
+  std::cout << phase << ": " << elapsed << "s, osd_pglog "
+	    << byte_u_t(bytes) << " in "
+	    << mempool::osd_pglog::allocated_items() << " items, "
+	    << byte_u_t(pgs ? bytes / pgs : 0) << " per pg" << std::endl;
+}
+
+struct BenchLog {
+  PGLog::IndexedLog log;
+  uint64_t pool = 1;
+  uint32_t seed = 0;
+  version_t next = 1;
+  uint64_t first_tid = 0;
+};
+
+static uint64_t next_tid = 1;
+
+static osd_reqid_t make_reqid(uint64_t tid)
+{
+  return osd_reqid_t(entity_name_t::CLIENT(tid % 4096), 0, tid);
+}
+
+static void append(BenchLog& b, std::mt19937_64& rng, uint64_t objects)
+{
+  hobject_t soid(object_t("obj_" + stringify(rng() % objects)),
+		 "", CEPH_NOSNAP, b.seed, b.pool, "");
+  eversion_t v(1, b.next++);
+  pg_log_entry_t e(pg_log_entry_t::MODIFY, soid, v, eversion_t(), v.version,
+		   make_reqid(next_tid++),
+		   utime_t(), 0);
+  b.log.add(e);
+}
+
+static void trim(BenchLog& b, uint64_t entries)
+{
+  if (b.log.log.size() > entries) {
+    b.log.skip_can_rollback_to_to_head();
+    b.log.trim(g_ceph_context,
+	       eversion_t(1, b.log.head.version - entries),
+	       nullptr, nullptr, nullptr);
+  }
+}
+
+int main(int argc, const char **argv)
+{
+  vector<const char*> args;
+  argv_to_vec(argc, argv, args);
+  auto cct = global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT,
+			 CODE_ENVIRONMENT_UTILITY,
+			 CINIT_FLAG_NO_DEFAULT_CONFIG_FILE);
+  common_init_finish(g_ceph_context);
+
+  uint64_t pgs = 200;
+  uint64_t entries = g_conf()->osd_min_pg_log_entries;
+  uint64_t objects = 1000;
+  uint64_t lookups = 100;
+  uint64_t seed = time(NULL);
+  for (auto i = args.begin(); i != args.end();) {
+    string val;
+    if (ceph_argparse_double_dash(args, i)) {
+      break;
+    } else if (ceph_argparse_witharg(args, i, &val, "--pgs", (char*)NULL)) {
+      pgs = std::max<uint64_t>(2, strtoull(val.c_str(), NULL, 10));
+    } else if (ceph_argparse_witharg(args, i, &val,
+				     "--entries", (char*)NULL)) {
+      entries = std::max<uint64_t>(1, strtoull(val.c_str(), NULL, 10));
+    } else if (ceph_argparse_witharg(args, i, &val,
+				     "--objects", (char*)NULL)) {
+      objects = std::max<uint64_t>(1, strtoull(val.c_str(), NULL, 10));
+    } else if (ceph_argparse_witharg(args, i, &val,
+				     "--lookups", (char*)NULL)) {
+      lookups = strtoull(val.c_str(), NULL, 10);
+    } else if (ceph_argparse_witharg(args, i, &val, "--seed", (char*)NULL)) {
+      seed = strtoull(val.c_str(), NULL, 10);
+    } else if (ceph_argparse_flag(args, i, "--help", (char*)NULL)) {
+      usage(argv[0]);
+      return 0;
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  uint64_t dups = g_conf()->osd_pg_log_dups_tracked;
+  std::cout << "seed " << seed << ", " << pgs << " pgs, " << entries
+	    << " entries and " << dups << " dups per pg" << std::endl;
+  report("empty", mono_clock::now(), pgs);
+
+  std::mt19937_64 rng(seed);
+  std::vector<BenchLog> logs(pgs);
+
+  // fill every log up to its steady state size; the oldest entries end
+  // up as dups
+  auto start = mono_clock::now();
+  for (uint64_t i = 0; i < pgs; ++i) {
+    BenchLog& b = logs[i];
+    b.seed = i;
+    b.first_tid = next_tid;
+    for (uint64_t j = 0; j < entries + dups; ++j) {
+      append(b, rng, objects);
+      if (j % 100 == 99) {
+	trim(b, entries);
+      }
+    }
+    trim(b, entries);
+  }
+  report("build", start, pgs);
+
+  // writes look their reqid up, which builds the request indexes
+  start = mono_clock::now();
+  uint64_t found = 0;
+  for (auto& b : logs) {
+    for (uint64_t j = 0; j < lookups; ++j) {
+      uint64_t tid = b.first_tid + rng() % (entries + dups);
+      eversion_t version;
+      version_t user_version;
+      int return_code;
+      if (b.log.get_request(make_reqid(tid),
+			    &version, &user_version, &return_code)) {
+	++found;
+      }
+    }
+  }
+  report("lookup", start, pgs);
+  std::cout << "  found " << found << " of " << pgs * lookups
+	    << " requests" << std::endl;
+
+  // steady state: each new entry pushes the oldest one out into the dups
+  start = mono_clock::now();
+  for (auto& b : logs) {
+    for (uint64_t j = 0; j < entries; ++j) {
+      append(b, rng, objects);
+      if (j % 100 == 99) {
+	trim(b, entries);
+      }
+    }
+    trim(b, entries);
+  }
+  report("trim", start, pgs);
+
+  // merge the upper half of the PGs into the lower half
+  start = mono_clock::now();
+  uint64_t half = pgs / 2;
+  for (uint64_t i = 0; i < half; ++i) {
+    auto& target = logs[i].log;
+    auto& source = logs[i + half].log;
+    vector<pg_log_t*> slogs = { &source };
+    eversion_t last_update = std::max(target.head, source.head);
+    target.unindex();
+    target.merge_from(slogs, last_update);
+    target.index();
+    source.clear();
+  }
+  logs.resize(pgs - half);
+  report("merge", start, pgs - half);
+
+  start = mono_clock::now();
+  logs.clear();
+  report("free", start, pgs);
+  return 0;
+}
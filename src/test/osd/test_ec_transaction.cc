@@ -122,3 +122,64 @@ TEST(ectransaction, many_writes)
   ASSERT_EQ(0u, plan.to_read.size());
   ASSERT_EQ(1u, plan.will_write.size());
 }
+
+TEST(ectransaction, parity_delta)
+{
+  ECUtil::stripe_info_t sinfo(4, 16384);
+  auto get_hinfo = [&](const hobject_t &i) {
+    ECUtil::HashInfoRef ref(new ECUtil::HashInfo(6));
+    ref->set_projected_total_logical_size(sinfo, 65536);
+    return ref;
+  };
+  hobject_t h;
+  bufferlist a;
+  a.append_zero(4096);
+
+  // 4096~4096 into the second stripe only changes data shard 1
+  {
+    PGTransactionUPtr t(new PGTransaction);
+    t->write(h, 16384 + 4096, a.length(), a, 0);
+    auto plan = ECTransaction::get_write_plan(
+      sinfo, std::move(t), get_hinfo, &dpp, 2);
+    generic_derr << "to_read " << plan.to_read << dendl;
+
+    ASSERT_EQ(1u, plan.to_read.size());
+    ASSERT_EQ(1u, plan.delta.size());
+    const auto &delta = plan.delta.at(h);
+    ASSERT_EQ(1u, delta.stripes.size());
+    ASSERT_EQ(set<int>({1}), delta.stripes.at(16384));
+    ASSERT_EQ(set<int>({1, 4, 5}), delta.read_shards);
+  }
+
+  // without coding chunks to plan for there is no delta
+  {
+    PGTransactionUPtr t(new PGTransaction);
+    t->write(h, 16384 + 4096, a.length(), a, 0);
+    auto plan = ECTransaction::get_write_plan(
+      sinfo, std::move(t), get_hinfo, &dpp);
+    ASSERT_EQ(1u, plan.to_read.size());
+    ASSERT_EQ(0u, plan.delta.size());
+  }
+
+  // three of four data shards plus parity is no cheaper than a full rmw
+  {
+    bufferlist b;
+    b.append_zero(12288);
+    PGTransactionUPtr t(new PGTransaction);
+    t->write(h, 32768 + 4096, b.length(), b, 0);
+    auto plan = ECTransaction::get_write_plan(
+      sinfo, std::move(t), get_hinfo, &dpp, 2);
+    ASSERT_EQ(1u, plan.to_read.size());
+    ASSERT_EQ(0u, plan.delta.size());
+  }
+
+  // writes that extend the object need the full stripe
+  {
+    PGTransactionUPtr t(new PGTransaction);
+    t->write(h, 65536 - 2048, a.length(), a, 0);
+    auto plan = ECTransaction::get_write_plan(
+      sinfo, std::move(t), get_hinfo, &dpp, 2);
+    ASSERT_EQ(1u, plan.to_read.size());
+    ASSERT_EQ(0u, plan.delta.size());
+  }
+}
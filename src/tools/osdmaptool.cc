@@ -22,6 +22,7 @@
 
 #include "global/global_init.h"
 #include "osd/OSDMap.h"
+#include "osd/OSDMapMapping.h"
 
 
 void usage()
@@ -43,6 +44,9 @@ void usage()
   cout << "   --with-default-pool     include default pool when creating map" << std::endl;
   cout << "   --clear-temp            clear pg_temp and primary_temp" << std::endl;
   cout << "   --test-random           do random placements" << std::endl;
+  cout << "   --test-mapping-incremental <num>" << std::endl;
+  cout << "                           apply <num> random incrementals, comparing" << std::endl;
+  cout << "                           incremental and full pg mapping updates" << std::endl;
   cout << "   --test-map-pg <pgid>    map a pgid to osds" << std::endl;
   cout << "   --test-map-object <objectname> [--pool <poolid>] map an object to osds"
        << std::endl;
@@ -146,6 +150,7 @@ int main(int argc, const char **argv)
   std::set<std::string> upmap_pools;
   int64_t pg_num = -1;
   bool test_map_pgs_dump_all = false;
+  int test_mapping_incremental = 0;
 
   std::string val;
   std::ostringstream err;
@@ -203,6 +208,11 @@ int main(int argc, const char **argv)
       test_map_pgs_dump_all = true;
     } else if (ceph_argparse_flag(args, i, "--test-random", (char*)NULL)) {
       test_random = true;
+    } else if (ceph_argparse_witharg(args, i, &test_mapping_incremental, err, "--test-mapping-incremental", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << err.str() << std::endl;
+	exit(EXIT_FAILURE);
+      }
     } else if (ceph_argparse_flag(args, i, "--clobber", (char*)NULL)) {
       clobber = true;
     } else if (ceph_argparse_witharg(args, i, &pg_bits, err, "--pg_bits", (char*)NULL)) {
@@ -614,6 +624,75 @@ int main(int argc, const char **argv)
         cout << "size " << i << "\t" << size[i] << std::endl;
     }
   }
+  if (test_mapping_incremental > 0) {
+    // work on a copy; the incrementals are never written out
+    OSDMap tmpmap;
+    tmpmap.deepish_copy_from(osdmap);
+    OSDMapMapping inc_mapping, full_mapping;
+    inc_mapping.update(tmpmap);
+    int n = tmpmap.get_max_osd();
+    if (n == 0) {
+      cerr << me << ": map has no osds" << std::endl;
+      exit(1);
+    }
+    ceph::timespan inc_time = ceph::timespan::zero();
+    ceph::timespan full_time = ceph::timespan::zero();
+    uint64_t redone = 0, total = 0;
+    for (int round = 0; round < test_mapping_incremental; ++round) {
+      OSDMap::Incremental inc(tmpmap.get_epoch() + 1);
+      inc.fsid = tmpmap.get_fsid();
+      int osd = rand() % n;
+      if (!tmpmap.exists(osd))
+	continue;
+      switch (rand() % 3) {
+      case 0:
+	inc.new_weight[osd] = tmpmap.is_out(osd) ? CEPH_OSD_IN : CEPH_OSD_OUT;
+	break;
+      case 1:
+	inc.new_state[osd] = CEPH_OSD_UP;
+	break;
+      case 2:
+	inc.new_primary_affinity[osd] =
+	  tmpmap.get_primary_affinity(osd) == CEPH_OSD_DEFAULT_PRIMARY_AFFINITY ?
+	  CEPH_OSD_DEFAULT_PRIMARY_AFFINITY / 2 :
+	  CEPH_OSD_DEFAULT_PRIMARY_AFFINITY;
+	break;
+      }
+      tmpmap.apply_incremental(inc);
+
+      auto start = mono_clock::now();
+      redone += inc_mapping.update(tmpmap, inc);
+      inc_time += mono_clock::now() - start;
+      start = mono_clock::now();
+      full_mapping.update(tmpmap);
+      full_time += mono_clock::now() - start;
+      total += full_mapping.get_num_pgs();
+
+      for (auto& p : tmpmap.get_pools()) {
+	for (ps_t ps = 0; ps < p.second.get_pg_num(); ++ps) {
+	  pg_t pgid(ps, p.first);
+	  vector<int> up, acting, up2, acting2;
+	  int up_primary, acting_primary, up_primary2, acting_primary2;
+	  full_mapping.get(pgid, &up, &up_primary, &acting, &acting_primary);
+	  inc_mapping.get(pgid, &up2, &up_primary2, &acting2, &acting_primary2);
+	  if (up != up2 || up_primary != up_primary2 ||
+	      acting != acting2 || acting_primary != acting_primary2) {
+	    cerr << "epoch " << tmpmap.get_epoch() << " " << pgid
+		 << " incremental " << up2 << "p" << up_primary2
+		 << " " << acting2 << "p" << acting_primary2
+		 << " != full " << up << "p" << up_primary
+		 << " " << acting << "p" << acting_primary << std::endl;
+	    exit(1);
+	  }
+	}
+      }
+    }
+    cout << "incremental: " << redone << " pgs remapped in "
+	 << timespan_str(inc_time) << std::endl;
+    cout << "full: " << total << " pgs remapped in "
+	 << timespan_str(full_time) << std::endl;
+  }
+
   if (test_crush) {
     int pass = 0;
     while (1) {
@@ -649,6 +728,7 @@ int main(int argc, const char **argv)
       export_crush.empty() && import_crush.empty() && 
       test_map_pg.empty() && test_map_object.empty() &&
       !test_map_pgs && !test_map_pgs_dump && !test_map_pgs_dump_all &&
+      !test_mapping_incremental &&
       !upmap && !upmap_cleanup) {
     cerr << me << ": no action specified?" << std::endl;
     usage();